@@ -107,6 +107,10 @@ class Graph(object):
                 assert isinstance(v, bool), "enable_op_tuning shoule be True or False."
                 ne_options.enable_op_tuning = v
 
+            def set_enable_online_tuning(v):
+                assert isinstance(v, bool), "enable_online_tuning shoule be True or False."
+                ne_options.enable_online_tuning = v
+
             def set_warmup_iter(v):
                 assert isinstance(v, int), "warmup_iter should be int."
                 ne_options.warmup_iter = v
@@ -123,12 +127,18 @@ class Graph(object):
                 assert isinstance(v, bool), "dump_activation_dag shoule be True or False."
                 ne_options.dump_activation_dag = v
 
+            def set_enable_execution_context(v):
+                assert isinstance(v, bool), "enable_execution_context shoule be True or False."
+                ne_options.enable_execution_context = v
+
             convert_options = {'execution_mode': set_execution_mode,
                                'enable_op_tuning': set_enable_op_tuning,
+                               'enable_online_tuning': set_enable_online_tuning,
                                'warmup_iter': set_warmup_iter,
                                'dispatch_table_file_root': set_dispatch_table_file_root,
                                'activation_mem_compression': set_activation_mem_compression,
-                               'dump_activation_dag': set_dump_activation_dag}
+                               'dump_activation_dag': set_dump_activation_dag,
+                               'enable_execution_context': set_enable_execution_context}
             for k, v in options.items():
                 if k in convert_options:
                     convert_options[k](v)
@@ -426,6 +436,9 @@ class Graph(object):
                         const_idx += 1
                         const_info[t.name] = const_idx
                         data = t.data
+                        # keep every weight 64 bytes aligned, so that the engine can map the bin
+                        # and use the weights in place
+                        weight_bytes.extend(bytes(-len(weight_bytes) % 64))
                         start = len(weight_bytes)
                         data_bytes = data.tobytes()
                         weight_bytes.extend(data_bytes)
@@ -565,8 +578,33 @@ class Graph(object):
             self._activation_mem_compression(self._max_input_shapes_list)
             self._refresh_max_input_shapes_list = False
 
-    def inference(self, input_data):
+    def create_context(self):
+        """Create an execution context of the neural engine model.
+
+        Each context owns the activations and operator states of one inference while the weights are
+        shared, so threads can run inference with their own context concurrently.
+        """
+        if self._refresh_execution_options or self._engine is None:
+            self.engine_init()
+            self._refresh_execution_options = False
+        return self._engine[0].create_context()
+
+    def reset_state(self, context=None):
+        """Start new sequences for the MultiHeadAttention operators with a kv_cache.
+
+        Their past keys and values are kept across inference calls, so a decode step only feeds the new
+        tokens. Call this before the prompt of the next sequence, for the model or for one of its contexts.
+        """
+        if context is not None:
+            context.reset_state()
+        elif self._engine is not None:
+            self._engine[0].reset_state()
+
+    def inference(self, input_data, context=None):
         """The inference API of the neural engine."""
+        if context is not None:
+            output = self._engine[0].forward(context, input_data)
+            return OrderedDict(zip(self._engine[1], output))
         # executor model init
         if self._refresh_execution_options or self._engine is None:
             self.engine_init()
@@ -583,6 +621,50 @@ class Graph(object):
 
         return output_dict
 
+    def inference_async(self, input_data, context=None):
+        """The asynchronous inference API of the neural engine.
+
+        Returns a concurrent.futures.Future of the output dict at once, use asyncio.wrap_future to await it.
+        The inference runs without the GIL on a thread of the model (or of the context), in submission order.
+        The output arrays view the engine memory without a copy and keep it until they are released.
+        """
+        if context is None:
+            if self._refresh_execution_options or self._engine is None:
+                self.engine_init()
+                self._refresh_execution_options = False
+            if self._refresh_max_input_shapes_list and self._do_activation_mem_compression and self._engine:
+                self.engine_init(refresh_model=False)
+            return _output_dict_future(self._engine[0].forward_async(input_data), self._engine[1])
+        return _output_dict_future(self._engine[0].forward_async(context, input_data), self._engine[1])
+
+    def dynamic_batcher(self, max_batch=8, max_wait_ms=2.0, buckets=None, sequence_inputs=None,
+                        sequence_outputs=None, token_outputs=None):
+        """Batch the requests of the neural engine model on the server side.
+
+        Requests are queued for up to max_wait_ms and grouped by the sequence length bucket they are padded to
+        (buckets default to 16, 32, 64, ... 512), each group of at most max_batch rows runs as one batch and its
+        outputs are cut back for every request. sequence_inputs are the indices of the inputs whose dimension 1
+        is the sequence, the first of them gives the sequence length of a request. They default to the inputs
+        with a dynamic dimension 1 in the model. sequence_outputs name the outputs of shape [batch, seq, ...] and
+        token_outputs those of shape [batch * seq, ...], the other outputs are split on dimension 0 only.
+        Returns a submit function which takes the input data of one request and returns a
+        concurrent.futures.Future of its output dict.
+        Don't run inference on the model otherwise while its batcher is in use.
+        """
+        import intel_extension_for_transformers.neural_engine_py as ne
+        if self._refresh_execution_options or self._engine is None:
+            self.engine_init()
+            self._refresh_execution_options = False
+        output_names = self._engine[1]
+        batcher = ne.DynamicBatcher(self._engine[0], max_batch, max_wait_ms, buckets or [], sequence_inputs or [],
+                                    [output_names.index(name) for name in sequence_outputs or []],
+                                    [output_names.index(name) for name in token_outputs or []])
+
+        def submit(input_data):
+            return _output_dict_future(batcher.submit(input_data), output_names)
+
+        return submit
+
     def graph_init(self, config, weight_data=None, load_weight=False):
         """The initialization of the neural engine graph.
 
@@ -1605,3 +1687,20 @@ class Graph(object):
         else:
             logger.warning("Skip activation_mem_compression due to empty engine model or " \
                                "empty input_shapes.")
+
+
+def _output_dict_future(engine_future, output_names):
+    """Map a future of the engine outputs to a future of the output dict."""
+    import concurrent.futures
+    future = concurrent.futures.Future()
+
+    def set_output(done):
+        if done.cancelled():
+            future.cancel()
+        elif done.exception() is not None:
+            future.set_exception(done.exception())
+        else:
+            future.set_result(OrderedDict(zip(output_names, done.result())))
+
+    engine_future.add_done_callback(set_output)
+    return future
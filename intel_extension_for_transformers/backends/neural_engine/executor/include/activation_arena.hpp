@@ -0,0 +1,120 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_ACTIVATION_ARENA_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_ACTIVATION_ARENA_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <vector>
+
+namespace executor {
+
+struct ArenaStats {
+  int64_t alloc_count = 0;     // blocks handed out
+  int64_t free_count = 0;      // blocks returned to the free lists
+  int64_t live_bytes = 0;      // bytes of blocks currently handed out
+  int64_t peak_bytes = 0;      // high-water mark of live_bytes
+  int64_t reserved_bytes = 0;  // bytes of chunks obtained from the system
+};
+
+/**
+ * @brief Size-class bucketed activation memory for one execution context.
+ *
+ * Blocks are carved from large chunks and carry their header (owner, size class and life count) inline,
+ * right in front of the data. Acquire pops a per-class lock-free free list or bumps the current chunk, release
+ * pushes the block back to the free list of its owner, so several threads can share one arena without a lock and
+ * a block may be released from any thread. Only obtaining a new chunk takes the arena mutex.
+ */
+class ActivationArena {
+ public:
+  ActivationArena() = default;
+  ~ActivationArena();
+  ActivationArena(const ActivationArena&) = delete;
+  ActivationArena& operator=(const ActivationArena&) = delete;
+
+  // returns a block of at least `size` bytes whose life count is `life_count`
+  void* Acquire(size_t size, int64_t life_count);
+
+  // returns the arena that owns `data`, nullptr for memory the arenas did not hand out
+  static ActivationArena* Owner(const void* data);
+
+  // life count interface of MemoryAllocator, `data` must be owned by an arena (see Owner)
+  static int64_t Life(const void* data);
+  // a life count of 0 parks the block: it is recycled by the next Acquire unless its life is set again before,
+  // which is how a buffer is handed over to an inplace tensor
+  static void SetLife(void* data, int64_t life_count);
+  // decrements the life count and returns the left count, reaching 0 parks the block
+  static int64_t Unref(void* data);
+
+  // recycles the whole arena at once when no block is handed out anymore, e.g. between two requests
+  // returns false and keeps everything otherwise
+  bool Reset();
+
+  ArenaStats Stats() const;
+
+  // the arena GetMemory allocates from on this thread, a process-wide arena unless a Scope is active
+  static ActivationArena* Current();
+
+  // binds an arena to the current thread for its lifetime
+  class Scope {
+   public:
+    explicit Scope(ActivationArena* arena);
+    ~Scope();
+
+   private:
+    ActivationArena* prev_;
+  };
+
+  // inline block header, defined in activation_arena.cpp
+  struct Block;
+
+ private:
+  struct Chunk {
+    char* base;
+    size_t size;
+    bool dedicated;  // holds a single large block
+    std::atomic<size_t> used;
+  };
+
+  Block* NewBlock(int size_class, size_t block_bytes);
+  Chunk* NewChunk(size_t bytes);
+  void Release(Block* block);
+  void Park(Block* block);
+  void DrainParked();
+  void Push(std::atomic<uint64_t>* head, Block* block, bool park_list);
+  Block* Pop(std::atomic<uint64_t>* head, bool park_list);
+
+  static constexpr int kNumClasses = 161;
+
+  std::atomic<uint64_t> free_lists_[kNumClasses] = {};
+  std::atomic<uint64_t> parked_ = {0};
+  std::atomic<Chunk*> current_ = {nullptr};
+  std::mutex chunk_mutex_;
+  std::vector<Chunk*> chunks_;
+  std::vector<Chunk*> spare_chunks_;  // rewound by Reset, bumped again before new chunks are allocated
+
+  std::atomic<int64_t> live_blocks_ = {0};
+  std::atomic<int64_t> alloc_count_ = {0};
+  std::atomic<int64_t> free_count_ = {0};
+  std::atomic<int64_t> live_bytes_ = {0};
+  std::atomic<int64_t> peak_bytes_ = {0};
+  std::atomic<int64_t> reserved_bytes_ = {0};
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_ACTIVATION_ARENA_HPP_
@@ -32,11 +32,12 @@ namespace executor {
  *        ActivationDAG (model, inplace_tensors_info)
  *                  /\
  *                  ||
- *        ActivationOperator (op_name, topological_order, input_tensors, output_tensors)
+ *        ActivationOperator (op_name, topological_order, input_tensors, output_tensors, workspace)
  *                  /\
  *                  ||
  *        ActivationTensor (tensor_memory_name, memory_bytes, dtype, shape, tensor_semantic_name)
  *        The tensors which have same memory name meaning their memory would be inplaced
+ *        The workspace is the scratch memory of the operator's kernel, it lives only while the operator runs
  *        serialization exmaple (yaml):
  *        ActivationDAG:
  *          ActivationOperator:
@@ -59,6 +60,11 @@ namespace executor {
  *                  dtype: fp32
  *                  shape: [16, 16]
  *                  semantic_alias: ""
+ *              workspace:
+ *                op_name:workspace:
+ *                  alloc_bytes: 4096
+ *                  dtype: u8
+ *                  shape: [4096]
  *            ......
  *          InplaceAliasHolder:
  *            tensor_memory_name:
@@ -105,7 +111,8 @@ class ActivationOperator {
  public:
   explicit ActivationOperator(const string& name, const int64_t& order,
                               const vector<shared_ptr<ActivationTensor>>& input,
-                              const vector<shared_ptr<ActivationTensor>>& output);
+                              const vector<shared_ptr<ActivationTensor>>& output,
+                              const shared_ptr<ActivationTensor>& workspace = nullptr);
   explicit ActivationOperator(const string& name, const YAML::Node& node);
   ActivationOperator() = default;
   ~ActivationOperator() {}
@@ -117,12 +124,16 @@ class ActivationOperator {
   inline const int64_t& topological_order() const { return topological_order_; }
   inline const vector<shared_ptr<ActivationTensor>>& input() const { return input_; }
   inline const vector<shared_ptr<ActivationTensor>>& output() const { return output_; }
+  // nullptr if the operator needs no workspace
+  inline const shared_ptr<ActivationTensor>& workspace() const { return workspace_; }
+  inline void set_workspace(const shared_ptr<ActivationTensor>& workspace) { workspace_ = workspace; }
 
  protected:
   string name_;
   int64_t topological_order_;
   vector<shared_ptr<ActivationTensor>> input_;
   vector<shared_ptr<ActivationTensor>> output_;
+  shared_ptr<ActivationTensor> workspace_;
 };
 
 class ActivationDAG {
@@ -60,8 +60,10 @@ class ActivationDAGHandler {
   shared_ptr<ActivationTensor> BuildTensor(const Tensor* tensor);
   void UpdateTensor(shared_ptr<ActivationTensor> dag_tensor, const Tensor* model_tensor);
   shared_ptr<ActivationOperator> BuildOperator(const string& name, const int64_t order, const vector<Tensor*> input,
-                                               const vector<Tensor*> output);
-  void UpdateOperator(shared_ptr<ActivationOperator> op, const vector<Tensor*> input, const vector<Tensor*> output);
+                                               const vector<Tensor*> output, const size_t workspace_bytes);
+  shared_ptr<ActivationTensor> BuildWorkspace(const string& op_name, const size_t bytes);
+  void UpdateOperator(shared_ptr<ActivationOperator> op, const vector<Tensor*> input, const vector<Tensor*> output,
+                      const size_t workspace_bytes);
   void BuildDAG(const vector<shared_ptr<Dispatcher>>& ops, const vector<vector<Tensor*>>& input_vecs,
                 const vector<vector<Tensor*>>& output_vecs);
   void UpdateDAG(const vector<shared_ptr<Dispatcher>>& ops, const vector<vector<Tensor*>>& input_vecs,
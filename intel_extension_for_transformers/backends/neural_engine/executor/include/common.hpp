@@ -28,6 +28,7 @@
 #include <functional>
 #include <iostream>  // NOLINT(readability/streams)
 #include <map>
+#include <mutex>  // NOLINT
 #include <numeric>
 #include <random>
 #include <set>
@@ -246,6 +247,26 @@ void block_minmax_avx512(const float* Input, size_t N, float* Min, float* Max);
 void block_minmax(const float* Input, size_t N, float* Min, float* Max);
 #endif
 
+/************ runtime isa dispatch ************/
+// Instruction sets the hand-vectorized operators keep a variant for. They pick the best one of the host before they
+// run, so that a build for AVX2 compatibility still runs the AVX512 variants on AVX512 hosts. Only RmsNorm, CosSin,
+// DequantizeLinear and the fp16 pooling of MergedEmbeddingbag do so far, the other `#if __AVX512F__` paths follow
+// the compile flags.
+enum class Isa : int { kScalar = 0, kAvx2 = 1, kAvx512 = 2 };
+
+// Best instruction set of the host, capped by SetMaxIsa() or the NE_MAX_ISA env (scalar, avx2 or avx512)
+NEURALENGINE_API_ Isa RuntimeIsa();
+NEURALENGINE_API_ void SetMaxIsa(Isa isa);
+
+#if defined(__GNUC__) || defined(__clang__)
+#define NE_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define NE_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq,avx2,fma,f16c")))
+#else
+// MSVC compiles any intrinsic regardless of /arch
+#define NE_TARGET_AVX2
+#define NE_TARGET_AVX512
+#endif
+
 /************ hash funtion for primitive cache ************/
 template <typename T>
 inline size_t hash_combine(size_t seed, const T& v) {
@@ -450,6 +471,24 @@ class ConvolutionPrimitiveFwdFactory : public DnnlPrimitiveFactory<dnnl::convolu
                        const float& output_scale, const int64_t& group, const vector<int64_t>& pads,
                        const vector<int64_t>& strides, const dnnl::engine* eng);
 };
+
+// Reordered copies of constant weights, keyed by the weights owner of a model, the weight name and the target
+// layout. Operator instances of different execution contexts share one copy of a weight kept in its original layout.
+// Keys do not use buffer addresses, which are reused once a buffer is freed, and the copies of a model go with it.
+class PrepackedWeightCache {
+ public:
+  // returns nullptr if no copy of weight `name` of `owner` in layout `desc` is cached
+  static void* Get(const void* owner, const string& name, const dnnl::memory::desc& desc);
+  // caches `packed` and returns it, or returns the copy cached meanwhile by another instance
+  static void* Set(const void* owner, const string& name, const dnnl::memory::desc& desc, void* packed);
+  // forgets the copies of `owner` and returns them for the owner to free
+  static vector<void*> Evict(const void* owner);
+
+ private:
+  typedef std::map<std::pair<const void*, string>, vector<std::pair<dnnl::memory::desc, void*>>> CacheMap;
+  static CacheMap& Cache();
+  static std::mutex& Mutex();
+};
 }  // namespace executor
 
 #endif  // ENGINE_EXECUTOR_INCLUDE_COMMON_HPP_
@@ -17,6 +17,7 @@
 
 #include <sys/stat.h>
 #include <glog/logging.h>
+#include <cstdio>
 #include <string>
 #include <vector>
 #include <memory>
@@ -29,6 +30,7 @@
 #include <boost/interprocess/containers/string.hpp>
 #include <boost/interprocess/containers/vector.hpp>
 #include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -122,9 +124,13 @@ class DispatchTable {
     auto shm_handle = GetTableHandle();
     auto& TableShm = OpenShm();
     auto& d_table = *(static_cast<DispatchMap*>(TableShm.get_address_from_handle(shm_handle)));
+    // online tuning inserts while serving, hold the insertion off until the table is written
+    ipc::interprocess_mutex* mtx_insert = utils_shm.find_or_construct<ipc::interprocess_mutex>("mtx_insert")();
+    mtx_insert->lock();
     std::ofstream f_table;
-    // rewrite the dispatch table file if it exists
-    f_table.open(root, std::ios::out | std::ios::trunc);
+    // rewrite the dispatch table file aside and rename it, a loading process never reads a half written table
+    std::string tmp_root = root + ".tmp";
+    f_table.open(tmp_root, std::ios::out | std::ios::trunc);
     size_t num_lines = 0;
     for (const auto& d_pair : d_table) num_lines += d_pair.second.size();
     f_table << num_lines << "\n";
@@ -142,6 +148,11 @@ class DispatchTable {
       }
     }
     f_table.close();
+    mtx_insert->unlock();
+    #ifdef _WIN32
+    remove(root.c_str());
+    #endif
+    if (rename(tmp_root.c_str(), root.c_str()) != 0) LOG(ERROR) << "Failed to save dispatch table file " << root;
     mtx_save->unlock();
   }
 
@@ -172,7 +183,11 @@ class DispatchTable {
   }
 
   // find kernel_config from dispatch table
+  // it takes the insertion lock, so that a kernel config promoted by online tuning is seen whole or not at all
   static std::vector<std::string> Find(const std::string& op_type, const size_t& hash_key) {
+    SharedTable::Segment utils_shm(ipc::open_or_create, "UtilsShm", 1024);
+    ipc::interprocess_mutex* mtx_insert = utils_shm.find_or_construct<ipc::interprocess_mutex>("mtx_insert")();
+    ipc::scoped_lock<ipc::interprocess_mutex> lock(*mtx_insert);
     auto shm_handle = GetTableHandle();
     auto& TableShm = OpenShm();
     auto& d_table = *(static_cast<DispatchMap*>(TableShm.get_address_from_handle(shm_handle)));
@@ -46,6 +46,9 @@ namespace executor {
  *           table file. If dispatcher find the best kernl by hash key, it
  *           will execut that kernel (maybe 1x1 conv). Otherwise, dispatcher
  *           will execute its default kernel (innerproduct there).
+ *        3. If online tuning is on, a hash key missing from the table is
+ *           handed to the OnlineTuner, which tunes it in the background
+ *           and inserts the best kernel into the table for later lookups.
  *
  */
 
@@ -53,6 +56,7 @@ using std::shared_ptr;
 using std::string;
 using std::vector;
 class Model;
+class WeightSnapshot;
 
 class Dispatcher {
  public:
@@ -87,6 +91,10 @@ class Dispatcher {
   void GetExecuteKernel(const vector<Tensor*>& input, const vector<Tensor*>& output, const bool& reshape_model,
                         const bool& has_dispatch_table_file);
 
+  // time every kernel `rounds` times and return the config of the fastest run, empty if no kernel could run
+  vector<string> TuneKernel(const vector<Tensor*>& input, const vector<Tensor*>& output, const bool& reshape_model,
+                            const int& rounds = 1);
+
   // turn on or turn off tuning mechanism in some specific operators if need
   inline void set_tuning_mode(const bool& mode) { do_tuning_ = mode; }
   inline const bool& do_tuning() const { return do_tuning_; }
@@ -106,16 +114,22 @@ class Dispatcher {
   inline const string& post_op() { return kernel_handler_[execute_kernel_]->post_op(); }
   inline void set_latency(const float latency) { kernel_handler_[execute_kernel_]->set_latency(latency); }
   inline const vector<float>& latency() { return kernel_handler_[execute_kernel_]->latency(); }
+  inline void set_hw_counters(const HwCounterSample& sample) {
+    kernel_handler_[execute_kernel_]->set_hw_counters(sample);
+  }
+  inline const vector<HwCounterSample>& hw_counters() { return kernel_handler_[execute_kernel_]->hw_counters(); }
   inline void set_enable_sparse(const bool enable_sparse) {
     kernel_handler_[execute_kernel_]->set_enable_sparse(enable_sparse);
   }
   inline const float& enable_sparse() { return kernel_handler_[execute_kernel_]->enable_sparse(); }
   inline const KERNEL_TYPE& kernel_type() { return kernel_handler_[execute_kernel_]->kernel_type(); }
+  inline size_t workspace_bytes() { return kernel_handler_[execute_kernel_]->workspace_bytes(); }
   inline const float& weight_zero_ratio() { return kernel_handler_[execute_kernel_]->weight_zero_ratio(); }
   inline void set_weight_shape(const vector<int64_t>& weight_shape) {
     kernel_handler_[execute_kernel_]->set_weight_shape(weight_shape);
   }
   inline const vector<int64_t>& weight_shape() { return kernel_handler_[execute_kernel_]->weight_shape(); }
+  inline const string& sparse_format_report() { return kernel_handler_[execute_kernel_]->sparse_format_report(); }
   inline void set_table_id(string table_id) { kernel_handler_[execute_kernel_]->set_table_id(table_id); }
   inline const string& table_id() { return kernel_handler_[execute_kernel_]->table_id(); }
   inline void set_perf_ratio_id(string perf_ratio_id) {
@@ -143,11 +157,16 @@ class Dispatcher {
     kernel_handler_[execute_kernel_]->set_attrs(input_attrs);
   }
   inline const std::map<string, string>& get_attrs() { return kernel_handler_[execute_kernel_]->get_attrs(); }
+  inline int64_t plan_cache_hits() { return kernel_handler_[execute_kernel_]->plan_cache_hits(); }
+  inline int64_t plan_cache_misses() { return kernel_handler_[execute_kernel_]->plan_cache_misses(); }
 
  protected:
   // get input_hash
   size_t GetHash(const vector<Tensor*>& input);
 
+  // let the OnlineTuner time the kernels for `input_hash` on copies of the tensors, see ExecutionOptions
+  void SubmitOnlineTuning(const vector<Tensor*>& input, const vector<Tensor*>& output, const size_t& input_hash);
+
   string name_;
   string type_;
   shared_ptr<OperatorConfig> operator_conf_;
@@ -163,6 +182,9 @@ class Dispatcher {
   bool dispatch_table_file_exists_ = false;
   const ExecutionOptions* execution_options_ptr_ = nullptr;
   bool adapt_action_ = true;
+  bool online_tuning_ = false;
+  // the weight copies of the queued online tuning jobs, freed with the last of them
+  std::weak_ptr<WeightSnapshot> weight_snapshot_;
   const Model* model_ = nullptr;
 };
 }  // namespace executor
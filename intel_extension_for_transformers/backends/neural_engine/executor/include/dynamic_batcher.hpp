@@ -0,0 +1,91 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_DYNAMIC_BATCHER_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_DYNAMIC_BATCHER_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "forward_queue.hpp"
+#include "tensor.hpp"
+
+namespace executor {
+
+struct DynamicBatcherOptions {
+  // rows (dimension 0 summed over the requests) of one run at most, a larger request runs alone
+  int64_t max_batch = 8;
+  // how long the oldest request of a bucket waits for others before its bucket runs anyway
+  int64_t max_wait_us = 2000;
+  // sequence lengths the requests are padded to, a longer request runs at its own length
+  std::vector<int64_t> buckets = {16, 32, 64, 128, 256, 384, 512};
+  // inputs (by index) whose dimension 1 is the sequence, the first of them gives the sequence length of a request.
+  // They are right padded to the bucket, the other inputs are only stacked on dimension 0.
+  std::vector<int> sequence_inputs;
+  // outputs of shape [rows, positions, ...] whose positions are those of the sequence
+  std::vector<int> sequence_outputs;
+  // outputs of shape [rows * positions, ...], the flattened tokens of the sequence
+  std::vector<int> token_outputs;
+};
+
+/**
+ * @brief Groups the requests of a model by sequence length bucket and runs each group as one batch.
+ *
+ * Every input has the batch on dimension 0, the sequence inputs of the options are right padded with zeros on
+ * dimension 1 up to the bucket. A zero attention mask is what PaddingSequence and SequenceLength read as padding,
+ * token and segment ids of 0 are masked out by it. So the model runs few shapes of GEMM-friendly batches instead of
+ * reshaping for every caller.
+ *
+ * Outputs are scattered back by dimension 0, each request gets its rows (its tokens for the token outputs). The
+ * positions of the sequence and token outputs are cut back to the sequence length of the request. Which axes are
+ * the sequence is never guessed from the shapes, a pooled output [rows, 512] is not cut for a bucket of 512.
+ */
+class DynamicBatcher {
+ public:
+  typedef ForwardQueue::ForwardFunc ForwardFunc;
+  // as for ForwardQueue, the outputs are valid until the callback returns
+  typedef ForwardQueue::DoneFunc DoneFunc;
+
+  DynamicBatcher(ForwardFunc forward, const DynamicBatcherOptions& options);
+  // runs the queued requests before it returns, a done callback may destroy the batcher as it may a ForwardQueue
+  ~DynamicBatcher();
+  DynamicBatcher(const DynamicBatcher&) = delete;
+  DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+  void Submit(std::vector<Tensor> input, DoneFunc done);
+  // blocks until every submitted request is done
+  void Drain();
+
+  // the sequence length `seq_len` is padded to
+  int64_t Bucket(int64_t seq_len) const;
+  const DynamicBatcherOptions& options() const;
+  // runs so far and the requests they took, their ratio is the average group size
+  int64_t runs() const;
+  int64_t batched_requests() const;
+
+ private:
+  // queues, buffers and counters, shared with the batching thread. Defined in dynamic_batcher.cpp.
+  struct State;
+
+  static void Work(std::shared_ptr<State> state);
+
+  std::shared_ptr<State> state_;
+  std::thread worker_;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_DYNAMIC_BATCHER_HPP_
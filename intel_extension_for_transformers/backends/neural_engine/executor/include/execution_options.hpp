@@ -57,12 +57,30 @@ struct ExecutionOptions {
   // dispatch table will be saved in this path if enable op tuning.
   std::string dispatch_table_file_root = "./engine_dispatch_table.txt";
 
+  // tune the kernels of unseen input shapes while serving (INFERENCE mode only).
+  // a shape missing from the dispatch table runs the default kernel, a low priority background thread times the
+  // other kernels on copies of its inputs and promotes the winner into the dispatch table, which is saved then.
+  // not supported together with activation memory compression.
+  bool enable_online_tuning = getenv("ENGINE_ONLINE_TUNING") != NULL ? true : false;
+
   // if use activation memory compression engine or not.
   bool activation_mem_compression = getenv("ENGINE_ACTIVATION_MEM_COMPRESSION") != NULL ? true : false;
 
   // save the activation DAG to disk or not.
   // worked only when activation_mem_compression == true.
   bool dump_activation_dag = false;
+
+  // allow Model::CreateContext, so that several threads can run one model with their own execution contexts.
+  // weights stay in their original layout and operators share their reordered copies through a cache.
+  bool enable_execution_context = false;
+
+  // map the weight bin (or the serialized model file) instead of reading it, weight tensors point into the
+  // mapping and processes loading the same model share its pages. ignored when weights use boost shared memory.
+  bool weight_mmap = getenv("ENGINE_WEIGHT_MMAP") != NULL ? true : false;
+  // read the whole mapping ahead at load time (MADV_WILLNEED) instead of faulting it in by the first inference.
+  bool weight_mmap_prefetch = getenv("ENGINE_WEIGHT_MMAP_PREFETCH") != NULL ? true : false;
+  // ask for transparent huge pages on the mapping, it needs a kernel with huge pages for the page cache.
+  bool weight_mmap_hugepage = getenv("ENGINE_WEIGHT_MMAP_HUGEPAGE") != NULL ? true : false;
 };
 
 }  // namespace executor
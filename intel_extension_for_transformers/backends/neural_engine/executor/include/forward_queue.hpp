@@ -0,0 +1,82 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_FORWARD_QUEUE_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_FORWARD_QUEUE_HPP_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "tensor.hpp"
+
+namespace executor {
+
+/**
+ * @brief Runs the requests of one Model (or ExecutionContext) on a thread of its own, in submission order.
+ *
+ * The caller hands a request over and returns at once, which is what the asynchronous forward of the python
+ * bindings needs: the interpreter keeps serving I/O while the request runs without the GIL. The outputs given to
+ * the done callback live in the buffers of the model and are overwritten by its next run, so the callback, which
+ * runs on the queue thread before the next request starts, must pin or copy what it keeps.
+ */
+class ForwardQueue {
+ public:
+  // runs a request and returns its outputs
+  typedef std::function<std::vector<Tensor>&(std::vector<Tensor>&)> ForwardFunc;
+  // `outputs` is null and `error` set if the request threw
+  typedef std::function<void(std::vector<Tensor>* outputs, const std::string& error)> DoneFunc;
+
+  explicit ForwardQueue(ForwardFunc forward);
+  // finishes the queued requests before it returns. A done callback may drop the last reference to the owner of
+  // the queue, the thread is then left to finish on its own.
+  ~ForwardQueue();
+  ForwardQueue(const ForwardQueue&) = delete;
+  ForwardQueue& operator=(const ForwardQueue&) = delete;
+
+  void Submit(std::vector<Tensor> input, DoneFunc done);
+  // blocks until every submitted request is done
+  void Drain();
+  // queued and running requests
+  size_t pending();
+
+ private:
+  struct Request {
+    std::vector<Tensor> input;
+    DoneFunc done;
+  };
+  // shared with the thread, so that it outlives a queue destroyed from its own callback
+  struct State {
+    ForwardFunc forward;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Request> requests;
+    bool running = false;
+    bool stop = false;
+  };
+
+  static void Work(std::shared_ptr<State> state);
+
+  std::shared_ptr<State> state_;
+  std::thread worker_;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_FORWARD_QUEUE_HPP_
@@ -0,0 +1,110 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_HW_COUNTERS_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_HW_COUNTERS_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace executor {
+
+// counters and estimated work of one operator run
+struct HwCounterSample {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t llc_misses = 0;
+  // read and written DRAM bytes of the whole socket, only valid with has_dram
+  uint64_t dram_bytes = 0;
+  bool has_dram = false;
+  // estimated from the tensor shapes, see OperatorFlops
+  double flops = 0;
+  double bytes = 0;
+  float ms = 0;
+
+  inline double ipc() const { return cycles == 0 ? 0 : static_cast<double>(instructions) / cycles; }
+  inline double gflops() const { return ms <= 0 ? 0 : flops / ms / 1e6; }
+  // DRAM traffic if the uncore counters are readable, the tensor bytes otherwise
+  inline double traffic_bytes() const { return has_dram ? static_cast<double>(dram_bytes) : bytes; }
+  inline double gbps() const { return ms <= 0 ? 0 : traffic_bytes() / ms / 1e6; }
+};
+
+/**
+ * @brief Hardware counters around operator runs, read through perf_event_open.
+ *
+ * Cycles, instructions and LLC misses are counted for every thread of the process, so that the OpenMP workers of
+ * a kernel are included. DRAM traffic comes from the uncore memory controllers (uncore_imc_*) when the kernel
+ * exposes them and perf_event_paranoid allows system wide events, it includes other processes on the socket.
+ * Everything degrades to zero counts where perf events are not available (other OS, containers, no permission).
+ */
+class HwCounters {
+ public:
+  HwCounters();
+  ~HwCounters();
+  HwCounters(const HwCounters&) = delete;
+  HwCounters& operator=(const HwCounters&) = delete;
+
+  // false if not even the per-thread counters could be opened
+  inline bool available() const { return !threads_.empty(); }
+  inline bool has_dram() const { return !imc_fds_.empty(); }
+
+  // resets and starts the counters, threads started since the last call are picked up
+  void Start();
+  // stops the counters and returns their sums
+  HwCounterSample Stop();
+
+ private:
+  struct ThreadEvents {
+    int tid;
+    // group leader (cycles), instructions, LLC misses
+    int fds[3];
+  };
+
+  void OpenThreads();
+  void OpenImc();
+
+  std::vector<ThreadEvents> threads_;
+  std::vector<int> imc_fds_;
+};
+
+/**
+ * @brief Compute and memory ceilings of the machine, the lines of the roofline the operators are placed against.
+ *
+ * Measured once with a multiply-add loop and a streaming read over all OpenMP threads. The loops are compiled
+ * code rather than hand tuned kernels, ENGINE_PROFILING_PEAK_GFLOPS and ENGINE_PROFILING_PEAK_GBPS override them
+ * with the vendor figures or the numbers of a proper benchmark.
+ */
+struct Roofline {
+  double peak_gflops = 0;
+  double peak_gbps = 0;
+
+  static const Roofline& Measured();
+
+  // flops per byte where the two ceilings cross
+  inline double ridge() const { return peak_gbps <= 0 ? 0 : peak_gflops / peak_gbps; }
+  // "compute" or "memory", by which ceiling limits an operator of this arithmetic intensity
+  const char* Bound(double flops, double bytes) const;
+  // share of the ceiling the operator reached
+  double Efficiency(const HwCounterSample& sample) const;
+};
+
+// floating point operations of one run of an operator of type `type`. GEMM like operators (InnerProduct, Matmul,
+// BatchMatMul, Convolution) count 2 * M * N * K, the others one operation per output element.
+double OperatorFlops(const std::string& type, const std::vector<std::vector<int64_t>>& input_shapes,
+                     const std::vector<std::vector<int64_t>>& output_shapes);
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_HW_COUNTERS_HPP_
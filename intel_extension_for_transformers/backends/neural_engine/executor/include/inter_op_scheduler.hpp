@@ -0,0 +1,84 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_INTER_OP_SCHEDULER_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_INTER_OP_SCHEDULER_HPP_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace executor {
+
+/**
+ * @brief Runs the operators of a model as soon as their producers are done.
+ *
+ * The dependency DAG is given by the producers of each operator's inputs. Ready operators are pushed to the deque
+ * of the worker which finished their last producer and idle workers steal from the others, so independent branches
+ * (e.g. the Q/K/V InnerProducts of an attention) overlap without any compiler hint. Each operator gets an OpenMP
+ * thread budget of the total threads divided by the number of operators on its DAG level.
+ */
+class InterOpScheduler {
+ public:
+  // `deps[i]` lists the operators whose outputs operator i reads, all smaller than i
+  InterOpScheduler(const std::vector<std::vector<int>>& deps, int total_threads);
+  ~InterOpScheduler();
+  InterOpScheduler(const InterOpScheduler&) = delete;
+  InterOpScheduler& operator=(const InterOpScheduler&) = delete;
+
+  // false if the DAG is a chain, Run would then only add overhead
+  inline bool parallel() const { return !workers_.empty(); }
+  inline int thread_budget(int op) const { return thread_budget_[op]; }
+
+  // runs `task(op)` for every operator respecting the dependencies, the calling thread takes part
+  void Run(const std::function<void(int)>& task);
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<int> ready;
+  };
+
+  void WorkLoop(int worker_id);
+  void Execute(int worker_id, int op);
+  void Push(int worker_id, int op);
+  bool Pop(int worker_id, int* op);
+
+  int num_ops_;
+  std::vector<std::vector<int>> successors_;
+  std::vector<int> num_deps_;
+  std::vector<int> thread_budget_;
+
+  std::vector<std::unique_ptr<Worker>> queues_;
+  std::vector<std::thread> workers_;
+  std::unique_ptr<std::atomic<int>[]> pending_;
+  const std::function<void(int)>* task_ = nullptr;
+  std::atomic<int> remaining_ = {0};
+  std::atomic<int> queued_ = {0};
+
+  std::mutex mutex_;
+  std::condition_variable work_cond_;
+  std::condition_variable done_cond_;
+  int64_t generation_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_INTER_OP_SCHEDULER_HPP_
@@ -27,6 +27,7 @@
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
 
+#include "activation_arena.hpp"
 #include "i_malloc.hpp"
 #include "execution_options.hpp"
 #include "static_compressed_buffer.hpp"
@@ -70,6 +71,10 @@ class MemoryAllocator {
   }
 
   static void InitCompressedBufferManager(const ActivationDAG& dag, const bool& debug_mode = false);
+  // planned and touched bytes of the static compressed buffer, all 0 before the plan is made
+  static CompressedBufferStats StaticCompressedBufferStats() {
+    return scpb_manager_ == nullptr ? CompressedBufferStats() : scpb_manager_->Stats();
+  }
 
   // use another memory buffer which not be freed by memory_allocator
   static MemoryBuffer& CompressedBuffer() {
@@ -166,6 +171,7 @@ class MemoryAllocator {
   }
 
   static int CheckMemory(void* data) {
+    if (ActivationArena::Owner(data) != nullptr) return ActivationArena::Life(data);
     MemoryBuffer& memory_buffer = Buffer();
     MemoryBuffer& scpb_mem_buffer = CompressedBuffer();
     if (memory_buffer.count(data) != 0) {
@@ -182,6 +188,10 @@ class MemoryAllocator {
 
   // set the data buffer a new life count
   static void ResetMemory(void* data, const int life_count) {
+    if (ActivationArena::Owner(data) != nullptr) {
+      ActivationArena::SetLife(data, life_count);
+      return;
+    }
     MemoryBuffer& memory_buffer = Buffer();
     MemoryBuffer& scpb_mem_buffer = CompressedBuffer();
     StrategyList& strategy_list = Strategy();
@@ -198,6 +208,8 @@ class MemoryAllocator {
 
   // will return the left count of one tensor
   static int UnrefMemory(void* data, bool inplace = false) {
+    // an arena block reaching 0 stays parked until the next allocation, so inplace needs no special case
+    if (ActivationArena::Owner(data) != nullptr) return ActivationArena::Unref(data);
     MemoryBuffer& memory_buffer = Buffer();
     MemoryBuffer& scpb_mem_buffer = CompressedBuffer();
     StrategyList& strategy_list = Strategy();
@@ -243,8 +255,6 @@ class MemoryAllocator {
   }
 
   static void* GetMemory(size_t size, const int life_count, const string& tensor_name = "") {
-    static std::mutex getmem_lock;
-    std::lock_guard<std::mutex> lock(getmem_lock);
     if (size == 0) {
       DLOG(INFO) << "please set the tensor size...";
       return nullptr;
@@ -254,19 +264,20 @@ class MemoryAllocator {
       return nullptr;
     }
     StrategyList& strategy_list = Strategy();
+    // the cycle buffer is served by the lock-free arena of the calling context, the other strategies share maps
+    if (strategy_list["cycle_buffer"] ||
+        (strategy_list["static_compressed_buffer"] &&
+         (tensor_name == "" || scpb_manager_ == nullptr || !scpb_manager_->Contains(tensor_name)))) {
+      // memory outside the activation plan (unnamed buffers, shape inference before planning) goes to the arena
+      return CycleBufferGetMemory(size, life_count);
+    }
+    static std::mutex getmem_lock;
+    std::lock_guard<std::mutex> lock(getmem_lock);
     if (strategy_list["static_compressed_buffer"]) {
-      if (tensor_name != "") {
-        // activation memory allocation
-        return StaticCompressedBufferGetMemory(size, life_count, tensor_name);
-      } else {
-        // workspace and other memory allocation
-        // (TODO) it's not good to use one more memory management tools in one instance
-        return CycleBufferGetMemory(size, life_count);
-      }
+      // activation memory allocation
+      return StaticCompressedBufferGetMemory(size, life_count, tensor_name);
     } else if (strategy_list["direct_buffer"]) {
       return DirectBufferGetMemory(size, life_count);
-    } else if (strategy_list["cycle_buffer"]) {
-      return CycleBufferGetMemory(size, life_count);
     } else if (strategy_list["unified_buffer"]) {
       return UnifiedBufferGetMemory(size, life_count);
     } else {
@@ -279,32 +290,14 @@ class MemoryAllocator {
   static void* StaticCompressedBufferGetMemory(size_t size, const int life_count, const string& tensor_name = "");
 
   static void* CycleBufferGetMemory(size_t size, const int life_count) {
-    MemoryBuffer& memory_buffer = Buffer();
-    DLOG(INFO) << "cycle buffer tensor size is " << memory_buffer.size();
-    for (auto iter = memory_buffer.begin(); iter != memory_buffer.end(); ++iter) {
-      auto buffer_count = iter->second[0];
-      auto buffer_size = iter->second[1];
-      if (buffer_count == 0) {
-        if (size > buffer_size) {
-          auto free_ptr = iter->first;
-          aligned_free(free_ptr);
-          memory_buffer.erase(free_ptr);
-          // allocate new buffer
-          void* buf = reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, (size / ALIGNMENT + 1) * ALIGNMENT));
-          memory_buffer.insert({buf, vector<size_t>({static_cast<size_t>(life_count), size})});
-          return buf;
-        } else {
-          memory_buffer[iter->first] = vector<size_t>({static_cast<size_t>(life_count), buffer_size});
-          return iter->first;
-        }
-      }
-    }
-    // allocate new buffer
-    void* buf = reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, (size / ALIGNMENT + 1) * ALIGNMENT));
-    memory_buffer.insert({buf, vector<size_t>({static_cast<size_t>(life_count), size})});
+    void* buf = ActivationArena::Current()->Acquire(size, life_count);
+    LOG_IF(ERROR, buf == nullptr) << "cycle buffer failed to get " << size << " bytes";
     return buf;
   }
 
+  // statistics of the arena the calling thread allocates from
+  static ArenaStats CycleBufferStats() { return ActivationArena::Current()->Stats(); }
+
   static void* DirectBufferGetMemory(size_t size, const int life_count) {
     MemoryBuffer& memory_buffer = Buffer();
     DLOG(INFO) << "direct buffer tensor size is " << memory_buffer.size();
@@ -19,8 +19,10 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <sstream>
 #include <string>
@@ -30,18 +32,25 @@
 
 #include "common.hpp"
 #include "dispatcher.hpp"
+#include "forward_queue.hpp"
 #include "glog/logging.h"
+#include "hw_counters.hpp"
 #include "llga_kernel.hpp"
 #include "memory_allocator.hpp"
+#include "online_tuner.hpp"
 #include "operator.hpp"
 #include "operator_registry.hpp"
 #include "profiling.hpp"
 #include "tensor.hpp"
-#include "thread_pool.hpp"
+#include "inter_op_scheduler.hpp"
 #include "activation_dag_handler.hpp"
+#include "state_store.hpp"
+#include "weight_mapping.hpp"
 
 namespace executor {
 
+class ExecutionContext;
+
 /**
  * @brief Connects Operator%s together into a directed acyclic graph (DAG)
  *        specified by a ModelConfig.
@@ -70,6 +79,15 @@ class NEURALENGINE_API_ Model {
   ipc::managed_shared_memory::handle_t LoadSharedWeight(const string& root, const string& type,
                                                         const vector<int64_t>& shape, const vector<int64_t>& location);
   vector<Tensor>& Forward(vector<Tensor>& input_data);  // NOLINT
+  // runs the model with the state of `context`, threads may call it concurrently with distinct contexts
+  vector<Tensor>& Forward(ExecutionContext* context, vector<Tensor>& input_data);  // NOLINT
+  // queues a Forward on a thread owned by the model (or by `context`) and returns at once, `done` is called on
+  // that thread with the outputs. Don't mix it with the synchronous Forward of the same model or context.
+  void ForwardAsync(vector<Tensor> input_data, ForwardQueue::DoneFunc done);
+  void ForwardAsync(ExecutionContext* context, vector<Tensor> input_data, ForwardQueue::DoneFunc done);
+
+  // creates an execution context sharing the weights of this model, which must outlive it
+  shared_ptr<ExecutionContext> CreateContext() const;
 
   void SetInput(const shared_ptr<OperatorConfig>& conf, const int operator_id, const int tensor_id,
                 map<string, int>* tensor_name_to_idx);
@@ -111,11 +129,35 @@ class NEURALENGINE_API_ Model {
   }
 
   inline const vector<int64_t>& input_shape() const { return input_shape_; }
+  // bytes of the weight file mapped by this model, 0 if the weights were read
+  inline size_t mapped_weight_bytes() const { return weight_mapping_ ? weight_mapping_->size() : 0; }
+  // activation memory statistics of this model, output data stays valid until the next Forward or destruction
+  inline ArenaStats activation_stats() const { return activation_arena_.Stats(); }
   inline const bool& has_dispatch_table_file() const { return has_dispatch_table_file_; }
+  // kernels of unseen shapes are tuned in the background while serving
+  inline const bool& online_tuning() const { return online_tuning_; }
+  // state kept across Forward calls, e.g. the past key/value of MultiHeadAttention with a kv_cache
+  inline StateStore* state_store() const { return &state_store_; }
+  // identifies the weights shared by a model and its execution contexts, alive until the last of them is destroyed
+  inline const void* weights_owner() const { return weights_.get(); }
+  // true if `data` is the buffer the model holds for weight `name`, not a copy or a replacement of it
+  bool HoldsWeight(const string& name, const void* data) const;
+  // true if `data` points into the mapped weight file, such a weight is dropped rather than freed
+  bool IsMappedWeight(const void* data) const;
+  // starts new sequences, the next Forward attends only to its own tokens
+  inline void ResetState() { state_store_.Reset(); }
 
   friend class ActivationDAGHandler;
 
  protected:
+  // builds the runtime of an ExecutionContext, the weights are taken from `weights_owner`
+  explicit Model(const Model* weights_owner);
+
+  // activation and workspace memory of this model, declared first so that it outlives the operators which
+  // release their workspaces on destruction
+  ActivationArena activation_arena_;
+  // written by the operators through the const Model they hold
+  mutable StateStore state_store_;
   string name_;
   shared_ptr<ModelConfig> model_conf_;
   string weight_root_;
@@ -133,15 +175,21 @@ class NEURALENGINE_API_ Model {
   vector<shared_ptr<TensorConfig>> model_input_configs_;
   vector<Tensor*> model_output_tensors_;
   vector<Tensor> output_tensors_;
-  bool multi_stream_flag = (getenv("MULTI_STREAM") != NULL);
-  // collect the op index with parallel thread
-  unordered_map<int, int64_t> multi_stream_tasks_;
-  ThreadPool tp;
+  // runs independent operators in parallel, null when the graph is a chain or activations are not in the arena
+  std::unique_ptr<InterOpScheduler> inter_op_scheduler_;
+  void InitInterOpScheduler();
+  // lowers the single consumer chains of elementwise operators into EltwiseChain operators, after Prepare
+  void FuseEltwiseChains();
   // for dispatcher
   bool has_dispatch_table_file_ = false;
+  bool online_tuning_ = false;
+  // OnlineTuner generation the kernels were last looked up at, operators dispatch again when it moved on
+  uint64_t online_tuning_generation_ = std::numeric_limits<uint64_t>::max();
   ExecutionOptions execution_options_;
   // for profiling
   bool engine_profiling_ = false;
+  // perf counters around each operator, profiling with ENGINE_PROFILING_HW_COUNTERS
+  std::unique_ptr<HwCounters> hw_counters_;
   // for onednn graph
   LLGAINFO llga_info_;
   shared_ptr<Operator> CreateLLGAKernel(const vector<shared_ptr<OperatorConfig>>& op_configs,
@@ -151,6 +199,41 @@ class NEURALENGINE_API_ Model {
   // assume shapes of all input data should be same
   vector<int64_t> input_shape_;
   ActivationDAGHandler act_dag_handler_;
+  // weight buffers by tensor name, read once and shared with the execution contexts
+  shared_ptr<unordered_map<string, void*>> weights_ = std::make_shared<unordered_map<string, void*>>();
+  // the mapped weight file when ExecutionOptions::weight_mmap is on, mapped weights in `weights_` point into it
+  shared_ptr<WeightMapping> weight_mapping_;
+  void MapWeight(const string& file_name, size_t offset);
+  void* LoadMappedWeight(const shared_ptr<TensorConfig>& tensor_config);
+  // true for the runtime of an ExecutionContext, which leaves process-wide state alone
+  bool is_context_ = false;
+  // thread of ForwardAsync, created by its first call
+  std::mutex forward_queue_mutex_;
+  std::unique_ptr<ForwardQueue> forward_queue_;
+};
+
+/**
+ * @brief Per-request state of a Model: activation tensors and their shapes, operator instances with their
+ *        kernels and workspaces, and the activation arena. Weights stay with the Model, so concurrency no longer
+ *        needs one Model per request.
+ *
+ */
+class NEURALENGINE_API_ ExecutionContext {
+ public:
+  inline const Model* model() const { return model_; }
+  inline ArenaStats activation_stats() const { return runtime_->activation_stats(); }
+  inline size_t state_bytes() const { return runtime_->state_store()->reserved_bytes(); }
+  inline void ResetState() { runtime_->ResetState(); }
+
+ private:
+  friend class Model;
+  ExecutionContext(const Model* model, Model* runtime) : model_(model), runtime_(runtime) {}
+
+  const Model* model_;
+  std::unique_ptr<Model> runtime_;
+  // declared last, so that its thread is joined before the runtime goes away
+  std::mutex forward_queue_mutex_;
+  std::unique_ptr<ForwardQueue> forward_queue_;
 };
 
 }  // namespace executor
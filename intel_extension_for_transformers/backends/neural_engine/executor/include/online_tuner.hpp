@@ -0,0 +1,96 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_ONLINE_TUNER_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_ONLINE_TUNER_HPP_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_set>
+#include <vector>
+
+namespace executor {
+
+/**
+ * @brief Tunes the kernels of shapes met while serving on a low priority background thread.
+ *
+ * A dispatcher which misses its input hash in the dispatch table keeps running its default kernel and submits a
+ * job here. The job times the candidate kernels on its own copies of the inputs and returns the winning kernel
+ * config, which is then promoted (inserted into the dispatch table and saved) and counted in generation(), so that
+ * models know when to look their kernels up again. Each (op type, hash) is tuned once per process, whether its
+ * winner was promoted or the default kernel won.
+ */
+class OnlineTuner {
+ public:
+  // returns the config of the fastest kernel, empty if the default kernel won
+  typedef std::function<std::vector<std::string>()> TuneFunc;
+  typedef std::function<void(const std::vector<std::string>&)> PromoteFunc;
+  // builds the job, called on the submitting thread only once the key is taken and the queue has room
+  typedef std::function<TuneFunc()> MakeTuneFunc;
+
+  explicit OnlineTuner(size_t max_pending = 256);
+  ~OnlineTuner();
+  OnlineTuner(const OnlineTuner&) = delete;
+  OnlineTuner& operator=(const OnlineTuner&) = delete;
+
+  static OnlineTuner& Global();
+
+  // queues a job of `owner` unless (op_type, hash_key) was submitted before or the queue is full.
+  // returns false if the job was dropped.
+  bool Submit(const void* owner, const std::string& op_type, size_t hash_key, TuneFunc tune, PromoteFunc promote);
+  // same as above for jobs which are costly to build, e.g. copy tensors, so that dropped ones are never built
+  bool Submit(const void* owner, const std::string& op_type, size_t hash_key, MakeTuneFunc make_tune,
+              PromoteFunc promote);
+  // drops the queued jobs of `owner` and waits for its running one, call it before the owner goes away
+  void Cancel(const void* owner);
+  // blocks until the queue is empty and no job is running
+  void Drain();
+
+  // number of promoted winners, it only grows
+  inline uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+  size_t pending();
+
+ private:
+  struct Job {
+    const void* owner;
+    std::string key;
+    TuneFunc tune;
+    PromoteFunc promote;
+  };
+
+  void Work();
+
+  size_t max_pending_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Job> jobs_;
+  std::unordered_set<std::string> submitted_;
+  // keys taken by Submit whose jobs are being built, they count towards max_pending_
+  size_t building_ = 0;
+  const void* running_owner_ = nullptr;
+  bool running_ = false;
+  bool stop_ = false;
+  std::thread worker_;
+  std::atomic<uint64_t> generation_{0};
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_ONLINE_TUNER_HPP_
@@ -27,6 +27,7 @@
 #include "operator_registry.hpp"
 #include "tensor.hpp"
 #include "execution_options.hpp"
+#include "hw_counters.hpp"
 
 using std::shared_ptr;
 
@@ -133,6 +134,9 @@ class Operator {
   inline const string& post_op() const { return post_op_; }
   inline void set_latency(const float latency) { latency_.emplace_back(latency); }
   inline const vector<float>& latency() const { return latency_; }
+  // one sample per profiled Forward, empty unless ENGINE_PROFILING_HW_COUNTERS is set
+  inline void set_hw_counters(const HwCounterSample& sample) { hw_counters_.emplace_back(sample); }
+  inline const vector<HwCounterSample>& hw_counters() const { return hw_counters_; }
   inline void set_enable_sparse(const bool enable_sparse) { enable_sparse_ = enable_sparse; }
   inline const float& enable_sparse() const { return enable_sparse_; }
   inline const KERNEL_TYPE& kernel_type() const { return kernel_type_; }
@@ -140,6 +144,8 @@ class Operator {
   inline const float& weight_zero_ratio() const { return weight_zero_ratio_; }
   inline void set_weight_shape(const vector<int64_t>& weight_shape) { weight_shape_ = weight_shape; }
   inline const vector<int64_t>& weight_shape() const { return weight_shape_; }
+  // per-layer choice of the weight encoding made at Prepare, see SparseFormatAdvisor::Report
+  inline const string& sparse_format_report() const { return sparse_format_report_; }
   inline void set_table_id(const string& table_id) { table_id_ = table_id; }
   inline const string& table_id() const { return table_id_; }
   inline void set_perf_ratio_id(const string& perf_ratio_id) { perf_ratio_id_ = perf_ratio_id; }
@@ -156,6 +162,18 @@ class Operator {
   inline const vector<float>& get_reshape_time() const { return reshape_time_; }
   inline void set_attrs(const std::map<string, string>& input_attrs) { attrs_ = input_attrs; }
   inline const std::map<string, string>& get_attrs() const { return attrs_; }
+  // hits and misses of the shape keyed plan cache of operators which have one
+  inline void record_plan_cache(bool hit) { hit ? plan_cache_hits_++ : plan_cache_misses_++; }
+  inline int64_t plan_cache_hits() const { return plan_cache_hits_; }
+  inline int64_t plan_cache_misses() const { return plan_cache_misses_; }
+  // scratch memory the kernel needs while it runs, declared in Reshape so that the activation DAG holds it as a
+  // tensor living only during this operator and the static compressed buffer plans it with the activations
+  inline size_t workspace_bytes() const { return workspace_bytes_; }
+  inline string workspace_name() const { return name_ + ":workspace"; }
+  inline void* AcquireWorkspace(size_t bytes) {
+    workspace_bytes_ = bytes;
+    return MemoryAllocator::get().GetMemory(bytes, 1, workspace_name());
+  }
 
  protected:
   /** The conf that stores the operator configurations */
@@ -171,16 +189,21 @@ class Operator {
   // for profiling
   string post_op_;
   vector<float> latency_;
+  vector<HwCounterSample> hw_counters_;
   float enable_sparse_ = false;
   KERNEL_TYPE kernel_type_ = Unsupported;
   float weight_zero_ratio_ = 0.0;
   vector<int64_t> weight_shape_;
+  string sparse_format_report_;
   string table_id_;
   string perf_ratio_id_;
   vector<vector<int64_t>> input_tensor_shape_;
   vector<vector<int64_t>> output_tensor_shape_;
   vector<float> reshape_time_;
   std::map<string, string> attrs_;
+  int64_t plan_cache_hits_ = 0;
+  int64_t plan_cache_misses_ = 0;
+  size_t workspace_bytes_ = 0;
   static std::unordered_map<string, jd::data_type> type2sparsemem_;
   const Model* model_ = nullptr;
   static std::unordered_map<string, jd::data_type> type_2_sparsemem;
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "../operator.hpp"
+#include "../plan_cache.hpp"
 #include "oneapi/dnnl/dnnl.hpp"
 
 namespace executor {
@@ -44,14 +45,20 @@ class ConvolutionOperator : public Operator {
   void Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
   void Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
   vector<vector<string>> InplacePairs(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
+  // reordered copies of the weight, one per layout the plans asked for
+  inline size_t weight_reorders() const { return reordered_weight_m_.size(); }
 
  private:
   void MapTensors(const vector<Tensor*>& input, const vector<Tensor*>& output);
   void DstReshapeFusion(const vector<Tensor*>& input, const vector<Tensor*>& output);
+  bool ReshapeFromPlan(const vector<Tensor*>& input, const vector<Tensor*>& output, size_t plan_key);
+  void BindScratchpad(const memory::desc& scratchpad_md);
+  // the weight in the layout `weights_md`, reordered on the first request of that layout
+  memory ReorderedWeight(const memory::desc& weights_md);
   void DynamicForward(vector<int32_t>* src0_zero_points_ptr, vector<float>* rescales_ptr,
                       vector<float>* dynamic_bias_ptr, memory* any_bias_m_ptr);
 
-  bool weight_cached_;
+  bool bias_cached_;
   bool has_bias_;
   bool format_any_;
   bool append_sum_;
@@ -95,6 +102,7 @@ class ConvolutionOperator : public Operator {
   memory::desc any_bias_md_;
   memory src_m_;
   memory weight_m_;
+  vector<memory> reordered_weight_m_;
   memory bias_m_;
   memory dst_m_;
   memory gelu_m_;
@@ -116,7 +124,24 @@ class ConvolutionOperator : public Operator {
   Tensor* dst_min_ = nullptr;
   Tensor* dst_max_ = nullptr;
   void* scratchpad_ = nullptr;
+  size_t scratchpad_size_ = 0;
   string append_op_;
+
+  // everything Reshape prepares for one input shape, reordered weight and bias included
+  struct Plan {
+    vector<int64_t> src_shape;
+    vector<int64_t> dst_shape;
+    dnnl::convolution_forward::primitive_desc convolution_pd;
+    dnnl::convolution_forward convolution_p;
+    unordered_map<int, memory> memory_args;
+    memory src_m;
+    memory dst_m;
+    memory binary_m;
+    dnnl::eltwise_forward::primitive_desc gelu_pd;
+    dnnl::eltwise_forward gelu_p;
+    memory gelu_m;
+  };
+  PlanCache<Plan> plans_;
 };
 }  // namespace executor
 #endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_CONVOLUTION_HPP_
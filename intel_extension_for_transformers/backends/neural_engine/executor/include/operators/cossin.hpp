@@ -19,6 +19,7 @@
 #include <vector>
 #include <memory>
 
+#include "../common.hpp"
 #include "../operator.hpp"
 
 
@@ -42,6 +43,8 @@ class CosSinOperator : public Operator {
   string output_dtype_ = "fp32";
   string algorithm_ = "cos";
   int array_size_ = 0;
+  // sin or cos of len elements, the variant of the host isa
+  void (*kernel_)(const float* src, float* dst, int64_t len) = nullptr;
 };
 }  // namespace executor
 #endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_COSSIN_HPP_
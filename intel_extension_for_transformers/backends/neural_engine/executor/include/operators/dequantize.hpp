@@ -49,6 +49,7 @@ class DequantizeLinearOperator : public Operator {
   bool has_zp_ = false;
   size_t size_ = 0, scales_size_ = 0;
   vector<int64_t> src0_stride_;
+  Isa isa_ = Isa::kScalar;
 };
 }  // namespace executor
 #endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_DEQUANTIZE_HPP_
@@ -0,0 +1,57 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_OPERATORS_ELTWISE_CHAIN_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_OPERATORS_ELTWISE_CHAIN_HPP_
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../operator.hpp"
+#include "kernels/include/interface.hpp"
+
+namespace executor {
+
+/**
+ * @brief A chain of fp32 elementwise operators run as one jd::eltwiseop kernel, in one pass over the memory.
+ *
+ * It is not emitted by the compiler: Model::Init lowers the single consumer chains of Gelu (gelu_tanh), Exp, Sigmoid
+ * and binary add / sub / mul / div with a constant scalar into it, see Lower. The "postops" attr lists the steps
+ * separated by "+", a linear step carries its alpha and beta, e.g. "gelu+linear:0.5:0+tanh+linear:0.5:0.5".
+ */
+class EltwiseChainOperator : public Operator {
+ public:
+  explicit EltwiseChainOperator(const shared_ptr<OperatorConfig>& conf);
+  virtual ~EltwiseChainOperator() {}
+
+  void Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
+  void Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
+  void Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
+  vector<vector<string>> InplacePairs(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
+
+  /**
+   * @brief The postops of a prepared operator, empty if it cannot be lowered.
+   *
+   * @param data_input set to the index of the input the chain flows through, the others are constant scalars
+   */
+  static string Lower(const string& type, const std::map<string, string>& attrs, const vector<Tensor*>& input,
+                      const vector<Tensor*>& output, int* data_input);
+
+ private:
+  vector<jd::postop_attr> postops_;
+  jd::eltwiseop eltwise_ker_;
+};
+}  // namespace executor
+#endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_ELTWISE_CHAIN_HPP_
@@ -22,6 +22,8 @@
 
 #include "../common.hpp"
 #include "../operator.hpp"
+#include "../plan_cache.hpp"
+#include "../sparse_advisor.hpp"
 #include "../sparse_operators/sparse_inner_product.hpp"
 #include "oneapi/dnnl/dnnl.hpp"
 #include "../weight_compression.hpp"
@@ -41,6 +43,7 @@ class InnerProductOperator : public Operator {
   explicit InnerProductOperator(const shared_ptr<OperatorConfig>& conf);
   virtual ~InnerProductOperator() {
     if (scratchpad_) MemoryAllocator::get().UnrefMemory(scratchpad_);
+    for (void* weight : owned_weights_) aligned_free(weight);
   }
 
  public:
@@ -61,6 +64,10 @@ class InnerProductOperator : public Operator {
   void DynamicPrepare(const vector<Tensor*>& input, const vector<Tensor*>& output);
 
   void ReshapeDense(const vector<Tensor*>& input, const vector<Tensor*>& output);
+  bool ReshapeDenseFromPlan(const vector<Tensor*>& input, const vector<Tensor*>& output, size_t plan_key);
+  void BindScratchpad(const memory::desc& scratchpad_md);
+  // key of the packed weight in the WeightDiskCache, `layout` tells the packing of `kernel` apart
+  string PackedWeightKey(const string& kernel, const string& layout);
   void ForwardDense(const vector<Tensor*>& input, const vector<Tensor*>& output);
   void PrepareDense(const vector<Tensor*>& input, const vector<Tensor*>& output);
   void ShapeInferDense(const vector<Tensor*>& input, const vector<Tensor*>& output);
@@ -80,6 +87,9 @@ class InnerProductOperator : public Operator {
   void PrepareSparseLib(const vector<Tensor*>& input, const vector<Tensor*>& output);
   void ShapeInferSparseLib(const vector<Tensor*>& input, const vector<Tensor*>& output);
 #endif
+  // costs the candidate encodings of the [N, K] (or [K, N] if `transposed`) weight and records the report
+  template <typename T>
+  SparseFormatCost AdviseSparseFormat(Tensor* weight, bool transposed, const vector<SparseFormat>& candidates);
   void RuntimeMemoryArgs(vector<float>* dynamic_bias_ptr, memory* any_bias_m_ptr);
   void RuntimeMinmax();
   void CalculateCompensation(const vector<int64_t>& src1_shape, const vector<int64_t>& src1_stride,
@@ -106,6 +116,8 @@ class InnerProductOperator : public Operator {
   bool sigmoid_;
   bool relu_;
   bool weight_reorded_ = false;
+  // reordered weights of a kept source which are neither shared nor put in the place of the source
+  vector<void*> owned_weights_;
 
   bool append_eltwise_;
   bool is_dynamic_ = false;
@@ -182,6 +194,23 @@ class InnerProductOperator : public Operator {
   Tensor* dst_max_ = nullptr;
   Tensor* inner_product_dynamic_res_ = nullptr;
 
+  // everything ReshapeDense prepares for one input shape, ForwardDense only binds the data handles
+  struct DensePlan {
+    vector<int64_t> src0_shape;
+    vector<int64_t> dst_shape;
+    dnnl::inner_product_forward::primitive_desc inner_product_pd;
+    dnnl::inner_product_forward inner_product_p;
+    unordered_map<int, memory> memory_args;
+    memory src0_m;
+    memory dst_m;
+    memory binary_m;
+    dnnl::eltwise_forward::primitive_desc gelu_pd;
+    dnnl::eltwise_forward gelu_p;
+    memory gelu_m;
+  };
+  PlanCache<DensePlan> dense_plans_;
+  size_t scratchpad_size_ = 0;
+
   float sparse_threshold_ = 0.52;
 
   BSCMatrix<float>* sparse_weight_ = nullptr;
@@ -21,6 +21,7 @@
 
 #include "../common.hpp"
 #include "../operator.hpp"
+#include "../plan_cache.hpp"
 #include "oneapi/dnnl/dnnl.hpp"
 #include "kernels/include/interface.hpp"
 
@@ -46,6 +47,10 @@ class MatmulOperator : public Operator {
   void AdaptTensors(const vector<Tensor*>& input, const vector<Tensor*>& output, const string& stage) override;
 
   void ReshapewithOnednn(const vector<Tensor*>& input, const vector<Tensor*>& output);
+  bool ReshapewithOnednnFromPlan(const vector<Tensor*>& input, const vector<Tensor*>& output, size_t plan_key);
+  void BindScratchpad(const memory::desc& scratchpad_md);
+  // the cached weight in the layout `weights_md`, reordered on the first request of that layout
+  memory ReorderedWeight(const memory::desc& weights_md);
   void ForwardwithOnednn(const vector<Tensor*>& input, const vector<Tensor*>& output);
 
   void ReshapewithTransMode(const vector<Tensor*>& input, const vector<Tensor*>& output);
@@ -54,6 +59,8 @@ class MatmulOperator : public Operator {
 #endif
 
   vector<vector<string>> InplacePairs(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
+  // reordered copies of the cached weight, one per layout the plans asked for
+  inline size_t weight_reorders() const { return reordered_src1_m_.size(); }
 
  private:
   void MapTensors(const vector<Tensor*>& input, const vector<Tensor*>& output);
@@ -109,6 +116,7 @@ class MatmulOperator : public Operator {
   memory any_src0_m_;
   memory any_src1_m_;
   memory any_dst_m_;
+  vector<memory> reordered_src1_m_;
   dnnl::reorder reorder_prim_src_;
   dnnl::reorder reorder_prim_weight_;
   dnnl::reorder reorder_prim_dst_;
@@ -132,6 +140,22 @@ class MatmulOperator : public Operator {
   Tensor* dst_max_ = nullptr;
   string append_op_;
 
+  // everything ReshapewithOnednn prepares for one input shape, reordered weight and bias included
+  struct OnednnPlan {
+    vector<int64_t> dst_shape;
+    dnnl::matmul::primitive_desc matmul_pd;
+    dnnl::matmul matmul_p;
+    unordered_map<int, memory> memory_args;
+    memory src0_m;
+    memory src1_m;
+    memory bias_m;
+    memory dst_m;
+    memory binary_m;
+    memory any_src1_m;
+  };
+  PlanCache<OnednnPlan> onednn_plans_;
+  size_t scratchpad_size_ = 0;
+
   // src tensor shape before fall back
   vector<int64_t> src0_shape_bfb_;
   vector<int64_t> src1_shape_bfb_;
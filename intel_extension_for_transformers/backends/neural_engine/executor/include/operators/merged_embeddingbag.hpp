@@ -26,10 +26,16 @@
 namespace executor {
 
 /**
- * @brief A Padding Sequence Mask operator.
+ * @brief A Merged EmbeddingBag operator: the bags of several tables pooled in one operator.
  *
+ * Inputs are the offsets [tables, batch] and indices [tables, indices] followed by one weight table per output.
+ * Tables are fp32, bf16, u8 or fp16, and with the rowwise_quantized attribute the u8 tables hold fused 8 bit rows:
+ * the values of a row followed by its fp32 scale and fp32 bias (value = q * scale + bias). fp16 and row-wise
+ * quantized tables are dequantized while they are pooled and give fp32 outputs.
+ *
+ * The threads share chunks of bags rather than tables, cut by the rows the bags gather, so that few tables or
+ * skewed pooling factors still keep all cores busy. The rows a chunk gathers next are prefetched.
  */
-
 class MergedEmbeddingbagOperator : public Operator {
  public:
   explicit MergedEmbeddingbagOperator(const shared_ptr<OperatorConfig>& conf);
@@ -40,12 +46,40 @@ class MergedEmbeddingbagOperator : public Operator {
   void Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
 
  private:
+  // bags [begin, end) of a table, the unit of work of a thread
+  struct WorkChunk {
+    int64_t table;
+    int64_t begin;
+    int64_t end;
+  };
+  // cuts the bags into chunks of about the same gathered bytes
+  void PlanChunks(const int32_t* offsets_data, int64_t bs, int64_t n_indices, const vector<size_t>& row_bytes);
+
   string mode_;
+  bool rowwise_quantized_ = false;
+  vector<WorkChunk> chunks_;
 };
 
+// pools the fp32 rows of bag [pool_begin, pool_end), the rows up to prefetch_end are prefetched ahead
 template <typename T>
 void emb_pooling_ker(T* out, T* in, const size_t pool_begin, const size_t pool_end, const size_t vector_size,
-                     int32_t* indices_data, const string& mode);
+                     int32_t* indices_data, const string& mode, const size_t prefetch_end = 0);
+// bf16 pooling of bf16 rows, summed in fp32
+void emb_pooling_bf16_ker(uint16_t* out, const uint16_t* in, const size_t pool_begin, const size_t pool_end,
+                          const size_t vector_size, const int32_t* indices_data, const string& mode,
+                          const size_t prefetch_end = 0);
+// u8 pooling of u8 rows, summed in fp32 and saturated, means are rounded to nearest
+void emb_pooling_u8_ker(uint8_t* out, const uint8_t* in, const size_t pool_begin, const size_t pool_end,
+                        const size_t vector_size, const int32_t* indices_data, const string& mode,
+                        const size_t prefetch_end = 0);
+// fp32 pooling of fp16 rows
+void emb_pooling_fp16_ker(float* out, const uint16_t* in, const size_t pool_begin, const size_t pool_end,
+                          const size_t vector_size, const int32_t* indices_data, const string& mode,
+                          const size_t prefetch_end = 0);
+// fp32 pooling of fused 8 bit rows of vector_size values, an fp32 scale and an fp32 bias
+void emb_pooling_rowwise_u8_ker(float* out, const uint8_t* in, const size_t pool_begin, const size_t pool_end,
+                                const size_t vector_size, const int32_t* indices_data, const string& mode,
+                                const size_t prefetch_end = 0);
 
 }  // namespace executor
 #endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_MERGED_EMBEDDINGBAG_HPP_
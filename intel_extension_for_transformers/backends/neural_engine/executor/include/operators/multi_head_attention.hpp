@@ -22,6 +22,7 @@
 
 #include "../common.hpp"
 #include "../operator.hpp"
+#include "../state_store.hpp"
 #ifdef WITH_SPARSELIB
 #include "kernels/include/interface.hpp"
 #endif
@@ -45,8 +46,12 @@ class MultiHeadAttentionOperator : public Operator {
   void ForwardDense(const vector<Tensor*>& input, const vector<Tensor*>& output);
   void ForwardSparse(const vector<Tensor*>& input, const vector<Tensor*>& output);
   void MapTensors(const vector<Tensor*>& input, const vector<Tensor*>& output);
+  void AppendKVCache(const vector<Tensor*>& input, const vector<Tensor*>& output, int8_t** K_data, int8_t** V_data);
   // Converting string variables from operators attrs to boolean, or int/float
  protected:
+  // the store of the model running the operator, where kv_cache keeps K and V
+  virtual StateStore* state_store() const;
+
   Tensor *Q_ = nullptr, *K_ = nullptr, *V_ = nullptr, *QKV_ = nullptr;
   Tensor* att_mask_ = nullptr;
   Tensor* binary_add_mask_ = nullptr;
@@ -74,6 +79,22 @@ class MultiHeadAttentionOperator : public Operator {
   jd::transpose_mha mha_transpose_;
   std::vector<const void*> rt_data_;
   void* workspace_;
+
+  // with kv_cache K and V only hold the new tokens, they are appended in place to buffers of the model's state
+  // store and the kernel attends to all tokens of the sequence; no past inputs and no Concat in the graph
+  bool kv_cache_ = false;
+  StateBuffer* K_cache_ = nullptr;
+  StateBuffer* V_cache_ = nullptr;
+  // the kernel is built for this many K/V rows per batch, rows behind the sequence length are masked
+  int64_t kv_cache_capacity_ = 0;
+  vector<int32_t> kv_cache_len_;
+  vector<float> kv_cache_badd_;
+
+  // with a SequenceLength mask a second kernel computes only the real tokens of each sequence, read at their padded
+  // places; it is used when padding is a large part of the batch and the padded rows of dst get the zero point
+  bool ragged_ = false;
+  jd::mha_dense mha_ragged_;
+  vector<int32_t> seq_offset_;
 };
 
 }  // namespace executor
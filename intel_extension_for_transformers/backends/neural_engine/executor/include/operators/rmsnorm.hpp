@@ -33,11 +33,8 @@ namespace executor {
  */
 
 class RmsNormOperator : public Operator {
-#if __AVX512F__
-  using parallelBNormCallback = void (*)(char*, const float*, char*, int, __m512*);
-#else
-  using parallelBNormCallback = void (*)(char*, const float*, char*, int, __m256*);
-#endif
+  // normalizes a row of norm_dim fp32 or bf16 elements
+  using RmsNormKernel = void (*)(const char* src, const float* gamma, char* dst, int64_t norm_dim, float epsilon);
 
  public:
   explicit RmsNormOperator(const shared_ptr<OperatorConfig>& conf);
@@ -46,15 +43,13 @@ class RmsNormOperator : public Operator {
   void Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
   void Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
   void Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) override;
-  template <int dt_bytewidth>
-  void RmsNormParallelB(const void* src_data, const float* gamma_data, void* dst_data);
 
  private:
   float epsilon_ = 1e-05;
   int dt_bytewidth_ = 4;  // fp32 inference by default
   int64_t norm_dim_ = -1;
   int batchs_ = -1;
-  parallelBNormCallback parallelB_norm_callback_ = nullptr;
+  RmsNormKernel rms_norm_kernel_ = nullptr;  // variant of the host isa
 };
 }  // namespace executor
 #endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_RMS_NORM_HPP_
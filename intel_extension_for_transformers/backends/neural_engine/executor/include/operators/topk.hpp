@@ -17,6 +17,7 @@
 
 #include <vector>
 #include <memory>
+#include "kernels/include/interface.hpp"
 #include "../operator.hpp"
 namespace executor {
 
@@ -39,6 +40,11 @@ class TopKOperator : public Operator {
   int64_t largest_;
   int64_t sorted_;
   int64_t k_;
+  // the last axis of an fp32 input goes to the vectorized kernel, which gives the values as well
+  bool use_kernel_ = false;
+  jd::topk topk_;
+  std::vector<float> values_;
+  std::vector<const void*> rt_data_;
 };
 }  // namespace executor
 #endif  // ENGINE_EXECUTOR_INCLUDE_OPERATORS_TOPK_HPP
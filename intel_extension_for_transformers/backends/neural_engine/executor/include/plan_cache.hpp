@@ -0,0 +1,89 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_PLAN_CACHE_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_PLAN_CACHE_HPP_
+
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace executor {
+
+/**
+ * @brief A small LRU cache of the prepared state of one operator, keyed by a hash of its input shapes.
+ *
+ * Operators like InnerProduct rebuild their primitive descriptors, memory descriptors and reordered weights in
+ * Reshape. With variable sequence lengths the same few shapes come back again and again, so the operator keeps
+ * a plan per shape and switches to it instead of preparing everything again. The capacity is taken from
+ * ENGINE_PLAN_CACHE_SIZE (default 16), 0 disables the cache.
+ */
+template <typename Plan>
+class PlanCache {
+ public:
+  PlanCache() : capacity_(DefaultCapacity()) {}
+  explicit PlanCache(size_t capacity) : capacity_(capacity) {}
+
+  inline bool enabled() const { return capacity_ > 0; }
+  inline size_t size() const { return entries_.size(); }
+  inline size_t capacity() const { return capacity_; }
+
+  // returns nullptr on a miss, a hit becomes the most recently used plan
+  Plan* Get(size_t key) {
+    auto iter = index_.find(key);
+    if (iter == index_.end()) return nullptr;
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    return &iter->second->second;
+  }
+
+  // the least recently used plan is dropped when the cache is full
+  Plan* Put(size_t key, Plan plan) {
+    if (!enabled()) return nullptr;
+    auto iter = index_.find(key);
+    if (iter != index_.end()) {
+      iter->second->second = std::move(plan);
+      entries_.splice(entries_.begin(), entries_, iter->second);
+      return &iter->second->second;
+    }
+    if (entries_.size() >= capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    entries_.emplace_front(key, std::move(plan));
+    index_[key] = entries_.begin();
+    return &entries_.front().second;
+  }
+
+  void Clear() {
+    entries_.clear();
+    index_.clear();
+  }
+
+  static size_t DefaultCapacity() {
+    const char* env = getenv("ENGINE_PLAN_CACHE_SIZE");
+    if (env == nullptr) return 16;
+    int capacity = atoi(env);
+    return capacity > 0 ? capacity : 0;
+  }
+
+ private:
+  size_t capacity_;
+  std::list<std::pair<size_t, Plan>> entries_;
+  std::unordered_map<size_t, typename std::list<std::pair<size_t, Plan>>::iterator> index_;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_PLAN_CACHE_HPP_
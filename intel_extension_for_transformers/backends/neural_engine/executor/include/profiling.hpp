@@ -24,6 +24,7 @@
 #include "dispatcher.hpp"
 #include "tensor.hpp"
 #include "common.hpp"
+#include "hw_counters.hpp"
 
 namespace executor {
 class ProfilingTracer {
@@ -97,6 +98,17 @@ class ProfilingTracer {
                      << "\",";
         OutputStream << "\"forward_time\" :\"" << op->latency()[i] << "ms"
                      << "\",";
+        OutputStream << "\"plan_cache_hits\" :\"" << op->plan_cache_hits() << "/"
+                     << op->plan_cache_hits() + op->plan_cache_misses() << "\",";
+        if (i < op->hw_counters().size()) {
+          const HwCounterSample& sample = op->hw_counters()[i];
+          OutputStream << "\"cycles\" :\"" << sample.cycles << "\",";
+          OutputStream << "\"instructions\" :\"" << sample.instructions << "\",";
+          OutputStream << "\"llc_misses\" :\"" << sample.llc_misses << "\",";
+          OutputStream << "\"gflops\" :\"" << sample.gflops() << "\",";
+          OutputStream << "\"gbps\" :\"" << sample.gbps() << "\",";
+          OutputStream << "\"bound\" :\"" << Roofline::Measured().Bound(sample.flops, sample.traffic_bytes()) << "\",";
+        }
         OutputStream << "\"input_tensor_name\" :\"" << TensorsName(its) << "\",";
         OutputStream << "\"input_type\" :\"" << TensorsType(its) << "\",";
         OutputStream << "\"input_shape\" :\"" << TensorsShape(op->get_it_shape(), i, its.size()) << "\",";
@@ -260,10 +272,17 @@ class Profiling_ {
     FILE* fp = fopen(csv_file.c_str(), "w");
     if (fp) {
       ProfilingSparse(fp, operators_, input_vecs_, output_vecs_);  // for sparse performance estimation
-      fprintf(fp, "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n", "operator type", "post op", "operator name",
+      fprintf(fp, "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s", "operator type", "post op", "operator name",
               "input tensor name", "input shape", "input dtype", "output tensor name", "output shape", "output dtype",
               "weight shape", "weight sparse ratio", "sparse support", "operator latency (ms)",
-              "aim to weight sparse ratio", "sparse kernel pref ratio", "aim to sparse latency(ms)");
+              "aim to weight sparse ratio", "sparse kernel pref ratio", "aim to sparse latency(ms)",
+              "plan cache hit rate", "weight format (block density, latency vs dense)");
+      bool hw_counters = !operators_[1]->hw_counters().empty();
+      if (hw_counters) {
+        fprintf(fp, ",%s,%s,%s,%s,%s,%s,%s,%s,%s,%s", "cycles", "instructions", "IPC", "LLC misses", "DRAM bytes",
+                "GFLOP/s", "GB/s", "flops per byte", "bound", "roofline efficiency");
+      }
+      fprintf(fp, "\n");
       float total_latency = 0;
       float enable_sparse_latency = 0.;
       // skip input and output node
@@ -288,8 +307,19 @@ class Profiling_ {
         enable_sparse_latency += op->enable_sparse() ? average_latency : 0.;
         // for spase performance estimate
         ProfilingSparseEstimate(fp, op, average_latency);
+        // reuse of the shape keyed plans
+        fprintf(fp, "%s", PlanCacheHitRate(op).c_str());
+        // encodings costed from the weight zero pattern at Prepare, the starred one is used
+        fprintf(fp, ",%s", op->sparse_format_report().c_str());
+        if (hw_counters) ProfilingHwCounters(fp, op);
+        fprintf(fp, "\n");
       }
       ProfilingLatency(fp, operators_, enable_sparse_latency, total_latency);
+      if (hw_counters) {
+        const Roofline& roofline = Roofline::Measured();
+        fprintf(fp, ",,,,,,,,,,,%s,%.1f,%s,%.1f,%s,%.2f\n", "peak GFLOP/s", roofline.peak_gflops, "peak GB/s",
+                roofline.peak_gbps, "ridge flops per byte", roofline.ridge());
+      }
       fclose(fp);
     } else {
       LOG(ERROR) << "Open " << csv_file << " failed!";
@@ -479,10 +509,39 @@ class Profiling_ {
       fprintf(fp, "\"=IF(%s=90%%,%s,IF(%s=80%%,%s,IF(%s=70%%,%s,%s)))\",", aim2sparse_id.c_str(),
               ("B" + op->perf_ratio_id()).c_str(), aim2sparse_id.c_str(), ("C" + op->perf_ratio_id()).c_str(),
               aim2sparse_id.c_str(), ("D" + op->perf_ratio_id()).c_str(), ("E" + op->perf_ratio_id()).c_str());
-      fprintf(fp, "=%s/%s\n", ("M" + op->table_id()).c_str(), ("O" + op->table_id()).c_str());
+      fprintf(fp, "=%s/%s,", ("M" + op->table_id()).c_str(), ("O" + op->table_id()).c_str());
+    } else {
+      fprintf(fp, ",,%.3f,", average_latency);
+    }
+  }
+
+  // counters of the last inference, the bandwidth is measured DRAM traffic when the uncore counters are readable
+  // and the bytes of the input and output tensors otherwise
+  void ProfilingHwCounters(FILE* fp, const shared_ptr<Dispatcher>& op) {
+    if (op->hw_counters().empty()) {
+      fprintf(fp, ",,,,,,,,,,");
+      return;
+    }
+    const HwCounterSample& sample = op->hw_counters().back();
+    const Roofline& roofline = Roofline::Measured();
+    double traffic = sample.traffic_bytes();
+    fprintf(fp, ",%lu,%lu,%.2f,%lu,", sample.cycles, sample.instructions, sample.ipc(), sample.llc_misses);
+    if (sample.has_dram) {
+      fprintf(fp, "%lu,", sample.dram_bytes);
     } else {
-      fprintf(fp, ",,%.3f\n", average_latency);
+      fprintf(fp, ",");
     }
+    fprintf(fp, "%.2f,%.2f,%.2f,%s,%.2f%%", sample.gflops(), sample.gbps(), traffic > 0 ? sample.flops / traffic : 0.,
+            roofline.Bound(sample.flops, traffic), roofline.Efficiency(sample) * 100);
+  }
+
+  std::string PlanCacheHitRate(const shared_ptr<Dispatcher>& op) {
+    int64_t hits = op->plan_cache_hits();
+    int64_t lookups = hits + op->plan_cache_misses();
+    if (lookups == 0) return "";
+    char rate[64];
+    snprintf(rate, sizeof(rate), "%.2f%% (%ld/%ld)", 100.f * hits / lookups, hits, lookups);
+    return rate;
   }
 
  protected:
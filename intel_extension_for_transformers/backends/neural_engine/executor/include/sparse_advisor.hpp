@@ -0,0 +1,81 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_SPARSE_ADVISOR_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_SPARSE_ADVISOR_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace executor {
+
+/**
+ * @brief A block sparse encoding of a weight, seen as a [N, K] matrix (output channels x reduction).
+ *
+ * Blocks are `block_n` x `block_k`, and the non-zero blocks of a block row are stored `group` at a time, padding the
+ * last group with zero blocks, like jd::spns::reorder_to_bsr_group does. `block_n == 0` stands for dense.
+ */
+struct SparseFormat {
+  std::string name;
+  int64_t block_n = 0;
+  int64_t block_k = 0;
+  int64_t group = 1;
+  bool supported = false;  // whether the operator has a kernel for it
+
+  inline bool dense() const { return block_n == 0; }
+};
+
+struct SparseFormatCost {
+  SparseFormat format;
+  float block_density = 1.f;  // stored (padded) blocks / all blocks
+  float cost = 1.f;           // estimated latency relative to dense
+};
+
+/**
+ * @brief Picks the encoding of a weight from its actual zero pattern at Prepare.
+ *
+ * The cost of a block format is `block_cost * block_density` of the dense one: a sparse kernel streams the stored
+ * blocks at about 1 / block_cost of the dense throughput, since it gathers the activations by indices and keeps
+ * fewer accumulators busy. The default 2.5 is the 4x at 90% sparsity of 4x1 blocks assumed by the profiling sheet,
+ * ENGINE_SPARSE_BLOCK_COST overrides it for other machines. Formats the operator has no kernel for are costed all
+ * the same, the report tells whether a layer would pay off being converted to them.
+ */
+class SparseFormatAdvisor {
+ public:
+  explicit SparseFormatAdvisor(const std::vector<SparseFormat>& candidates, float block_cost = DefaultBlockCost());
+
+  // `weight` is [N, K] row major, or [K, N] if `transposed`
+  template <typename T>
+  const SparseFormatCost& Advise(const T* weight, int64_t N, int64_t K, bool transposed = false);
+
+  // the cheapest supported format, the first supported candidate if none was costed yet
+  const SparseFormatCost& selected() const { return costs_[selected_]; }
+  const std::vector<SparseFormatCost>& costs() const { return costs_; }
+  inline float block_cost() const { return block_cost_; }
+  // e.g. "*bsr_4x1_g4 35.2% 0.88x; dense 1.00x | bsr_16x1 38.0% 0.95x", the selected one starred and the formats
+  // without kernel after "|", no commas so that it fits in a csv cell
+  std::string Report() const;
+
+  static float DefaultBlockCost();
+
+ private:
+  std::vector<SparseFormatCost> costs_;
+  float block_cost_;
+  size_t selected_ = 0;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_SPARSE_ADVISOR_HPP_
@@ -0,0 +1,93 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_STATE_STORE_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_STATE_STORE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace executor {
+
+/**
+ * @brief A buffer of rows which grows along the sequence, e.g. the past keys of one attention layer.
+ *
+ * The layout is [batch, capacity, row_bytes] so that the valid rows of every batch are a plain prefix. New rows are
+ * appended in place behind the valid rows of each batch; when the capacity is exceeded it doubles and the rows are
+ * moved once, which keeps the copy cost per appended token constant. Batches of a padded batch have their own
+ * lengths, the padding of one step is overwritten by the next.
+ */
+class StateBuffer {
+ public:
+  StateBuffer(int64_t batch, size_t row_bytes);
+  ~StateBuffer();
+  StateBuffer(const StateBuffer&) = delete;
+  StateBuffer& operator=(const StateBuffer&) = delete;
+
+  inline void* data() const { return data_; }
+  inline int64_t batch() const { return batch_; }
+  inline size_t row_bytes() const { return row_bytes_; }
+  inline int64_t capacity() const { return capacity_; }
+  // the longest of the batches
+  inline int64_t length() const { return length_; }
+  inline int64_t length(int64_t b) const { return lengths_[b]; }
+  inline size_t reserved_bytes() const { return batch_ * capacity_ * row_bytes_; }
+
+  // makes room for `length` rows per batch, returns true if the capacity and so the data pointer changed
+  bool Reserve(int64_t length);
+  // appends `rows` rows to every batch, row r of batch b is read from src + (b * rows + r) * src_row_stride.
+  // With `valid`, only the first valid[b] of them count for batch b, the rest is padding
+  void Append(const void* src, int64_t rows, size_t src_row_stride, const int32_t* valid = nullptr);
+  // a new sequence starts, the memory is kept
+  void Clear();
+
+  // capacities are multiples of this, which is the padding of the attention kernels
+  static constexpr int64_t kMinCapacity = 64;
+
+ private:
+  int64_t batch_;
+  size_t row_bytes_;
+  int64_t capacity_ = 0;
+  int64_t length_ = 0;
+  std::vector<int64_t> lengths_;
+  char* data_ = nullptr;
+};
+
+/**
+ * @brief Persistent state of a Model which lives across Forward calls, the past key/value of autoregressive
+ *        decoding. Every ExecutionContext has its own store, so concurrent conversations keep their caches apart.
+ */
+class StateStore {
+ public:
+  // returns the buffer `name`, it is created again when the batch or the row size changed
+  StateBuffer* Get(const std::string& name, int64_t batch, size_t row_bytes);
+  // starts new sequences, all lengths go back to 0 and the memory is kept for them
+  void Reset();
+  // frees all buffers
+  void Release();
+  size_t reserved_bytes();
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::unique_ptr<StateBuffer>> buffers_;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_STATE_STORE_HPP_
@@ -47,6 +47,26 @@ struct TensorUsageRecord {
   size_t life_end;
 };
 
+struct CompressedBufferStats {
+  // the planner whose plan was taken
+  string strategy;
+  size_t raw_bytes = 0;
+  size_t planned_bytes = 0;
+  size_t low_bound_bytes = 0;
+  // end of the highest planned tensor handed out so far
+  size_t touched_bytes = 0;
+};
+
+/**
+ * @brief One buffer for all activations and kernel workspaces of a model, tensors whose lifetimes do not overlap
+ *        share its memory.
+ *
+ * Several planners place the tensors and the smallest plan is taken:
+ * - greedy by size: shared blocks as large as their largest tensor, tensors are taken by decreasing size.
+ * - best fit by size: every tensor gets the smallest gap between the tensors already placed which live at the same
+ *   time, tensors are taken by decreasing size.
+ * - best fit by breadth: the same placement, tensors are taken by the operators with the most live bytes first.
+ */
 class StaticCompressedBuffer {
  public:
   using SharedBlock = pair<size_t, set<string>>;
@@ -62,10 +82,20 @@ class StaticCompressedBuffer {
     } else {
       GenTensorUsageRecords(dag);
       GenLowBoundSize(dag);
-      GreedyBySize(dag);
+      vector<MemoryPlan> plans = {GreedyBySize(), BestFitBySize(), BestFitByBreadth()};
+      const MemoryPlan* best = &plans[0];
+      for (const auto& plan : plans) {
+        LOG(INFO) << "activation plan " << plan.strategy << " needs " << plan.bytes << " bytes.";
+        if (plan.bytes < best->bytes) best = &plan;
+      }
+      ApplyPlan(*best, dag);
     }
   }
   ~StaticCompressedBuffer() {
+    if (!debug_mode_ && stats_.touched_bytes > 0) {
+      LOG(INFO) << "activation buffer planned " << stats_.planned_bytes << " bytes, touched " << stats_.touched_bytes
+                << " bytes.";
+    }
     if (activation_buffer_ != nullptr) free(activation_buffer_);
     if (debug_mode_) {
       for (auto&& i : memory_map_) {
@@ -74,14 +104,31 @@ class StaticCompressedBuffer {
     }
   }
   void* GetDataByName(const string& name) { return memory_map_[name]; }
+  inline bool Contains(const string& name) const { return memory_map_.count(name) != 0; }
+  inline const CompressedBufferStats& Stats() const { return stats_; }
+  // tracks how much of the planned buffer is really used
+  void RecordUse(const void* data, size_t bytes) {
+    if (debug_mode_ || activation_buffer_ == nullptr) return;
+    size_t end = static_cast<const char*>(data) - static_cast<const char*>(activation_buffer_) + bytes;
+    if (end > stats_.touched_bytes) stats_.touched_bytes = end;
+  }
 
  private:
+  struct MemoryPlan {
+    string strategy;
+    size_t bytes = 0;
+    unordered_map<string, size_t> offsets;
+  };
+
   void* activation_buffer_ = nullptr;
   bool debug_mode_ = false;
   const int align_size = 64;  // TODO(zhe): make it configable based on different arch?
   unordered_map<string, void*> memory_map_;
   map<string, TensorUsageRecord> tensor_usage_records_;
   size_t low_bound_size_ = 0;
+  CompressedBufferStats stats_;
+
+  inline size_t AlignedBytes(size_t bytes) const { return (bytes + align_size - 1) / align_size * align_size; }
 
   void DagValidCheck(const ActivationDAG& dag) {
     // yaml-serialization-type can assert there will no ring in the DAG. So we needn't to check.
@@ -107,6 +154,8 @@ class StaticCompressedBuffer {
             record.name = tensor;
             record.hold_bytes = out_tensor->alloc_bytes();
             record.life_begin = op->topological_order();
+            // a tensor nobody reads lives only while its producer runs
+            record.life_end = op->topological_order();
             tensor_usage_records_[tensor] = record;
           }
         }
@@ -118,13 +167,23 @@ class StaticCompressedBuffer {
         }
       }
     }
+    // workspaces live during their operator only
+    for (const auto& op : dag.operators()) {
+      if (op->workspace() == nullptr || op->workspace()->alloc_bytes() == 0) continue;
+      TensorUsageRecord record;
+      record.name = op->workspace()->name();
+      record.hold_bytes = op->workspace()->alloc_bytes();
+      record.life_begin = op->topological_order();
+      record.life_end = op->topological_order();
+      tensor_usage_records_[record.name] = record;
+    }
   }
 
   void GenLowBoundSize(const ActivationDAG& dag) {
     map<int64_t, vector<size_t>> topological_tensor_width;
     int max_width = 0;
     for (auto&& record : tensor_usage_records_) {
-      for (int i = record.second.life_begin; i < record.second.life_end; i++) {
+      for (int i = record.second.life_begin; i <= record.second.life_end; i++) {
         if (topological_tensor_width.count(i) == 0) {
           topological_tensor_width[i] = {record.second.hold_bytes};
         } else {
@@ -148,15 +207,13 @@ class StaticCompressedBuffer {
     }
   }
 
+  inline bool Overlap(const TensorUsageRecord& a, const TensorUsageRecord& b) const {
+    return a.life_begin <= b.life_end && b.life_begin <= a.life_end;
+  }
+
   bool CheckOverlap(const string& tensor, const SharedBlock& shared_block) {
-    auto life_begin = tensor_usage_records_[tensor].life_begin;
-    auto life_end = tensor_usage_records_[tensor].life_end;
     for (auto&& tensor_name : shared_block.second) {
-      auto cur_life_begin = tensor_usage_records_[tensor_name].life_begin;
-      auto cur_life_end = tensor_usage_records_[tensor_name].life_end;
-      if (cur_life_end >= life_end && cur_life_begin <= life_end) return true;
-      if (life_begin >= cur_life_begin && life_begin <= cur_life_end) return true;
-      if (life_begin <= cur_life_begin && life_end >= cur_life_end) return true;
+      if (Overlap(tensor_usage_records_[tensor], tensor_usage_records_[tensor_name])) return true;
     }
     return false;
   }
@@ -166,28 +223,28 @@ class StaticCompressedBuffer {
     for (const auto& op : dag.operators()) {
       for (auto&& output_tensor : op->output()) {
         if (memory_map_.count(output_tensor->name()) == 0) {
-          auto allocate_bytes = (output_tensor->alloc_bytes() + align_size - 1) / align_size * align_size;
+          auto allocate_bytes = AlignedBytes(output_tensor->alloc_bytes());
           total_byte += allocate_bytes;
           memory_map_[output_tensor->name()] = aligned_alloc(align_size, allocate_bytes);
         }
       }
+      if (op->workspace() != nullptr && op->workspace()->alloc_bytes() != 0) {
+        auto allocate_bytes = AlignedBytes(op->workspace()->alloc_bytes());
+        total_byte += allocate_bytes;
+        memory_map_[op->workspace()->name()] = aligned_alloc(align_size, allocate_bytes);
+      }
     }
     LOG(INFO) << "static-debug-buffer allocate " << total_byte << " bytes.";
   }
 
-  void GreedyBySize(const ActivationDAG& dag) {
-    memory_map_.clear();
-    if (activation_buffer_ != nullptr) free(activation_buffer_);
-    size_t raw_bytes = 0;
-    size_t compressed_bytes = 0;
+  MemoryPlan GreedyBySize() {
+    MemoryPlan plan;
+    plan.strategy = "greedy_by_size";
     vector<SharedBlock> shared_blocks;
 
     // sort the tensor_usage_record by size
     vector<TensorUsageRecord> sorted_tensor_usage_records;
-    for (auto&& i : tensor_usage_records_) {
-      raw_bytes += i.second.hold_bytes;
-      sorted_tensor_usage_records.push_back(i.second);
-    }
+    for (auto&& i : tensor_usage_records_) sorted_tensor_usage_records.push_back(i.second);
 
     std::sort(sorted_tensor_usage_records.begin(), sorted_tensor_usage_records.end(),
               [](const TensorUsageRecord& a, const TensorUsageRecord& b) { return a.hold_bytes > b.hold_bytes; });
@@ -206,31 +263,113 @@ class StaticCompressedBuffer {
       }
       if (!find_suitable_block) {
         SharedBlock new_block;
-        new_block.first = (allocate_bytes + align_size - 1) / align_size * align_size;
+        new_block.first = AlignedBytes(allocate_bytes);
         new_block.second.insert(tensor_name);
         shared_blocks.push_back(new_block);
-        compressed_bytes += new_block.first;
       }
     }
-
-    activation_buffer_ = aligned_alloc(align_size, compressed_bytes);
-    size_t offset = 0;
     for (auto&& i : shared_blocks) {
-      for (auto&& j : i.second) {
-        memory_map_[j] = static_cast<char*>(activation_buffer_) + offset;
+      for (auto&& j : i.second) plan.offsets[j] = plan.bytes;
+      plan.bytes += i.first;
+    }
+    return plan;
+  }
+
+  // places the tensors in `order`, each one into the smallest gap left by the placed tensors it lives with
+  MemoryPlan BestFit(const vector<const TensorUsageRecord*>& order, const string& strategy) {
+    MemoryPlan plan;
+    plan.strategy = strategy;
+    vector<pair<const TensorUsageRecord*, size_t>> placed;
+    for (const auto* record : order) {
+      size_t bytes = AlignedBytes(record->hold_bytes);
+      vector<pair<size_t, size_t>> taken;  // [offset, end) of the placed tensors living at the same time
+      for (const auto& p : placed) {
+        if (Overlap(*record, *p.first)) taken.push_back({p.second, p.second + AlignedBytes(p.first->hold_bytes)});
+      }
+      std::sort(taken.begin(), taken.end());
+      size_t best_offset = 0;
+      size_t best_gap = 0;
+      bool found = false;
+      size_t prev_end = 0;
+      for (const auto& t : taken) {
+        if (t.first > prev_end) {
+          size_t gap = t.first - prev_end;
+          if (gap >= bytes && (!found || gap < best_gap)) {
+            best_offset = prev_end;
+            best_gap = gap;
+            found = true;
+          }
+        }
+        prev_end = std::max(prev_end, t.second);
+      }
+      if (!found) best_offset = prev_end;
+      placed.push_back({record, best_offset});
+      plan.offsets[record->name] = best_offset;
+      plan.bytes = std::max(plan.bytes, best_offset + bytes);
+    }
+    return plan;
+  }
+
+  MemoryPlan BestFitBySize() {
+    vector<const TensorUsageRecord*> order;
+    for (auto&& i : tensor_usage_records_) order.push_back(&i.second);
+    std::stable_sort(order.begin(), order.end(), [](const TensorUsageRecord* a, const TensorUsageRecord* b) {
+      return a->hold_bytes > b->hold_bytes;
+    });
+    return BestFit(order, "best_fit_by_size");
+  }
+
+  MemoryPlan BestFitByBreadth() {
+    // breadth of an operator: the bytes of all tensors living while it runs
+    map<size_t, size_t> breadth;
+    for (auto&& i : tensor_usage_records_) {
+      for (size_t t = i.second.life_begin; t <= i.second.life_end; ++t) breadth[t] += AlignedBytes(i.second.hold_bytes);
+    }
+    vector<pair<size_t, size_t>> ops(breadth.begin(), breadth.end());
+    std::stable_sort(ops.begin(), ops.end(),
+                     [](const pair<size_t, size_t>& a, const pair<size_t, size_t>& b) { return a.second > b.second; });
+    vector<const TensorUsageRecord*> order;
+    set<string> ordered;
+    for (const auto& op : ops) {
+      vector<const TensorUsageRecord*> live;
+      for (auto&& i : tensor_usage_records_) {
+        if (i.second.life_begin <= op.first && op.first <= i.second.life_end && ordered.count(i.first) == 0) {
+          live.push_back(&i.second);
+        }
+      }
+      std::stable_sort(live.begin(), live.end(), [](const TensorUsageRecord* a, const TensorUsageRecord* b) {
+        return a->hold_bytes > b->hold_bytes;
+      });
+      for (const auto* record : live) {
+        order.push_back(record);
+        ordered.insert(record->name);
       }
-      offset += i.first;
     }
+    return BestFit(order, "best_fit_by_breadth");
+  }
+
+  void ApplyPlan(const MemoryPlan& plan, const ActivationDAG& dag) {
+    memory_map_.clear();
+    if (activation_buffer_ != nullptr) free(activation_buffer_);
+    size_t raw_bytes = 0;
+    for (auto&& i : tensor_usage_records_) raw_bytes += i.second.hold_bytes;
+    activation_buffer_ = aligned_alloc(align_size, std::max(plan.bytes, static_cast<size_t>(align_size)));
+    for (auto&& i : plan.offsets) memory_map_[i.first] = static_cast<char*>(activation_buffer_) + i.second;
     // process in-place tensors.
     for (auto&& i : dag.inplace_alias_holder()) {
       for (auto&& j : i.second) {
         memory_map_[j] = memory_map_[i.first];
       }
     }
-    LOG(INFO) << "activation buffer raw bytes: " << raw_bytes << " compressed bytes: " << compressed_bytes
-              << " compress ratio: " << (static_cast<float>(raw_bytes) - compressed_bytes) / raw_bytes;
+    stats_.strategy = plan.strategy;
+    stats_.raw_bytes = raw_bytes;
+    stats_.planned_bytes = plan.bytes;
+    stats_.low_bound_bytes = low_bound_size_;
+    LOG(INFO) << "activation buffer raw bytes: " << raw_bytes << " compressed bytes: " << plan.bytes
+              << " compress ratio: " << (static_cast<float>(raw_bytes) - plan.bytes) / raw_bytes << " by "
+              << plan.strategy;
     LOG(INFO) << "low-bound compressed bytes: " << low_bound_size_
-              << " compressed efficiency: " << (static_cast<float>(low_bound_size_)) / compressed_bytes * 100 << "%";
+              << " compressed efficiency: " << (static_cast<float>(low_bound_size_)) / plan.bytes * 100 << "%";
   }
 };
 }  // namespace executor
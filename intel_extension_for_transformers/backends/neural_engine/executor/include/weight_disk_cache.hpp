@@ -0,0 +1,68 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_WEIGHT_DISK_CACHE_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_WEIGHT_DISK_CACHE_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "weight_mapping.hpp"
+
+namespace executor {
+
+/**
+ * @brief A directory of weights which operators have already reordered into their kernel layout.
+ *
+ * Each entry is one file holding a key and the packed weight. The key describes everything the layout depends on
+ * (operator, kernel, ISA, shapes, dispatch choice and a fingerprint of the source weight), so an entry written for
+ * another machine or another model is simply not found and gets overwritten. Entries are mapped, the next start of
+ * the model skips the reorders and shares the packed weights with other processes through the page cache.
+ * The directory of the global cache is taken from ENGINE_WEIGHT_CACHE_DIR, it is off when the variable is not set.
+ */
+class WeightDiskCache {
+ public:
+  explicit WeightDiskCache(const std::string& dir);
+  WeightDiskCache(const WeightDiskCache&) = delete;
+  WeightDiskCache& operator=(const WeightDiskCache&) = delete;
+
+  static WeightDiskCache& Global();
+  // a hash of all bytes of the source weight, one parallel pass over it at the first start of an operator
+  static size_t Fingerprint(const void* data, size_t bytes);
+
+  inline bool enabled() const { return !dir_.empty(); }
+  inline const std::string& dir() const { return dir_; }
+
+  // returns the packed weight stored for `key`, nullptr if there is none of `bytes` bytes.
+  // the memory is read-only shared, it is copy-on-write and stays valid as long as the cache.
+  void* Load(const std::string& key, size_t bytes);
+  // writes the packed weight of `key`, concurrent writers of one key are safe. returns false on failure.
+  bool Store(const std::string& key, const void* data, size_t bytes);
+  // true if `ptr` is a weight loaded by this cache, it must not be freed
+  bool Contains(const void* ptr);
+
+ private:
+  std::string EntryPath(const std::string& key) const;
+
+  std::string dir_;
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<WeightMapping>> loaded_;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_WEIGHT_DISK_CACHE_HPP_
@@ -0,0 +1,66 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_EXECUTOR_INCLUDE_WEIGHT_MAPPING_HPP_
+#define ENGINE_EXECUTOR_INCLUDE_WEIGHT_MAPPING_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace executor {
+
+/**
+ * @brief The weight bin of a model mapped into memory, weight tensors point into it instead of owning a copy.
+ *
+ * The file is mapped private and copy-on-write: pages come from the page cache, so all processes which load the same
+ * model share one physical copy, and an operator which rewrites its weight in place only gets a private copy of the
+ * touched pages. A weight whose offset does not keep the ALIGNMENT of the kernels is copied out by the caller.
+ */
+class WeightMapping {
+ public:
+  // maps the bytes of `file_name` starting at `offset`, returns nullptr if the file can not be mapped.
+  // `prefetch` asks the kernel to read the whole file ahead (MADV_WILLNEED), `hugepage` to back it by huge pages.
+  static std::shared_ptr<WeightMapping> Map(const std::string& file_name, size_t offset = 0, bool prefetch = false,
+                                            bool hugepage = false);
+  ~WeightMapping();
+  WeightMapping(const WeightMapping&) = delete;
+  WeightMapping& operator=(const WeightMapping&) = delete;
+
+  // the weights, `offset` bytes behind the start of the file
+  inline const char* data() const { return data_; }
+  inline size_t size() const { return size_; }
+  inline const std::string& file_name() const { return file_name_; }
+
+  // address of the weight at [offset, offset + bytes) of the weights, nullptr if it is out of the mapping
+  void* Slice(int64_t offset, int64_t bytes) const;
+  inline bool Contains(const void* ptr) const {
+    const char* p = static_cast<const char*>(ptr);
+    return p >= data_ && p < data_ + size_;
+  }
+
+ private:
+  WeightMapping(const std::string& file_name, void* addr, size_t length, size_t offset);
+
+  std::string file_name_;
+  void* addr_;
+  size_t length_;
+  const char* data_;
+  size_t size_;
+};
+
+}  // namespace executor
+
+#endif  // ENGINE_EXECUTOR_INCLUDE_WEIGHT_MAPPING_HPP_
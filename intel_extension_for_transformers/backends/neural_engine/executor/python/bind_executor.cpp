@@ -15,8 +15,13 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <cstring>
+#include <functional>
+#include <string>
 #include <vector>
 
+#include "activation_arena.hpp"
+#include "dynamic_batcher.hpp"
 #include "executor.hpp"
 #include "pybind_tensor.hpp"
 #include "tensor.hpp"
@@ -24,6 +29,105 @@
 
 namespace py = pybind11;
 
+namespace {
+
+// python objects of an asynchronous request, only touched with the GIL held
+struct AsyncRequest {
+  py::object owner;  // the model or context, which owns the output buffers
+  py::object input;  // the arrays the input tensors point into
+  py::object future;
+};
+
+// one output handed to python: an arena block pinned for the array, or a copy of memory the next run reuses
+struct AsyncOutput {
+  executor::Tensor tensor;
+  bool pinned;
+};
+
+struct ArrayBase {
+  void* data;
+  bool pinned;
+  py::object owner;
+};
+
+py::dtype NumpyDtype(const std::string& dtype) {
+  if (dtype == "int32" || dtype == "s32") return py::dtype::of<int32_t>();
+  if (dtype == "u8") return py::dtype::of<uint8_t>();
+  if (dtype == "s8") return py::dtype::of<int8_t>();
+  if (dtype == "bf16") return py::dtype::of<int16_t>();
+  return py::dtype::of<float>();
+}
+
+// runs on the queue thread before the next request, which would reuse the output buffers
+std::vector<AsyncOutput> KeepOutputs(const std::vector<executor::Tensor>& outputs) {
+  std::vector<AsyncOutput> kept;
+  for (const auto& output : outputs) {
+    void* data = const_cast<void*>(output.raw_data());
+    bool pinned = data != nullptr && executor::ActivationArena::Owner(data) != nullptr;
+    if (pinned) {
+      // the arena hands the block out again only once the array released it
+      executor::ActivationArena::SetLife(data, executor::ActivationArena::Life(data) + 1);
+    } else if (data != nullptr) {
+      size_t bytes = output.size() * executor::type2bytes[output.dtype()];
+      void* copy = new char[bytes];
+      memcpy(copy, data, bytes);
+      data = copy;
+    }
+    // set_data would hand the pointer to the MemoryAllocator
+    kept.push_back({executor::Tensor(data, output.shape(), output.dtype()), pinned});
+  }
+  return kept;
+}
+
+py::list OutputArrays(const std::vector<AsyncOutput>& outputs, const py::object& owner) {
+  py::list arrays;
+  for (const auto& output : outputs) {
+    void* data = const_cast<void*>(output.tensor.raw_data());
+    py::capsule base(new ArrayBase{data, output.pinned, owner}, [](void* p) {
+      ArrayBase* base = reinterpret_cast<ArrayBase*>(p);
+      if (base->pinned) {
+        executor::ActivationArena::Unref(base->data);
+      } else {
+        delete[] reinterpret_cast<char*>(base->data);
+      }
+      delete base;
+    });
+    arrays.append(py::array(NumpyDtype(output.tensor.dtype()), output.tensor.shape(), data, base));
+  }
+  return arrays;
+}
+
+typedef std::function<void(std::vector<executor::Tensor>, executor::ForwardQueue::DoneFunc)> SubmitFunc;
+
+// the future is resolved with numpy arrays viewing the output memory, which stays valid as long as they live
+py::object SubmitAsync(py::object owner, py::object input, const SubmitFunc& submit) {
+  std::vector<executor::Tensor> input_data = input.cast<std::vector<executor::Tensor>>();
+  py::object future = py::module::import("concurrent.futures").attr("Future")();
+  AsyncRequest* request = new AsyncRequest{owner, input, future};
+  auto done = [request](std::vector<executor::Tensor>* outputs, const std::string& error) {
+    std::vector<AsyncOutput> kept;
+    if (outputs != nullptr) kept = KeepOutputs(*outputs);
+    py::gil_scoped_acquire gil;
+    py::list arrays = OutputArrays(kept, request->owner);
+    // a cancelled future takes no result, the arrays release their memory right away
+    if (!request->future.attr("done")().cast<bool>()) {
+      if (outputs != nullptr) {
+        request->future.attr("set_result")(arrays);
+      } else {
+        request->future.attr("set_exception")(py::module::import("builtins").attr("RuntimeError")(error));
+      }
+    }
+    delete request;
+  };
+  {
+    py::gil_scoped_release release;
+    submit(std::move(input_data), done);
+  }
+  return future;
+}
+
+}  // namespace
+
 PYBIND11_MODULE(neural_engine_py, m) {
   m.doc() = "pybind11 engine plugin";
   py::class_<executor::Model>(m, "Model")
@@ -31,8 +135,93 @@ PYBIND11_MODULE(neural_engine_py, m) {
       .def(py::init<executor::ModelConfig, std::string>())
       .def(py::init<executor::ModelConfig, std::string, executor::ExecutionOptions>())
       .def(py::init<std::string, std::string, executor::ExecutionOptions>())
-      .def("forward", &executor::Model::Forward, py::arg("input"), py::return_value_policy::take_ownership)
-      .def("activation_mem_compression", &executor::Model::ActivationMemCompression, py::arg("input_shapes"));
+      .def("forward", py::overload_cast<std::vector<executor::Tensor>&>(&executor::Model::Forward), py::arg("input"),
+           py::return_value_policy::take_ownership)
+      // contexts run without the GIL, so python threads can share one model
+      .def("forward",
+           py::overload_cast<executor::ExecutionContext*, std::vector<executor::Tensor>&>(&executor::Model::Forward),
+           py::arg("context"), py::arg("input"), py::return_value_policy::take_ownership,
+           py::call_guard<py::gil_scoped_release>())
+      // returns a concurrent.futures.Future at once (asyncio.wrap_future makes it awaitable), the request runs
+      // without the GIL on a thread of the model or context
+      .def(
+          "forward_async",
+          [](py::object self, py::object input) {
+            executor::Model* model = self.cast<executor::Model*>();
+            return SubmitAsync(self, input, [model](std::vector<executor::Tensor> input_data,
+                                                    executor::ForwardQueue::DoneFunc done) {
+              model->ForwardAsync(std::move(input_data), std::move(done));
+            });
+          },
+          py::arg("input"))
+      .def(
+          "forward_async",
+          [](py::object self, py::object context, py::object input) {
+            executor::Model* model = self.cast<executor::Model*>();
+            executor::ExecutionContext* ctx = context.cast<executor::ExecutionContext*>();
+            return SubmitAsync(context, input, [model, ctx](std::vector<executor::Tensor> input_data,
+                                                            executor::ForwardQueue::DoneFunc done) {
+              model->ForwardAsync(ctx, std::move(input_data), std::move(done));
+            });
+          },
+          py::arg("context"), py::arg("input"))
+      .def("create_context", &executor::Model::CreateContext, py::keep_alive<0, 1>())
+      .def("reset_state", &executor::Model::ResetState)
+      .def("activation_mem_compression", &executor::Model::ActivationMemCompression, py::arg("input_shapes"))
+      // the operators as they run, after the fusions of Init
+      .def("operator_types", [](const executor::Model& model) {
+        std::vector<std::string> types;
+        for (const auto& op : model.operators()) types.push_back(op->type());
+        return types;
+      });
+
+  // groups the requests of a model by sequence length bucket into batches, see DynamicBatcher. submit returns a
+  // future as forward_async does, the model must not be run otherwise while the batcher is in use.
+  py::class_<executor::DynamicBatcher>(m, "DynamicBatcher")
+      .def(py::init([](executor::Model* model, int64_t max_batch, double max_wait_ms, std::vector<int64_t> buckets,
+                       std::vector<int> sequence_inputs, std::vector<int> sequence_outputs,
+                       std::vector<int> token_outputs) {
+             executor::DynamicBatcherOptions options;
+             options.max_batch = max_batch;
+             options.max_wait_us = static_cast<int64_t>(max_wait_ms * 1000);
+             if (!buckets.empty()) options.buckets = buckets;
+             // by default the inputs whose dimension 1 is dynamic in the model config, as [-1, -1] of input ids
+             if (sequence_inputs.empty()) {
+               const auto& configs = model->input_configs();
+               for (size_t i = 0; i < configs.size(); ++i) {
+                 const auto& shape = configs[i]->shape();
+                 if (shape.size() >= 2 && shape[1] < 0) sequence_inputs.push_back(i);
+               }
+             }
+             options.sequence_inputs = sequence_inputs;
+             options.sequence_outputs = sequence_outputs;
+             options.token_outputs = token_outputs;
+             return new executor::DynamicBatcher(
+                 [model](std::vector<executor::Tensor>& input) -> std::vector<executor::Tensor>& {
+                   return model->Forward(input);
+                 },
+                 options);
+           }),
+           py::arg("model"), py::arg("max_batch") = 8, py::arg("max_wait_ms") = 2.0,
+           py::arg("buckets") = std::vector<int64_t>(), py::arg("sequence_inputs") = std::vector<int>(),
+           py::arg("sequence_outputs") = std::vector<int>(), py::arg("token_outputs") = std::vector<int>(),
+           py::keep_alive<1, 2>())
+      .def(
+          "submit",
+          [](py::object self, py::object input) {
+            executor::DynamicBatcher* batcher = self.cast<executor::DynamicBatcher*>();
+            return SubmitAsync(self, input, [batcher](std::vector<executor::Tensor> input_data,
+                                                      executor::ForwardQueue::DoneFunc done) {
+              batcher->Submit(std::move(input_data), std::move(done));
+            });
+          },
+          py::arg("input"))
+      .def("runs", &executor::DynamicBatcher::runs)
+      .def("batched_requests", &executor::DynamicBatcher::batched_requests);
+
+  py::class_<executor::ExecutionContext, std::shared_ptr<executor::ExecutionContext>>(m, "ExecutionContext")
+      .def("reset_state", &executor::ExecutionContext::ResetState)
+      .def("state_bytes", &executor::ExecutionContext::state_bytes);
 
   py::class_<executor::TensorConfig, std::shared_ptr<executor::TensorConfig>>(m, "tensor_config")
       .def(py::init<std::string, const std::vector<int64_t>&, std::string, const std::vector<int64_t>&,
@@ -60,7 +249,12 @@ PYBIND11_MODULE(neural_engine_py, m) {
       .def_readwrite("warmup_iter", &executor::ExecutionOptions::warmup_iter)
       .def_readwrite("dispatch_table_file_root", &executor::ExecutionOptions::dispatch_table_file_root)
       .def_readwrite("enable_op_tuning", &executor::ExecutionOptions::enable_op_tuning)
+      .def_readwrite("enable_online_tuning", &executor::ExecutionOptions::enable_online_tuning)
       .def_readwrite("execution_mode", &executor::ExecutionOptions::execution_mode)
       .def_readwrite("activation_mem_compression", &executor::ExecutionOptions::activation_mem_compression)
-      .def_readwrite("dump_activation_dag", &executor::ExecutionOptions::dump_activation_dag);
+      .def_readwrite("dump_activation_dag", &executor::ExecutionOptions::dump_activation_dag)
+      .def_readwrite("enable_execution_context", &executor::ExecutionOptions::enable_execution_context)
+      .def_readwrite("weight_mmap", &executor::ExecutionOptions::weight_mmap)
+      .def_readwrite("weight_mmap_prefetch", &executor::ExecutionOptions::weight_mmap_prefetch)
+      .def_readwrite("weight_mmap_hugepage", &executor::ExecutionOptions::weight_mmap_hugepage);
 }
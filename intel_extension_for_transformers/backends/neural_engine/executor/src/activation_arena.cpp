@@ -0,0 +1,397 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "activation_arena.hpp"
+
+#include <stdlib.h>
+#include <new>
+
+#include "glog/logging.h"
+#include "i_malloc.hpp"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace executor {
+
+namespace {
+
+// chunks are 2MB aligned and registered page by page, so that any pointer can be checked for arena ownership
+// before its block header is read
+constexpr int kPageShift = 21;
+constexpr size_t kPageBytes = size_t(1) << kPageShift;
+constexpr size_t kChunkBytes = 32 * kPageBytes;
+// blocks larger than this get a chunk of their own instead of being carved from the current one
+constexpr size_t kDedicatedBytes = kChunkBytes / 4;
+
+// size classes: 256 bytes, then 4 classes per power of two (at most 25% internal waste)
+constexpr int kMinClassShift = 8;
+
+inline int SizeClass(size_t bytes) {
+  if (bytes <= (size_t(1) << kMinClassShift)) return 0;
+  int lg = 0;
+  for (size_t v = bytes - 1; v > 1; v >>= 1) ++lg;
+  const size_t base = size_t(1) << lg;
+  const size_t step = base >> 2;
+  return (lg - kMinClassShift) * 4 + static_cast<int>((bytes - 1 - base) / step) + 1;
+}
+
+inline size_t ClassBytes(int size_class) {
+  if (size_class == 0) return size_t(1) << kMinClassShift;
+  const int lg = (size_class - 1) / 4 + kMinClassShift;
+  const size_t base = size_t(1) << lg;
+  return base + ((size_class - 1) % 4 + 1) * (base >> 2);
+}
+
+void* ChunkAlloc(size_t bytes) {
+#ifdef _WIN32
+  return _aligned_malloc(bytes, kPageBytes);
+#else
+  return aligned_alloc(kPageBytes, bytes);
+#endif
+}
+
+void ChunkFree(void* ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+// open addressing set of the pages owned by any arena; inserts and removals only happen with chunks
+class PageRegistry {
+ public:
+  static PageRegistry& get() {
+    static PageRegistry* registry = new PageRegistry();
+    return *registry;
+  }
+
+  void Insert(uintptr_t page) {
+    const uintptr_t key = page + 1;
+    for (size_t i = Hash(page), n = 0; n < kSlots; i = (i + 1) & (kSlots - 1), ++n) {
+      uintptr_t cur = slots_[i].load(std::memory_order_relaxed);
+      while (cur == kEmpty || cur == kTombstone) {
+        if (slots_[i].compare_exchange_weak(cur, key, std::memory_order_release, std::memory_order_relaxed)) return;
+      }
+      if (cur == key) return;
+    }
+    LOG(FATAL) << "Activation arena page registry is full.";
+  }
+
+  void Remove(uintptr_t page) {
+    const uintptr_t key = page + 1;
+    for (size_t i = Hash(page), n = 0; n < kSlots; i = (i + 1) & (kSlots - 1), ++n) {
+      const uintptr_t cur = slots_[i].load(std::memory_order_relaxed);
+      if (cur == kEmpty) return;
+      if (cur == key) {
+        slots_[i].store(kTombstone, std::memory_order_release);
+        return;
+      }
+    }
+  }
+
+  bool Contains(uintptr_t page) const {
+    const uintptr_t key = page + 1;
+    for (size_t i = Hash(page), n = 0; n < kSlots; i = (i + 1) & (kSlots - 1), ++n) {
+      const uintptr_t cur = slots_[i].load(std::memory_order_acquire);
+      if (cur == kEmpty) return false;
+      if (cur == key) return true;
+    }
+    return false;
+  }
+
+ private:
+  PageRegistry() = default;
+
+  static constexpr int kSlotShift = 17;  // 128K pages, 256GB of chunks
+  static constexpr size_t kSlots = size_t(1) << kSlotShift;
+  static constexpr uintptr_t kEmpty = 0;
+  static constexpr uintptr_t kTombstone = ~uintptr_t(0);
+
+  static size_t Hash(uintptr_t page) { return (page * 0x9E3779B97F4A7C15ull) >> (64 - kSlotShift); }
+
+  std::atomic<uintptr_t> slots_[kSlots] = {};
+};
+
+// free list heads carry an ABA tag in the upper 16 bits of the pointer
+constexpr uint64_t kPtrMask = (uint64_t(1) << 48) - 1;
+inline uint64_t Pack(const void* ptr, uint64_t tag) {
+  return (tag << 48) | (reinterpret_cast<uintptr_t>(ptr) & kPtrMask);
+}
+inline uint64_t Tag(uint64_t v) { return v >> 48; }
+
+thread_local ActivationArena* t_current_arena = nullptr;
+
+}  // namespace
+
+constexpr uint64_t kBlockMagic = 0x61637461726e6131ull;  // 'actarna1'
+
+// block states, kInParked marks membership of the parked list independently of the state
+enum : uint32_t { kLive = 0, kParked = 1, kFree = 2, kStateMask = 3, kInParked = 4 };
+
+struct alignas(ALIGNMENT) ActivationArena::Block {
+  uint64_t magic;
+  ActivationArena* owner;
+  void* data;
+  size_t bytes;
+  std::atomic<int64_t> life;
+  std::atomic<uint32_t> state;
+  int32_t size_class;
+  Block* free_next;
+  Block* park_next;
+};
+static_assert(sizeof(ActivationArena::Block) == ALIGNMENT, "arena block header must keep the data aligned");
+
+static inline ActivationArena::Block* Header(const void* data) {
+  return reinterpret_cast<ActivationArena::Block*>(const_cast<char*>(static_cast<const char*>(data)) - ALIGNMENT);
+}
+
+static bool TransitionState(std::atomic<uint32_t>* state, uint32_t from, uint32_t to) {
+  uint32_t cur = state->load(std::memory_order_acquire);
+  while ((cur & kStateMask) == from) {
+    if (state->compare_exchange_weak(cur, (cur & ~kStateMask) | to, std::memory_order_acq_rel)) return true;
+  }
+  return false;
+}
+
+ActivationArena::~ActivationArena() {
+  for (Chunk* chunk : chunks_) {
+    const uintptr_t first = reinterpret_cast<uintptr_t>(chunk->base) >> kPageShift;
+    for (size_t i = 0; i < chunk->size >> kPageShift; ++i) PageRegistry::get().Remove(first + i);
+    ChunkFree(chunk->base);
+    delete chunk;
+  }
+}
+
+void ActivationArena::Push(std::atomic<uint64_t>* head, Block* block, bool park_list) {
+  uint64_t old = head->load(std::memory_order_acquire);
+  uint64_t desired;
+  do {
+    Block* next = reinterpret_cast<Block*>(old & kPtrMask);
+    if (park_list) {
+      block->park_next = next;
+    } else {
+      block->free_next = next;
+    }
+    desired = Pack(block, Tag(old) + 1);
+  } while (!head->compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_acquire));
+}
+
+ActivationArena::Block* ActivationArena::Pop(std::atomic<uint64_t>* head, bool park_list) {
+  uint64_t old = head->load(std::memory_order_acquire);
+  while (true) {
+    Block* block = reinterpret_cast<Block*>(old & kPtrMask);
+    if (block == nullptr) return nullptr;
+    // block headers live as long as the arena, reading a stale next is caught by the tag
+    Block* next = park_list ? block->park_next : block->free_next;
+    if (head->compare_exchange_weak(old, Pack(next, Tag(old) + 1), std::memory_order_acquire,
+                                    std::memory_order_acquire)) {
+      return block;
+    }
+  }
+}
+
+ActivationArena::Chunk* ActivationArena::NewChunk(size_t bytes) {
+  const size_t size = (bytes + kPageBytes - 1) & ~(kPageBytes - 1);
+  char* base = static_cast<char*>(ChunkAlloc(size));
+  if (base == nullptr) {
+    LOG(ERROR) << "Activation arena failed to allocate " << size << " bytes.";
+    return nullptr;
+  }
+  Chunk* chunk = new Chunk{base, size, bytes > kChunkBytes / 4, {0}};
+  const uintptr_t first = reinterpret_cast<uintptr_t>(base) >> kPageShift;
+  for (size_t i = 0; i < size >> kPageShift; ++i) PageRegistry::get().Insert(first + i);
+  chunks_.push_back(chunk);
+  reserved_bytes_.fetch_add(size, std::memory_order_relaxed);
+  return chunk;
+}
+
+ActivationArena::Block* ActivationArena::NewBlock(int size_class, size_t block_bytes) {
+  const size_t total = sizeof(Block) + block_bytes;
+  char* addr = nullptr;
+  if (total > kDedicatedBytes) {
+    std::lock_guard<std::mutex> lock(chunk_mutex_);
+    Chunk* chunk = NewChunk(total);
+    if (chunk == nullptr) return nullptr;
+    chunk->used.store(chunk->size, std::memory_order_relaxed);
+    addr = chunk->base;
+  } else {
+    while (addr == nullptr) {
+      Chunk* chunk = current_.load(std::memory_order_acquire);
+      if (chunk != nullptr) {
+        const size_t offset = chunk->used.fetch_add(total, std::memory_order_relaxed);
+        if (offset + total <= chunk->size) {
+          addr = chunk->base + offset;
+          break;
+        }
+      }
+      std::lock_guard<std::mutex> lock(chunk_mutex_);
+      if (current_.load(std::memory_order_acquire) == chunk) {
+        Chunk* fresh = nullptr;
+        if (!spare_chunks_.empty()) {
+          fresh = spare_chunks_.back();
+          spare_chunks_.pop_back();
+        } else {
+          fresh = NewChunk(kChunkBytes);
+          if (fresh == nullptr) return nullptr;
+        }
+        current_.store(fresh, std::memory_order_release);
+      }
+    }
+  }
+
+  Block* block = new (addr) Block;
+  block->magic = kBlockMagic;
+  block->owner = this;
+  block->data = addr + sizeof(Block);
+  block->bytes = block_bytes;
+  block->life.store(0, std::memory_order_relaxed);
+  block->state.store(kLive, std::memory_order_relaxed);
+  block->size_class = size_class;
+  block->free_next = nullptr;
+  block->park_next = nullptr;
+  return block;
+}
+
+void* ActivationArena::Acquire(size_t size, int64_t life_count) {
+  DrainParked();
+  // keep the padding of the former cycle buffer, some kernels write slightly past the tensor end
+  const int size_class = SizeClass((size / ALIGNMENT + 1) * ALIGNMENT);
+  Block* block = Pop(&free_lists_[size_class], false);
+  if (block == nullptr) {
+    block = NewBlock(size_class, ClassBytes(size_class));
+    if (block == nullptr) return nullptr;
+  } else {
+    block->state.fetch_and(kInParked, std::memory_order_acq_rel);  // kLive, parked list membership kept
+  }
+  block->life.store(life_count, std::memory_order_release);
+
+  alloc_count_.fetch_add(1, std::memory_order_relaxed);
+  live_blocks_.fetch_add(1, std::memory_order_relaxed);
+  const int64_t live = live_bytes_.fetch_add(block->bytes, std::memory_order_relaxed) + block->bytes;
+  int64_t peak = peak_bytes_.load(std::memory_order_relaxed);
+  while (live > peak && !peak_bytes_.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+  return block->data;
+}
+
+void ActivationArena::Release(Block* block) {
+  Push(&free_lists_[block->size_class], block, false);
+  free_count_.fetch_add(1, std::memory_order_relaxed);
+  live_blocks_.fetch_sub(1, std::memory_order_relaxed);
+  live_bytes_.fetch_sub(block->bytes, std::memory_order_relaxed);
+}
+
+void ActivationArena::Park(Block* block) {
+  if (!TransitionState(&block->state, kLive, kParked)) return;
+  if ((block->state.fetch_or(kInParked, std::memory_order_acq_rel) & kInParked) == 0) {
+    Push(&parked_, block, true);
+  }
+}
+
+void ActivationArena::DrainParked() {
+  if (parked_.load(std::memory_order_acquire) & kPtrMask) {
+    while (Block* block = Pop(&parked_, true)) {
+      block->state.fetch_and(~static_cast<uint32_t>(kInParked), std::memory_order_acq_rel);
+      // a parked block whose life was set again in the meantime stays with its new user
+      if (TransitionState(&block->state, kParked, kFree)) Release(block);
+    }
+  }
+}
+
+ActivationArena* ActivationArena::Owner(const void* data) {
+  if (data == nullptr) return nullptr;
+  const uintptr_t addr = reinterpret_cast<uintptr_t>(data);
+  const PageRegistry& registry = PageRegistry::get();
+  if (!registry.Contains(addr >> kPageShift) || !registry.Contains((addr - ALIGNMENT) >> kPageShift)) {
+    return nullptr;
+  }
+  const Block* block = Header(data);
+  if (block->magic != kBlockMagic || block->data != data) return nullptr;
+  return block->owner;
+}
+
+int64_t ActivationArena::Life(const void* data) { return Header(data)->life.load(std::memory_order_acquire); }
+
+void ActivationArena::SetLife(void* data, int64_t life_count) {
+  Block* block = Header(data);
+  if (life_count > 0) {
+    TransitionState(&block->state, kParked, kLive);
+    if ((block->state.load(std::memory_order_acquire) & kStateMask) == kFree) {
+      DLOG(WARNING) << "reset the life of a freed memory...";
+    }
+    block->life.store(life_count, std::memory_order_release);
+  } else {
+    block->life.store(0, std::memory_order_release);
+    block->owner->Park(block);
+  }
+}
+
+int64_t ActivationArena::Unref(void* data) {
+  Block* block = Header(data);
+  int64_t life = block->life.load(std::memory_order_acquire);
+  do {
+    if (life <= 0) {
+      DLOG(WARNING) << "free a no-used memory...";
+      return 0;
+    }
+  } while (!block->life.compare_exchange_weak(life, life - 1, std::memory_order_acq_rel));
+  // like the cycle buffer, a dead block keeps its content until the next allocation
+  if (life == 1) block->owner->Park(block);
+  return life - 1;
+}
+
+bool ActivationArena::Reset() {
+  DrainParked();
+  if (live_blocks_.load(std::memory_order_acquire) != 0) return false;
+  std::lock_guard<std::mutex> lock(chunk_mutex_);
+  for (auto& head : free_lists_) head.store(0, std::memory_order_relaxed);
+  spare_chunks_.clear();
+  Chunk* current = current_.load(std::memory_order_relaxed);
+  for (Chunk* chunk : chunks_) {
+    if (chunk->dedicated) {
+      // a large block is reused as a whole through its free list
+      Push(&free_lists_[reinterpret_cast<Block*>(chunk->base)->size_class], reinterpret_cast<Block*>(chunk->base),
+           false);
+      continue;
+    }
+    chunk->used.store(0, std::memory_order_relaxed);
+    if (chunk != current) spare_chunks_.push_back(chunk);
+  }
+  return true;
+}
+
+ArenaStats ActivationArena::Stats() const {
+  ArenaStats stats;
+  stats.alloc_count = alloc_count_.load(std::memory_order_relaxed);
+  stats.free_count = free_count_.load(std::memory_order_relaxed);
+  stats.live_bytes = live_bytes_.load(std::memory_order_relaxed);
+  stats.peak_bytes = peak_bytes_.load(std::memory_order_relaxed);
+  stats.reserved_bytes = reserved_bytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+ActivationArena* ActivationArena::Current() {
+  if (t_current_arena != nullptr) return t_current_arena;
+  static ActivationArena* process_arena = new ActivationArena();
+  return process_arena;
+}
+
+ActivationArena::Scope::Scope(ActivationArena* arena) : prev_(t_current_arena) { t_current_arena = arena; }
+
+ActivationArena::Scope::~Scope() { t_current_arena = prev_; }
+
+}  // namespace executor
@@ -71,8 +71,9 @@ YAML::Node ActivationTensor::DumpConfig() {
 // ActivationOperator class construction
 ActivationOperator::ActivationOperator(const string& name, const int64_t& order,
                                        const vector<shared_ptr<ActivationTensor>>& input,
-                                       const vector<shared_ptr<ActivationTensor>>& output)
-    : name_(name), topological_order_(order), input_(input), output_(output) {}
+                                       const vector<shared_ptr<ActivationTensor>>& output,
+                                       const shared_ptr<ActivationTensor>& workspace)
+    : name_(name), topological_order_(order), input_(input), output_(output), workspace_(workspace) {}
 
 ActivationOperator::ActivationOperator(const string& name, const YAML::Node& node)
     : name_(name), topological_order_(-1), input_({}), output_({}) {
@@ -83,6 +84,7 @@ ActivationOperator::ActivationOperator(const string& name, const YAML::Node& nod
 void ActivationOperator::LoadConfig(const YAML::Node& node) {
   input_.clear();
   output_.clear();
+  workspace_ = nullptr;
   for (YAML::const_iterator it = node.begin(); it != node.end(); ++it) {
     YAML::Node key = it->first;
     YAML::Node value = it->second;
@@ -99,6 +101,10 @@ void ActivationOperator::LoadConfig(const YAML::Node& node) {
         output_.push_back(std::make_shared<ActivationTensor>(vit->first.as<string>(), vit->second));
       }
     }
+    if (key.as<std::string>() == "workspace") {
+      YAML::const_iterator vit = value.begin();
+      if (vit != value.end()) workspace_ = std::make_shared<ActivationTensor>(vit->first.as<string>(), vit->second);
+    }
   }
 }
 
@@ -121,6 +127,11 @@ YAML::Node ActivationOperator::DumpConfig() {
     }
     operator_node["output"] = output_node;
   }
+  if (workspace_ != nullptr) {
+    YAML::Node workspace_node;
+    workspace_node[workspace_->name()] = workspace_->DumpConfig();
+    operator_node["workspace"] = workspace_node;
+  }
   return operator_node;
 }
 
@@ -85,7 +85,8 @@ void ActivationDAGHandler::UpdateTensor(shared_ptr<ActivationTensor> dag_tensor,
 
 shared_ptr<ActivationOperator> ActivationDAGHandler::BuildOperator(const string& name, const int64_t order,
                                                                    const vector<Tensor*> input,
-                                                                   const vector<Tensor*> output) {
+                                                                   const vector<Tensor*> output,
+                                                                   const size_t workspace_bytes) {
   DLOG(INFO) << "Building activation operator " << name << " in DAG...";
   vector<shared_ptr<ActivationTensor>> t_in;
   vector<shared_ptr<ActivationTensor>> t_out;
@@ -98,12 +99,24 @@ shared_ptr<ActivationOperator> ActivationDAGHandler::BuildOperator(const string&
   for (const auto t : output) {
     t_out.push_back(BuildTensor(t));
   }
-  return std::make_shared<ActivationOperator>(name, order, t_in, t_out);
+  return std::make_shared<ActivationOperator>(name, order, t_in, t_out, BuildWorkspace(name, workspace_bytes));
+}
+
+shared_ptr<ActivationTensor> ActivationDAGHandler::BuildWorkspace(const string& op_name, const size_t bytes) {
+  if (bytes == 0) return nullptr;
+  return std::make_shared<ActivationTensor>(op_name + ":workspace", bytes, "u8",
+                                            vector<int64_t>({static_cast<int64_t>(bytes)}));
 }
 
 void ActivationDAGHandler::UpdateOperator(shared_ptr<ActivationOperator> op, const vector<Tensor*> input,
-                                          const vector<Tensor*> output) {
+                                          const vector<Tensor*> output, const size_t workspace_bytes) {
   DLOG(INFO) << "Updating activation operator " << op->name() << " in DAG...";
+  // the workspace keeps the largest size over all input shapes
+  if (op->workspace() == nullptr) {
+    op->set_workspace(BuildWorkspace(op->name(), workspace_bytes));
+  } else {
+    op->workspace()->Update(workspace_bytes, {static_cast<int64_t>(workspace_bytes)});
+  }
   if (!op->input().empty() && !input.empty()) {
     int j = 0;
     for (int i = 0; i < input.size(); ++i) {
@@ -131,7 +144,8 @@ void ActivationDAGHandler::BuildDAG(const vector<shared_ptr<Dispatcher>>& ops,
   int64_t topological_order = 0;
   for (int i = 0; i < ops.size(); ++i) {
     if (ops[i]->type() == "Input") continue;
-    operators.push_back(BuildOperator(ops[i]->name(), topological_order++, input_vecs[i], output_vecs[i]));
+    operators.push_back(BuildOperator(ops[i]->name(), topological_order++, input_vecs[i], output_vecs[i],
+                                      ops[i]->workspace_bytes()));
   }
   if (inplace_alias_info_.empty()) {
     dag_ = ActivationDAG(operators);
@@ -150,7 +164,7 @@ void ActivationDAGHandler::UpdateDAG(const vector<shared_ptr<Dispatcher>>& ops,
   int64_t topological_order = 0;
   for (int i = 0; i < ops.size(); ++i) {
     if (ops[i]->type() == "Input") continue;
-    UpdateOperator(dag_.operators()[topological_order++], input_vecs[i], output_vecs[i]);
+    UpdateOperator(dag_.operators()[topological_order++], input_vecs[i], output_vecs[i], ops[i]->workspace_bytes());
   }
 }
 
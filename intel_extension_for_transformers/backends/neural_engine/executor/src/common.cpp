@@ -13,13 +13,16 @@
 //  limitations under the License.
 #include "common.hpp"
 
+#include <atomic>
+
 #include "cmath"
 
 namespace executor {
 
 unordered_map<string, int> type2bytes = {
     {"fp32", sizeof(float)}, {"int8", sizeof(char)}, {"int32", sizeof(int)},     {"u8", sizeof(unsigned char)},
-    {"s8", sizeof(char)},    {"s32", sizeof(int)},   {"bf16", sizeof(uint16_t)}, {"int64", sizeof(int64_t)}};
+    {"s8", sizeof(char)},    {"s32", sizeof(int)},   {"bf16", sizeof(uint16_t)}, {"int64", sizeof(int64_t)},
+    {"fp16", sizeof(uint16_t)}};
 unordered_map<string, vector<string>> dispatch_kernel_config = {
     {"InnerProduct_to_Convolution", {"input_shape"}},
     {"InnerProduct_to_SparseLib", {"input_shape", "micro_oc", "sub_func"}},
@@ -100,6 +103,42 @@ float Duration(int64_t start, int64_t end) {
   return duration;
 }
 
+static Isa HostIsa() {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512dq"))
+    return Isa::kAvx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Isa::kAvx2;
+  return Isa::kScalar;
+#elif __AVX512F__
+  return Isa::kAvx512;
+#elif __AVX2__
+  return Isa::kAvx2;
+#else
+  return Isa::kScalar;
+#endif
+}
+
+static std::atomic<int>& MaxIsa() {
+  static std::atomic<int> max_isa([] {
+    const char* env = getenv("NE_MAX_ISA");
+    string isa = env == nullptr ? "avx512" : env;
+    if (isa == "scalar") return static_cast<int>(Isa::kScalar);
+    if (isa == "avx2") return static_cast<int>(Isa::kAvx2);
+    LOG_IF(WARNING, isa != "avx512") << "Unknown NE_MAX_ISA " << isa << ", use avx512 instead.";
+    return static_cast<int>(Isa::kAvx512);
+  }());
+  return max_isa;
+}
+
+Isa RuntimeIsa() {
+  static const Isa host_isa = HostIsa();
+  return static_cast<Isa>(std::min(static_cast<int>(host_isa), MaxIsa().load()));
+}
+
+void SetMaxIsa(Isa isa) { MaxIsa().store(static_cast<int>(isa)); }
+
 int64_t Product(const vector<int64_t>& shape) {
   return std::accumulate(shape.begin(), shape.end(), (int64_t)1, std::multiplies<int64_t>());
 }
@@ -1354,4 +1393,48 @@ ConvolutionPrimitiveFwdFactory& ConvolutionPrimitiveFwdFactory::GetInstance() {
   return instance_;
 }
 
+/************ PrepackedWeightCache member function ************/
+void* PrepackedWeightCache::Get(const void* owner, const string& name, const dnnl::memory::desc& desc) {
+  std::lock_guard<std::mutex> lock(Mutex());
+  auto iter = Cache().find({owner, name});
+  if (iter == Cache().end()) return nullptr;
+  for (const auto& packed : iter->second) {
+    if (packed.first == desc) return packed.second;
+  }
+  return nullptr;
+}
+
+void* PrepackedWeightCache::Set(const void* owner, const string& name, const dnnl::memory::desc& desc,
+                                void* packed) {
+  std::lock_guard<std::mutex> lock(Mutex());
+  auto& copies = Cache()[{owner, name}];
+  for (const auto& copy : copies) {
+    if (copy.first == desc) return copy.second;
+  }
+  copies.push_back({desc, packed});
+  return packed;
+}
+
+vector<void*> PrepackedWeightCache::Evict(const void* owner) {
+  std::lock_guard<std::mutex> lock(Mutex());
+  vector<void*> evicted;
+  // the keys of one owner are adjacent
+  auto iter = Cache().lower_bound({owner, string()});
+  while (iter != Cache().end() && iter->first.first == owner) {
+    for (const auto& copy : iter->second) evicted.push_back(copy.second);
+    iter = Cache().erase(iter);
+  }
+  return evicted;
+}
+
+PrepackedWeightCache::CacheMap& PrepackedWeightCache::Cache() {
+  static CacheMap cache_;
+  return cache_;
+}
+
+std::mutex& PrepackedWeightCache::Mutex() {
+  static std::mutex mutex_;
+  return mutex_;
+}
+
 }  // namespace executor
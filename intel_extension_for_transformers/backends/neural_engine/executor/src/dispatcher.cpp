@@ -12,12 +12,122 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include <algorithm>
+#include <cstring>
+
 #include "dispatcher.hpp"
 #include "op_tuning.hpp"
 #include "model.hpp"
+#include "online_tuner.hpp"
 
 namespace executor {
 
+// copies of the weights of one operator, made once and shared read-only by all of its online tuning jobs: the
+// serving kernels may free or replace their weights before a job runs, and a copy per job would hold every weight
+// once per queued shape.
+class WeightSnapshot {
+ public:
+  explicit WeightSnapshot(const vector<Tensor*>& tensors) {
+    for (const auto& tensor : tensors) {
+      size_t bytes = tensor->alloc_bytes();
+      if (tensor->location().empty() || bytes == 0 || tensor->raw_data() == nullptr) continue;
+      void* buf = aligned_alloc(ALIGNMENT, (bytes / ALIGNMENT + 1) * ALIGNMENT);
+      memcpy(buf, tensor->raw_data(), bytes);
+      weights_.push_back({tensor->name(), tensor->raw_data(), bytes, buf});
+    }
+  }
+  ~WeightSnapshot() {
+    for (const auto& weight : weights_) aligned_free(weight.copy);
+  }
+  WeightSnapshot(const WeightSnapshot&) = delete;
+  WeightSnapshot& operator=(const WeightSnapshot&) = delete;
+
+  // true if every weight of `tensors` is copied here from its current data
+  bool Covers(const vector<Tensor*>& tensors) const {
+    for (const auto& tensor : tensors) {
+      size_t bytes = tensor->alloc_bytes();
+      if (tensor->location().empty() || bytes == 0) continue;
+      auto iter = std::find_if(weights_.begin(), weights_.end(), [&](const Weight& weight) {
+        return weight.name == tensor->name() && weight.source == tensor->raw_data() && weight.bytes == bytes;
+      });
+      if (iter == weights_.end()) return false;
+    }
+    return true;
+  }
+  // nullptr if the weight had no data when the snapshot was made
+  void* Find(const string& name, size_t bytes) const {
+    for (const auto& weight : weights_) {
+      if (weight.name == name && weight.bytes == bytes) return weight.copy;
+    }
+    return nullptr;
+  }
+
+ private:
+  struct Weight {
+    string name;
+    const void* source;
+    size_t bytes;
+    void* copy;
+  };
+  vector<Weight> weights_;
+};
+
+namespace {
+
+// each kernel runs this many times in the background and is ranked by its best run
+constexpr int kOnlineTuningRounds = 3;
+
+// the tensors of one operator as the online tuner sees them. weights point into a WeightSnapshot, activations get a
+// zeroed buffer of the same size: the serving ones are not computed yet when the kernels are picked, and the kernels
+// this tunes do not take longer on other values.
+class ShadowTensors {
+ public:
+  ShadowTensors(const vector<Tensor*>& tensors, const shared_ptr<WeightSnapshot>& weights) : weights_(weights) {
+    for (const auto& tensor : tensors) {
+      Tensor* shadow = new Tensor(nullptr, tensor->shape(), tensor->dtype(), tensor->strides(), tensor->location(),
+                                  tensor->name());
+      shadow->set_transpose(tensor->is_transposed());
+      shadow->set_tensor_format(tensor->tensor_format());
+      // one more than the serving tensor, kernels free the weights they are the last user of
+      shadow->add_tensor_life(tensor->life() + 1);
+      tensors_.push_back(shadow);
+    }
+  }
+  ~ShadowTensors() {
+    for (const auto& buf : buffers_) aligned_free(buf);
+    for (const auto& tensor : tensors_) delete tensor;
+  }
+  ShadowTensors(const ShadowTensors&) = delete;
+  ShadowTensors& operator=(const ShadowTensors&) = delete;
+
+  // points the weights to the snapshot and allocates the activations, returns false if a weight had no data
+  bool Materialize() {
+    for (const auto& tensor : tensors_) {
+      size_t bytes = tensor->alloc_bytes();
+      if (bytes == 0) continue;
+      if (!tensor->location().empty()) {
+        void* data = weights_->Find(tensor->name(), bytes);
+        if (data == nullptr) return false;
+        tensor->set_data(data);
+        continue;
+      }
+      void* buf = aligned_alloc(ALIGNMENT, (bytes / ALIGNMENT + 1) * ALIGNMENT);
+      buffers_.push_back(buf);
+      memset(buf, 0, bytes);
+      tensor->set_data(buf);
+    }
+    return true;
+  }
+  inline const vector<Tensor*>& tensors() const { return tensors_; }
+
+ private:
+  shared_ptr<WeightSnapshot> weights_;
+  vector<Tensor*> tensors_;
+  vector<void*> buffers_;
+};
+
+}  // namespace
+
 Dispatcher::Dispatcher(const shared_ptr<OperatorConfig>& conf, const ExecutionOptions* e_ptr, const Model* m_ptr)
     : operator_conf_(conf),
       execution_options_ptr_(e_ptr),
@@ -39,7 +149,9 @@ Dispatcher::Dispatcher(const shared_ptr<OperatorConfig>& conf, const ExecutionOp
   }
   execute_kernel_ = type_;
   do_tuning_ = (execution_options_ptr_->execution_mode == ExecutionMode::TUNING);
-  adapt_action_ = (model_->has_dispatch_table_file() && execution_options_ptr_->execution_mode != ExecutionMode::DEBUG)
+  online_tuning_ = model_->online_tuning();
+  adapt_action_ = ((model_->has_dispatch_table_file() || online_tuning_) &&
+                   execution_options_ptr_->execution_mode != ExecutionMode::DEBUG)
                       ? true
                       : false;
 }
@@ -54,7 +166,9 @@ Dispatcher::Dispatcher(const shared_ptr<Operator>& op, const ExecutionOptions* e
   kernel_handler_[name_] = op;
   execute_kernel_ = type_;
   do_tuning_ = (execution_options_ptr_->execution_mode == ExecutionMode::TUNING);
-  adapt_action_ = (model_->has_dispatch_table_file() && execution_options_ptr_->execution_mode != ExecutionMode::DEBUG)
+  online_tuning_ = model_->online_tuning();
+  adapt_action_ = ((model_->has_dispatch_table_file() || online_tuning_) &&
+                   execution_options_ptr_->execution_mode != ExecutionMode::DEBUG)
                       ? true
                       : false;
 }
@@ -68,7 +182,7 @@ void Dispatcher::Prepare(const vector<Tensor*>& input, const vector<Tensor*>& ou
   // let default kernel prepare first
   kernel_handler_[type_]->Prepare(input, output);
   if (execution_options_ptr_->execution_mode == ExecutionMode::INFERENCE && model_ != nullptr &&
-      !model_->has_dispatch_table_file()) return;
+      !model_->has_dispatch_table_file() && !model_->online_tuning()) return;
   for (const auto& k_pair : kernel_handler_) {
     auto kernel_name = k_pair.first;
     auto kernel = k_pair.second;
@@ -143,8 +257,8 @@ void Dispatcher::GetExecuteKernel(const vector<Tensor*>& input, const vector<Ten
     vector<string> kernel_config;
     if (has_dispatch_table_file && execution_options_ptr_->execution_mode != ExecutionMode::DEBUG) {
       dispatch_table_file_exists_ = true;
-      // dispatch table only load once
-      if (DispatchTable::Size() == 0) {
+      // dispatch table only load once, online tuning may start without a file
+      if (DispatchTable::Size() == 0 && model_->has_dispatch_table_file()) {
         DLOG(INFO) << "Loading diapatch table file...";
         DispatchTable::Load(execution_options_ptr_->dispatch_table_file_root);
       }
@@ -160,7 +274,8 @@ void Dispatcher::GetExecuteKernel(const vector<Tensor*>& input, const vector<Ten
         AdaptAttrs(input, output, "out");
       }
       if (!no_tuning_space_) {
-        kernel_config = DispatchTable::Find(type_, GetHash(input));
+        size_t input_hash = GetHash(input);
+        kernel_config = DispatchTable::Find(type_, input_hash);
         if (!kernel_config.empty()) {
           string kernel_name = kernel_config[0];
           // sparselib
@@ -179,6 +294,7 @@ void Dispatcher::GetExecuteKernel(const vector<Tensor*>& input, const vector<Ten
         } else {
           // reset kernel_config to empty if next shape not in table under dynamic shapes
           kernel_handler_[type_]->set_dispatch_config({});
+          if (online_tuning_) SubmitOnlineTuning(input, output, input_hash);
         }
       }
     } else {
@@ -197,51 +313,10 @@ void Dispatcher::GetExecuteKernel(const vector<Tensor*>& input, const vector<Ten
     DLOG(INFO) << "tuning warm up iterations is " << (execution_options_ptr_->warmup_iter);
     if (!no_tuning_space_ && (iter_cnt_<= (execution_options_ptr_->warmup_iter + 1) ||
         DispatchTable::Find(type_, input_hash).empty())) {
-      // keep kernel with the least time as first pair
-      std::map<float, vector<string>, std::less<float>> timer;
-      OpTuning op_tuning(type_, model_);
-      // increase input tensors' life when tune
-      // default kernel does not count towards the extra life
-      int idx = 0;
-      string suffix;
-      for (const auto& k_pair : kernel_handler_) {
-        auto kernel_name = k_pair.first;
-        auto kernel = k_pair.second;
-        suffix = sparselib_available_[idx++] ? "SparseLib" : kernel_name;
-        if (tune_dense_in_sparse_ && suffix == "SparseLib") {
-          kernel->set_kernel_type(Dense);
-          op_tuning.Start(kernel_name, kernel, input, output, reshape_model);
-          kernel->set_kernel_type(SparseLib);
-        }
-        op_tuning.Start(suffix, kernel, input, output, reshape_model);
-        if (monopoly_kernel_ == kernel_name) break;
-      }
-      for (auto& tensor : input) tensor->disposable_extra_life(op_tuning.extra_tensor_life());
-      op_tuning.reset_extra_tensor_life();
-      // tune kernel
-      idx = 0;
-      for (const auto& k_pair : kernel_handler_) {
-        auto kernel_name = k_pair.first;
-        auto kernel = k_pair.second;
-        suffix = sparselib_available_[idx++] == true ? "SparseLib" : kernel_name;
-        try {
-          if (tune_dense_in_sparse_ && suffix == "SparseLib") {
-            kernel->set_kernel_type(Dense);
-            op_tuning.Run(kernel_name, kernel, input, output, reshape_model);
-            kernel->set_kernel_type(SparseLib);
-          }
-          op_tuning.Run(suffix, kernel, input, output, reshape_model);
-          timer[op_tuning.best_execute_time()] = op_tuning.kernel_config();
-        // some kernels don't support specific dtype, fusion, etc.
-        } catch (const std::exception& e) {
-          LOG(WARNING) << kernel_name << " kernel tuning failure: " << e.what();
-        }
-        if (monopoly_kernel_ == kernel_name) break;
-      }
-      if (timer.size() > 0) {
-        execute_kernel_ = timer.begin()->second[0];
-        DLOG(INFO) << "best kernel is " << execute_kernel_ << " with time " << timer.begin()->first << "ms";
-        if (execute_kernel_ != type_) DispatchTable::Insert(type_, input_hash, timer.begin()->second);
+      vector<string> kernel_config = TuneKernel(input, output, reshape_model);
+      if (!kernel_config.empty()) {
+        execute_kernel_ = kernel_config[0];
+        if (execute_kernel_ != type_) DispatchTable::Insert(type_, input_hash, kernel_config);
       }
     } else {
       DLOG(INFO) << "Skip tuning function due to existing input hash or no tuning space...";
@@ -255,6 +330,98 @@ void Dispatcher::GetExecuteKernel(const vector<Tensor*>& input, const vector<Ten
   }
 }
 
+vector<string> Dispatcher::TuneKernel(const vector<Tensor*>& input, const vector<Tensor*>& output,
+                                      const bool& reshape_model, const int& rounds) {
+  // keep kernel with the least time as first pair
+  std::map<float, vector<string>, std::less<float>> timer;
+  OpTuning op_tuning(type_, model_);
+  // increase input tensors' life when tune
+  // default kernel does not count towards the extra life
+  int idx = 0;
+  string suffix;
+  for (const auto& k_pair : kernel_handler_) {
+    auto kernel_name = k_pair.first;
+    auto kernel = k_pair.second;
+    suffix = sparselib_available_[idx++] ? "SparseLib" : kernel_name;
+    if (tune_dense_in_sparse_ && suffix == "SparseLib") {
+      kernel->set_kernel_type(Dense);
+      op_tuning.Start(kernel_name, kernel, input, output, reshape_model);
+      kernel->set_kernel_type(SparseLib);
+    }
+    op_tuning.Start(suffix, kernel, input, output, reshape_model);
+    if (monopoly_kernel_ == kernel_name) break;
+  }
+  int extra_tensor_life = (op_tuning.extra_tensor_life() + 1) * rounds - 1;
+  for (auto& tensor : input) tensor->disposable_extra_life(extra_tensor_life);
+  op_tuning.reset_extra_tensor_life();
+  // tune kernel
+  idx = 0;
+  for (const auto& k_pair : kernel_handler_) {
+    auto kernel_name = k_pair.first;
+    auto kernel = k_pair.second;
+    suffix = sparselib_available_[idx++] == true ? "SparseLib" : kernel_name;
+    try {
+      for (int i = 0; i < rounds; ++i) {
+        if (tune_dense_in_sparse_ && suffix == "SparseLib") {
+          kernel->set_kernel_type(Dense);
+          op_tuning.Run(kernel_name, kernel, input, output, reshape_model);
+          kernel->set_kernel_type(SparseLib);
+        }
+        op_tuning.Run(suffix, kernel, input, output, reshape_model);
+        timer[op_tuning.best_execute_time()] = op_tuning.kernel_config();
+      }
+    // some kernels don't support specific dtype, fusion, etc.
+    } catch (const std::exception& e) {
+      LOG(WARNING) << kernel_name << " kernel tuning failure: " << e.what();
+    }
+    if (monopoly_kernel_ == kernel_name) break;
+  }
+  if (timer.empty() || timer.begin()->second.empty()) return {};
+  DLOG(INFO) << "best kernel is " << timer.begin()->second[0] << " with time " << timer.begin()->first << "ms";
+  return timer.begin()->second;
+}
+
+void Dispatcher::SubmitOnlineTuning(const vector<Tensor*>& input, const vector<Tensor*>& output,
+                                    const size_t& input_hash) {
+  if (type_ == "Input" || type_ == "Output") return;
+  auto conf = operator_conf_;
+  auto type = type_;
+  auto execution_options_ptr = execution_options_ptr_;
+  auto model = model_;
+  // only runs once the tuner took the key, shapes tuned before or dropped for a full queue copy nothing
+  auto make_tune = [&]() -> OnlineTuner::TuneFunc {
+    shared_ptr<WeightSnapshot> weights = weight_snapshot_.lock();
+    if (weights == nullptr || !weights->Covers(input)) {
+      weights = std::make_shared<WeightSnapshot>(input);
+      weight_snapshot_ = weights;
+    }
+    // the tensors are described here, the activations are made on the tuning thread
+    auto shadow_input = std::make_shared<ShadowTensors>(input, weights);
+    auto shadow_output = std::make_shared<ShadowTensors>(output, weights);
+    return [=]() -> vector<string> {
+      if (!shadow_input->Materialize()) return {};
+      // outputs and workspaces of the shadow kernels come from an arena of their own
+      ActivationArena arena;
+      ActivationArena::Scope arena_scope(&arena);
+      // kernels keep per-shape state, the serving ones must not be touched from here
+      Dispatcher shadow(conf, execution_options_ptr, model);
+      shadow.Prepare(shadow_input->tensors(), shadow_output->tensors());
+      vector<string> kernel_config =
+          shadow.TuneKernel(shadow_input->tensors(), shadow_output->tensors(), true, kOnlineTuningRounds);
+      if (!kernel_config.empty() && kernel_config[0] == type) kernel_config.clear();
+      return kernel_config;
+    };
+  };
+  string table_root = execution_options_ptr_->dispatch_table_file_root;
+  auto promote = [type, input_hash, table_root](const vector<string>& kernel_config) {
+    DispatchTable::Insert(type, input_hash, kernel_config);
+    DispatchTable::Save(table_root);
+  };
+  if (OnlineTuner::Global().Submit(model_, type_, input_hash, OnlineTuner::MakeTuneFunc(make_tune), promote)) {
+    DLOG(INFO) << "Operator " << name_ << " submitted input hash " << input_hash << " to online tuning...";
+  }
+}
+
 // get input_hash
 size_t Dispatcher::GetHash(const vector<Tensor*>& input) {
   vector<size_t> combine_hash{static_cast<size_t>(cpu_isa_)};
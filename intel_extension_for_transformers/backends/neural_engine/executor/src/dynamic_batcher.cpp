@@ -0,0 +1,329 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "dynamic_batcher.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>  // NOLINT
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace executor {
+
+namespace {
+
+int64_t Product(vector<int64_t>::const_iterator begin, vector<int64_t>::const_iterator end) {
+  return std::accumulate(begin, end, int64_t(1), std::multiplies<int64_t>());
+}
+
+std::string ShapeString(const vector<int64_t>& shape) {
+  std::string str;
+  for (auto dim : shape) str += (str.empty() ? "" : ",") + std::to_string(dim);
+  return "[" + str + "]";
+}
+
+bool Contains(const vector<int>& indices, size_t index) {
+  return std::find(indices.begin(), indices.end(), static_cast<int>(index)) != indices.end();
+}
+
+}  // namespace
+
+struct DynamicBatcher::State {
+  typedef std::chrono::steady_clock Clock;
+  struct Request {
+    vector<Tensor> input;
+    DoneFunc done;
+    int64_t rows;
+    int64_t seq_len;
+    Clock::time_point arrival;
+  };
+
+  // the bucket to run now, -1 and the time to wake up at if none is due
+  int64_t DueBucket(Clock::time_point now, Clock::time_point* wake_up);
+  void Run(int64_t bucket, vector<Request>* group);
+  vector<Tensor> Pad(int64_t bucket, const vector<Request>& group);
+  // the outputs of each request of the group
+  vector<vector<Tensor>> Scatter(int64_t bucket, const vector<Request>& group, const vector<Tensor>& outputs);
+
+  ForwardFunc forward;
+  DynamicBatcherOptions options;
+  std::mutex mutex;
+  std::condition_variable cond;
+  // queued requests by bucket
+  std::map<int64_t, std::deque<Request>> pending;
+  size_t num_pending = 0;
+  bool running = false;
+  bool stop = false;
+  std::atomic<int64_t> runs{0};
+  std::atomic<int64_t> batched_requests{0};
+  // batch inputs and scattered outputs, reused across runs by the batching thread
+  vector<std::vector<char>> input_buffers;
+  vector<vector<std::vector<char>>> output_buffers;
+};
+
+DynamicBatcher::DynamicBatcher(ForwardFunc forward, const DynamicBatcherOptions& options)
+    : state_(std::make_shared<State>()) {
+  CHECK_GT(options.max_batch, 0) << "max batch of the dynamic batcher should be positive...";
+  state_->forward = std::move(forward);
+  state_->options = options;
+  std::sort(state_->options.buckets.begin(), state_->options.buckets.end());
+}
+
+DynamicBatcher::~DynamicBatcher() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stop = true;
+  }
+  state_->cond.notify_all();
+  if (!worker_.joinable()) return;
+  if (worker_.get_id() == std::this_thread::get_id()) {
+    worker_.detach();
+  } else {
+    worker_.join();
+  }
+}
+
+int64_t DynamicBatcher::Bucket(int64_t seq_len) const {
+  const vector<int64_t>& buckets = state_->options.buckets;
+  auto iter = std::lower_bound(buckets.begin(), buckets.end(), seq_len);
+  return iter == buckets.end() ? seq_len : *iter;
+}
+
+const DynamicBatcherOptions& DynamicBatcher::options() const { return state_->options; }
+
+int64_t DynamicBatcher::runs() const { return state_->runs.load(); }
+
+int64_t DynamicBatcher::batched_requests() const { return state_->batched_requests.load(); }
+
+void DynamicBatcher::Submit(vector<Tensor> input, DoneFunc done) {
+  CHECK(!input.empty() && !input[0].shape().empty()) << "dynamic batching needs inputs with a batch dimension...";
+  int64_t rows = input[0].shape()[0];
+  // checked against the other sequence inputs when the group is padded
+  int64_t seq_len = 1;
+  const vector<int>& sequence_inputs = state_->options.sequence_inputs;
+  if (!sequence_inputs.empty()) {
+    CHECK(sequence_inputs[0] >= 0 && static_cast<size_t>(sequence_inputs[0]) < input.size() &&
+          input[sequence_inputs[0]].shape().size() >= 2)
+        << "sequence input " << sequence_inputs[0] << " of the dynamic batcher has no dimension 1...";
+    seq_len = input[sequence_inputs[0]].shape()[1];
+  }
+  int64_t bucket = Bucket(seq_len);
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    CHECK(!state_->stop) << "dynamic batcher is shutting down...";
+    state_->pending[bucket].push_back({std::move(input), std::move(done), rows, seq_len, State::Clock::now()});
+    state_->num_pending++;
+    // started by the first request, as the thread of ForwardQueue
+    if (!worker_.joinable()) worker_ = std::thread(&DynamicBatcher::Work, state_);
+  }
+  state_->cond.notify_all();
+}
+
+void DynamicBatcher::Drain() {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->cond.wait(lock, [&] { return state_->num_pending == 0 && !state_->running; });
+}
+
+int64_t DynamicBatcher::State::DueBucket(Clock::time_point now, Clock::time_point* wake_up) {
+  int64_t due = -1;
+  Clock::time_point oldest = Clock::time_point::max();
+  *wake_up = Clock::time_point::max();
+  for (const auto& bucket : pending) {
+    if (bucket.second.empty()) continue;
+    Clock::time_point arrival = bucket.second.front().arrival;
+    Clock::time_point deadline = arrival + std::chrono::microseconds(options.max_wait_us);
+    int64_t rows = 0;
+    for (const auto& request : bucket.second) rows += request.rows;
+    // the bucket which waited longest goes first among the due ones
+    if ((stop || rows >= options.max_batch || deadline <= now) && arrival < oldest) {
+      due = bucket.first;
+      oldest = arrival;
+    }
+    *wake_up = std::min(*wake_up, deadline);
+  }
+  return due;
+}
+
+void DynamicBatcher::Work(std::shared_ptr<State> state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (true) {
+    if (state->num_pending == 0) {
+      // queued requests still run, their callers wait on them
+      if (state->stop) return;
+      state->cond.wait(lock);
+      continue;
+    }
+    State::Clock::time_point wake_up;
+    int64_t bucket = state->DueBucket(State::Clock::now(), &wake_up);
+    if (bucket < 0) {
+      state->cond.wait_until(lock, wake_up);
+      continue;
+    }
+    std::deque<State::Request>& queue = state->pending[bucket];
+    vector<State::Request> group;
+    int64_t rows = 0;
+    while (!queue.empty() && (group.empty() || rows + queue.front().rows <= state->options.max_batch)) {
+      rows += queue.front().rows;
+      group.push_back(std::move(queue.front()));
+      queue.pop_front();
+    }
+    state->num_pending -= group.size();
+    state->running = true;
+    lock.unlock();
+    state->Run(bucket, &group);
+    // the callbacks may hold the last reference to the owner of the batcher
+    group.clear();
+    lock.lock();
+    state->running = false;
+    state->cond.notify_all();
+  }
+}
+
+void DynamicBatcher::State::Run(int64_t bucket, vector<Request>* group) {
+  vector<vector<Tensor>> outputs;
+  std::string error;
+  try {
+    vector<Tensor> input = Pad(bucket, *group);
+    outputs = Scatter(bucket, *group, forward(input));
+    runs++;
+    batched_requests += group->size();
+  } catch (const std::exception& e) {
+    error = e.what();
+    LOG(WARNING) << "Dynamic batch of " << group->size() << " requests failed: " << error;
+  }
+  for (size_t i = 0; i < group->size(); ++i) {
+    (*group)[i].done(error.empty() ? &outputs[i] : nullptr, error);
+  }
+}
+
+vector<Tensor> DynamicBatcher::State::Pad(int64_t bucket, const vector<Request>& group) {
+  const size_t num_inputs = group[0].input.size();
+  int64_t rows = 0;
+  for (const auto& request : group) {
+    if (request.input.size() != num_inputs) throw std::invalid_argument("requests have different numbers of inputs");
+    rows += request.rows;
+  }
+  input_buffers.resize(num_inputs);
+  vector<Tensor> batch;
+  for (size_t k = 0; k < num_inputs; ++k) {
+    const Tensor& first = group[0].input[k];
+    const std::string& dtype = first.dtype();
+    const size_t elem_bytes = type2bytes[dtype];
+    vector<int64_t> shape = first.shape();
+    if (shape.empty()) throw std::invalid_argument("input " + std::to_string(k) + " has no batch dimension");
+    const bool is_seq = Contains(options.sequence_inputs, k);
+    if (is_seq && shape.size() < 2) throw std::invalid_argument("sequence input " + std::to_string(k) + " has rank 1");
+    if (is_seq) shape[1] = bucket;
+    shape[0] = rows;
+    // bytes of one sequence position (or of one row for inputs which are not padded)
+    const size_t row_bytes = Product(shape.begin() + 1, shape.end()) * elem_bytes;
+    const size_t inner_bytes = shape.size() >= 2 ? Product(shape.begin() + 2, shape.end()) * elem_bytes : row_bytes;
+    std::vector<char>& buffer = input_buffers[k];
+    buffer.resize(rows * row_bytes);
+    char* dst = buffer.data();
+    for (const auto& request : group) {
+      const Tensor& tensor = request.input[k];
+      vector<int64_t> padded = tensor.shape();
+      if (is_seq && (padded.size() < 2 || padded[1] != request.seq_len)) {
+        throw std::invalid_argument("sequence input " + std::to_string(k) + " of shape " +
+                                    ShapeString(tensor.shape()) + " has not the sequence length " +
+                                    std::to_string(request.seq_len));
+      }
+      if (is_seq) padded[1] = bucket;
+      if (tensor.dtype() != dtype || padded.size() != shape.size() ||
+          !std::equal(padded.begin() + 1, padded.end(), shape.begin() + 1)) {
+        throw std::invalid_argument("input " + std::to_string(k) + " of shape " + ShapeString(tensor.shape()) +
+                                    " can't be batched with " + ShapeString(first.shape()));
+      }
+      const char* src = static_cast<const char*>(tensor.raw_data());
+      if (!is_seq) {
+        memcpy(dst, src, request.rows * row_bytes);
+        dst += request.rows * row_bytes;
+        continue;
+      }
+      const size_t seq_bytes = request.seq_len * inner_bytes;
+      for (int64_t r = 0; r < request.rows; ++r) {
+        memcpy(dst, src + r * seq_bytes, seq_bytes);
+        // a zero mask marks the tail as padding
+        memset(dst + seq_bytes, 0, row_bytes - seq_bytes);
+        dst += row_bytes;
+      }
+    }
+    batch.emplace_back(buffer.data(), shape, dtype);
+  }
+  return batch;
+}
+
+vector<vector<Tensor>> DynamicBatcher::State::Scatter(int64_t bucket, const vector<Request>& group,
+                                                      const vector<Tensor>& outputs) {
+  int64_t rows = 0;
+  for (const auto& request : group) rows += request.rows;
+  if (output_buffers.size() < group.size()) output_buffers.resize(group.size());
+  vector<vector<Tensor>> scattered(group.size());
+  for (size_t k = 0; k < outputs.size(); ++k) {
+    const Tensor& output = outputs[k];
+    const vector<int64_t>& shape = output.shape();
+    const size_t elem_bytes = type2bytes[output.dtype()];
+    // viewed as [rows, positions, inner], the positions of a request are cut to its sequence length
+    bool per_token = Contains(options.token_outputs, k);
+    bool padded = per_token || Contains(options.sequence_outputs, k);
+    if (shape.empty() || shape[0] != (per_token ? rows * bucket : rows) ||
+        (padded && !per_token && (shape.size() < 2 || shape[1] != bucket))) {
+      throw std::invalid_argument("output " + std::to_string(k) + " of shape " + ShapeString(shape) +
+                                  " has no batch dimension of " + std::to_string(rows) + " rows" +
+                                  (padded ? " and " + std::to_string(bucket) + " positions" : ""));
+    }
+    int64_t positions = per_token ? bucket : (shape.size() >= 2 ? shape[1] : 1);
+    const size_t inner_bytes = Product(shape.begin() + (per_token || shape.size() < 2 ? 1 : 2), shape.end()) *
+                               elem_bytes;
+    const char* src = static_cast<const char*>(output.raw_data());
+    for (size_t i = 0; i < group.size(); ++i) {
+      const Request& request = group[i];
+      int64_t keep = padded ? request.seq_len : positions;
+      vector<int64_t> request_shape = shape;
+      if (per_token) {
+        request_shape[0] = request.rows * keep;
+      } else {
+        request_shape[0] = request.rows;
+        if (shape.size() >= 2) request_shape[1] = keep;
+      }
+      if (output_buffers[i].size() < outputs.size()) output_buffers[i].resize(outputs.size());
+      std::vector<char>& buffer = output_buffers[i][k];
+      buffer.resize(request.rows * keep * inner_bytes);
+      char* dst = buffer.data();
+      for (int64_t r = 0; r < request.rows; ++r) {
+        memcpy(dst, src, keep * inner_bytes);
+        dst += keep * inner_bytes;
+        src += positions * inner_bytes;
+      }
+      scattered[i].emplace_back(buffer.data(), request_shape, output.dtype());
+    }
+  }
+  return scattered;
+}
+
+}  // namespace executor
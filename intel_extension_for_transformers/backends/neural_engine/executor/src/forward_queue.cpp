@@ -0,0 +1,95 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "forward_queue.hpp"
+
+#include <exception>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace executor {
+
+ForwardQueue::ForwardQueue(ForwardFunc forward) : state_(std::make_shared<State>()) {
+  state_->forward = std::move(forward);
+}
+
+ForwardQueue::~ForwardQueue() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stop = true;
+  }
+  state_->cond.notify_all();
+  if (!worker_.joinable()) return;
+  if (worker_.get_id() == std::this_thread::get_id()) {
+    // nothing is queued anymore, the queued requests would have kept the owner alive
+    worker_.detach();
+  } else {
+    worker_.join();
+  }
+}
+
+void ForwardQueue::Submit(std::vector<Tensor> input, DoneFunc done) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    CHECK(!state_->stop) << "forward queue is shutting down...";
+    state_->requests.push_back({std::move(input), std::move(done)});
+    // started by the first request, so that synchronous users never get the thread
+    if (!worker_.joinable()) worker_ = std::thread(&ForwardQueue::Work, state_);
+  }
+  state_->cond.notify_all();
+}
+
+void ForwardQueue::Drain() {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->cond.wait(lock, [&] { return state_->requests.empty() && !state_->running; });
+}
+
+size_t ForwardQueue::pending() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->requests.size() + (state_->running ? 1 : 0);
+}
+
+void ForwardQueue::Work(std::shared_ptr<State> state) {
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->cond.wait(lock, [&] { return state->stop || !state->requests.empty(); });
+      // queued requests still run, their callers wait on them
+      if (state->requests.empty()) return;
+      request = std::move(state->requests.front());
+      state->requests.pop_front();
+      state->running = true;
+    }
+    std::vector<Tensor>* outputs = nullptr;
+    std::string error;
+    try {
+      outputs = &state->forward(request.input);
+    } catch (const std::exception& e) {
+      error = e.what();
+      LOG(WARNING) << "Asynchronous forward failed: " << error;
+    }
+    request.done(outputs, error);
+    // the callback may hold the last reference to the owner of the queue
+    request.done = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->running = false;
+    }
+    state->cond.notify_all();
+  }
+}
+
+}  // namespace executor
@@ -0,0 +1,301 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "hw_counters.hpp"
+
+#include <omp.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <sstream>
+
+#include "glog/logging.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace executor {
+
+namespace {
+
+#ifdef __linux__
+int PerfEventOpen(perf_event_attr* attr, pid_t pid, int cpu, int group_fd) {
+  return static_cast<int>(syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, 0));
+}
+
+int OpenEvent(uint32_t type, uint64_t config, pid_t pid, int cpu, int group_fd) {
+  perf_event_attr attr = {};
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = group_fd == -1 ? 1 : 0;
+  attr.exclude_kernel = pid == -1 ? 0 : 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return PerfEventOpen(&attr, pid, cpu, group_fd);
+}
+
+std::vector<int> ThreadIds() {
+  std::vector<int> tids;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) return tids;
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') tids.push_back(atoi(entry->d_name));
+  }
+  closedir(dir);
+  std::sort(tids.begin(), tids.end());
+  return tids;
+}
+
+std::string ReadLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// "event=0x04,umask=0x03" of a sysfs event to the config of perf_event_attr
+uint64_t EventConfig(const std::string& spec) {
+  uint64_t config = 0;
+  std::stringstream fields(spec);
+  std::string field;
+  while (std::getline(fields, field, ',')) {
+    size_t eq = field.find('=');
+    if (eq == std::string::npos) continue;
+    uint64_t value = strtoull(field.substr(eq + 1).c_str(), nullptr, 0);
+    std::string name = field.substr(0, eq);
+    if (name == "event") config |= value;
+    if (name == "umask") config |= value << 8;
+  }
+  return config;
+}
+#endif
+
+int64_t Product(const std::vector<int64_t>& shape) {
+  return std::accumulate(shape.begin(), shape.end(), int64_t(1), std::multiplies<int64_t>());
+}
+
+double EnvDouble(const char* name) {
+  const char* value = getenv(name);
+  return value == nullptr ? 0 : atof(value);
+}
+
+double MeasurePeakGflops() {
+  constexpr int kLanes = 64;
+  constexpr int kIters = 1 << 20;
+  double best = 0;
+  for (int round = 0; round < 3; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    float sink = 0;
+#pragma omp parallel reduction(+ : sink)
+    {
+      float acc[kLanes];
+      for (int j = 0; j < kLanes; ++j) acc[j] = 1.f + omp_get_thread_num() * 1e-3f + j * 1e-6f;
+      const float a = 0.999999f, b = 1e-7f;
+      for (int i = 0; i < kIters; ++i) {
+        for (int j = 0; j < kLanes; ++j) acc[j] = acc[j] * a + b;
+      }
+      for (int j = 0; j < kLanes; ++j) sink += acc[j];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // the sink keeps the loop alive
+    if (sink == 0) LOG(INFO) << "roofline compute probe returned 0";
+    best = std::max(best, 2.0 * kLanes * kIters * omp_get_max_threads() / seconds / 1e9);
+  }
+  return best;
+}
+
+double MeasurePeakGbps() {
+  // large enough to stream from DRAM rather than from the last level cache
+  const size_t elems = size_t(64) << 20;
+  std::vector<float> buf(elems, 1.f);
+  double best = 0;
+  for (int round = 0; round < 3; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    float sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+    for (int64_t i = 0; i < static_cast<int64_t>(elems); ++i) sum += buf[i];
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (sum == 0) LOG(INFO) << "roofline memory probe returned 0";
+    best = std::max(best, elems * sizeof(float) / seconds / 1e9);
+  }
+  return best;
+}
+
+}  // namespace
+
+HwCounters::HwCounters() {
+  OpenThreads();
+  OpenImc();
+  if (!available()) {
+    LOG(WARNING) << "Hardware counters are not available (check /proc/sys/kernel/perf_event_paranoid), "
+                 << "profiling continues without them...";
+  } else if (!has_dram()) {
+    DLOG(INFO) << "Uncore memory counters are not available, bandwidth is estimated from the tensor bytes";
+  }
+}
+
+HwCounters::~HwCounters() {
+#ifdef __linux__
+  for (const auto& thread : threads_) {
+    for (int fd : thread.fds) {
+      if (fd >= 0) close(fd);
+    }
+  }
+  for (int fd : imc_fds_) close(fd);
+#endif
+}
+
+void HwCounters::OpenThreads() {
+#ifdef __linux__
+  std::vector<int> tids = ThreadIds();
+  for (int tid : tids) {
+    bool known = std::any_of(threads_.begin(), threads_.end(), [&](const ThreadEvents& t) { return t.tid == tid; });
+    if (known) continue;
+    ThreadEvents events = {tid, {-1, -1, -1}};
+    events.fds[0] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, tid, -1, -1);
+    if (events.fds[0] < 0) continue;
+    events.fds[1] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, tid, -1, events.fds[0]);
+    // the group is read in opening order, so a missing event ends it. the generic cache miss event is the last
+    // level cache on x86
+    if (events.fds[1] >= 0) {
+      events.fds[2] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, tid, -1, events.fds[0]);
+    }
+    threads_.push_back(events);
+  }
+#endif
+}
+
+void HwCounters::OpenImc() {
+#ifdef __linux__
+  const std::string root = "/sys/bus/event_source/devices/";
+  DIR* dir = opendir(root.c_str());
+  if (dir == nullptr) return;
+  while (dirent* entry = readdir(dir)) {
+    std::string pmu = entry->d_name;
+    if (pmu.compare(0, 11, "uncore_imc_") != 0 || pmu.find("free_running") != std::string::npos) continue;
+    std::string type = ReadLine(root + pmu + "/type");
+    std::string cpumask = ReadLine(root + pmu + "/cpumask");
+    if (type.empty() || cpumask.empty()) continue;
+    // one cpu of the socket reads its controllers
+    int cpu = atoi(cpumask.c_str());
+    for (const char* event : {"cas_count_read", "cas_count_write"}) {
+      std::string spec = ReadLine(root + pmu + "/events/" + event);
+      if (spec.empty()) continue;
+      int fd = OpenEvent(atoi(type.c_str()), EventConfig(spec), -1, cpu, -1);
+      if (fd >= 0) imc_fds_.push_back(fd);
+    }
+  }
+  closedir(dir);
+#endif
+}
+
+void HwCounters::Start() {
+#ifdef __linux__
+  // OpenMP starts its workers with the first parallel region
+  OpenThreads();
+  for (const auto& thread : threads_) {
+    ioctl(thread.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(thread.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  for (int fd : imc_fds_) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+HwCounterSample HwCounters::Stop() {
+  HwCounterSample sample;
+#ifdef __linux__
+  for (int fd : imc_fds_) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  for (const auto& thread : threads_) ioctl(thread.fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  for (const auto& thread : threads_) {
+    // nr followed by the value of each event of the group in the order they were opened
+    uint64_t values[4] = {0, 0, 0, 0};
+    if (read(thread.fds[0], values, sizeof(values)) <= 0) continue;
+    if (values[0] > 0) sample.cycles += values[1];
+    if (values[0] > 1) sample.instructions += values[2];
+    if (values[0] > 2) sample.llc_misses += values[3];
+  }
+  for (int fd : imc_fds_) {
+    uint64_t values[2] = {0, 0};
+    // each column address strobe moves one 64 bytes cache line
+    if (read(fd, values, sizeof(values)) > 0) sample.dram_bytes += values[1] * 64;
+  }
+  sample.has_dram = has_dram();
+#endif
+  return sample;
+}
+
+const Roofline& Roofline::Measured() {
+  static Roofline roofline = [] {
+    Roofline measured;
+    measured.peak_gflops = EnvDouble("ENGINE_PROFILING_PEAK_GFLOPS");
+    measured.peak_gbps = EnvDouble("ENGINE_PROFILING_PEAK_GBPS");
+    if (measured.peak_gflops <= 0) measured.peak_gflops = MeasurePeakGflops();
+    if (measured.peak_gbps <= 0) measured.peak_gbps = MeasurePeakGbps();
+    LOG(INFO) << "Profiling roofline: " << measured.peak_gflops << " GFLOP/s, " << measured.peak_gbps << " GB/s";
+    return measured;
+  }();
+  return roofline;
+}
+
+const char* Roofline::Bound(double flops, double bytes) const {
+  if (bytes <= 0) return "compute";
+  return flops / bytes < ridge() ? "memory" : "compute";
+}
+
+double Roofline::Efficiency(const HwCounterSample& sample) const {
+  if (std::string(Bound(sample.flops, sample.traffic_bytes())) == "memory") {
+    return peak_gbps <= 0 ? 0 : sample.gbps() / peak_gbps;
+  }
+  return peak_gflops <= 0 ? 0 : sample.gflops() / peak_gflops;
+}
+
+double OperatorFlops(const std::string& type, const std::vector<std::vector<int64_t>>& input_shapes,
+                     const std::vector<std::vector<int64_t>>& output_shapes) {
+  if (output_shapes.empty()) return 0;
+  double dst = static_cast<double>(Product(output_shapes[0]));
+  if (input_shapes.size() < 2 || dst <= 0) return dst;
+  double src0 = static_cast<double>(Product(input_shapes[0]));
+  double src1 = static_cast<double>(Product(input_shapes[1]));
+  if (type == "InnerProduct" || type == "Matmul" || type == "BatchMatMul") {
+    // M * K, K * N and M * N elements (times the batch) give K whatever the layout and transposes are
+    double batch = 1;
+    const std::vector<int64_t>& dst_shape = output_shapes[0];
+    if (type != "InnerProduct" && dst_shape.size() > 2) {
+      batch = dst / (dst_shape[dst_shape.size() - 1] * dst_shape[dst_shape.size() - 2]);
+    }
+    double k = std::round(std::sqrt(src0 * src1 / dst / batch));
+    return 2 * dst * k;
+  }
+  if (type == "Convolution" && !input_shapes[1].empty() && input_shapes[1][0] > 0) {
+    // weight [OC, IC / groups, KH, KW], every output element takes one filter
+    return 2 * dst * (src1 / input_shapes[1][0]);
+  }
+  return dst;
+}
+
+}  // namespace executor
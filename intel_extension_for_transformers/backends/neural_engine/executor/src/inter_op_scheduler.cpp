@@ -0,0 +1,160 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "inter_op_scheduler.hpp"
+
+#include <algorithm>
+
+#include "glog/logging.h"
+
+namespace executor {
+
+InterOpScheduler::InterOpScheduler(const std::vector<std::vector<int>>& deps, int total_threads)
+    : num_ops_(deps.size()),
+      successors_(deps.size()),
+      num_deps_(deps.size(), 0),
+      thread_budget_(deps.size(), std::max(total_threads, 1)),
+      pending_(new std::atomic<int>[deps.size()]) {
+  // ASAP levels of the DAG, the operators of one level may run at the same time
+  std::vector<int> level(num_ops_, 0);
+  std::vector<int> width;
+  for (int i = 0; i < num_ops_; ++i) {
+    std::vector<int> unique_deps(deps[i]);
+    std::sort(unique_deps.begin(), unique_deps.end());
+    unique_deps.erase(std::unique(unique_deps.begin(), unique_deps.end()), unique_deps.end());
+    for (int d : unique_deps) {
+      CHECK(d >= 0 && d < i) << "operator " << i << " depends on operator " << d << " which does not run before it";
+      successors_[d].push_back(i);
+      level[i] = std::max(level[i], level[d] + 1);
+    }
+    num_deps_[i] = unique_deps.size();
+    if (level[i] >= width.size()) width.resize(level[i] + 1, 0);
+    width[level[i]]++;
+  }
+  int max_width = width.empty() ? 1 : *std::max_element(width.begin(), width.end());
+  for (int i = 0; i < num_ops_; ++i) thread_budget_[i] = std::max(1, total_threads / width[level[i]]);
+
+  int num_workers = std::min(max_width, std::max(total_threads, 1));
+  if (num_workers <= 1) return;
+  for (int i = 0; i < num_workers; ++i) queues_.emplace_back(new Worker());
+  // worker 0 is the thread calling Run
+  for (int i = 1; i < num_workers; ++i) workers_.emplace_back(&InterOpScheduler::WorkLoop, this, i);
+  DLOG(INFO) << "Inter-op scheduler uses " << num_workers << " workers for a DAG of width " << max_width;
+}
+
+InterOpScheduler::~InterOpScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cond_.notify_all();
+  for (auto& worker : workers_) worker.join();
+}
+
+void InterOpScheduler::Run(const std::function<void(int)>& task) {
+  if (!parallel()) {
+    for (int i = 0; i < num_ops_; ++i) task(i);
+    return;
+  }
+  task_ = &task;
+  for (int i = 0; i < num_ops_; ++i) pending_[i].store(num_deps_[i], std::memory_order_relaxed);
+  remaining_.store(num_ops_, std::memory_order_release);
+  for (int i = 0; i < num_ops_; ++i) {
+    if (num_deps_[i] == 0) Push(0, i);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  work_cond_.notify_all();
+
+  while (remaining_.load(std::memory_order_acquire) > 0) {
+    int op;
+    if (Pop(0, &op)) {
+      Execute(0, op);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_cond_.wait(lock, [this] {
+      return queued_.load(std::memory_order_acquire) > 0 || remaining_.load(std::memory_order_acquire) == 0;
+    });
+  }
+  task_ = nullptr;
+}
+
+void InterOpScheduler::WorkLoop(int worker_id) {
+  while (true) {
+    int op;
+    if (Pop(worker_id, &op)) {
+      Execute(worker_id, op);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_cond_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+    if (stop_) return;
+  }
+}
+
+void InterOpScheduler::Execute(int worker_id, int op) {
+  (*task_)(op);
+  int ready = 0;
+  for (int succ : successors_[op]) {
+    if (pending_[succ].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Push(worker_id, succ);
+      ready++;
+    }
+  }
+  // this worker goes on with one of the ready operators, wake up others for the rest
+  if (ready > 1) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    for (int i = 1; i < ready; ++i) work_cond_.notify_one();
+  }
+  if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    work_cond_.notify_all();
+  }
+}
+
+void InterOpScheduler::Push(int worker_id, int op) {
+  {
+    std::lock_guard<std::mutex> lock(queues_[worker_id]->mutex);
+    queues_[worker_id]->ready.push_back(op);
+  }
+  queued_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool InterOpScheduler::Pop(int worker_id, int* op) {
+  const int num_queues = queues_.size();
+  for (int k = 0; k < num_queues; ++k) {
+    Worker* queue = queues_[(worker_id + k) % num_queues].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->ready.empty()) continue;
+    // the own deque is used as a stack for locality, others are stolen from the other end
+    if (k == 0) {
+      *op = queue->ready.back();
+      queue->ready.pop_back();
+    } else {
+      *op = queue->ready.front();
+      queue->ready.pop_front();
+    }
+    queued_.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+  }
+  return false;
+}
+
+}  // namespace executor
@@ -32,6 +32,7 @@ void* MemoryAllocator::StaticCompressedBufferGetMemory(size_t size, const int li
   } catch (...) {
     LOG(FATAL) << "tensor " << tensor_name << " is not in activation dag.";
   }
+  scpb_manager_->RecordUse(buf, size);
   MemoryBuffer& scpb_mem_buffer = CompressedBuffer();
   DLOG(INFO) << "static compressed buffer tensor size is " << scpb_mem_buffer.size();
   if (scpb_mem_buffer.count(buf) == 0) {
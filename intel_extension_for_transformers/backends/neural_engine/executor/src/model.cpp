@@ -13,6 +13,9 @@
 //  limitations under the License.
 #include "model.hpp"
 
+#include "operators/eltwise_chain.hpp"
+#include "weight_disk_cache.hpp"
+
 namespace executor {
 
 Model::Model(const ModelConfig& conf, const string& weight_root)
@@ -27,7 +30,9 @@ Model::Model(const string& conf_file, const string& weight_root) : weight_root_(
 }
 
 Model::Model(const ModelConfig& conf, const string& weight_root, const ExecutionOptions& execution_options)
-    : weight_root_(weight_root), execution_options_(execution_options) {
+    : model_conf_(std::make_shared<ModelConfig>(conf)),
+      weight_root_(weight_root),
+      execution_options_(execution_options) {
   if (execution_options_.enable_op_tuning) execution_options_.execution_mode = ExecutionMode::TUNING;
   if (execution_options_.execution_mode == ExecutionMode::TUNING) execution_options_.enable_op_tuning = true;
   Init(conf);
@@ -42,7 +47,29 @@ Model::Model(const string& conf_file, const string& weight_root, const Execution
   Init(*model_conf_);
 }
 
+Model::Model(const Model* weights_owner)
+    : model_conf_(weights_owner->model_conf_),
+      weight_root_(weights_owner->weight_root_),
+      execution_options_(weights_owner->execution_options_),
+      weights_(weights_owner->weights_),
+      weight_mapping_(weights_owner->weight_mapping_),
+      is_context_(true) {
+  Init(*model_conf_);
+}
+
 Model::~Model() {
+  // finishes the asynchronous requests while the model is still whole
+  forward_queue_.reset();
+  // background tuning jobs point to the operators of this model
+  if (online_tuning_) OnlineTuner::Global().Cancel(this);
+  // the last of the model and its contexts frees the reordered weights they shared
+  if (weights_.use_count() == 1) {
+    for (void* packed : PrepackedWeightCache::Evict(weights_.get())) {
+      if (!WeightDiskCache::Global().Contains(packed)) aligned_free(packed);
+    }
+  }
+  // the profiling of contexts is not collected
+  if (is_context_) return;
   // profiling must after forward
   if (engine_profiling_ && !operators_[1]->latency().empty()) {
     DLOG(INFO) << "Neural engine profiling ...";
@@ -71,10 +98,18 @@ string Model::Serialize() {
     weight_c = std::shared_ptr<char>(new char[weight_len], std::default_delete<char[]>());
     weight_file.read(weight_c.get(), weight_len);
     weight_file.close();
+  } else if (weight_mapping_) {
+    // the mapping stays alive as long as the aliasing pointer
+    weight_c = std::shared_ptr<char>(weight_mapping_, const_cast<char*>(weight_mapping_->data()));
+    weight_len = weight_mapping_->size();
   } else {
     weight_c = std::shared_ptr<char>(const_cast<char*>(weight_root_.c_str()));
     weight_len = weight_root_.length();
   }
+  // the weights start at a multiple of ALIGNMENT like in model.bin, so that a mapped file needs no copies of them.
+  // the model conf archive is padded, its reader stops at its end
+  model_conf_len += (ALIGNMENT - (2 * sizeof(size_t) + model_conf_len) % ALIGNMENT) % ALIGNMENT;
+  model_conf_str.resize(model_conf_len, '\0');
   // combine model_conf_len, weight_len, model_config, weight into one string
   std::shared_ptr<char> model_conf_len_c =
       std::shared_ptr<char>(new char[sizeof(size_t) + 1], std::default_delete<char[]>());
@@ -129,6 +164,29 @@ void Model::SerializeToFile(const string& file_name) {
 
 void Model::DeserializeFromFile(const string& file_name) {
   std::ifstream model_file(file_name, std::ios::in | std::ios::binary);
+  if (model_file && execution_options_.weight_mmap && !MemoryAllocator::SharedEnv()) {
+    // only the model conf is read, the weights behind it are mapped
+    string lens(2 * sizeof(size_t), '\0');
+    model_file.read(&lens[0], lens.size());
+    size_t model_conf_len = StringToNum<size_t>(lens.substr(0, sizeof(size_t)));
+    size_t weight_len = StringToNum<size_t>(lens.substr(sizeof(size_t), sizeof(size_t)));
+    string model_conf_str(model_conf_len, '\0');
+    model_file.read(&model_conf_str[0], model_conf_len);
+    model_file.close();
+    MapWeight(file_name, 2 * sizeof(size_t) + model_conf_len);
+    if (weight_mapping_ && weight_mapping_->size() == weight_len) {
+      std::stringstream model_conf_stream;
+      model_conf_stream << model_conf_str;
+      cereal::PortableBinaryInputArchive model_conf_ia(model_conf_stream);
+      model_conf_ = std::make_shared<ModelConfig>();
+      model_conf_ia(*model_conf_);
+      weight_root_ = file_name;
+      Init(*model_conf_);
+      return;
+    }
+    weight_mapping_.reset();
+    model_file.open(file_name, std::ios::in | std::ios::binary);
+  }
   if (model_file) {
     size_t model_len = static_cast<size_t>(model_file.seekg(0, std::ios::end).tellg());
     model_file.seekg(0, std::ios::beg);
@@ -142,13 +200,19 @@ void Model::DeserializeFromFile(const string& file_name) {
 }
 
 void Model::Init(const ModelConfig& conf) {
+  ActivationArena::Scope arena_scope(&activation_arena_);
   llga_info_.SetTensors(&tensors_);
   llga_info_.SetTensorNameIndex(&tensor_name_index_);
-  // Clear the whole dnnl primitive cache map when init engine
-  InnerProductPrimitiveFwdFactory::ClearFactory();
-  MatMulPrimitiveFwdFactory::ClearFactory();
-  ConvolutionPrimitiveFwdFactory::ClearFactory();
-  InitSharedWeight();
+  if (!is_context_) {
+    // Clear the whole dnnl primitive cache map when init engine
+    InnerProductPrimitiveFwdFactory::ClearFactory();
+    MatMulPrimitiveFwdFactory::ClearFactory();
+    ConvolutionPrimitiveFwdFactory::ClearFactory();
+    InitSharedWeight();
+    if (execution_options_.weight_mmap && !MemoryAllocator::SharedEnv() && !weight_mapping_) {
+      MapWeight(weight_root_, 0);
+    }
+  }
   name_ = conf.name();
   MemoryAllocator::InitStrategy(execution_options_);
 #ifdef WIN32
@@ -172,6 +236,13 @@ void Model::Init(const ModelConfig& conf) {
       DLOG(INFO) << "In DEBUG MODE, ignore dispatch table file even if there is it...";
     }
   }
+  online_tuning_ =
+      execution_options_.enable_online_tuning && execution_options_.execution_mode == ExecutionMode::INFERENCE;
+  if (online_tuning_ && execution_options_.activation_mem_compression) {
+    // the shadow kernels of the tuner would write into the planned buffers of the serving ones
+    LOG(WARNING) << "Online tuning does not support activation memory compression, it is turned off...";
+    online_tuning_ = false;
+  }
   // For each operator, set up its input and output
   auto op_configs = conf.operators();
   input_vecs_.resize(op_configs.size());
@@ -222,27 +293,111 @@ void Model::Init(const ModelConfig& conf) {
       operators_[i]->set_attrs(attrs);
     }
   }
-  if (multi_stream_flag) {
-    multi_stream_tasks_.clear();
-    for (int i = 0; i < operators_.size(); ++i) {
-      auto op_attr_map = operators_[i]->operator_conf()->attributes();
-      auto it = op_attr_map.find("multi_stream");
-      if (it != op_attr_map.end()) {
-        multi_stream_tasks_.insert({i, StringToNum<int64_t>(it->second)});
-      }
-    }
-    auto max_tasks = std::max_element(
-        multi_stream_tasks_.begin(), multi_stream_tasks_.end(),
-        [](const std::pair<int, int64_t>& a, const std::pair<int, int64_t>& b) -> bool { return a.second < b.second; });
-    int tp_max_threads = max_tasks->second + (max_tasks->second & 1);
-    int total_available_threads = omp_get_num_procs();
-    tp_max_threads = tp_max_threads > total_available_threads ? total_available_threads : tp_max_threads;
-    tp.begin(tp_max_threads);
-    DLOG(INFO) << "Thread pool is initialized with " << tp_max_threads << " threads. ("
-               << "Total avaiable threads: " << total_available_threads << ")";
+  // the dtypes the chains are lowered by are known once the operators are prepared. The eltwiseop kernel is jitted
+  // for avx512_core only, elsewhere it falls back to a single threaded reference loop slower than the operators
+  if (execution_options_.execution_mode == ExecutionMode::INFERENCE && getenv("ENGINE_ELTWISE_FUSION_OFF") == NULL &&
+      RuntimeIsa() == Isa::kAvx512) {
+    FuseEltwiseChains();
   }
+  if (getenv("ENGINE_INTER_OP_PARALLEL_OFF") == NULL) InitInterOpScheduler();
 
   engine_profiling_ = (getenv("ENGINE_PROFILING") != NULL);  // profiling env
+  if (engine_profiling_ && getenv("ENGINE_PROFILING_HW_COUNTERS") != NULL && !is_context_) {
+    hw_counters_.reset(new HwCounters());
+  }
+}
+
+void Model::FuseEltwiseChains() {
+  std::unordered_map<const Tensor*, int> consumers, consumer;
+  for (int i = 0; i < operators_.size(); ++i) {
+    for (const auto& tensor : input_vecs_[i]) {
+      consumers[tensor]++;
+      consumer[tensor] = i;
+    }
+  }
+  vector<string> postops(operators_.size());
+  vector<int> data_input(operators_.size(), 0);
+  // skip input and output node
+  for (int i = 1; i < operators_.size() - 1; ++i) {
+    if (operators_[i]->type() == "LLGAKernel") continue;
+    postops[i] = EltwiseChainOperator::Lower(operators_[i]->type(), operators_[i]->operator_conf()->attributes(),
+                                             input_vecs_[i], output_vecs_[i], &data_input[i]);
+  }
+  // the operator the chain of `i` goes on with, -1 if the output of `i` is read by anything else
+  auto next = [&](int i) {
+    const Tensor* tensor = output_vecs_[i][0];
+    if (consumers[tensor] != 1) return -1;
+    int j = consumer[tensor];
+    return !postops[j].empty() && input_vecs_[j][data_input[j]] == tensor ? j : -1;
+  };
+  vector<bool> fused(operators_.size(), false);
+  int chains = 0;
+  // operators are in topological order, so a chain is met at its head first
+  for (int i = 1; i < operators_.size() - 1; ++i) {
+    if (postops[i].empty() || fused[i]) continue;
+    vector<int> chain = {i};
+    for (int j = next(i); j != -1; j = next(j)) chain.push_back(j);
+    if (chain.size() < 2) continue;
+    const int head = chain.front(), tail = chain.back();
+    string chain_postops;
+    for (int j : chain) {
+      chain_postops += (chain_postops.empty() ? "" : "+") + postops[j];
+      fused[j] = j != tail;
+    }
+    // the fused operator takes the place of the tail, where all the operators of the chain have run
+    auto tail_conf = operators_[tail]->operator_conf();
+    auto conf = std::make_shared<OperatorConfig>(
+        tail_conf->name(), "EltwiseChain",
+        vector<shared_ptr<TensorConfig>>{operators_[head]->operator_conf()->input_tensors(data_input[head])},
+        vector<shared_ptr<TensorConfig>>{tail_conf->output_tensors(0)},
+        std::make_shared<AttrConfig>(std::map<string, string>{{"postops", chain_postops}}));
+    operators_[tail] = std::make_shared<Dispatcher>(conf, &execution_options_, this);
+    input_vecs_[tail] = {input_vecs_[head][data_input[head]]};
+    operators_[tail]->Prepare(input_vecs_[tail], output_vecs_[tail]);
+    operators_[tail]->set_attrs(conf->attributes());
+    DLOG(INFO) << "Fused " << chain.size() << " elementwise operators into " << conf->name() << ": " << chain_postops;
+    chains++;
+  }
+  if (chains == 0) return;
+  int kept = 0;
+  for (int i = 0; i < operators_.size(); ++i) {
+    if (fused[i]) continue;
+    operators_[kept] = operators_[i];
+    input_vecs_[kept] = input_vecs_[i];
+    output_vecs_[kept] = output_vecs_[i];
+    kept++;
+  }
+  operators_.resize(kept);
+  input_vecs_.resize(kept);
+  output_vecs_.resize(kept);
+}
+
+void Model::InitInterOpScheduler() {
+  // operators run on several threads only over the lock-free arena of the cycle buffer: the direct and unified
+  // buffers keep unlocked per thread maps, a buffer released on another thread than its allocation would leak, and
+  // the static compressed buffer lets tensors share memory by their topological order, so operators run in order
+  if (!MemoryAllocator::Strategy()["cycle_buffer"] || execution_options_.activation_mem_compression) return;
+  // operator i depends on the producers of its inputs
+  std::unordered_map<const Tensor*, int> producer;
+  for (int i = 0; i < operators_.size(); ++i) {
+    for (const auto& tensor : output_vecs_[i]) producer[tensor] = i;
+  }
+  vector<vector<int>> deps(operators_.size());
+  // the kernels picked from a dispatch table may reorder shared inputs in place, run their consumers in order then
+  std::unordered_map<const Tensor*, int> last_consumer;
+  for (int i = 0; i < operators_.size(); ++i) {
+    for (const auto& tensor : input_vecs_[i]) {
+      auto iter = producer.find(tensor);
+      if (iter != producer.end() && iter->second != i) deps[i].push_back(iter->second);
+      if ((has_dispatch_table_file_ || online_tuning_) && tensor->location().empty()) {
+        auto consumer = last_consumer.find(tensor);
+        if (consumer != last_consumer.end() && consumer->second != i) deps[i].push_back(consumer->second);
+        last_consumer[tensor] = i;
+      }
+    }
+  }
+  inter_op_scheduler_.reset(new InterOpScheduler(deps, omp_get_max_threads()));
+  if (!inter_op_scheduler_->parallel()) inter_op_scheduler_.reset();
 }
 
 void Model::RemoveSharedWeight(bool is_begin, char* count_space_name, char* count_name, char* count_mtx_name,
@@ -303,6 +458,36 @@ ipc::managed_shared_memory::handle_t Model::LoadSharedWeight(const string& root,
   return handle;
 }
 
+void Model::MapWeight(const string& file_name, size_t offset) {
+  weight_mapping_ = WeightMapping::Map(file_name, offset, execution_options_.weight_mmap_prefetch,
+                                       execution_options_.weight_mmap_hugepage);
+  if (!weight_mapping_) {
+    DLOG(INFO) << "Weights are not mapped, they will be read into private buffers";
+  }
+}
+
+bool Model::HoldsWeight(const string& name, const void* data) const {
+  auto iter = weights_->find(name);
+  return iter != weights_->end() && iter->second == data;
+}
+
+bool Model::IsMappedWeight(const void* data) const {
+  return weight_mapping_ != nullptr && weight_mapping_->Contains(data);
+}
+
+void* Model::LoadMappedWeight(const shared_ptr<TensorConfig>& tensor_config) {
+  const vector<int64_t>& location = tensor_config->location();
+  void* weight_ptr = weight_mapping_->Slice(location[0], location[1]);
+  CHECK(weight_ptr != nullptr) << "weight " << tensor_config->name() << " is out of " << weight_mapping_->file_name();
+  if (reinterpret_cast<uintptr_t>(weight_ptr) % ALIGNMENT == 0) return weight_ptr;
+  // the kernels expect aligned weights, an unaligned one is copied out like a read weight
+  DLOG(INFO) << "Weight " << tensor_config->name() << " is not aligned in the mapping, it is copied";
+  int64_t bytes = Product(tensor_config->shape()) * type2bytes[tensor_config->dtype()];
+  void* p = aligned_alloc(ALIGNMENT, (bytes / ALIGNMENT + 1) * ALIGNMENT);
+  std::memcpy(p, weight_ptr, location[1]);
+  return p;
+}
+
 void Model::SetInput(const shared_ptr<OperatorConfig>& op_conf, const int operator_id, const int tensor_id,
                      map<string, int>* tensor_name_index_) {
   // model input tensor not in output tensors
@@ -357,10 +542,18 @@ void Model::SetOutput(const shared_ptr<OperatorConfig>& op_conf, const int opera
             LoadSharedWeight(weight_root_, tensor_config->dtype(), tensor_config->shape(), tensor_config->location());
         tensor_ptr->set_shm_handle(handle);
       } else {
-        void* weight_ptr =
-            read_file_to_type(weight_root_, tensor_config->dtype(), tensor_config->shape(), tensor_config->location());
-        tensor_ptr->set_data(weight_ptr);
+        auto iter = weights_->find(tensor_name);
+        if (iter == weights_->end()) {
+          CHECK(!is_context_) << "weight " << tensor_name << " is not loaded by the model";
+          void* weight_ptr = weight_mapping_ ? LoadMappedWeight(tensor_config)
+                                             : read_file_to_type(weight_root_, tensor_config->dtype(),
+                                                                 tensor_config->shape(), tensor_config->location());
+          iter = weights_->insert({tensor_name, weight_ptr}).first;
+        }
+        tensor_ptr->set_data(iter->second);
       }
+      // the extra life keeps operators from replacing a weight shared with the contexts by their own layout
+      if (execution_options_.enable_execution_context) tensor_ptr->add_tensor_life(1);
       return;
     }
     // set model input tensors
@@ -372,6 +565,7 @@ void Model::SetOutput(const shared_ptr<OperatorConfig>& op_conf, const int opera
 // collect operator's dtype and shape
 // ignore dispatching kernel process
 void Model::ShapeInference(const vector<vector<int64_t>>& input_shapes) {
+  ActivationArena::Scope arena_scope(&activation_arena_);
   DLOG(INFO) << "Start to implement model shape inference...";
   for (int i = 0; i < input_shapes.size(); ++i) {
     model_input_tensors_[i]->set_shape(input_shapes[i]);
@@ -426,7 +620,8 @@ void Model::SetDispatchKernel(const bool& reshape_model) {
   } else {
     if (reshape_model) {
       for (int i = 0; i < operators_.size(); ++i) {
-        operators_[i]->GetExecuteKernel(input_vecs_[i], output_vecs_[i], reshape_model, has_dispatch_table_file_);
+        operators_[i]->GetExecuteKernel(input_vecs_[i], output_vecs_[i], reshape_model,
+                                        has_dispatch_table_file_ || online_tuning_);
       }
     }
   }
@@ -440,6 +635,9 @@ void Model::SetDispatchKernel(const bool& reshape_model) {
 vector<Tensor>& Model::Forward(vector<Tensor>& input_data) {
   CHECK_EQ(input_data.size(), model_input_tensors_.size())
       << "input data size not equal with model input tensor size....";
+  ActivationArena::Scope arena_scope(&activation_arena_);
+  // rewinds the arena when nothing of the last run is alive anymore, otherwise blocks are recycled one by one
+  activation_arena_.Reset();
   // if we want use dynamic input data shape at run time, we should check the
   // input data shape and get the output shape, this should be necessary in each
   // Operator's Forward function
@@ -471,6 +669,11 @@ vector<Tensor>& Model::Forward(vector<Tensor>& input_data) {
     }
   }
   if (reshape_model) input_shape_ = input_data[0].shape();
+  // the first run and every kernel promoted by the online tuner since the last one dispatch the operators again
+  if (online_tuning_ && online_tuning_generation_ != OnlineTuner::Global().generation()) {
+    online_tuning_generation_ = OnlineTuner::Global().generation();
+    reshape_model = true;
+  }
   for (int i = 0; i < input_data.size(); ++i) {
     // model_input_tesnor_[i]->free_data();
     model_input_tensors_[i]->set_data(input_data[i].mutable_data());
@@ -524,60 +727,55 @@ vector<Tensor>& Model::Forward(vector<Tensor>& input_data) {
         }
       }
     }
-    int thread_count = 1;
     if (engine_profiling_) {
       for (int i = 0; i < operators_.size(); ++i) {
         DLOG(INFO) << "operator " << operators_[i]->name() << " gonna forward with type " << operators_[i]->type();
-        if (multi_stream_flag && multi_stream_tasks_.find(i) != multi_stream_tasks_.end()) {
-          int64_t start = Time();
-          tp.commitTask(std::bind(&executor::Dispatcher::Forward, operators_[i], input_vecs_[i], output_vecs_[i]));
-          int64_t end = Time();
-          float forward_time = Duration(start, end);
-          operators_[i]->set_latency(forward_time);
-          for (int j = 0; j < input_vecs_[i].size(); ++j) {
-            operators_[i]->append_it_shape(input_vecs_[i][j]->shape());
-          }
-          if (i != operators_.size() - 1) {
-            operators_[i]->append_ot_shape(output_vecs_[i][0]->shape());  // the last output is not exsit
-          }
-          DLOG(INFO) << "operator: " << operators_[i]->name() << ", latency: " << forward_time << " ms";
-          if (thread_count >= multi_stream_tasks_[i]) {
-            tp.waitAllTaskRunOver();
-            thread_count = 0;
-          }
-          thread_count++;
-        } else {
-          int64_t start = Time();
-          operators_[i]->Forward(input_vecs_[i], output_vecs_[i]);
-          int64_t end = Time();
-          float forward_time = Duration(start, end);
-          // for profiling
-          operators_[i]->set_latency(forward_time);
-          for (int j = 0; j < input_vecs_[i].size(); ++j) {
-            operators_[i]->append_it_shape(input_vecs_[i][j]->shape());
+        if (hw_counters_ != nullptr) hw_counters_->Start();
+        int64_t start = Time();
+        operators_[i]->Forward(input_vecs_[i], output_vecs_[i]);
+        int64_t end = Time();
+        float forward_time = Duration(start, end);
+        // for profiling
+        operators_[i]->set_latency(forward_time);
+        if (hw_counters_ != nullptr) {
+          HwCounterSample sample = hw_counters_->Stop();
+          sample.ms = forward_time;
+          vector<vector<int64_t>> input_shapes, output_shapes;
+          for (const auto& tensor : input_vecs_[i]) {
+            input_shapes.push_back(tensor->shape());
+            sample.bytes += tensor->alloc_bytes();
           }
-          if (i != operators_.size() - 1) {
-            operators_[i]->append_ot_shape(output_vecs_[i][0]->shape());
+          for (const auto& tensor : output_vecs_[i]) {
+            output_shapes.push_back(tensor->shape());
+            sample.bytes += tensor->alloc_bytes();
           }
-          DLOG(INFO) << "operator: " << operators_[i]->name() << ", latency: " << forward_time << " ms";
+          sample.flops = OperatorFlops(operators_[i]->type(), input_shapes, output_shapes);
+          operators_[i]->set_hw_counters(sample);
+        }
+        for (int j = 0; j < input_vecs_[i].size(); ++j) {
+          operators_[i]->append_it_shape(input_vecs_[i][j]->shape());
+        }
+        if (i != operators_.size() - 1) {
+          operators_[i]->append_ot_shape(output_vecs_[i][0]->shape());
         }
+        DLOG(INFO) << "operator: " << operators_[i]->name() << ", latency: " << forward_time << " ms";
       }
+    } else if (inter_op_scheduler_ != nullptr && execution_options_.execution_mode == ExecutionMode::INFERENCE) {
+      int omp_threads = omp_get_max_threads();
+      inter_op_scheduler_->Run([this](int i) {
+        ActivationArena::Scope task_scope(&activation_arena_);
+        omp_set_num_threads(inter_op_scheduler_->thread_budget(i));
+        DLOG(INFO) << "operator " << operators_[i]->name() << " gonna forward with type " << operators_[i]->type();
+        operators_[i]->Forward(input_vecs_[i], output_vecs_[i]);
+      });
+      omp_set_num_threads(omp_threads);
     } else {
       for (int i = 0; i < operators_.size(); ++i) {
         DLOG(INFO) << "operator " << operators_[i]->name() << " gonna forward with type " << operators_[i]->type();
-        if (multi_stream_flag && multi_stream_tasks_.find(i) != multi_stream_tasks_.end()) {
-          tp.commitTask(std::bind(&executor::Dispatcher::Forward, operators_[i], input_vecs_[i], output_vecs_[i]));
-          if (thread_count >= multi_stream_tasks_[i]) {
-            tp.waitAllTaskRunOver();
-            thread_count = 0;
-          }
-          thread_count++;
-        } else {
-          operators_[i]->Forward(input_vecs_[i], output_vecs_[i]);
-        }
+        operators_[i]->Forward(input_vecs_[i], output_vecs_[i]);
       }
     }
-    if (execution_options_.execution_mode == ExecutionMode::INFERENCE && has_dispatch_table_file_) {
+    if (execution_options_.execution_mode == ExecutionMode::INFERENCE && (has_dispatch_table_file_ || online_tuning_)) {
       for (int i = 0; i < operators_.size(); ++i) {
         operators_[i]->ResetOpStatus(input_vecs_[i], output_vecs_[i]);
       }
@@ -586,6 +784,48 @@ vector<Tensor>& Model::Forward(vector<Tensor>& input_data) {
   return this->output_tensors();
 }
 
+shared_ptr<ExecutionContext> Model::CreateContext() const {
+  CHECK(execution_options_.enable_execution_context)
+      << "execution context needs the enable_execution_context execution option...";
+  CHECK(model_conf_ != nullptr) << "execution context needs the model config...";
+  CHECK(MemoryAllocator::SharedEnv() == nullptr) << "execution context does not support weight sharing memory...";
+  // the static compressed buffer plans the activations of a single model instance
+  CHECK(!execution_options_.activation_mem_compression)
+      << "execution context does not support activation memory compression...";
+  return shared_ptr<ExecutionContext>(new ExecutionContext(this, new Model(this)));
+}
+
+vector<Tensor>& Model::Forward(ExecutionContext* context, vector<Tensor>& input_data) {
+  CHECK(context != nullptr && context->model() == this) << "execution context is not created by this model...";
+  return context->runtime_->Forward(input_data);
+}
+
+void Model::ForwardAsync(vector<Tensor> input_data, ForwardQueue::DoneFunc done) {
+  {
+    std::lock_guard<std::mutex> lock(forward_queue_mutex_);
+    if (forward_queue_ == nullptr) {
+      forward_queue_.reset(new ForwardQueue([this](vector<Tensor>& input) -> vector<Tensor>& {
+        return Forward(input);
+      }));
+    }
+  }
+  forward_queue_->Submit(std::move(input_data), std::move(done));
+}
+
+void Model::ForwardAsync(ExecutionContext* context, vector<Tensor> input_data, ForwardQueue::DoneFunc done) {
+  CHECK(context != nullptr && context->model() == this) << "execution context is not created by this model...";
+  {
+    std::lock_guard<std::mutex> lock(context->forward_queue_mutex_);
+    if (context->forward_queue_ == nullptr) {
+      Model* runtime = context->runtime_.get();
+      context->forward_queue_.reset(new ForwardQueue([runtime](vector<Tensor>& input) -> vector<Tensor>& {
+        return runtime->Forward(input);
+      }));
+    }
+  }
+  context->forward_queue_->Submit(std::move(input_data), std::move(done));
+}
+
 shared_ptr<TensorConfig> findTensorConfig(const vector<shared_ptr<OperatorConfig>>& op_configs, string tensor_name) {
   // travel op_configs to find tensorconfig with specificed tensor name
   for (int i = 0; i < op_configs.size() - 1; ++i) {
@@ -0,0 +1,148 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "online_tuner.hpp"
+
+#include <exception>
+#include <utility>
+
+#include "glog/logging.h"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace executor {
+
+OnlineTuner::OnlineTuner(size_t max_pending) : max_pending_(max_pending) {}
+
+OnlineTuner::~OnlineTuner() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    jobs_.clear();
+  }
+  cond_.notify_all();
+  if (worker_.joinable()) worker_.join();
+}
+
+OnlineTuner& OnlineTuner::Global() {
+  static OnlineTuner tuner;
+  return tuner;
+}
+
+bool OnlineTuner::Submit(const void* owner, const std::string& op_type, size_t hash_key, TuneFunc tune,
+                         PromoteFunc promote) {
+  return Submit(owner, op_type, hash_key, MakeTuneFunc([tune]() { return tune; }), std::move(promote));
+}
+
+bool OnlineTuner::Submit(const void* owner, const std::string& op_type, size_t hash_key, MakeTuneFunc make_tune,
+                         PromoteFunc promote) {
+  std::string key = op_type + " " + std::to_string(hash_key);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_ || submitted_.count(key) != 0) return false;
+    if (jobs_.size() + building_ >= max_pending_) {
+      DLOG(INFO) << "Online tuning queue is full, " << key << " keeps its default kernel for now...";
+      return false;
+    }
+    submitted_.insert(key);
+    building_++;
+  }
+  // built out of the lock, the worker keeps taking jobs meanwhile
+  TuneFunc tune;
+  try {
+    tune = make_tune();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    submitted_.erase(key);
+    building_--;
+    throw;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    building_--;
+    if (stop_) return false;
+    jobs_.push_back({owner, key, std::move(tune), std::move(promote)});
+    // started by the first job, so that models without online tuning never get the thread
+    if (!worker_.joinable()) worker_ = std::thread(&OnlineTuner::Work, this);
+  }
+  cond_.notify_all();
+  return true;
+}
+
+void OnlineTuner::Cancel(const void* owner) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto iter = jobs_.begin(); iter != jobs_.end();) {
+    if (iter->owner == owner) {
+      // another owner of the same shape may submit it again
+      submitted_.erase(iter->key);
+      iter = jobs_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  cond_.wait(lock, [&] { return !running_ || running_owner_ != owner; });
+}
+
+void OnlineTuner::Drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [&] { return jobs_.empty() && !running_; });
+}
+
+size_t OnlineTuner::pending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size() + (running_ ? 1 : 0);
+}
+
+void OnlineTuner::Work() {
+#ifdef __linux__
+  // niceness is per thread on linux and inherited by the threads the kernels spawn from here
+  if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19) != 0) {
+    DLOG(INFO) << "Failed to lower the priority of the online tuning thread";
+  }
+#endif
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+      if (stop_) return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+      running_ = true;
+      running_owner_ = job.owner;
+    }
+    try {
+      std::vector<std::string> kernel_config = job.tune();
+      if (!kernel_config.empty()) {
+        job.promote(kernel_config);
+        generation_.fetch_add(1, std::memory_order_release);
+        LOG(INFO) << "Online tuning promoted kernel " << kernel_config[0] << " for " << job.key;
+      }
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "Online tuning of " << job.key << " failed: " << e.what();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+      running_owner_ = nullptr;
+    }
+    cond_.notify_all();
+  }
+}
+
+}  // namespace executor
@@ -30,7 +30,7 @@ ConvolutionOperator::ConvolutionOperator(const shared_ptr<OperatorConfig>& conf)
       output_scale_(1.),
       format_any_(true),
       gelu_split_(false),
-      weight_cached_(false),
+      bias_cached_(false),
       has_bias_(false) {
   auto attrs_map = operator_conf_->attributes();
   auto iter = attrs_map.find("src_perm");
@@ -327,6 +327,7 @@ void ConvolutionOperator::Prepare(const vector<Tensor*>& input, const vector<Ten
   any_weight_md_ = memory::desc(weight_shape_m, type2mem[weight_->dtype()], memory::format_tag::any);
   weight_md_ = memory::desc(weight_shape_m, type2mem[weight_->dtype()], weight_stride_m);
   weight_m_ = memory(weight_md_, eng_, weight_->mutable_data());
+  reordered_weight_m_.clear();
 
   if (bias_ != nullptr) {
     const vector<int64_t> bias_shape = bias_->shape();
@@ -350,7 +351,63 @@ void ConvolutionOperator::DstReshapeFusion(const vector<Tensor*>& input, const v
 }
 
 // 1. Create primitive
+bool ConvolutionOperator::ReshapeFromPlan(const vector<Tensor*>& input, const vector<Tensor*>& output,
+                                          size_t plan_key) {
+  if (!plans_.enabled()) return false;
+  Plan* plan = plans_.Get(plan_key);
+  record_plan_cache(plan != nullptr);
+  if (plan == nullptr) return false;
+  if (dispatch_from_.empty()) src_->set_shape(plan->src_shape);
+  dst_->set_shape(plan->dst_shape);
+  if (output.size() > 1) {
+    dst_min_->set_shape({1});
+    dst_max_->set_shape({1});
+  }
+  convolution_pd_ = plan->convolution_pd;
+  convolution_p_ = plan->convolution_p;
+  memory_args_ = plan->memory_args;
+  src_m_ = plan->src_m;
+  dst_m_ = plan->dst_m;
+  binary_m_ = plan->binary_m;
+  gelu_pd_ = plan->gelu_pd;
+  gelu_p_ = plan->gelu_p;
+  gelu_m_ = plan->gelu_m;
+  BindScratchpad(convolution_pd_.scratchpad_desc());
+  DstReshapeFusion(input, output);
+  return true;
+}
+
+memory ConvolutionOperator::ReorderedWeight(const memory::desc& weights_md) {
+  if (weights_md == weight_m_.get_desc()) return weight_m_;
+  // plans of the shapes whose primitives take the same weight layout share one reordered copy
+  for (const auto& reordered : reordered_weight_m_) {
+    if (reordered.get_desc() == weights_md) return reordered;
+  }
+  memory reordered = memory(weights_md, eng_);
+  dnnl::reorder(weight_m_, reordered).execute(eng_stream_, weight_m_, reordered);
+  reordered_weight_m_.push_back(reordered);
+  return reordered;
+}
+
+void ConvolutionOperator::BindScratchpad(const memory::desc& scratchpad_md) {
+  // all plans share one scratchpad which only grows
+  size_t scratchpad_size = (scratchpad_md.get_size() / ALIGNMENT + 1) * ALIGNMENT;
+  if (scratchpad_ == nullptr || scratchpad_size > scratchpad_size_) {
+    if (scratchpad_) aligned_free(scratchpad_);
+    scratchpad_ = reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, scratchpad_size));
+    scratchpad_size_ = scratchpad_size;
+  }
+  memory_args_[DNNL_ARG_SCRATCHPAD] = memory(scratchpad_md, eng_, scratchpad_);
+}
+
 void ConvolutionOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  // a convolution dispatched from InnerProduct reorders its weight in every Reshape, the plan keeps the result
+  size_t plan_key = get_array_hash(0, src_->shape(), src_->shape().size());
+  plan_key = get_array_hash(plan_key, src_perm_, src_perm_.size());
+  for (const auto& config : dispatch_config_) plan_key = hash_combine(plan_key, config);
+  if (binary_add_ && post_ != nullptr) plan_key = get_array_hash(plan_key, post_->shape(), post_->shape().size());
+  if (ReshapeFromPlan(input, output, plan_key)) return;
+
   // Part1: Derive operator's user proper shape and strides
   // 1.1 Transpose tensor shape and get it
   vector<int64_t> src_shape_origin;
@@ -547,27 +604,13 @@ void ConvolutionOperator::Reshape(const vector<Tensor*>& input, const vector<Ten
   }
 
   convolution_pd_ = dnnl::convolution_forward::primitive_desc(convolution_d, attr_, eng_);
-  memory::desc scratchpad_md = convolution_pd_.scratchpad_desc();
-  if (scratchpad_) {
-    aligned_free(scratchpad_);
-    scratchpad_ = nullptr;
-  }
-
-  scratchpad_ =
-      reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, (scratchpad_md.get_size() / ALIGNMENT + 1) * ALIGNMENT));
-  memory scratchpad_m = memory(scratchpad_md, eng_, scratchpad_);
-  memory_args_[DNNL_ARG_SCRATCHPAD] = scratchpad_m;
+  BindScratchpad(convolution_pd_.scratchpad_desc());
 
   // 2.4 Prepare memory objects (cached)
   src_m_ = memory(src_md, eng_, DNNL_MEMORY_NONE);
   dst_m_ = memory(dst_md, eng_, DNNL_MEMORY_NONE);
-  if (!weight_cached_) {
-    memory any_weight_m = weight_m_;
-    if (convolution_pd_.weights_desc() != weight_m_.get_desc()) {
-      any_weight_m = memory(convolution_pd_.weights_desc(), eng_);
-      dnnl::reorder(weight_m_, any_weight_m).execute(eng_stream_, weight_m_, any_weight_m);
-    }
-    memory_args_[DNNL_ARG_WEIGHTS] = any_weight_m;
+  memory_args_[DNNL_ARG_WEIGHTS] = ReorderedWeight(convolution_pd_.weights_desc());
+  if (!bias_cached_) {
     if (!is_dynamic_ && has_bias_) {
       memory any_bias_m = bias_m_;
       if (convolution_pd_.bias_desc() != bias_m_.get_desc()) {
@@ -576,7 +619,7 @@ void ConvolutionOperator::Reshape(const vector<Tensor*>& input, const vector<Ten
       }
       memory_args_[DNNL_ARG_BIAS] = any_bias_m;
     }
-    weight_cached_ = (dispatch_from_ == "InnerProduct") ? false : true;
+    bias_cached_ = (dispatch_from_ == "InnerProduct") ? false : true;
   }
 
   // If the convolution forward class in the cache pool, just get it from the pool.
@@ -591,6 +634,8 @@ void ConvolutionOperator::Reshape(const vector<Tensor*>& input, const vector<Ten
     convolution_p_ = dnnl::convolution_forward(convolution_pd_);
     ConvolutionPrimitiveFwdFactory::Set(key, convolution_p_);
   }
+  plans_.Put(plan_key, {src_shape, dst_->shape(), convolution_pd_, convolution_p_, memory_args_, src_m_, dst_m_,
+                        binary_m_, gelu_pd_, gelu_p_, gelu_m_});
   DstReshapeFusion(input, output);
 }
 
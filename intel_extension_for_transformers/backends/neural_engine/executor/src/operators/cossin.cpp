@@ -16,185 +16,156 @@
 
 namespace executor {
 
-CosSinOperator::CosSinOperator(const shared_ptr<OperatorConfig>& conf) : Operator(conf) {
-  auto attrs_map = operator_conf_->attributes();
-  auto iter = attrs_map.find("algorithm");
-  if (iter != attrs_map.end()) {
-    algorithm_ = iter->second;
-  }
-}
-
-CosSinOperator::~CosSinOperator() {}
-
-void CosSinOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) {
-  //// Part1: Derive operator's user proper shape and strides
-  // 1.1: Prepare Tensor origin shape
-  vector<int64_t> src_shape = input[0]->shape();
-
-  // 1.2 Get tensor's adjusted shapes
-  // dst shape
-  output[0]->set_shape(src_shape);
-  output[0]->set_dtype(output_dtype_);
-  array_size_ = input[0]->size();
-}
-
-#define PS256_CONST(Name, Val) static const auto ps256_##Name = _mm256_set1_ps(Val)
-#define PI32_CONST256(Name, Val) static const auto pi256_##Name = _mm256_set1_epi32(Val)
-
-PS256_CONST(1, 1.0f);
-PS256_CONST(0p5, 0.5f);
-PI32_CONST256(0, 0);
-PI32_CONST256(1, 1);
-PI32_CONST256(2, 2);
-PI32_CONST256(4, 4);
-
-PI32_CONST256(inv1, ~1);
-PI32_CONST256(sign_mask, 0x80000000);
-PI32_CONST256(inv_sign_mask, ~0x80000000);
-
-PS256_CONST(minus_cephes_DP1, -0.78515625);
-PS256_CONST(minus_cephes_DP2, -2.4187564849853515625e-4);
-PS256_CONST(minus_cephes_DP3, -3.77489497744594108e-8);
-PS256_CONST(sincof_p0, -1.9515295891E-4);
-PS256_CONST(sincof_p1, 8.3321608736E-3);
-PS256_CONST(sincof_p2, -1.6666654611E-1);
-PS256_CONST(coscof_p0, 2.443315711809948E-005);
-PS256_CONST(coscof_p1, -1.388731625493765E-003);
-PS256_CONST(coscof_p2, 4.166664568298827E-002);
-PS256_CONST(cephes_FOPI, 1.27323954473516);
-
-PI32_CONST256(min_norm_pos, 0x00800000);
-PI32_CONST256(inv_mant_mask, ~0x7f800000);
-
-PI32_CONST256(0x7f, 0x7f);
-
-// evaluation of 8 sines at onces using AVX intrisics
-__m256 sinf(__m256 x) {
-  __m256 sign_bit = x;
+// The cephes sinf/cosf, 8 or 16 at once. cos(x) is evaluated as the sine polynom of the octant two ahead of x.
+#define CEPHES_DP1 -0.78515625f
+#define CEPHES_DP2 -2.4187564849853515625e-4f
+#define CEPHES_DP3 -3.77489497744594108e-8f
+#define CEPHES_SINCOF_P0 -1.9515295891E-4f
+#define CEPHES_SINCOF_P1 8.3321608736E-3f
+#define CEPHES_SINCOF_P2 -1.6666654611E-1f
+#define CEPHES_COSCOF_P0 2.443315711809948E-005f
+#define CEPHES_COSCOF_P1 -1.388731625493765E-003f
+#define CEPHES_COSCOF_P2 4.166664568298827E-002f
+#define CEPHES_FOPI 1.27323954473516f
+
+template <bool is_cos>
+NE_TARGET_AVX2 static inline __m256 sincos_avx2(__m256 x) {
+  const __m256i sign_mask = _mm256_set1_epi32(0x80000000);
+  // cos is even, sin takes the sign of x
+  __m256 sign_bit = is_cos ? _mm256_setzero_ps() : _mm256_and_ps(x, _mm256_castsi256_ps(sign_mask));
   // take the absolute value
-  x = _mm256_and_ps(x, _mm256_castsi256_ps(pi256_inv_sign_mask));
-  // extract the sign bit (upper one)
-  sign_bit = _mm256_and_ps(sign_bit, _mm256_castsi256_ps(pi256_sign_mask));
-
-  // scale by 4/Pi
-  __m256 y = _mm256_mul_ps(x, ps256_cephes_FOPI);
-
-  // store the integer part of y in mm0
-  __m256i imm2 = _mm256_cvttps_epi32(y);
-
-  // j=(j+1) & (~1) (see the cephes sources)
-  imm2 = _mm256_add_epi32(imm2, pi256_1);
-  imm2 = _mm256_and_si256(imm2, pi256_inv1);
-  y = _mm256_cvtepi32_ps(imm2);
-
-  // get the swap sign flag
-  __m256i imm0 = _mm256_and_si256(imm2, pi256_4);
+  x = _mm256_andnot_ps(_mm256_castsi256_ps(sign_mask), x);
+
+  // scale by 4/Pi, j=(j+1) & (~1) (see the cephes sources)
+  __m256i imm2 = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(CEPHES_FOPI)));
+  imm2 = _mm256_add_epi32(imm2, _mm256_set1_epi32(1));
+  imm2 = _mm256_and_si256(imm2, _mm256_set1_epi32(~1));
+  __m256 y = _mm256_cvtepi32_ps(imm2);
+  if (is_cos) imm2 = _mm256_sub_epi32(imm2, _mm256_set1_epi32(2));
+
+  // get the swap sign flag and the polynom selection mask
+  const __m256i four = _mm256_set1_epi32(4);
+  __m256i imm0 = is_cos ? _mm256_andnot_si256(imm2, four) : _mm256_and_si256(imm2, four);
   imm0 = _mm256_slli_epi32(imm0, 29);
-
-  imm2 = _mm256_and_si256(imm2, pi256_2);
-  imm2 = _mm256_cmpeq_epi32(imm2, pi256_0);
-
-  __m256 swap_sign_bit = _mm256_castsi256_ps(imm0);
+  imm2 = _mm256_and_si256(imm2, _mm256_set1_epi32(2));
+  imm2 = _mm256_cmpeq_epi32(imm2, _mm256_setzero_si256());
+  sign_bit = _mm256_xor_ps(sign_bit, _mm256_castsi256_ps(imm0));
   __m256 poly_mask = _mm256_castsi256_ps(imm2);
-  sign_bit = _mm256_xor_ps(sign_bit, swap_sign_bit);
 
-  // x = ((x - y * DP1) - y * DP2) - y * DP3;
-  x = _mm256_add_ps(x, _mm256_mul_ps(y, ps256_minus_cephes_DP1));
-  x = _mm256_add_ps(x, _mm256_mul_ps(y, ps256_minus_cephes_DP2));
-  x = _mm256_add_ps(x, _mm256_mul_ps(y, ps256_minus_cephes_DP3));
+  // x = ((x - y * DP1) - y * DP2) - y * DP3
+  x = _mm256_fmadd_ps(y, _mm256_set1_ps(CEPHES_DP1), x);
+  x = _mm256_fmadd_ps(y, _mm256_set1_ps(CEPHES_DP2), x);
+  x = _mm256_fmadd_ps(y, _mm256_set1_ps(CEPHES_DP3), x);
 
   // Evaluate the first polynom  (0 <= x <= Pi/4)
   __m256 z = _mm256_mul_ps(x, x);
-
-  y = _mm256_mul_ps(ps256_coscof_p0, z);
-  y = _mm256_add_ps(y, ps256_coscof_p1);
-  y = _mm256_mul_ps(y, z);
-  y = _mm256_add_ps(y, ps256_coscof_p2);
-  y = _mm256_mul_ps(y, z);
-  y = _mm256_mul_ps(y, z);
-  y = _mm256_sub_ps(y, _mm256_mul_ps(z, ps256_0p5));
-  y = _mm256_add_ps(y, ps256_1);
+  y = _mm256_fmadd_ps(_mm256_set1_ps(CEPHES_COSCOF_P0), z, _mm256_set1_ps(CEPHES_COSCOF_P1));
+  y = _mm256_fmadd_ps(y, z, _mm256_set1_ps(CEPHES_COSCOF_P2));
+  y = _mm256_mul_ps(_mm256_mul_ps(y, z), z);
+  y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+  y = _mm256_add_ps(y, _mm256_set1_ps(1.f));
 
   // Evaluate the second polynom  (Pi/4 <= x <= 0)
-
-  __m256 y2 = _mm256_mul_ps(ps256_sincof_p0, z);
-  y2 = _mm256_add_ps(y2, ps256_sincof_p1);
+  __m256 y2 = _mm256_fmadd_ps(_mm256_set1_ps(CEPHES_SINCOF_P0), z, _mm256_set1_ps(CEPHES_SINCOF_P1));
+  y2 = _mm256_fmadd_ps(y2, z, _mm256_set1_ps(CEPHES_SINCOF_P2));
   y2 = _mm256_mul_ps(y2, z);
-  y2 = _mm256_add_ps(y2, ps256_sincof_p2);
-  y2 = _mm256_mul_ps(y2, z);
-  y2 = _mm256_mul_ps(y2, x);
-  y2 = _mm256_add_ps(y2, x);
-
-  // select the correct result from the two polynoms
-  y2 = _mm256_and_ps(poly_mask, y2);
-  y = _mm256_andnot_ps(poly_mask, y);
-  y = _mm256_add_ps(y, y2);
-  // update the sign
-  y = _mm256_xor_ps(y, sign_bit);
+  y2 = _mm256_fmadd_ps(y2, x, x);
 
-  return y;
+  // select the correct result from the two polynoms and update the sign
+  y = _mm256_blendv_ps(y, y2, poly_mask);
+  return _mm256_xor_ps(y, sign_bit);
 }
 
-__m256 cosf(__m256 x) {
-  // take the absolute value
-  x = _mm256_and_ps(x, _mm256_castsi256_ps(pi256_inv_sign_mask));
-
-  // scale by 4/Pi
-  __m256 y = _mm256_mul_ps(x, ps256_cephes_FOPI);
-
-  // store the integer part of y in mm0
-  __m256i imm2 = _mm256_cvttps_epi32(y);
-
-  // j=(j+1) & (~1) (see the cephes sources)
-  imm2 = _mm256_add_epi32(imm2, pi256_1);
-  imm2 = _mm256_and_si256(imm2, pi256_inv1);
-  y = _mm256_cvtepi32_ps(imm2);
-  imm2 = _mm256_sub_epi32(imm2, pi256_2);
+template <bool is_cos>
+NE_TARGET_AVX512 static inline __m512 sincos_avx512(__m512 x) {
+  const __m512i sign_mask = _mm512_set1_epi32(0x80000000);
+  __m512i sign_bit = is_cos ? _mm512_setzero_si512() : _mm512_and_si512(_mm512_castps_si512(x), sign_mask);
+  x = _mm512_castsi512_ps(_mm512_andnot_si512(sign_mask, _mm512_castps_si512(x)));
+
+  __m512i imm2 = _mm512_cvttps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(CEPHES_FOPI)));
+  imm2 = _mm512_add_epi32(imm2, _mm512_set1_epi32(1));
+  imm2 = _mm512_and_si512(imm2, _mm512_set1_epi32(~1));
+  __m512 y = _mm512_cvtepi32_ps(imm2);
+  if (is_cos) imm2 = _mm512_sub_epi32(imm2, _mm512_set1_epi32(2));
+
+  const __m512i four = _mm512_set1_epi32(4);
+  __m512i imm0 = is_cos ? _mm512_andnot_si512(imm2, four) : _mm512_and_si512(imm2, four);
+  sign_bit = _mm512_xor_si512(sign_bit, _mm512_slli_epi32(imm0, 29));
+  __mmask16 poly_mask = _mm512_testn_epi32_mask(imm2, _mm512_set1_epi32(2));
+
+  x = _mm512_fmadd_ps(y, _mm512_set1_ps(CEPHES_DP1), x);
+  x = _mm512_fmadd_ps(y, _mm512_set1_ps(CEPHES_DP2), x);
+  x = _mm512_fmadd_ps(y, _mm512_set1_ps(CEPHES_DP3), x);
+
+  __m512 z = _mm512_mul_ps(x, x);
+  y = _mm512_fmadd_ps(_mm512_set1_ps(CEPHES_COSCOF_P0), z, _mm512_set1_ps(CEPHES_COSCOF_P1));
+  y = _mm512_fmadd_ps(y, z, _mm512_set1_ps(CEPHES_COSCOF_P2));
+  y = _mm512_mul_ps(_mm512_mul_ps(y, z), z);
+  y = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y);
+  y = _mm512_add_ps(y, _mm512_set1_ps(1.f));
+
+  __m512 y2 = _mm512_fmadd_ps(_mm512_set1_ps(CEPHES_SINCOF_P0), z, _mm512_set1_ps(CEPHES_SINCOF_P1));
+  y2 = _mm512_fmadd_ps(y2, z, _mm512_set1_ps(CEPHES_SINCOF_P2));
+  y2 = _mm512_mul_ps(y2, z);
+  y2 = _mm512_fmadd_ps(y2, x, x);
+
+  y = _mm512_mask_blend_ps(poly_mask, y, y2);
+  return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(y), sign_bit));
+}
 
-  // get the swap sign flag
-  __m256i imm0 = _mm256_andnot_si256(imm2, pi256_4);
-  imm0 = _mm256_slli_epi32(imm0, 29);
+template <bool is_cos>
+NE_TARGET_AVX2 static void sincos_avx2_ker(const float* src, float* dst, int64_t len) {
+  int64_t i = 0;
+  for (; i + 8 <= len; i += 8) _mm256_storeu_ps(dst + i, sincos_avx2<is_cos>(_mm256_loadu_ps(src + i)));
+  for (; i < len; ++i) dst[i] = is_cos ? std::cos(src[i]) : std::sin(src[i]);
+}
 
-  // get the polynom selection mask
-  imm2 = _mm256_and_si256(imm2, pi256_2);
-  imm2 = _mm256_cmpeq_epi32(imm2, pi256_0);
+template <bool is_cos>
+NE_TARGET_AVX512 static void sincos_avx512_ker(const float* src, float* dst, int64_t len) {
+  int64_t i = 0;
+  for (; i + 16 <= len; i += 16) _mm512_storeu_ps(dst + i, sincos_avx512<is_cos>(_mm512_loadu_ps(src + i)));
+  if (i < len) {
+    __mmask16 tail = (1 << (len - i)) - 1;
+    _mm512_mask_storeu_ps(dst + i, tail, sincos_avx512<is_cos>(_mm512_maskz_loadu_ps(tail, src + i)));
+  }
+}
 
-  __m256 sign_bit = _mm256_castsi256_ps(imm0);
-  __m256 poly_mask = _mm256_castsi256_ps(imm2);
+template <bool is_cos>
+static void sincos_scalar_ker(const float* src, float* dst, int64_t len) {
+  for (int64_t i = 0; i < len; ++i) dst[i] = is_cos ? std::cos(src[i]) : std::sin(src[i]);
+}
 
-  // x = ((x - y * DP1) - y * DP2) - y * DP3
-  x = _mm256_add_ps(x, _mm256_mul_ps(y, ps256_minus_cephes_DP1));
-  x = _mm256_add_ps(x, _mm256_mul_ps(y, ps256_minus_cephes_DP2));
-  x = _mm256_add_ps(x, _mm256_mul_ps(y, ps256_minus_cephes_DP3));
+CosSinOperator::CosSinOperator(const shared_ptr<OperatorConfig>& conf) : Operator(conf) {
+  auto attrs_map = operator_conf_->attributes();
+  auto iter = attrs_map.find("algorithm");
+  if (iter != attrs_map.end()) {
+    algorithm_ = iter->second;
+  }
+  const bool is_cos = algorithm_ != "sin";
+  switch (RuntimeIsa()) {
+    case Isa::kAvx512:
+      kernel_ = is_cos ? sincos_avx512_ker<true> : sincos_avx512_ker<false>;
+      break;
+    case Isa::kAvx2:
+      kernel_ = is_cos ? sincos_avx2_ker<true> : sincos_avx2_ker<false>;
+      break;
+    default:
+      kernel_ = is_cos ? sincos_scalar_ker<true> : sincos_scalar_ker<false>;
+  }
+}
 
-  // Evaluate the first polynom  (0 <= x <= Pi/4)
-  __m256 z = _mm256_mul_ps(x, x);
+CosSinOperator::~CosSinOperator() {}
 
-  y = _mm256_mul_ps(ps256_coscof_p0, z);
-  y = _mm256_add_ps(y, ps256_coscof_p1);
-  y = _mm256_mul_ps(y, z);
-  y = _mm256_add_ps(y, ps256_coscof_p2);
-  y = _mm256_mul_ps(y, z);
-  y = _mm256_mul_ps(y, z);
-  y = _mm256_sub_ps(y, _mm256_mul_ps(z, ps256_0p5));
-  y = _mm256_add_ps(y, ps256_1);
+void CosSinOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  //// Part1: Derive operator's user proper shape and strides
+  // 1.1: Prepare Tensor origin shape
+  vector<int64_t> src_shape = input[0]->shape();
 
-  // Evaluate the second polynom  (Pi/4 <= x <= 0)
-  __m256 y2 = _mm256_mul_ps(ps256_sincof_p0, z);
-  y2 = _mm256_add_ps(y2, ps256_sincof_p1);
-  y2 = _mm256_mul_ps(y2, z);
-  y2 = _mm256_add_ps(y2, ps256_sincof_p2);
-  y2 = _mm256_mul_ps(y2, z);
-  y2 = _mm256_mul_ps(y2, x);
-  y2 = _mm256_add_ps(y2, x);
-
-  // select the correct result from the two polynoms
-  y2 = _mm256_and_ps(poly_mask, y2);
-  y = _mm256_andnot_ps(poly_mask, y);
-  y = _mm256_add_ps(y, y2);
-  // update the sign
-  y = _mm256_xor_ps(y, sign_bit);
-  return y;
+  // 1.2 Get tensor's adjusted shapes
+  // dst shape
+  output[0]->set_shape(src_shape);
+  output[0]->set_dtype(output_dtype_);
+  array_size_ = input[0]->size();
 }
 
 // 2. inference kernel(for int8 and f32)
@@ -203,29 +174,13 @@ void CosSinOperator::Forward(const vector<Tensor*>& input, const vector<Tensor*>
   Tensor* dst = output[0];
   const float* src_data = static_cast<const float*>(src->data());
   float* dst_data = static_cast<float*>(dst->mutable_data());
-  // Tail should equals 0
-  int tail = input[0]->size() % 8;
-  int batch = input[0]->size() / 8;
-
-#if __AVX2__
-  if (algorithm_ == "sin") {
-#pragma omp parallel for
-    for (int i = 0; i < batch; ++i) {
-      __m256 p = _mm256_load_ps(src_data + i * 8);
-      __m256 c = sinf(p);
-      _mm256_storeu_ps(dst_data + i * 8, c);
-    }
-  } else {
+  // blocks of whole cache lines for the threads
+  constexpr int64_t kBlock = 1024;
+  const int64_t size = src->size();
 #pragma omp parallel for
-    for (int i = 0; i < batch; ++i) {
-      __m256 p = _mm256_load_ps(src_data + i * 8);
-      __m256 c = cosf(p);
-      _mm256_storeu_ps(dst_data + i * 8, c);
-    }
+  for (int64_t i = 0; i < size; i += kBlock) {
+    kernel_(src_data + i, dst_data + i, std::min(kBlock, size - i));
   }
-#else
-  LOG(ERROR) << "No AVX2";
-#endif
   this->unref_tensors(input);
 }
 
@@ -14,10 +14,13 @@
 
 #include "dequantize.hpp"
 
+#include <type_traits>
+
 namespace executor {
 
 void DequantizeLinearOperator::Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   output[0]->set_dtype("fp32");
+  isa_ = RuntimeIsa();
 }
 
 void DequantizeLinearOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) {
@@ -31,6 +34,41 @@ void DequantizeLinearOperator::Reshape(const vector<Tensor*>& input, const vecto
   }
 }
 
+// dst = (src - zero_point) * scale of a per-tensor quantized u8/s8 block, one variant per isa
+template <typename T>
+static void dequantize_scalar(const T* src, float* dst, int64_t len, float scale, T zero_point) {
+  for (int64_t i = 0; i < len; ++i) dst[i] = (src[i] - zero_point) * scale;
+}
+
+template <typename T>
+NE_TARGET_AVX2 static void dequantize_avx2(const T* src, float* dst, int64_t len, float scale, T zero_point) {
+  const __m256 _scale = _mm256_set1_ps(scale);
+  const __m256 _zero_point = _mm256_set1_ps(zero_point * scale);
+  int64_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m128i _src_data_8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    __m256i _src_data_32 = std::is_same<T, int8_t>::value ? _mm256_cvtepi8_epi32(_src_data_8)
+                                                          : _mm256_cvtepu8_epi32(_src_data_8);
+    __m256 data = _mm256_fmsub_ps(_mm256_cvtepi32_ps(_src_data_32), _scale, _zero_point);
+    _mm256_storeu_ps(dst + i, data);
+  }
+  dequantize_scalar(src + i, dst + i, len - i, scale, zero_point);
+}
+
+template <typename T>
+NE_TARGET_AVX512 static void dequantize_avx512(const T* src, float* dst, int64_t len, float scale, T zero_point) {
+  const __m512 _scale = _mm512_set1_ps(scale);
+  const __m512 _zero_point = _mm512_set1_ps(zero_point * scale);
+  for (int64_t i = 0; i < len; i += 16) {
+    __mmask16 mask = len - i >= 16 ? 0xffff : (1 << (len - i)) - 1;
+    __m128i _src_data_8 = _mm_maskz_loadu_epi8(mask, src + i);
+    __m512i _src_data_32 = std::is_same<T, int8_t>::value ? _mm512_cvtepi8_epi32(_src_data_8)
+                                                          : _mm512_cvtepu8_epi32(_src_data_8);
+    __m512 data = _mm512_fmsub_ps(_mm512_cvtepi32_ps(_src_data_32), _scale, _zero_point);
+    _mm512_mask_storeu_ps(dst + i, mask, data);
+  }
+}
+
 template <typename T>
 void DequantizeLinearOperator::ForwardImpl(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   auto src0_data = static_cast<const T*>(input[0]->data());
@@ -38,32 +76,23 @@ void DequantizeLinearOperator::ForwardImpl(const vector<Tensor*>& input, const v
   const T* src2_data = has_zp_ ? static_cast<const T*>(input[2]->data()) : nullptr;
   auto dst_data = static_cast<float*>(output[0]->mutable_data());
 
-#if __AVX512F__
   if (scales_size_ == 1) {
-    int avx512_loop_len = size_ >> 4;
-    __m512 _scale = _mm512_set1_ps(src1_data[0]);
-    T zero_point = has_zp_ ? src2_data[0] : 0;
-    __m512 _zero_point = _mm512_set1_ps(zero_point * src1_data[0]);
+    const float scale = src1_data[0];
+    const T zero_point = has_zp_ ? src2_data[0] : 0;
+    constexpr int64_t kBlock = 4096;
 #pragma omp parallel for
-    for (int i = 0; i < avx512_loop_len; ++i) {
-      __m128i _src_data_8 = _mm_loadu_si128((const __m128i *)(src0_data + (i << 4)));
-      __m512i _src_data_32 = _mm512_setzero_epi32();
-      if (typeid(T) == typeid(int8_t)) {
-        _src_data_32 = _mm512_cvtepi8_epi32(_src_data_8);
-      } else if (typeid(T) == typeid(uint8_t)) {
-        _src_data_32 = _mm512_cvtepu8_epi32(_src_data_8);
+    for (int64_t i = 0; i < size_; i += kBlock) {
+      const int64_t len = std::min<int64_t>(kBlock, size_ - i);
+      if (isa_ == Isa::kAvx512) {
+        dequantize_avx512(src0_data + i, dst_data + i, len, scale, zero_point);
+      } else if (isa_ == Isa::kAvx2) {
+        dequantize_avx2(src0_data + i, dst_data + i, len, scale, zero_point);
+      } else {
+        dequantize_scalar(src0_data + i, dst_data + i, len, scale, zero_point);
       }
-      __m512 _src_data = _mm512_cvtepi32_ps(_src_data_32);
-      __m512 data = _mm512_fmsub_ps(_src_data, _scale, _zero_point);
-      _mm512_storeu_ps(reinterpret_cast<__m512*>(dst_data + (i << 4)), data);
-    }
-#pragma omp parallel for
-    for (int i = (avx512_loop_len << 4); i < size_; i++) {
-      dst_data[i] = (src0_data[i] - zero_point) * src1_data[0];
     }
     return;
   }
-#endif
 
 #pragma omp parallel for
   for (int out_idx = 0; out_idx < size_; out_idx++) {
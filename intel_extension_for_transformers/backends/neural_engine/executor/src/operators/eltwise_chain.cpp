@@ -0,0 +1,146 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "eltwise_chain.hpp"
+
+#include <sstream>
+
+#include "common.hpp"
+
+namespace executor {
+
+namespace {
+string Linear(float alpha, float beta) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "linear:%.9g:%.9g", alpha, beta);
+  return buf;
+}
+
+// a constant fp32 tensor of one element, like the 0.5 of `x * 0.5`
+bool ConstScalar(Tensor* tensor, float* value) {
+  if (tensor->location().empty() || tensor->size() != 1 || tensor->dtype() != "fp32") return false;
+  *value = *static_cast<const float*>(tensor->data());
+  return true;
+}
+}  // namespace
+
+EltwiseChainOperator::EltwiseChainOperator(const shared_ptr<OperatorConfig>& conf) : Operator(conf) {
+  static std::map<string, jd::postop_alg> name2alg{{"gelu", jd::postop_alg::gelu},
+                                                   {"exp", jd::postop_alg::exp},
+                                                   {"tanh", jd::postop_alg::tanh},
+                                                   {"linear", jd::postop_alg::linear}};
+  auto attrs_map = operator_conf_->attributes();
+  std::stringstream steps(attrs_map["postops"]);
+  string step;
+  while (std::getline(steps, step, '+')) {
+    std::stringstream fields(step);
+    string name;
+    std::getline(fields, name, ':');
+    vector<float> args;
+    string arg;
+    while (std::getline(fields, arg, ':')) args.push_back(StringToNum<float>(arg));
+    args.resize(2, 0.f);
+    auto iter = name2alg.find(name);
+    if (iter == name2alg.end()) {
+      LOG(ERROR) << "EltwiseChain step " << name << " is not supported.";
+      continue;
+    }
+    postops_.emplace_back(jd::data_type::fp32, jd::postop_type::eltwise, iter->second, args[0], args[1]);
+  }
+}
+
+string EltwiseChainOperator::Lower(const string& type, const std::map<string, string>& attrs,
+                                   const vector<Tensor*>& input, const vector<Tensor*>& output, int* data_input) {
+  *data_input = 0;
+  if (output.size() != 1 || output[0]->dtype() != "fp32") return "";
+  auto attr = [&](const string& key) {
+    auto iter = attrs.find(key);
+    return iter == attrs.end() ? string() : iter->second;
+  };
+  if (input.size() == 1) {
+    if (input[0]->dtype() != "fp32") return "";
+    if (type == "Gelu" && (attr("algorithm").empty() || attr("algorithm") == "gelu_tanh")) return "gelu";
+    if (type == "Exp") return "exp";
+    // 1 / (1 + e^-x) = 0.5 * tanh(0.5 * x) + 0.5
+    if (type == "Sigmoid") return "linear:0.5:0+tanh+linear:0.5:0.5";
+    return "";
+  }
+  if ((type != "BinaryAdd" && type != "BinaryOp") || input.size() != 2 || !attr("append_op").empty()) return "";
+  float c;
+  int scalar = ConstScalar(input[1], &c) ? 1 : (ConstScalar(input[0], &c) ? 0 : -1);
+  if (scalar < 0) return "";
+  *data_input = 1 - scalar;
+  const Tensor* data = input[*data_input];
+  // the output has to be the shape of the data input
+  if (data->dtype() != "fp32" || input[scalar]->shape().size() > data->shape().size()) return "";
+  string algorithm = attr("algorithm");
+  if (algorithm.empty() && type == "BinaryAdd") algorithm = "add";
+  if (algorithm == "add") return Linear(1.f, c);
+  if (algorithm == "mul") return Linear(c, 0.f);
+  if (algorithm == "sub") return scalar == 1 ? Linear(1.f, -c) : Linear(-1.f, c);
+  if (algorithm == "div" && scalar == 1 && c != 0.f) return Linear(1.f / c, 0.f);
+  return "";
+}
+
+void EltwiseChainOperator::Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  if (input[0]->dtype() != "fp32") {
+    LOG(ERROR) << "dtype " << input[0]->dtype() << " is not supported by EltwiseChain.";
+  }
+  output[0]->set_dtype(input[0]->dtype());
+}
+
+void EltwiseChainOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  const vector<int64_t>& shape = input[0]->shape();
+  output[0]->set_shape(shape);
+  jd::tensor_desc src_desc = {shape, jd::data_type::fp32, jd::format_type::undef};
+  jd::tensor_desc dst_desc = {shape, jd::data_type::fp32, jd::format_type::undef};
+  vector<jd::tensor_desc> ts_descs = {src_desc, dst_desc};
+  std::unordered_map<string, string> op_attrs;
+  jd::operator_desc op_desc(jd::kernel_kind::eltwiseop, jd::kernel_prop::forward_inference, jd::engine_kind::cpu,
+                            ts_descs, op_attrs, postops_);
+  jd::eltwiseop_desc eltwiseop_desc(op_desc);
+  eltwise_ker_ = jd::eltwiseop(eltwiseop_desc);
+}
+
+vector<vector<string>> EltwiseChainOperator::InplacePairs(const vector<Tensor*>& input,
+                                                          const vector<Tensor*>& output) {
+  vector<vector<string>> inplace_pairs;
+  // skip inplace in debug mode
+  if (this->get_execution_mode() == ExecutionMode::DEBUG) {
+    return inplace_pairs;
+  }
+  // input[0] -> output[0]
+  if (input[0]->left_life() == 1) {
+    inplace_pairs.emplace_back(vector<string>({input[0]->name(), output[0]->name()}));
+  }
+  return inplace_pairs;
+}
+
+void EltwiseChainOperator::Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  Tensor* src_ptr = input[0];
+  Tensor* dst_ptr = output[0];
+  void* src_data = src_ptr->mutable_data();
+  vector<Tensor*> inputs(input);
+  if (src_ptr->left_life() == 1 && this->get_execution_mode() != ExecutionMode::DEBUG) {
+    src_ptr->unref_data(true);
+    dst_ptr->set_data(src_data);
+    inputs = {};
+  }
+  std::vector<const void*> runtime_data = {src_data, dst_ptr->mutable_data()};
+  eltwise_ker_.execute(runtime_data);
+  this->unref_tensors(inputs);
+}
+
+REGISTER_OPERATOR_CLASS(EltwiseChain);
+}  // namespace executor
@@ -20,6 +20,7 @@
 #include "engine_factory.hpp"
 #include "model.hpp"
 #include "kernels/exposed_enum.hpp"
+#include "weight_disk_cache.hpp"
 
 namespace executor {
 
@@ -211,6 +212,20 @@ void InnerProductOperator::MapTensors(const vector<Tensor*>& input, const vector
   }
 }
 
+template <typename T>
+SparseFormatCost InnerProductOperator::AdviseSparseFormat(Tensor* weight, bool transposed,
+                                                          const vector<SparseFormat>& candidates) {
+  SparseFormatAdvisor advisor(candidates);
+  const vector<int64_t>& shape = weight->shape();
+  if (shape.size() != 2 || weight->data() == nullptr) return advisor.selected();
+  const int64_t N = transposed ? shape[1] : shape[0];
+  const int64_t K = transposed ? shape[0] : shape[1];
+  SparseFormatCost selected = advisor.Advise(static_cast<const T*>(weight->data()), N, K, transposed);
+  sparse_format_report_ = advisor.Report();
+  DLOG(INFO) << "Innerproduct " << name_ << " sparse format: " << sparse_format_report_;
+  return selected;
+}
+
 void InnerProductOperator::Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   // set output dtype and primitive attr(without post_ops) in Prepare
   MapTensors(input, output);
@@ -221,17 +236,37 @@ void InnerProductOperator::Prepare(const vector<Tensor*>& input, const vector<Te
     weight_zero_ratio_ = GetSparseRatio<float>(static_cast<const float*>(src1_->data()), src1_->shape(), blocksize_);
     if (weight_zero_ratio_ >= sparse_threshold_) kernel_type_ = Dense;
     DLOG(INFO) << "weight zero ratio: " << weight_zero_ratio_;
+    // no fp32 sparse kernel in this layout, so the weight is only costed for the profiling report: it tells whether
+    // the layer would pay off as SparseLib
+    if (getenv("ENGINE_PROFILING") != NULL) {
+      AdviseSparseFormat<float>(src1_, !(src1_perm_ == vector<int64_t>{0, 1}),
+                                {{"dense", 0, 0, 1, true}, {"bsr_16x1", 16, 1, 1, false}});
+    }
   } else if (src1_->dtype() == "s8") {
     kernel_type_ = Dense;
     blocksize_ = {4, 16};
     weight_zero_ratio_ = GetSparseRatio<int8_t>(static_cast<const int8_t*>(src1_->data()), src1_->shape(), blocksize_);
     if (weight_zero_ratio_ >= sparse_threshold_) kernel_type_ = Dense;
     DLOG(INFO) << "weight zero ratio: " << weight_zero_ratio_;
+    if (getenv("ENGINE_PROFILING") != NULL) {
+      AdviseSparseFormat<int8_t>(
+          src1_, !(src1_perm_ == vector<int64_t>{0, 1}),
+          {{"dense", 0, 0, 1, true}, {"bsr_4x1_g4", 4, 1, 4, false}, {"bsr_16x1_g64", 16, 1, 64, false}});
+    }
   } else if (src0_->dtype() == "s8" && src1_->dtype() == "u8") {
     blocksize_ = {4, 1};
     weight_zero_ratio_ = GetSparseRatio<int8_t>(static_cast<const int8_t*>(src0_->data()), src0_->shape(), blocksize_);
     if (weight_zero_ratio_ >= sparse_threshold_) kernel_type_ = SparseLib;
     DLOG(INFO) << "weight zero ratio: " << weight_zero_ratio_;
+    // this layout has no dense kernel, the threshold alone decides. The advisor costs the VNNI 4x1 encoding from
+    // the padded groups the weight really packs into, which the zero ratio doesn't see, and points out a layer
+    // over the threshold expected to run slower than the dense layout would.
+    SparseFormatCost advice = AdviseSparseFormat<int8_t>(
+        src0_, false, {{"dense", 0, 0, 1, false}, {"bsr_4x1_g4", 4, 1, 4, true}, {"bsr_16x1_g64", 16, 1, 64, false}});
+    if (kernel_type_ == SparseLib && advice.cost > 1.f) {
+      LOG(WARNING) << "Innerproduct " << name_ << " runs bsr_4x1_g4 for a zero ratio of " << weight_zero_ratio_
+                   << " but dense would be faster (" << sparse_format_report_ << ")";
+    }
   } else if (src1_->dtype() == "bf16") {
     kernel_type_ = Dense;
     auto shape = src1_->shape();
@@ -566,15 +601,25 @@ void InnerProductOperator::DynamicReshape(const vector<Tensor*>& input, const ve
     jd::dynamic_quant_matmul_desc dynamic_quant_matmul_desc(op_desc);
     dynamic_quant_matmul_ker_ = jd::dynamic_quant_matmul(dynamic_quant_matmul_desc);
     if (scratchpad_) MemoryAllocator::get().UnrefMemory(scratchpad_);
-    scratchpad_ = MemoryAllocator::get().GetMemory(dynamic_quant_matmul_ker_.get_workspace_size(), 1);
+    scratchpad_ = AcquireWorkspace(dynamic_quant_matmul_ker_.get_workspace_size());
     if (!weight_cached_) {
       int k = src1_shape[1], n = src1_shape[0];
       int pad_n = ((n + 15) / 16) * 16;
+      bool transpose = src1_perm_.empty() || src1_perm_ == vector<int64_t>{0, 1};
       if (transposed_weight_) MemoryAllocator::get().UnrefMemory(transposed_weight_);
-      transposed_weight_ = MemoryAllocator::get().GetMemory(k * pad_n, 1);
-      reorder_dynamic_weight(reinterpret_cast<int8_t*>(src1_->mutable_data()),
-                             reinterpret_cast<int8_t*>(transposed_weight_), k, n, pad_n,
-                             src1_perm_.empty() || src1_perm_ == vector<int64_t>{0, 1});
+      WeightDiskCache& disk_cache = WeightDiskCache::Global();
+      string disk_key;
+      transposed_weight_ = nullptr;
+      if (disk_cache.enabled()) {
+        disk_key = PackedWeightKey("dynamic_quant_matmul", std::to_string(pad_n) + (transpose ? " t" : " n"));
+        transposed_weight_ = disk_cache.Load(disk_key, k * pad_n);
+      }
+      if (transposed_weight_ == nullptr) {
+        transposed_weight_ = MemoryAllocator::get().GetMemory(k * pad_n, 1);
+        reorder_dynamic_weight(reinterpret_cast<int8_t*>(src1_->mutable_data()),
+                               reinterpret_cast<int8_t*>(transposed_weight_), k, n, pad_n, transpose);
+        if (disk_cache.enabled()) disk_cache.Store(disk_key, transposed_weight_, k * pad_n);
+      }
       weight_cached_ = true;
     }
     DstReshapeFusion(input, output);
@@ -1213,8 +1258,61 @@ void InnerProductOperator::ShapeInferDense(const vector<Tensor*>& input, const v
   DstReshapeFusion(input, output);
 }
 
+bool InnerProductOperator::ReshapeDenseFromPlan(const vector<Tensor*>& input, const vector<Tensor*>& output,
+                                                size_t plan_key) {
+  if (!dense_plans_.enabled()) return false;
+  DensePlan* plan = dense_plans_.Get(plan_key);
+  record_plan_cache(plan != nullptr);
+  if (plan == nullptr) return false;
+  // the cached weight memory stays valid, a reordered weight only replaces the original one once and later
+  // primitive descriptors are built on that layout
+  src0_->set_shape(plan->src0_shape);
+  dst_->set_shape(plan->dst_shape);
+  inner_product_pd_ = plan->inner_product_pd;
+  inner_product_p_ = plan->inner_product_p;
+  memory_args_ = plan->memory_args;
+  src0_m_ = plan->src0_m;
+  dst_m_ = plan->dst_m;
+  binary_m_ = plan->binary_m;
+  gelu_pd_ = plan->gelu_pd;
+  gelu_p_ = plan->gelu_p;
+  gelu_m_ = plan->gelu_m;
+  BindScratchpad(inner_product_pd_.scratchpad_desc());
+  DstReshapeFusion(input, output);
+  return true;
+}
+
+string InnerProductOperator::PackedWeightKey(const string& kernel, const string& layout) {
+  std::stringstream key;
+  key << name_ << "|" << kernel << "|isa " << static_cast<int>(dnnl::get_effective_cpu_isa()) << "|" << src1_->dtype();
+  for (const auto& d : src1_->shape()) key << " " << d;
+  key << "|perm";
+  for (const auto& p : src1_perm_) key << " " << p;
+  key << "|layout " << layout << "|dispatch";
+  for (const auto& c : dispatch_config_) key << " " << c;
+  key << "|src " << WeightDiskCache::Fingerprint(src1_->data(), src1_->size() * type2bytes[src1_->dtype()]);
+  return key.str();
+}
+
+void InnerProductOperator::BindScratchpad(const memory::desc& scratchpad_md) {
+  // all plans share one scratchpad which only grows
+  size_t scratchpad_size = (scratchpad_md.get_size() / ALIGNMENT + 1) * ALIGNMENT;
+  if (scratchpad_ == nullptr || scratchpad_size > scratchpad_size_) {
+    if (scratchpad_) free(scratchpad_);
+    scratchpad_ = reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, scratchpad_size));
+    scratchpad_size_ = scratchpad_size;
+  }
+  memory_args_[DNNL_ARG_SCRATCHPAD] = memory(scratchpad_md, eng_, scratchpad_);
+}
+
 // 1. Create primitive
 void InnerProductOperator::ReshapeDense(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  size_t plan_key = get_array_hash(0, src0_->shape(), src0_->shape().size());
+  plan_key = get_array_hash(plan_key, src0_perm_, src0_perm_.size());
+  plan_key = get_array_hash(plan_key, dst_perm_, dst_perm_.size());
+  if (binary_add_ && post_ != nullptr) plan_key = get_array_hash(plan_key, post_->shape(), post_->shape().size());
+  if (ReshapeDenseFromPlan(input, output, plan_key)) return;
+
   dnnl::post_ops po;
   vector<int64_t> src1_shape = src1_->shape();
   vector<int64_t> src1_stride = GetStrides(src1_shape_origin_, src1_perm_);
@@ -1383,19 +1481,7 @@ void InnerProductOperator::ReshapeDense(const vector<Tensor*>& input, const vect
 
   attr_.set_scratchpad_mode(dnnl::scratchpad_mode::user);
   inner_product_pd_ = dnnl::inner_product_forward::primitive_desc(inner_product_d, attr_, eng_);
-
-  memory::desc scratchpad_md = inner_product_pd_.scratchpad_desc();
-
-  if (scratchpad_) {
-    free(scratchpad_);
-    scratchpad_ = nullptr;
-  }
-
-  scratchpad_ = reinterpret_cast<void*>(
-    aligned_alloc(ALIGNMENT, (scratchpad_md.get_size() / ALIGNMENT + 1) * ALIGNMENT));
-
-  memory scratchpad_m = memory(scratchpad_md, eng_, scratchpad_);
-  memory_args_[DNNL_ARG_SCRATCHPAD] = scratchpad_m;
+  BindScratchpad(inner_product_pd_.scratchpad_desc());
 
   // 2.4 Prepare memory objects (cached)
   src0_m_ = memory(src0_md, eng_, DNNL_MEMORY_NONE);
@@ -1411,19 +1497,54 @@ void InnerProductOperator::ReshapeDense(const vector<Tensor*>& input, const vect
             MemoryAllocator::ManagedShm().find_or_construct<char>(src1_->name().c_str())[weight_size](0);
         any_src1_m.set_data_handle(weight_shm_ptr);
         cached_w_ptr = weight_shm_ptr;
+        dnnl::reorder(any_src1_m_last_, any_src1_m).execute(eng_stream_, any_src1_m_last_, any_src1_m);
       } else {
-        cached_w_ptr = reinterpret_cast<void*>(
-          aligned_alloc(ALIGNMENT, (any_src1_m.get_desc().get_size() / ALIGNMENT + 1) * ALIGNMENT));
+        // a weight which keeps its original layout may be held by other execution contexts, share their copy
+        bool keep_src = this->get_execution_mode() != ExecutionMode::INFERENCE || src1_->life() > 1;
+        // only copies of the model's own buffer are shared, not those of the weight copies of online tuning
+        const void* owner = model_ == nullptr ? nullptr : model_->weights_owner();
+        bool share = keep_src && owner != nullptr && model_->HoldsWeight(src1_->name(), src1_->data());
+        cached_w_ptr = share ? PrepackedWeightCache::Get(owner, src1_->name(), inner_product_pd_.weights_desc())
+                             : nullptr;
+        if (cached_w_ptr == nullptr) {
+          // a weight packed by an earlier start of the model is mapped from the disk cache
+          WeightDiskCache& disk_cache = WeightDiskCache::Global();
+          const memory::desc& packed_md = inner_product_pd_.weights_desc();
+          size_t packed_bytes = packed_md.get_size();
+          string disk_key;
+          if (disk_cache.enabled()) {
+            string layout(reinterpret_cast<const char*>(&packed_md.data), sizeof(packed_md.data));
+            disk_key = PackedWeightKey("onednn_inner_product", std::to_string(std::hash<string>()(layout)));
+            cached_w_ptr = disk_cache.Load(disk_key, packed_bytes);
+          }
+          if (cached_w_ptr == nullptr) {
+            cached_w_ptr =
+                reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, (packed_bytes / ALIGNMENT + 1) * ALIGNMENT));
+            any_src1_m.set_data_handle(cached_w_ptr);
+            dnnl::reorder(any_src1_m_last_, any_src1_m).execute(eng_stream_, any_src1_m_last_, any_src1_m);
+            if (disk_cache.enabled()) disk_cache.Store(disk_key, cached_w_ptr, packed_bytes);
+          }
+          if (share) {
+            void* shared_w_ptr = PrepackedWeightCache::Set(owner, src1_->name(), packed_md, cached_w_ptr);
+            if (shared_w_ptr != cached_w_ptr && !disk_cache.Contains(cached_w_ptr)) aligned_free(cached_w_ptr);
+            cached_w_ptr = shared_w_ptr;
+          } else if (keep_src && !disk_cache.Contains(cached_w_ptr)) {
+            // nobody else frees a copy which replaces neither the weight nor a shared one
+            owned_weights_.push_back(cached_w_ptr);
+          }
+        }
         any_src1_m.set_data_handle(cached_w_ptr);
       }
-      dnnl::reorder(any_src1_m_last_, any_src1_m).execute(eng_stream_, any_src1_m_last_, any_src1_m);
       if (src1_->is_shared() && this->get_execution_mode() == ExecutionMode::INFERENCE &&
           src1_->life() <= 1) {
         MemoryAllocator::ManagedShm().destroy_ptr(src1_->mutable_data());
         src1_->set_shm_handle(MemoryAllocator::ManagedShm().get_handle_from_address(cached_w_ptr));
       } else {
         if (this->get_execution_mode() == ExecutionMode::INFERENCE && src1_->life() <= 1) {
-          aligned_free(src1_->mutable_data());
+          // a weight in the disk cache or the mapped weight file is dropped, it was never allocated
+          bool mapped = WeightDiskCache::Global().Contains(src1_->data()) ||
+                        (model_ != nullptr && model_->IsMappedWeight(src1_->data()));
+          if (!mapped) aligned_free(src1_->mutable_data());
           src1_->set_data(cached_w_ptr);
           weight_reorded_ = true;
         }
@@ -1454,7 +1575,7 @@ void InnerProductOperator::ReshapeDense(const vector<Tensor*>& input, const vect
           bias_->set_shm_handle(MemoryAllocator::ManagedShm().get_handle_from_address(cached_b_ptr));
         } else {
           if (this->get_execution_mode() == ExecutionMode::INFERENCE && bias_->life() <= 1) {
-              aligned_free(bias_->mutable_data());
+            if (model_ == nullptr || !model_->IsMappedWeight(bias_->data())) aligned_free(bias_->mutable_data());
             bias_->set_data(cached_b_ptr);
           }
           any_bias_m_last_ = memory(inner_product_pd_.bias_desc(), eng_, cached_b_ptr);
@@ -1478,6 +1599,8 @@ void InnerProductOperator::ReshapeDense(const vector<Tensor*>& input, const vect
     inner_product_p_ = dnnl::inner_product_forward(inner_product_pd_);
     InnerProductPrimitiveFwdFactory::Set(key, inner_product_p_);
   }
+  dense_plans_.Put(plan_key, {src0_shape, dst_shape, inner_product_pd_, inner_product_p_, memory_args_, src0_m_,
+                              dst_m_, binary_m_, gelu_pd_, gelu_p_, gelu_m_});
   DstReshapeFusion(input, output);
 }
 
@@ -237,6 +237,7 @@ void MatmulOperator::DstReshapeFusion(const vector<Tensor*>& input, const vector
 
 void MatmulOperator::Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   MapTensors(input, output);
+  reordered_src1_m_.clear();
   dst_->set_dtype(output_dtype_);
   is_dynamic_ =
       output.size() > 1 || (src0_min_ != nullptr && src0_min_->raw_data() == nullptr && !src0_min_->is_shared());
@@ -346,7 +347,68 @@ void MatmulOperator::ForwardwithTransMode(const vector<Tensor*>& input, const ve
 }
 #endif
 // 1. Create primitive
+bool MatmulOperator::ReshapewithOnednnFromPlan(const vector<Tensor*>& input, const vector<Tensor*>& output,
+                                               size_t plan_key) {
+  if (!onednn_plans_.enabled()) return false;
+  OnednnPlan* plan = onednn_plans_.Get(plan_key);
+  record_plan_cache(plan != nullptr);
+  if (plan == nullptr) return false;
+  dst_->set_shape(plan->dst_shape);
+  if (output.size() > 1) {
+    dst_min_->set_shape({1});
+    dst_max_->set_shape({1});
+  }
+  matmul_pd_ = plan->matmul_pd;
+  matmul_p_ = plan->matmul_p;
+  memory_args_ = plan->memory_args;
+  src0_m_ = plan->src0_m;
+  src1_m_ = plan->src1_m;
+  bias_m_ = plan->bias_m;
+  dst_m_ = plan->dst_m;
+  binary_m_ = plan->binary_m;
+  any_src1_m_ = plan->any_src1_m;
+  BindScratchpad(matmul_pd_.scratchpad_desc());
+  DstReshapeFusion(input, output);
+  return true;
+}
+
+memory MatmulOperator::ReorderedWeight(const memory::desc& weights_md) {
+  if (weights_md == src1_m_.get_desc()) return src1_m_;
+  // plans of the shapes whose primitives take the same weight layout share one reordered copy
+  for (const auto& reordered : reordered_src1_m_) {
+    if (reordered.get_desc() == weights_md) return reordered;
+  }
+  memory reordered = memory(weights_md, eng_);
+  if (src1_->is_shared()) {
+    int64_t weight_size = weights_md.get_size();
+    void* weight_shm_ptr = MemoryAllocator::ManagedShm().find_or_construct<char>(src1_->name().c_str())[weight_size](0);
+    reordered.set_data_handle(weight_shm_ptr);
+  }
+  dnnl::reorder(src1_m_, reordered).execute(eng_stream_, src1_m_, reordered);
+  reordered_src1_m_.push_back(reordered);
+  return reordered;
+}
+
+void MatmulOperator::BindScratchpad(const memory::desc& scratchpad_md) {
+  // all plans share one scratchpad which only grows
+  size_t scratchpad_size = (scratchpad_md.get_size() / ALIGNMENT + 1) * ALIGNMENT;
+  if (scratchpad_ == nullptr || scratchpad_size > scratchpad_size_) {
+    if (scratchpad_) free(scratchpad_);
+    scratchpad_ = reinterpret_cast<void*>(aligned_alloc(ALIGNMENT, scratchpad_size));
+    scratchpad_size_ = scratchpad_size;
+  }
+  memory_args_[DNNL_ARG_SCRATCHPAD] = memory(scratchpad_md, eng_, scratchpad_);
+}
+
 void MatmulOperator::ReshapewithOnednn(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  size_t plan_key = get_array_hash(0, src0_->shape(), src0_->shape().size());
+  plan_key = get_array_hash(plan_key, src1_->shape(), src1_->shape().size());
+  plan_key = get_array_hash(plan_key, src0_perm_, src0_perm_.size());
+  plan_key = get_array_hash(plan_key, src1_perm_, src1_perm_.size());
+  plan_key = get_array_hash(plan_key, dst_perm_, dst_perm_.size());
+  if (binary_add_ && post_ != nullptr) plan_key = get_array_hash(plan_key, post_->shape(), post_->shape().size());
+  if (ReshapewithOnednnFromPlan(input, output, plan_key)) return;
+
   //// Part1: Derive operator's user proper shape and strides
   // 1.1 Transpose tensor shape and get it
   vector<int64_t> src0_shape_origin = src0_->shape();
@@ -486,19 +548,7 @@ void MatmulOperator::ReshapewithOnednn(const vector<Tensor*>& input, const vecto
   attr_.set_scratchpad_mode(dnnl::scratchpad_mode::user);
 
   matmul_pd_ = dnnl::matmul::primitive_desc(matmul_d, attr_, eng_);
-
-  memory::desc scratchpad_md = matmul_pd_.scratchpad_desc();
-
-  if (scratchpad_) {
-    free(scratchpad_);
-    scratchpad_ = nullptr;
-  }
-
-  scratchpad_ = reinterpret_cast<void*>(
-    aligned_alloc(ALIGNMENT, (scratchpad_md.get_size() / ALIGNMENT + 1) * ALIGNMENT));
-
-  memory scratchpad_m = memory(scratchpad_md, eng_, scratchpad_);
-  memory_args_[DNNL_ARG_SCRATCHPAD] = scratchpad_m;
+  BindScratchpad(matmul_pd_.scratchpad_desc());
 
   // 2.4 Prepare memory objects (cached)
   src0_m_ = memory(src0_md, eng_, DNNL_MEMORY_NONE);
@@ -520,17 +570,7 @@ void MatmulOperator::ReshapewithOnednn(const vector<Tensor*>& input, const vecto
   if (cache_weight_) {
     memory::desc user_src1_md = memory::desc(src1_shape, type2mem[src1_->dtype()], memory::format_tag::ab);
     src1_m_ = memory(user_src1_md, eng_, const_cast<void*>(src1_->data()));
-    any_src1_m_ = src1_m_;
-    if (matmul_pd_.weights_desc() != src1_m_.get_desc()) {
-      any_src1_m_ = memory(matmul_pd_.weights_desc(), eng_);
-      if (src1_->is_shared()) {
-        int64_t weight_size = any_src1_m_.get_desc().get_size();
-        void* weight_shm_ptr =
-            MemoryAllocator::ManagedShm().find_or_construct<char>(src1_->name().c_str())[weight_size](0);
-        any_src1_m_.set_data_handle(weight_shm_ptr);
-      }
-      dnnl::reorder(src1_m_, any_src1_m_).execute(eng_stream_, src1_m_, any_src1_m_);
-    }
+    any_src1_m_ = ReorderedWeight(matmul_pd_.weights_desc());
     memory_args_[DNNL_ARG_WEIGHTS] = any_src1_m_;
   } else {
     src1_m_ = memory(src1_md, eng_, DNNL_MEMORY_NONE);
@@ -548,6 +588,8 @@ void MatmulOperator::ReshapewithOnednn(const vector<Tensor*>& input, const vecto
     matmul_p_ = dnnl::matmul(matmul_pd_);
     MatMulPrimitiveFwdFactory::Set(key, matmul_p_);
   }
+  onednn_plans_.Put(plan_key, {dst_shape, matmul_pd_, matmul_p_, memory_args_, src0_m_, src1_m_, bias_m_, dst_m_,
+                               binary_m_, any_src1_m_});
   DstReshapeFusion(input, output);
 }
 
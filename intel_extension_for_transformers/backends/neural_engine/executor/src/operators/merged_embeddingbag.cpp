@@ -13,31 +13,200 @@
 //  limitations under the License.
 #include "merged_embeddingbag.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace executor {
 
+namespace {
+
+// rows gathered ahead of the one being pooled
+constexpr size_t kPrefetchRows = 8;
+// fp32 scale and bias behind the values of a fused 8 bit row
+constexpr size_t kRowwiseTailBytes = 2 * sizeof(float);
+// chunks per thread, more of them balance better and cost more scheduling
+constexpr int64_t kChunksPerThread = 4;
+// bytes a bag costs besides its rows: offsets, output row and loop overhead
+constexpr size_t kBagOverheadBytes = 64;
+// columns of a bf16 or u8 bag summed in fp32 at a time, on the stack
+constexpr size_t kPoolBlock = 256;
+
+inline void prefetch_row(const void* row, size_t row_bytes) {
+  const char* ptr = static_cast<const char*>(row);
+  // the first lines of the row, the hardware prefetcher follows on within it
+  size_t lines = std::min<size_t>((row_bytes + 63) / 64, 4);
+  for (size_t l = 0; l < lines; ++l) _mm_prefetch(ptr + l * 64, _MM_HINT_T0);
+}
+
+inline float half_to_float(uint16_t h) {
+#if __F16C__
+  return _cvtsh_ss(h);
+#else
+  uint32_t sign = (h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ffu;
+  uint32_t bits;
+  if (exp == 0x1f) {
+    bits = sign | 0x7f800000u | (mant << 13);
+  } else if (exp != 0) {
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  } else if (mant == 0) {
+    bits = sign;
+  } else {
+    // subnormal half, normalized for fp32
+    exp = 113;
+    while ((mant & 0x400u) == 0) {
+      mant <<= 1;
+      exp--;
+    }
+    bits = sign | (exp << 23) | ((mant & 0x3ffu) << 13);
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+#endif
+}
+
+void add_fp16_scalar(float* inout, const uint16_t* in, size_t len) {
+  for (size_t d = 0; d < len; ++d) inout[d] += half_to_float(in[d]);
+}
+
+NE_TARGET_AVX2 void add_fp16_avx2(float* inout, const uint16_t* in, size_t len) {
+  size_t d = 0;
+  for (; d + 8 <= len; d += 8) {
+    __m256 row = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + d)));
+    _mm256_storeu_ps(inout + d, _mm256_add_ps(_mm256_loadu_ps(inout + d), row));
+  }
+  add_fp16_scalar(inout + d, in + d, len - d);
+}
+
+NE_TARGET_AVX512 void add_fp16_avx512(float* inout, const uint16_t* in, size_t len) {
+  for (size_t d = 0; d < len; d += 16) {
+    __mmask16 mask = len - d >= 16 ? 0xffff : (1 << (len - d)) - 1;
+    __m512 row = _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(mask, in + d));
+    _mm512_mask_storeu_ps(inout + d, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, inout + d), row));
+  }
+}
+
+using AddFp16Kernel = void (*)(float* inout, const uint16_t* in, size_t len);
+
+AddFp16Kernel add_fp16_ker(Isa isa) {
+  switch (isa) {
+    case Isa::kAvx512:
+      return add_fp16_avx512;
+    case Isa::kAvx2:
+      return add_fp16_avx2;
+    default:
+      return add_fp16_scalar;
+  }
+}
+
+void scale_ker(float* inout, float scale, size_t len) {
+#pragma omp simd
+  for (size_t d = 0; d < len; ++d) inout[d] *= scale;
+}
+
+inline float widen(uint16_t bf16) {
+  uint32_t bits = static_cast<uint32_t>(bf16) << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline float widen(uint8_t value) { return value; }
+
+// round to nearest even as vcvtneps2bf16 does
+inline void narrow(float f, uint16_t* bf16) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  *bf16 = static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+inline void narrow(float f, uint8_t* value) {
+  *value = static_cast<uint8_t>(std::min(std::max(std::nearbyint(f), 0.f), 255.f));
+}
+
+// sums and scales the rows in fp32 and rounds once, the table type has neither the range nor the precision
+template <typename T>
+void pool_in_fp32(T* out, const T* in, const size_t pool_begin, const size_t pool_end, const size_t vector_size,
+                  const int32_t* indices_data, const string& mode, const size_t prefetch_end) {
+  const float scale = mode == "mean" && pool_end > pool_begin ? 1.f / (pool_end - pool_begin) : 1.f;
+  float acc[kPoolBlock];
+  for (size_t d0 = 0; d0 < vector_size; d0 += kPoolBlock) {
+    const size_t len = std::min(kPoolBlock, vector_size - d0);
+    std::fill(acc, acc + len, 0.f);
+    for (auto p = pool_begin; p < pool_end; ++p) {
+      if (d0 == 0 && p + kPrefetchRows < prefetch_end) {
+        prefetch_row(&in[indices_data[p + kPrefetchRows] * vector_size], vector_size * sizeof(T));
+      }
+      const T* row = &in[indices_data[p] * vector_size + d0];
+#pragma omp simd
+      for (size_t d = 0; d < len; ++d) acc[d] += widen(row[d]);
+    }
+    for (size_t d = 0; d < len; ++d) narrow(acc[d] * scale, out + d0 + d);
+  }
+}
+
+}  // namespace
+
 MergedEmbeddingbagOperator::MergedEmbeddingbagOperator(const shared_ptr<OperatorConfig>& conf) : Operator(conf) {
   auto attrs_map = operator_conf_->attributes();
   auto iter = attrs_map.find("mode");
   mode_ = (iter != attrs_map.end()) ? iter->second : "";
+  iter = attrs_map.find("rowwise_quantized");
+  rowwise_quantized_ = (iter != attrs_map.end() && iter->second == "true");
 }
 
 void MergedEmbeddingbagOperator::Prepare(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   assert(input.size() == output.size() + 2);
   for (int i = 0; i < output.size(); i++) {
     const string weight_dtype = input[i + 2]->dtype();
-    output[i]->set_dtype(weight_dtype);
+    // dequantized while pooled
+    bool dequantize = weight_dtype == "fp16" || (weight_dtype == "u8" && rowwise_quantized_);
+    output[i]->set_dtype(dequantize ? "fp32" : weight_dtype);
   }
 }
 
 void MergedEmbeddingbagOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>& output) {
-  const vector<int64_t> offset_shape = input[1]->shape();
+  const vector<int64_t> offset_shape = input[0]->shape();
   for (int i = 0; i < output.size(); i++) {
     const vector<int64_t> weight_shape = input[i + 2]->shape();
-    vector<int64_t> dst_shape = {offset_shape[1], weight_shape[1]};
+    int64_t feature_size = weight_shape[1];
+    if (input[i + 2]->dtype() == "u8" && rowwise_quantized_) feature_size -= kRowwiseTailBytes;
+    vector<int64_t> dst_shape = {offset_shape[1], feature_size};
     output[i]->set_shape(dst_shape);
   }
 }
 
+void MergedEmbeddingbagOperator::PlanChunks(const int32_t* offsets_data, int64_t bs, int64_t n_indices,
+                                            const vector<size_t>& row_bytes) {
+  const int64_t n_tables = row_bytes.size();
+  // bag n of table t gathers offsets[t][n + 1] - offsets[t][n] rows, the last one up to the end of its indices
+  auto bag_cost = [&](int64_t t, int64_t n) {
+    int64_t end = n + 1 < bs ? offsets_data[t * bs + n + 1] : n_indices;
+    return (end - offsets_data[t * bs + n]) * row_bytes[t] + kBagOverheadBytes;
+  };
+  size_t total = 0;
+  for (int64_t t = 0; t < n_tables; ++t) {
+    for (int64_t n = 0; n < bs; ++n) total += bag_cost(t, n);
+  }
+  const size_t target = std::max<size_t>(total / (omp_get_max_threads() * kChunksPerThread), 1);
+  chunks_.clear();
+  for (int64_t t = 0; t < n_tables; ++t) {
+    int64_t begin = 0;
+    size_t cost = 0;
+    for (int64_t n = 0; n < bs; ++n) {
+      cost += bag_cost(t, n);
+      if (cost >= target || n == bs - 1) {
+        chunks_.push_back({t, begin, n + 1});
+        begin = n + 1;
+        cost = 0;
+      }
+    }
+  }
+}
+
 void MergedEmbeddingbagOperator::Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   Tensor* offsets = input[0];
   Tensor* indices = input[1];
@@ -46,6 +215,7 @@ void MergedEmbeddingbagOperator::Forward(const vector<Tensor*>& input, const vec
 
   int64_t n_tables = weights.size();
   int64_t bs = offsets->shape()[1];
+  int64_t n_indices = indices->shape()[1];
   if (n_tables != offsets->shape()[0] || n_tables != indices->shape()[0]) {
     LOG(ERROR) << "weights size: " << n_tables << ", offset shape 0: " << offsets->shape()[0]
                << ", indices shape 0: " << indices->shape()[0];
@@ -53,9 +223,11 @@ void MergedEmbeddingbagOperator::Forward(const vector<Tensor*>& input, const vec
 
   vector<void*> weights_ptr;
   vector<string> dtypes;
+  vector<size_t> row_bytes;
   for (auto& w : weights) {
     weights_ptr.emplace_back(w->mutable_data());
     dtypes.emplace_back(w->dtype());
+    row_bytes.emplace_back(w->shape()[1] * type2bytes[w->dtype()]);
   }
   vector<void*> outs_ptr;
   for (auto& o : output) {
@@ -64,28 +236,46 @@ void MergedEmbeddingbagOperator::Forward(const vector<Tensor*>& input, const vec
 
   int32_t* offsets_data = reinterpret_cast<int32_t*>(offsets->mutable_data());
   int32_t* indices_data = reinterpret_cast<int32_t*>(indices->mutable_data());
+  PlanChunks(offsets_data, bs, n_indices, row_bytes);
 
-#pragma omp parallel for
-  for (int table_id = 0; table_id < n_tables; ++table_id) {
-#pragma omp simd
-    for (int n = 0; n < bs; ++n) {
-      int32_t offset_idx = n + table_id * bs;
-      int32_t pool_begin = offsets_data[offset_idx] + table_id * bs;
-      int32_t pool_end = ((offset_idx + 1) % bs == 0) ? (table_id + 1) * indices->shape()[1]
-                                                      : offsets_data[offset_idx + 1] + table_id * bs;
-      int64_t feature_size = weights[table_id]->shape()[1];
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int c = 0; c < chunks_.size(); ++c) {
+    const WorkChunk& chunk = chunks_[c];
+    const int64_t table_id = chunk.table;
+    // offsets count from the indices of their table
+    int32_t* table_indices = indices_data + table_id * n_indices;
+    const int32_t* table_offsets = offsets_data + table_id * bs;
+    // the rows of the following bags of the chunk are prefetched as well
+    const size_t prefetch_end = chunk.end < bs ? table_offsets[chunk.end] : n_indices;
+    const int64_t feature_size = output[table_id]->shape()[1];
+    for (int64_t n = chunk.begin; n < chunk.end; ++n) {
+      size_t pool_begin = table_offsets[n];
+      size_t pool_end = n + 1 < bs ? table_offsets[n + 1] : n_indices;
       if (dtypes[table_id] == "fp32") {
         float* out_ptr = &((reinterpret_cast<float*>(outs_ptr[table_id]))[n * feature_size]);
         float* weight_ptr = reinterpret_cast<float*>(weights_ptr[table_id]);
-        emb_pooling_ker<float>(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, indices_data, mode_);
+        emb_pooling_ker<float>(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, table_indices, mode_,
+                               prefetch_end);
       } else if (dtypes[table_id] == "bf16") {
         uint16_t* out_ptr = &((reinterpret_cast<uint16_t*>(outs_ptr[table_id]))[n * feature_size]);
-        uint16_t* weight_ptr = reinterpret_cast<uint16_t*>(weights_ptr[table_id]);
-        emb_pooling_ker<uint16_t>(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, indices_data, mode_);
+        const uint16_t* weight_ptr = reinterpret_cast<const uint16_t*>(weights_ptr[table_id]);
+        emb_pooling_bf16_ker(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, table_indices, mode_,
+                             prefetch_end);
+      } else if (dtypes[table_id] == "fp16") {
+        float* out_ptr = &((reinterpret_cast<float*>(outs_ptr[table_id]))[n * feature_size]);
+        const uint16_t* weight_ptr = reinterpret_cast<const uint16_t*>(weights_ptr[table_id]);
+        emb_pooling_fp16_ker(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, table_indices, mode_,
+                             prefetch_end);
+      } else if (dtypes[table_id] == "u8" && rowwise_quantized_) {
+        float* out_ptr = &((reinterpret_cast<float*>(outs_ptr[table_id]))[n * feature_size]);
+        const uint8_t* weight_ptr = reinterpret_cast<const uint8_t*>(weights_ptr[table_id]);
+        emb_pooling_rowwise_u8_ker(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, table_indices, mode_,
+                                   prefetch_end);
       } else if (dtypes[table_id] == "u8") {
         uint8_t* out_ptr = &((reinterpret_cast<uint8_t*>(outs_ptr[table_id]))[n * feature_size]);
-        uint8_t* weight_ptr = reinterpret_cast<uint8_t*>(weights_ptr[table_id]);
-        emb_pooling_ker<uint8_t>(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, indices_data, mode_);
+        const uint8_t* weight_ptr = reinterpret_cast<const uint8_t*>(weights_ptr[table_id]);
+        emb_pooling_u8_ker(out_ptr, weight_ptr, pool_begin, pool_end, feature_size, table_indices, mode_,
+                           prefetch_end);
       } else {
         LOG(ERROR) << "Merged embedding can not support dtype: " << dtypes[table_id];
       }
@@ -97,41 +287,90 @@ void MergedEmbeddingbagOperator::Forward(const vector<Tensor*>& input, const vec
 
 template <typename T>
 void emb_pooling_ker(T* out, T* in, const size_t pool_begin, const size_t pool_end, const size_t vector_size,
-                     int32_t* indices_data, const string& mode) {
+                     int32_t* indices_data, const string& mode, const size_t prefetch_end) {
+  if (pool_end <= pool_begin) {
+    zero_ker(out, vector_size);
+    return;
+  }
   auto idx = indices_data[pool_begin];
   auto weight_ptr = &in[idx * vector_size];
   if (pool_end - pool_begin == 1) {
+    if (pool_begin + kPrefetchRows < prefetch_end) {
+      prefetch_row(&in[indices_data[pool_begin + kPrefetchRows] * vector_size], vector_size * sizeof(T));
+    }
     move_ker(out, weight_ptr, vector_size);
   } else {
-    // add if there is more than 1 indice in this bag, need accumulate to float
-    // buffer
-    T* temp_out = reinterpret_cast<T*>(malloc(vector_size * sizeof(T)));
-    if (temp_out != nullptr) {
-      zero_ker(temp_out, vector_size);
-      for (auto p = pool_begin; p < pool_end; ++p) {
-        idx = indices_data[p];
-        weight_ptr = &in[idx * vector_size];
-        add_ker(temp_out, weight_ptr, vector_size);
+    // add if there is more than 1 indice in this bag, the output row is the accumulator
+    zero_ker(out, vector_size);
+    for (auto p = pool_begin; p < pool_end; ++p) {
+      if (p + kPrefetchRows < prefetch_end) {
+        prefetch_row(&in[indices_data[p + kPrefetchRows] * vector_size], vector_size * sizeof(T));
       }
-      if (mode == "mean") {
-        auto L = pool_end - pool_begin;
-        const uint8_t scale_factor = 1.0 / L;
+      idx = indices_data[p];
+      weight_ptr = &in[idx * vector_size];
+      add_ker(out, weight_ptr, vector_size);
+    }
+    if (mode == "mean") {
+      auto L = pool_end - pool_begin;
+      const float scale_factor = 1.0 / L;
 #pragma omp simd
-        for (int d = 0; d < vector_size; ++d) {
-          temp_out[d] = scale_factor * temp_out[d];
-        }
+      for (int d = 0; d < vector_size; ++d) {
+        out[d] = scale_factor * out[d];
       }
-      move_ker(out, temp_out, vector_size);
     }
-    free(temp_out);
   }
 }
 template void emb_pooling_ker(float* out, float* in, const size_t pool_begin, const size_t pool_end,
-                              const size_t vector_size, int32_t* indices_data, const string& mode);
-template void emb_pooling_ker(uint16_t* out, uint16_t* in, const size_t pool_begin, const size_t pool_end,
-                              const size_t vector_size, int32_t* indices_data, const string& mode);
-template void emb_pooling_ker(uint8_t* out, uint8_t* in, const size_t pool_begin, const size_t pool_end,
-                              const size_t vector_size, int32_t* indices_data, const string& mode);
+                              const size_t vector_size, int32_t* indices_data, const string& mode,
+                              const size_t prefetch_end);
+
+void emb_pooling_bf16_ker(uint16_t* out, const uint16_t* in, const size_t pool_begin, const size_t pool_end,
+                          const size_t vector_size, const int32_t* indices_data, const string& mode,
+                          const size_t prefetch_end) {
+  pool_in_fp32(out, in, pool_begin, pool_end, vector_size, indices_data, mode, prefetch_end);
+}
+
+void emb_pooling_u8_ker(uint8_t* out, const uint8_t* in, const size_t pool_begin, const size_t pool_end,
+                        const size_t vector_size, const int32_t* indices_data, const string& mode,
+                        const size_t prefetch_end) {
+  pool_in_fp32(out, in, pool_begin, pool_end, vector_size, indices_data, mode, prefetch_end);
+}
+
+void emb_pooling_fp16_ker(float* out, const uint16_t* in, const size_t pool_begin, const size_t pool_end,
+                          const size_t vector_size, const int32_t* indices_data, const string& mode,
+                          const size_t prefetch_end) {
+  const AddFp16Kernel add_fp16 = add_fp16_ker(RuntimeIsa());
+  zero_ker(out, vector_size);
+  for (auto p = pool_begin; p < pool_end; ++p) {
+    if (p + kPrefetchRows < prefetch_end) {
+      prefetch_row(&in[indices_data[p + kPrefetchRows] * vector_size], vector_size * sizeof(uint16_t));
+    }
+    add_fp16(out, &in[indices_data[p] * vector_size], vector_size);
+  }
+  if (mode == "mean" && pool_end > pool_begin + 1) scale_ker(out, 1.f / (pool_end - pool_begin), vector_size);
+}
+
+void emb_pooling_rowwise_u8_ker(float* out, const uint8_t* in, const size_t pool_begin, const size_t pool_end,
+                                const size_t vector_size, const int32_t* indices_data, const string& mode,
+                                const size_t prefetch_end) {
+  const size_t row_bytes = vector_size + kRowwiseTailBytes;
+  zero_ker(out, vector_size);
+  // the biases of the rows add up to one term
+  float bias_sum = 0;
+  for (auto p = pool_begin; p < pool_end; ++p) {
+    if (p + kPrefetchRows < prefetch_end) prefetch_row(&in[indices_data[p + kPrefetchRows] * row_bytes], row_bytes);
+    const uint8_t* row = &in[indices_data[p] * row_bytes];
+    float scale, bias;
+    memcpy(&scale, row + vector_size, sizeof(float));
+    memcpy(&bias, row + vector_size + sizeof(float), sizeof(float));
+    bias_sum += bias;
+#pragma omp simd
+    for (size_t d = 0; d < vector_size; ++d) out[d] += scale * row[d];
+  }
+  float scale = mode == "mean" && pool_end > pool_begin ? 1.f / (pool_end - pool_begin) : 1.f;
+#pragma omp simd
+  for (size_t d = 0; d < vector_size; ++d) out[d] = (out[d] + bias_sum) * scale;
+}
 
 REGISTER_OPERATOR_CLASS(MergedEmbeddingbag);
 }  // namespace executor
@@ -15,6 +15,8 @@
 #include "multi_head_attention.hpp"
 #include "kernels/exposed_enum.hpp"
 
+#include "isa.hpp"
+#include "model.hpp"
 #include "operator_registry.hpp"
 using dt = jd::data_type;
 using ft = jd::format_type;
@@ -65,6 +67,10 @@ MultiHeadAttentionOperator::MultiHeadAttentionOperator(const shared_ptr<Operator
   if (iter != attrs_map.end()) {
     stable_softmax_ = true;
   }
+  iter = attrs_map.find("kv_cache");
+  if (iter != attrs_map.end()) {
+    kv_cache_ = true;
+  }
 
   if (dst_reshape_.size() > 0 && dst_reshape_[0] != -1) {
     is_sparse_ = true;
@@ -213,6 +219,8 @@ void MultiHeadAttentionOperator::Prepare(const vector<Tensor*>& input, const vec
   LOG_IF(FATAL, dtype != "s8" && dtype != "bf16") << "only support int8/bf16, but get " << dtype;
   is_dynamic_ = (Q_max_ && Q_max_->raw_data() == nullptr) || (K_max_ && K_max_->raw_data() == nullptr) ||
                 (V_max_ && V_max_->raw_data() == nullptr);
+  LOG_IF(FATAL, kv_cache_ && (Q_ == nullptr || is_sparse_ || is_dynamic_ || state_store() == nullptr))
+      << name_ << ": kv_cache needs separate Q/K/V inputs of a static int8 or bf16 dense MHA inside a model";
   if (dtype == "bf16") {
     dst_->set_dtype("bf16");
     if (is_dynamic_) LOG(ERROR) << "bf16 not support dynamic";
@@ -327,6 +335,16 @@ void MultiHeadAttentionOperator::ReshapeDense(const vector<Tensor*>& input, cons
         << "head_size of Q should be equal with K, but get" << Q_shape[3] << "VS" << K_shape[2];
     head_size_qk_ = Q_shape[3];
     head_size_v_ = V_shape[3];
+    if (kv_cache_) {
+      // a new batch starts new sequences
+      size_t elem_bytes = type2bytes[K_->dtype()];
+      K_cache_ = state_store()->Get(name_ + ":K", bs_, head_num_ * head_size_qk_ * elem_bytes);
+      V_cache_ = state_store()->Get(name_ + ":V", bs_, head_num_ * head_size_v_ * elem_bytes);
+      K_cache_->Reserve(K_cache_->length() + seq_len_kv_);
+      V_cache_->Reserve(V_cache_->length() + seq_len_kv_);
+      kv_cache_capacity_ = K_cache_->capacity();
+      seq_len_kv_ = kv_cache_capacity_;
+    }
     attr_map["merged_QKV"] = "False";
     attn_shape = {bs_, seq_len_q_, head_num_, head_size_v_};
   } else {
@@ -402,23 +420,43 @@ void MultiHeadAttentionOperator::ReshapeDense(const vector<Tensor*>& input, cons
       ts_descs[io::SRC_K] = {attn_shape, qkv_dtype, qkv_ft};
       ts_descs[io::SRC_V] = {attn_shape, qkv_dtype, qkv_ft};
     }
-    if (att_mask_ != nullptr) {
+    if (att_mask_ != nullptr || kv_cache_) {
       ts_descs[io::MASK] = {{bs_}, dt::s32, ft::a};
     }
     ts_descs[io::DST] = {attn_shape, (dst_->dtype() == "bf16") ? dt::bf16 : dt::u8, qkv_ft};
 
     if (binary_add_mask_ != nullptr) {
-      const auto& badd_mask_size = binary_add_mask_->shape().size();
+      vector<int64_t> badd_shape = binary_add_mask_->shape();
+      const auto& badd_mask_size = badd_shape.size();
       LOG_IF(FATAL, badd_mask_size > dst_->shape().size()) << "Unsupported binary add mask dimension";
-      ts_descs[io::BINARY_ADD] = {binary_add_mask_->shape(), dt::fp32, jd::plain_format(badd_mask_size)};
+      // the mask covers the whole sequence, it is widened to the rows of the cache in Forward
+      if (kv_cache_) badd_shape.back() = kv_cache_capacity_;
+      ts_descs[io::BINARY_ADD] = {badd_shape, dt::fp32, jd::plain_format(badd_mask_size)};
     }
   }
   jd::operator_desc op_desc(jd::kernel_kind::mha_dense, jd::kernel_prop::forward_inference, jd::engine_kind::cpu,
                             ts_descs, attr_map);
   jd::mha_dense_desc mha_dense_d(op_desc);
   mha_dense_ = jd::mha_dense(mha_dense_d);
+  size_t workspace_size = mha_dense_.get_workspace_size();
+
+  // self-attention in the shapes of the VNNI kernel, any other host would only get the reference for it
+  ragged_ = !is_dynamic_ && !kv_cache_ && att_mask_ != nullptr && seq_len_q_ == seq_len_kv_ &&
+            ts_descs[io::SRC_Q].dtype() == dt::s8 && head_size_qk_ == head_size_v_ && head_size_qk_ % 16 == 0 &&
+            get_max_isa() >= isa::avx512_core_vnni;
+  if (ragged_) {
+    seq_offset_.resize(bs_);
+    for (int i = 0; i < bs_; ++i) seq_offset_[i] = i * seq_len_q_;
+    ts_descs[io::SEQ_OFFSET] = {{bs_}, dt::s32, ft::a};
+    jd::operator_desc ragged_desc(jd::kernel_kind::mha_dense, jd::kernel_prop::forward_inference,
+                                  jd::engine_kind::cpu, ts_descs, attr_map);
+    jd::mha_dense_desc mha_ragged_d(ragged_desc);
+    mha_ragged_ = jd::mha_dense(mha_ragged_d);
+    rt_data_[io::SEQ_OFFSET] = seq_offset_.data();
+    workspace_size = std::max(workspace_size, mha_ragged_.get_workspace_size());
+  }
   if (workspace_) MemoryAllocator::get().UnrefMemory(workspace_);
-  workspace_ = MemoryAllocator::get().GetMemory(mha_dense_.get_workspace_size(), 1);
+  workspace_ = AcquireWorkspace(workspace_size);
   rt_data_[io::WORKSPACE] = workspace_;
   if (!dst_reshape_.empty()) {
     vector<int64_t> dst_shape = GetDstShape(dst_reshape_, dst_->size(), {}, {});
@@ -462,9 +500,58 @@ void MultiHeadAttentionOperator::ForwardSparse(const vector<Tensor*>& input, con
   this->unref_tensors(input);
 }
 
+void MultiHeadAttentionOperator::AppendKVCache(const vector<Tensor*>& input, const vector<Tensor*>& output,
+                                               int8_t** K_data, int8_t** V_data) {
+  // bs x new_tokens x head_num x head_size (K, V)
+  const int64_t new_tokens = K_->shape()[1];
+  const int64_t seq_len = K_cache_->length() + new_tokens;
+  K_cache_->Reserve(seq_len);
+  V_cache_->Reserve(seq_len);
+  // the kernel is rebuilt when the cache grows, i.e. log2 times of the sequence length
+  if (K_cache_->capacity() != kv_cache_capacity_) ReshapeDense(input, output);
+  // the padding mask counts the valid new tokens of each batch, padded rows keep their own length in the cache
+  const int32_t* valid = att_mask_ == nullptr ? nullptr : reinterpret_cast<const int32_t*>(att_mask_->data());
+  bool padded = false;
+  for (int i = 0; valid != nullptr && i < bs_; ++i) padded |= valid[i] < new_tokens;
+  LOG_IF(FATAL, padded && binary_add_mask_ != nullptr)
+      << name_ << ": a padded batch with kv_cache takes the padding mask, not a binary add mask as well";
+  K_cache_->Append(*K_data, new_tokens, K_cache_->row_bytes(), valid);
+  V_cache_->Append(*V_data, new_tokens, V_cache_->row_bytes(), valid);
+  *K_data = reinterpret_cast<int8_t*>(K_cache_->data());
+  *V_data = reinterpret_cast<int8_t*>(V_cache_->data());
+  kv_cache_len_.resize(bs_);
+  for (int i = 0; i < bs_; ++i) kv_cache_len_[i] = static_cast<int32_t>(K_cache_->length(i));
+  rt_data_[io::MASK] = kv_cache_len_.data();
+
+  if (binary_add_mask_ != nullptr) {
+    const int64_t mask_len = binary_add_mask_->shape().back();
+    LOG_IF(FATAL, mask_len != seq_len) << name_ << ": binary add mask covers " << mask_len
+                                       << " tokens but the sequence has " << seq_len;
+    const int64_t rows = binary_add_mask_->size() / mask_len;
+    const float* mask = reinterpret_cast<const float*>(binary_add_mask_->data());
+    kv_cache_badd_.resize(rows * kv_cache_capacity_);
+#pragma omp parallel for
+    for (int64_t r = 0; r < rows; ++r) {
+      memcpy(kv_cache_badd_.data() + r * kv_cache_capacity_, mask + r * mask_len, mask_len * sizeof(float));
+      // rows behind the sequence are cut by the padding mask
+      memset(kv_cache_badd_.data() + r * kv_cache_capacity_ + mask_len, 0,
+             (kv_cache_capacity_ - mask_len) * sizeof(float));
+    }
+  }
+}
+
+StateStore* MultiHeadAttentionOperator::state_store() const {
+  return model_ == nullptr ? nullptr : model_->state_store();
+}
+
 void MultiHeadAttentionOperator::ForwardDense(const vector<Tensor*>& input, const vector<Tensor*>& output) {
   int8_t *Q_data = nullptr, *K_data = nullptr, *V_data = nullptr;
-  if (Q_ != nullptr) {
+  if (Q_ != nullptr && kv_cache_) {
+    Q_data = reinterpret_cast<int8_t*>(Q_->mutable_data());
+    K_data = reinterpret_cast<int8_t*>(K_->mutable_data());
+    V_data = reinterpret_cast<int8_t*>(V_->mutable_data());
+    AppendKVCache(input, output, &K_data, &V_data);
+  } else if (Q_ != nullptr) {
     Q_data = reinterpret_cast<int8_t*>(Q_->mutable_data());
     K_data = reinterpret_cast<int8_t*>(K_->mutable_data());
     V_data = reinterpret_cast<int8_t*>(V_->mutable_data());
@@ -497,9 +584,11 @@ void MultiHeadAttentionOperator::ForwardDense(const vector<Tensor*>& input, cons
   rt_data_[io::SRC_Q] = Q_data;
   rt_data_[io::SRC_K] = K_data;
   rt_data_[io::SRC_V] = V_data;
-  if (att_mask_ != nullptr) rt_data_[io::MASK] = reinterpret_cast<int32_t*>(att_mask_->mutable_data());
+  if (att_mask_ != nullptr && !kv_cache_) rt_data_[io::MASK] = reinterpret_cast<int32_t*>(att_mask_->mutable_data());
   rt_data_[io::DST] = dst_data;
-  if (binary_add_mask_ != nullptr) {
+  if (binary_add_mask_ != nullptr && kv_cache_) {
+    rt_data_[io::BINARY_ADD] = kv_cache_badd_.data();
+  } else if (binary_add_mask_ != nullptr) {
     float* binary_add_mask_data = reinterpret_cast<float*>(binary_add_mask_->mutable_data());
     rt_data_[io::BINARY_ADD] = binary_add_mask_data;
   }
@@ -509,7 +598,22 @@ void MultiHeadAttentionOperator::ForwardDense(const vector<Tensor*>& input, cons
     rt_data_[io::V_SCALE] = V_max_->mutable_data();
     if (output.size() > 1) rt_data_[io::DST_SCALE] = dst_max_->mutable_data();
   }
-  mha_dense_.execute(rt_data_);
+
+  // skip the padding when it is at least a quarter of the batch
+  const int32_t* seq_len = ragged_ ? reinterpret_cast<const int32_t*>(att_mask_->data()) : nullptr;
+  int64_t tokens = 0;
+  for (int i = 0; ragged_ && i < bs_; ++i) tokens += std::min(seq_len[i], seq_len_q_);
+  if (ragged_ && tokens * 4 <= static_cast<int64_t>(bs_) * seq_len_q_ * 3) {
+    mha_ragged_.execute(rt_data_);
+    const int64_t row_bytes = head_num_ * head_size_v_;  // u8 dst
+#pragma omp parallel for
+    for (int i = 0; i < bs_; ++i) {
+      const int len = std::min(seq_len[i], seq_len_q_);
+      memset(dst_data + (i * seq_len_q_ + len) * row_bytes, QKV_zeropoint_, (seq_len_q_ - len) * row_bytes);
+    }
+  } else {
+    mha_dense_.execute(rt_data_);
+  }
   this->unref_tensors(input);
 }
 
@@ -16,127 +16,116 @@
 
 namespace executor {
 
-static inline float _mm256_reduce_add_ps(__m256 x) {
-  const __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(x, 1), _mm256_castps256_ps128(x));
-  const __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
-  const __m128 x32 = _mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55));
-  return _mm_cvtss_f32(x32);
+// Every variant normalizes one row: dst = src * gamma / sqrt((sum(src^2) + epsilon) / norm_dim). The variants only
+// differ in the instructions they are compiled for, the one of the host is picked at Prepare time.
+static inline float bf16_to_fp32(uint16_t x) {
+  uint32_t bits = static_cast<uint32_t>(x) << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
 }
 
-#if __AVX512F__
-#define FP32_POWXSUM(zmm1, zmm2)    \
-  zmm2 = _mm512_mul_ps(zmm2, zmm2); \
-  zmm1 = _mm512_add_ps(zmm1, zmm2);
-#elif __AVX2__
-#define FP32_POWXSUM(ymm1, ymm2)    \
-  ymm2 = _mm256_mul_ps(ymm2, ymm2); \
-  ymm1 = _mm256_add_ps(ymm1, ymm2);
-#endif
-
-#if __AVX512F__
-void fp32_norm(char* src, const float* gamma, char* dst, int norm_dim, __m512* scale) {
-  for (int i = 0; i < norm_dim; i += 16) {
-    auto zmm_src = _mm512_loadu_ps(src + i * 4);
-    auto zmm_gamma = _mm512_loadu_ps(gamma + i);
-    auto zmm_fin_scale = _mm512_mul_ps(zmm_gamma, *scale);
-    _mm512_storeu_ps(dst + i * 4, _mm512_mul_ps(zmm_src, zmm_fin_scale));
-  }
+// round to nearest even as vcvtneps2bf16 does
+static inline uint16_t fp32_to_bf16(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
 }
-#elif __AVX2__
-void fp32_norm(char* src, const float* gamma, char* dst, int norm_dim, __m256* scale) {
-  for (int i = 0; i < norm_dim; i += 8) {
-    auto ymm_src = _mm256_loadu_ps(reinterpret_cast<float*>(static_cast<void*>(src)) + i);
-    auto ymm_gamma = _mm256_loadu_ps(gamma + i);
-    auto ymm_fin_scale = _mm256_mul_ps(ymm_gamma, *scale);
-    _mm256_storeu_ps(reinterpret_cast<float*>(static_cast<void*>(dst)) + i, _mm256_mul_ps(ymm_src, ymm_fin_scale));
+
+template <bool is_bf16>
+void rms_norm_scalar(const char* src, const float* gamma, char* dst, int64_t norm_dim, float epsilon) {
+  auto load = [&](int64_t i) {
+    return is_bf16 ? bf16_to_fp32(reinterpret_cast<const uint16_t*>(src)[i]) : reinterpret_cast<const float*>(src)[i];
+  };
+  float powx_sum = 0.f;
+  for (int64_t i = 0; i < norm_dim; ++i) powx_sum += load(i) * load(i);
+  const float scale = 1.f / std::sqrt((powx_sum + epsilon) / norm_dim);
+  for (int64_t i = 0; i < norm_dim; ++i) {
+    float val = load(i) * gamma[i] * scale;
+    if (is_bf16) {
+      reinterpret_cast<uint16_t*>(dst)[i] = fp32_to_bf16(val);
+    } else {
+      reinterpret_cast<float*>(dst)[i] = val;
+    }
   }
 }
-#endif
-
-#if __AVX512F__
-static inline __m512 bf16_load(float* addr) {
-  auto bf16_data = _mm256_loadu_ps(addr);
-#if __AVX512BF16__ && __GNUC__ > 11
-  return _mm512_cvtpbh_ps((__m256bh)bf16_data);
-#else
-  auto y = _mm512_cvtepu16_epi32(_mm256_castps_si256(bf16_data));
-  return _mm512_castsi512_ps(_mm512_bslli_epi128(y, 2));
-#endif
-}
-#elif __AVX2__
-static inline __m256 bf16_load(float* addr) {
-  auto bf16_data = _mm_loadu_ps(addr);
-  auto y = _mm256_cvtepu16_epi32(_mm_castps_si128(bf16_data));
-  return _mm256_castsi256_ps(_mm256_bslli_epi128(y, 2));
+
+NE_TARGET_AVX2 static inline __m256 bf16_load_avx2(const char* addr) {
+  auto y = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(addr)));
+  return _mm256_castsi256_ps(_mm256_slli_epi32(y, 16));
 }
-#endif
-
-#if __AVX512F__
-void bf16_norm(char* src, const float* gamma, char* dst, int norm_dim, __m512* scale) {
-  for (int i = 0; i < norm_dim; i += 16) {
-    auto zmm_src = bf16_load(static_cast<float*>(static_cast<void*>(src + i * 2)));
-    auto zmm_gamma = _mm512_loadu_ps(gamma + i);
-    auto zmm_fin_scale = _mm512_mul_ps(zmm_gamma, *scale);
-    auto zmm_dst = _mm512_mul_ps(zmm_src, zmm_fin_scale);
-    auto bf16_dst = cvt_fp32_to_bf16(zmm_dst);
-    _mm256_storeu_ps(static_cast<float*>(static_cast<void*>(dst + i * 2)), _mm256_castsi256_ps(bf16_dst));
-  }
+
+NE_TARGET_AVX2 static inline void bf16_store_avx2(char* addr, __m256 x) {
+  auto bits = _mm256_castps_si256(x);
+  auto lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+  bits = _mm256_srli_epi32(_mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff))), 16);
+  // pack the low halves of the 8 dwords, packus works within 128-bit lanes
+  auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits, bits), 0x08);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(addr), _mm256_castsi256_si128(packed));
 }
-#elif __AVX2__
-void bf16_norm(char* src, const float* gamma, char* dst, int norm_dim, __m256* scale) {
-  for (int i = 0; i < norm_dim; i += 8) {
-    auto ymm_src = bf16_load(static_cast<float*>(static_cast<void*>(src + i * 2)));
-    auto ymm_gamma = _mm256_loadu_ps(gamma + i);
-    auto ymm_fin_scale = _mm256_mul_ps(ymm_gamma, *scale);
-    auto ymm_dst = _mm256_mul_ps(ymm_src, ymm_fin_scale);
-    auto bf16_dst = cvt_fp32_to_bf16(ymm_dst);
-    _mm_storeu_ps(static_cast<float*>(static_cast<void*>(dst + i * 2)), _mm_castsi128_ps(bf16_dst));
-  }
+
+NE_TARGET_AVX2 static inline float reduce_add_avx2(__m256 x) {
+  const __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(x, 1), _mm256_castps256_ps128(x));
+  const __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
+  const __m128 x32 = _mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55));
+  return _mm_cvtss_f32(x32);
 }
-#endif
 
-template <int dt_bytewidth>
-void RmsNormOperator::RmsNormParallelB(const void* src_data, const float* gamma_data, void* dst_data) {
-#pragma omp parallel for
-  for (int batch = 0; batch < batchs_; batch++) {
-    auto offset = batch * norm_dim_ * dt_bytewidth_;
-    auto src = static_cast<const char*>(src_data) + offset;
-    auto dst = static_cast<char*>(dst_data) + offset;
-
-#if __AVX512F__
-    auto zmm_powx_sum = _mm512_setzero_ps();
-    for (int j = 0; j < norm_dim_; j += 16) {
-#if dt_bytewidth == 2
-      auto zmm_src = bf16_load(static_cast<float*>(static_cast<void*>(const_cast<char*>(src) + j * 2)));
-#else
-      auto zmm_src = _mm512_loadu_ps(src + j * dt_bytewidth_);
-#endif
-      FP32_POWXSUM(zmm_powx_sum, zmm_src);
+template <bool is_bf16>
+NE_TARGET_AVX2 void rms_norm_avx2(const char* src, const float* gamma, char* dst, int64_t norm_dim, float epsilon) {
+  constexpr int dt_bytewidth = is_bf16 ? 2 : 4;
+  auto load = [&](int64_t i) NE_TARGET_AVX2 {
+    return is_bf16 ? bf16_load_avx2(src + i * dt_bytewidth) : _mm256_loadu_ps(reinterpret_cast<const float*>(src) + i);
+  };
+  auto ymm_powx_sum = _mm256_setzero_ps();
+  for (int64_t i = 0; i < norm_dim; i += 8) {
+    auto ymm_src = load(i);
+    ymm_powx_sum = _mm256_fmadd_ps(ymm_src, ymm_src, ymm_powx_sum);
+  }
+  auto ymm_scale = _mm256_set1_ps(1.f / std::sqrt((reduce_add_avx2(ymm_powx_sum) + epsilon) / norm_dim));
+  for (int64_t i = 0; i < norm_dim; i += 8) {
+    auto ymm_dst = _mm256_mul_ps(load(i), _mm256_mul_ps(_mm256_loadu_ps(gamma + i), ymm_scale));
+    if (is_bf16) {
+      bf16_store_avx2(dst + i * dt_bytewidth, ymm_dst);
+    } else {
+      _mm256_storeu_ps(reinterpret_cast<float*>(dst) + i, ymm_dst);
     }
+  }
+}
 
-    auto powx_mean = (_mm512_reduce_add_ps(zmm_powx_sum) + epsilon_) / norm_dim_;
-
-    auto zmm_scale = _mm512_set1_ps(powx_mean);
-    zmm_scale = _mm512_rsqrt14_ps(zmm_scale);
-    parallelB_norm_callback_(const_cast<char*>(src), gamma_data, dst, norm_dim_, &zmm_scale);
-#elif __AVX2__
-    auto ymm_powx_sum = _mm256_setzero_ps();
-    for (int j = 0; j < norm_dim_; j += 8) {
-#if dt_bytewidth == 2
-      auto ymm_src = bf16_load(static_cast<float*>(static_cast<void*>(const_cast<char*>(src) + j * 2)));
-#else
-      auto ymm_src =
-          _mm256_loadu_ps(static_cast<float*>(static_cast<void*>(const_cast<char*>(src) + j * dt_bytewidth_)));
-#endif
-      FP32_POWXSUM(ymm_powx_sum, ymm_src);
-    }
+NE_TARGET_AVX512 static inline __m512 bf16_load_avx512(const char* addr) {
+  auto y = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(addr)));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(y, 16));
+}
 
-    auto powx_mean = (_mm256_reduce_add_ps(ymm_powx_sum) + epsilon_) / norm_dim_;
+NE_TARGET_AVX512 static inline void bf16_store_avx512(char* addr, __m512 x) {
+  auto bits = _mm512_castps_si512(x);
+  auto lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+  bits = _mm512_srli_epi32(_mm512_add_epi32(bits, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff))), 16);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(addr), _mm512_cvtepi32_epi16(bits));
+}
 
-    auto ymm_scale = _mm256_set1_ps(powx_mean);
-    ymm_scale = _mm256_rsqrt_ps(ymm_scale);
-    parallelB_norm_callback_(const_cast<char*>(src), gamma_data, dst, norm_dim_, &ymm_scale);
-#endif
+template <bool is_bf16>
+NE_TARGET_AVX512 void rms_norm_avx512(const char* src, const float* gamma, char* dst, int64_t norm_dim,
+                                      float epsilon) {
+  constexpr int dt_bytewidth = is_bf16 ? 2 : 4;
+  auto load = [&](int64_t i) NE_TARGET_AVX512 {
+    return is_bf16 ? bf16_load_avx512(src + i * dt_bytewidth)
+                   : _mm512_loadu_ps(reinterpret_cast<const float*>(src) + i);
+  };
+  auto zmm_powx_sum = _mm512_setzero_ps();
+  for (int64_t i = 0; i < norm_dim; i += 16) {
+    auto zmm_src = load(i);
+    zmm_powx_sum = _mm512_fmadd_ps(zmm_src, zmm_src, zmm_powx_sum);
+  }
+  auto zmm_scale = _mm512_set1_ps(1.f / std::sqrt((_mm512_reduce_add_ps(zmm_powx_sum) + epsilon) / norm_dim));
+  for (int64_t i = 0; i < norm_dim; i += 16) {
+    auto zmm_dst = _mm512_mul_ps(load(i), _mm512_mul_ps(_mm512_loadu_ps(gamma + i), zmm_scale));
+    if (is_bf16) {
+      bf16_store_avx512(dst + i * dt_bytewidth, zmm_dst);
+    } else {
+      _mm512_storeu_ps(reinterpret_cast<float*>(dst) + i, zmm_dst);
+    }
   }
 }
 
@@ -149,10 +138,16 @@ void RmsNormOperator::Prepare(const vector<Tensor*>& input, const vector<Tensor*
   Tensor* src = input[0];
   assert(src->dtype() == "fp32" || src->dtype() == "bf16");
   dt_bytewidth_ = src->dtype() == "fp32" ? 4 : 2;
-  if (dt_bytewidth_ == 4) {
-    parallelB_norm_callback_ = fp32_norm;
-  } else {
-    parallelB_norm_callback_ = bf16_norm;
+  const bool is_bf16 = dt_bytewidth_ == 2;
+  switch (RuntimeIsa()) {
+    case Isa::kAvx512:
+      rms_norm_kernel_ = is_bf16 ? rms_norm_avx512<true> : rms_norm_avx512<false>;
+      break;
+    case Isa::kAvx2:
+      rms_norm_kernel_ = is_bf16 ? rms_norm_avx2<true> : rms_norm_avx2<false>;
+      break;
+    default:
+      rms_norm_kernel_ = is_bf16 ? rms_norm_scalar<true> : rms_norm_scalar<false>;
   }
   output[0]->set_dtype(src->dtype());
 }
@@ -174,10 +169,12 @@ void RmsNormOperator::Forward(const vector<Tensor*>& input, const vector<Tensor*
   Tensor* dst = output[0];
   void* dst_data = dst->mutable_data();
 
-  if (dt_bytewidth_ == 4)
-    RmsNormParallelB<4>(src_data, gamma_data, dst_data);
-  else
-    RmsNormParallelB<2>(src_data, gamma_data, dst_data);
+#pragma omp parallel for
+  for (int batch = 0; batch < batchs_; batch++) {
+    auto offset = batch * norm_dim_ * dt_bytewidth_;
+    rms_norm_kernel_(static_cast<const char*>(src_data) + offset, gamma_data, static_cast<char*>(dst_data) + offset,
+                     norm_dim_, epsilon_);
+  }
 
   this->unref_tensors(input);
 }
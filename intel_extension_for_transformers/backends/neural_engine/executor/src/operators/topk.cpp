@@ -17,7 +17,7 @@
 #include "operator_registry.hpp"
 
 namespace executor {
-
+using io = jd::exposed_enum::topk::io;
 
 TopKOperator::TopKOperator(const shared_ptr<OperatorConfig>& conf)
     : Operator(conf),
@@ -46,7 +46,25 @@ void TopKOperator::Reshape(const vector<Tensor*>& input, const vector<Tensor*>&
   dst_shape[axis_] = k_;
   output[0]->set_shape(dst_shape);
   output[0]->set_dtype("int32");
+
+  use_kernel_ = input[0]->dtype() == "fp32" && axis_ == static_cast<int64_t>(input_shape.size()) - 1;
+  if (use_kernel_) {
+    std::vector<jd::tensor_desc> ts_descs(io::SIZE);
+    ts_descs[io::SRC] = {input_shape, jd::data_type::fp32, jd::plain_format(input_shape.size())};
+    ts_descs[io::DST] = {dst_shape, jd::data_type::fp32, jd::plain_format(dst_shape.size())};
+    ts_descs[io::IDX] = {dst_shape, jd::data_type::s32, jd::plain_format(dst_shape.size())};
+    std::unordered_map<std::string, std::string> attr_map;
+    attr_map["k"] = std::to_string(k_);
+    attr_map["largest"] = largest_ ? "true" : "false";
+    attr_map["sorted"] = sorted_ ? "true" : "false";
+    jd::operator_desc op_desc(jd::kernel_kind::topk, jd::kernel_prop::forward_inference, jd::engine_kind::cpu,
+                              ts_descs, attr_map);
+    jd::topk_desc topk_d(op_desc);
+    topk_ = jd::topk(topk_d);
+    values_.resize(ts_descs[io::DST].size());
+    rt_data_.resize(io::SIZE, nullptr);
   }
+}
 
 static int64_t SizeHelper(size_t start, size_t end, const vector<int64_t>& shape) {
   // Must return 1 for an empty sequence
@@ -155,6 +173,13 @@ struct LesserValueCmp {
 
 // 2. inference kernel(for int8 and f32)
 void TopKOperator::Forward(const vector<Tensor*>& input, const vector<Tensor*>& output) {
+  if (use_kernel_) {
+    rt_data_[io::SRC] = input[0]->data();
+    rt_data_[io::DST] = values_.data();
+    rt_data_[io::IDX] = output[0]->mutable_data();
+    topk_.execute(rt_data_);
+    return;
+  }
   const auto& src0 = input[0];
   const auto& dst0 = output[0];
   const auto& input_shape = src0->shape();
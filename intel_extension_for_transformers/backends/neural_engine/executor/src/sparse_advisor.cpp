@@ -0,0 +1,97 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "sparse_advisor.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace executor {
+
+SparseFormatAdvisor::SparseFormatAdvisor(const std::vector<SparseFormat>& candidates, float block_cost)
+    : block_cost_(block_cost) {
+  for (const SparseFormat& format : candidates) costs_.push_back({format, 1.f, format.dense() ? 1.f : block_cost});
+  if (costs_.empty()) costs_.push_back({{"dense", 0, 0, 1, true}, 1.f, 1.f});
+  auto first_supported =
+      std::find_if(costs_.begin(), costs_.end(), [](const SparseFormatCost& c) { return c.format.supported; });
+  selected_ = first_supported == costs_.end() ? 0 : first_supported - costs_.begin();
+}
+
+float SparseFormatAdvisor::DefaultBlockCost() {
+  const char* env = getenv("ENGINE_SPARSE_BLOCK_COST");
+  if (env == nullptr) return 2.5f;
+  float block_cost = atof(env);
+  return block_cost > 0.f ? block_cost : 2.5f;
+}
+
+template <typename T>
+const SparseFormatCost& SparseFormatAdvisor::Advise(const T* weight, int64_t N, int64_t K, bool transposed) {
+  auto at = [&](int64_t n, int64_t k) { return transposed ? weight[k * N + n] : weight[n * K + k]; };
+  for (SparseFormatCost& c : costs_) {
+    const SparseFormat& f = c.format;
+    if (f.dense()) continue;
+    const int64_t block_rows = (N + f.block_n - 1) / f.block_n;
+    const int64_t block_cols = (K + f.block_k - 1) / f.block_k;
+    int64_t stored = 0;
+    for (int64_t br = 0; br < block_rows; ++br) {
+      int64_t nnz = 0;
+      for (int64_t bc = 0; bc < block_cols; ++bc) {
+        bool nonzero = false;
+        for (int64_t n = br * f.block_n; n < std::min(N, (br + 1) * f.block_n) && !nonzero; ++n) {
+          for (int64_t k = bc * f.block_k; k < std::min(K, (bc + 1) * f.block_k); ++k) {
+            if (at(n, k) != 0) {
+              nonzero = true;
+              break;
+            }
+          }
+        }
+        nnz += nonzero;
+      }
+      stored += (nnz + f.group - 1) / f.group * f.group;
+    }
+    c.block_density = block_rows * block_cols == 0 ? 0.f : static_cast<float>(stored) / (block_rows * block_cols);
+    c.cost = block_cost_ * c.block_density;
+  }
+  for (size_t i = 0; i < costs_.size(); ++i) {
+    if (!costs_[i].format.supported) continue;
+    if (!costs_[selected_].format.supported || costs_[i].cost < costs_[selected_].cost) selected_ = i;
+  }
+  return selected();
+}
+template const SparseFormatCost& SparseFormatAdvisor::Advise<float>(const float*, int64_t, int64_t, bool);
+template const SparseFormatCost& SparseFormatAdvisor::Advise<int8_t>(const int8_t*, int64_t, int64_t, bool);
+
+std::string SparseFormatAdvisor::Report() const {
+  auto entry = [&](size_t i) {
+    const SparseFormatCost& c = costs_[i];
+    const char* starred = i == selected_ && c.format.supported ? "*" : "";
+    char buf[128];
+    if (c.format.dense()) {
+      snprintf(buf, sizeof(buf), "%s%s %.2fx", starred, c.format.name.c_str(), c.cost);
+    } else {
+      snprintf(buf, sizeof(buf), "%s%s %.1f%% %.2fx", starred, c.format.name.c_str(), c.block_density * 100, c.cost);
+    }
+    return std::string(buf);
+  };
+  std::string supported, unsupported;
+  for (size_t i = 0; i < costs_.size(); ++i) {
+    std::string& list = costs_[i].format.supported ? supported : unsupported;
+    list += (list.empty() ? "" : "; ") + entry(i);
+  }
+  return unsupported.empty() ? supported : supported + " | " + unsupported;
+}
+
+}  // namespace executor
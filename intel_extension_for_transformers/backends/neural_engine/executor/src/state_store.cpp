@@ -0,0 +1,132 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "state_store.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "glog/logging.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace executor {
+
+namespace {
+
+constexpr size_t kBufferAlignment = 64;
+
+void* BufferAlloc(size_t bytes) {
+  bytes = (bytes + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+#ifdef _WIN32
+  return _aligned_malloc(bytes, kBufferAlignment);
+#else
+  return aligned_alloc(kBufferAlignment, bytes);
+#endif
+}
+
+void BufferFree(void* ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+}  // namespace
+
+constexpr int64_t StateBuffer::kMinCapacity;
+
+StateBuffer::StateBuffer(int64_t batch, size_t row_bytes) : batch_(batch), row_bytes_(row_bytes) {
+  CHECK(batch > 0 && row_bytes > 0) << "state buffer needs a positive batch and row size";
+  lengths_.assign(batch, 0);
+}
+
+StateBuffer::~StateBuffer() {
+  if (data_ != nullptr) BufferFree(data_);
+}
+
+bool StateBuffer::Reserve(int64_t length) {
+  if (length <= capacity_) return false;
+  int64_t capacity = std::max(capacity_, kMinCapacity);
+  while (capacity < length) capacity *= 2;
+  char* data = static_cast<char*>(BufferAlloc(batch_ * capacity * row_bytes_));
+  CHECK(data != nullptr) << "failed to allocate " << batch_ * capacity * row_bytes_ << " bytes of state";
+  if (data_ != nullptr) {
+    for (int64_t b = 0; b < batch_; ++b) {
+      memcpy(data + b * capacity * row_bytes_, data_ + b * capacity_ * row_bytes_, length_ * row_bytes_);
+    }
+    BufferFree(data_);
+  }
+  DLOG(INFO) << "State buffer grows from " << capacity_ << " to " << capacity << " rows";
+  data_ = data;
+  capacity_ = capacity;
+  return true;
+}
+
+void StateBuffer::Append(const void* src, int64_t rows, size_t src_row_stride, const int32_t* valid) {
+  CHECK_LE(length_ + rows, capacity_) << "state buffer has to be reserved before appending";
+  const char* src_rows = static_cast<const char*>(src);
+  for (int64_t b = 0; b < batch_; ++b) {
+    // the padding is copied as well, a batch never reads its rows behind its own length
+    char* dst = data_ + (b * capacity_ + lengths_[b]) * row_bytes_;
+    if (src_row_stride == row_bytes_) {
+      memcpy(dst, src_rows + b * rows * row_bytes_, rows * row_bytes_);
+    } else {
+      for (int64_t r = 0; r < rows; ++r) {
+        memcpy(dst + r * row_bytes_, src_rows + (b * rows + r) * src_row_stride, row_bytes_);
+      }
+    }
+    lengths_[b] += valid == nullptr ? rows : std::min<int64_t>(std::max(valid[b], 0), rows);
+  }
+  length_ = *std::max_element(lengths_.begin(), lengths_.end());
+}
+
+void StateBuffer::Clear() {
+  length_ = 0;
+  lengths_.assign(batch_, 0);
+}
+
+StateBuffer* StateStore::Get(const std::string& name, int64_t batch, size_t row_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<StateBuffer>& buffer = buffers_[name];
+  if (buffer == nullptr || buffer->batch() != batch || buffer->row_bytes() != row_bytes) {
+    if (buffer != nullptr) LOG(INFO) << "State " << name << " changes its layout, the past sequence is dropped";
+    buffer.reset(new StateBuffer(batch, row_bytes));
+  }
+  return buffer.get();
+}
+
+void StateStore::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& buffer : buffers_) buffer.second->Clear();
+}
+
+void StateStore::Release() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffers_.clear();
+}
+
+size_t StateStore::reserved_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (auto& buffer : buffers_) bytes += buffer.second->reserved_bytes();
+  return bytes;
+}
+
+}  // namespace executor
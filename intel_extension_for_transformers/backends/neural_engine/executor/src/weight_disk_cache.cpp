@@ -0,0 +1,182 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "weight_disk_cache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>  // NOLINT
+
+#include "glog/logging.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace executor {
+
+namespace {
+
+const char kMagic[8] = {'E', 'N', 'G', 'W', 'C', 'A', 'C', 'H'};
+// the packed weight starts at a multiple of this behind the header
+constexpr size_t kDataAlignment = 64;
+// the fingerprint hashes chunks of this size in parallel and then the chunk hashes in order
+constexpr size_t kChunkBytes = 1 << 20;
+
+uint64_t HashBytes(const char* src, size_t bytes, uint64_t seed) {
+  constexpr uint64_t kMul = 0x9E3779B97F4A7C15ull;
+  uint64_t h = seed ^ (bytes * kMul);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, src + i, sizeof(word));
+    h = (h ^ word) * kMul;
+    h ^= h >> 29;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, src + i, bytes - i);
+  h = (h ^ tail) * kMul;
+  return h ^ (h >> 32);
+}
+
+struct EntryHeader {
+  char magic[8];
+  uint64_t key_len;
+  uint64_t bytes;
+};
+
+size_t DataOffset(size_t key_len) {
+  return (sizeof(EntryHeader) + key_len + kDataAlignment - 1) / kDataAlignment * kDataAlignment;
+}
+
+}  // namespace
+
+WeightDiskCache::WeightDiskCache(const std::string& dir) : dir_(dir) {
+  while (dir_.size() > 1 && (dir_.back() == '/' || dir_.back() == '\\')) dir_.pop_back();
+}
+
+WeightDiskCache& WeightDiskCache::Global() {
+  static WeightDiskCache cache(getenv("ENGINE_WEIGHT_CACHE_DIR") != NULL ? getenv("ENGINE_WEIGHT_CACHE_DIR") : "");
+  return cache;
+}
+
+size_t WeightDiskCache::Fingerprint(const void* data, size_t bytes) {
+  const char* src = static_cast<const char*>(data);
+  // every byte counts: two checkpoints of one shape may differ anywhere
+  const int64_t chunks = (bytes + kChunkBytes - 1) / kChunkBytes;
+  std::vector<uint64_t> chunk_hashes(chunks);
+#pragma omp parallel for
+  for (int64_t c = 0; c < chunks; ++c) {
+    const size_t begin = c * kChunkBytes;
+    chunk_hashes[c] = HashBytes(src + begin, std::min(kChunkBytes, bytes - begin), c);
+  }
+  return static_cast<size_t>(
+      HashBytes(reinterpret_cast<const char*>(chunk_hashes.data()), chunks * sizeof(uint64_t), bytes));
+}
+
+std::string WeightDiskCache::EntryPath(const std::string& key) const {
+  std::stringstream path;
+  path << dir_ << "/" << std::hex << std::hash<std::string>()(key) << ".bin";
+  return path.str();
+}
+
+void* WeightDiskCache::Load(const std::string& key, size_t bytes) {
+  if (!enabled()) return nullptr;
+  const std::string path = EntryPath(key);
+  std::ifstream entry(path, std::ios::in | std::ios::binary);
+  if (!entry) return nullptr;
+  EntryHeader header;
+  entry.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!entry || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.key_len != key.size() ||
+      header.bytes != bytes) {
+    return nullptr;
+  }
+  std::string stored_key(key.size(), '\0');
+  entry.read(&stored_key[0], key.size());
+  entry.close();
+  // another model, ISA or layout which hashed to the same entry
+  if (stored_key != key) return nullptr;
+  auto mapping = WeightMapping::Map(path, DataOffset(key.size()));
+  if (!mapping || mapping->size() < bytes) return nullptr;
+  std::lock_guard<std::mutex> lock(mutex_);
+  loaded_.push_back(mapping);
+  return mapping->Slice(0, bytes);
+}
+
+bool WeightDiskCache::Store(const std::string& key, const void* data, size_t bytes) {
+  if (!enabled()) return false;
+#ifdef _WIN32
+  _mkdir(dir_.c_str());
+#else
+  mkdir(dir_.c_str(), 0755);
+#endif
+  const std::string path = EntryPath(key);
+  // written aside and renamed, so that no process maps a half written entry
+  std::stringstream tmp_path;
+  tmp_path << path << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id());
+#ifndef _WIN32
+  tmp_path << "." << getpid();
+#endif
+  {
+    std::ofstream entry(tmp_path.str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!entry) {
+      LOG(WARNING) << "Can't write the weight cache entry " << path;
+      return false;
+    }
+    EntryHeader header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.key_len = key.size();
+    header.bytes = bytes;
+    entry.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    entry.write(key.data(), key.size());
+    std::string padding(DataOffset(key.size()) - sizeof(header) - key.size(), '\0');
+    entry.write(padding.data(), padding.size());
+    entry.write(static_cast<const char*>(data), bytes);
+    if (!entry) {
+      entry.close();
+      remove(tmp_path.str().c_str());
+      LOG(WARNING) << "Can't write the weight cache entry " << path;
+      return false;
+    }
+  }
+#ifdef _WIN32
+  remove(path.c_str());
+#endif
+  if (rename(tmp_path.str().c_str(), path.c_str()) != 0) {
+    remove(tmp_path.str().c_str());
+    return false;
+  }
+  DLOG(INFO) << "Stored " << bytes << " bytes of packed weight in " << path;
+  return true;
+}
+
+bool WeightDiskCache::Contains(const void* ptr) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& mapping : loaded_) {
+    if (mapping->Contains(ptr)) return true;
+  }
+  return false;
+}
+
+}  // namespace executor
@@ -0,0 +1,82 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "weight_mapping.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace executor {
+
+std::shared_ptr<WeightMapping> WeightMapping::Map(const std::string& file_name, size_t offset, bool prefetch,
+                                                  bool hugepage) {
+#ifdef _WIN32
+  LOG(INFO) << "Weight mapping is not supported on Windows, " << file_name << " will be read";
+  return nullptr;
+#else
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size <= 0 ||
+      static_cast<size_t>(file_stat.st_size) < offset) {
+    close(fd);
+    return nullptr;
+  }
+  size_t length = file_stat.st_size;
+  // private and writable: the pages are shared with the page cache until an operator writes to them
+  void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  close(fd);
+  if (addr == MAP_FAILED) {
+    LOG(WARNING) << "Failed to map " << file_name << ", it will be read";
+    return nullptr;
+  }
+#ifdef MADV_HUGEPAGE
+  if (hugepage && madvise(addr, length, MADV_HUGEPAGE) != 0) {
+    DLOG(INFO) << "Huge pages are not available for " << file_name;
+  }
+#endif
+  if (prefetch && madvise(addr, length, MADV_WILLNEED) != 0) {
+    DLOG(INFO) << "Failed to prefetch " << file_name;
+  }
+  DLOG(INFO) << "Mapped " << length << " bytes of " << file_name;
+  return std::shared_ptr<WeightMapping>(new WeightMapping(file_name, addr, length, offset));
+#endif
+}
+
+WeightMapping::WeightMapping(const std::string& file_name, void* addr, size_t length, size_t offset)
+    : file_name_(file_name),
+      addr_(addr),
+      length_(length),
+      data_(static_cast<const char*>(addr) + offset),
+      size_(length - offset) {}
+
+WeightMapping::~WeightMapping() {
+#ifndef _WIN32
+  munmap(addr_, length_);
+#endif
+}
+
+void* WeightMapping::Slice(int64_t offset, int64_t bytes) const {
+  if (offset < 0 || bytes < 0 || static_cast<size_t>(offset + bytes) > size_) return nullptr;
+  return const_cast<char*>(data_ + offset);
+}
+
+}  // namespace executor
@@ -0,0 +1,394 @@
+// Benchmark for the graph LLM runtime: sweeps prompt length, prompt batch size,
+// generation length, thread count and KV cache dtype, and reports the results as JSON.
+
+#include <stdlib.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#define MODEL_API_INTERNAL
+#include "models/llama/llama_config.h"
+#include "models/model_utils/model_utils.h"
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+struct bench_params {
+  std::string model = "models/7B/ne_core-model.bin";
+  std::string output = "";  // empty: print JSON to stdout
+  std::vector<int> n_prompt = {32, 512};
+  std::vector<int> n_batch = {512};
+  std::vector<int> n_gen = {128};
+  std::vector<int> n_threads = {get_num_physical_cores()};
+  std::vector<bool> f16_kv = {true};
+  int n_reps = 3;
+  int n_warmup = 1;
+  int seed = 1234;
+  bool use_mmap = true;
+};
+
+struct bench_result {
+  int n_prompt;
+  int n_batch;
+  int n_gen;
+  int n_threads;
+  bool f16_kv;
+
+  double prefill_ms;              // mean over repetitions
+  double prefill_tokens_per_s;
+  std::vector<double> decode_ms;  // per-token decode latency over all repetitions
+  double decode_bytes_per_token;  // weights + average KV bytes read per decode step
+  long rss_kb;                    // resident set after this configuration
+  long process_peak_rss_kb;       // peak of the process so far, i.e. of this and all earlier configurations
+};
+
+static void bench_print_usage(char** argv, const bench_params& params) {
+  fprintf(stderr, "usage: %s [options]\n", argv[0]);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "list-valued options take comma separated values, e.g. -p 32,128,512\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -h, --help            show this help message and exit\n");
+  fprintf(stderr, "  -m, --model FNAME     model path (default: %s)\n", params.model.c_str());
+  fprintf(stderr, "  -p, --n-prompt N,...  prompt lengths to prefill (default: 32,512)\n");
+  fprintf(stderr, "  -b, --batch-size N,.. batch sizes for prompt processing (default: 512)\n");
+  fprintf(stderr, "  -n, --n-gen N,...     number of tokens to generate (default: 128)\n");
+  fprintf(stderr, "  -t, --threads N,...   thread counts (default: %d)\n", params.n_threads[0]);
+  fprintf(stderr, "  --kv-type T,...       KV cache dtypes, f16 or f32 (default: f16)\n");
+  fprintf(stderr, "  -r, --repetitions N   measured repetitions per configuration (default: %d)\n", params.n_reps);
+  fprintf(stderr, "  --warmup N            warmup repetitions per configuration (default: %d)\n", params.n_warmup);
+  fprintf(stderr, "  -s, --seed N          RNG seed for the synthetic prompt (default: %d)\n", params.seed);
+  fprintf(stderr, "  --no-mmap             do not memory-map model\n");
+  fprintf(stderr, "  -o, --output FNAME    write JSON results to FNAME instead of stdout\n");
+  fprintf(stderr, "\n");
+}
+
+static bool bench_parse_int_list(const std::string& arg, std::vector<int>& out) {
+  out.clear();
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    char* end = nullptr;
+    const long v = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || v <= 0) {
+      return false;
+    }
+    out.push_back(static_cast<int>(v));
+  }
+  return !out.empty();
+}
+
+static bool bench_parse_kv_list(const std::string& arg, std::vector<bool>& out) {
+  out.clear();
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item == "f16") {
+      out.push_back(true);
+    } else if (item == "f32") {
+      out.push_back(false);
+    } else {
+      return false;
+    }
+  }
+  return !out.empty();
+}
+
+static bool bench_params_parse(int argc, char** argv, bench_params& params) {
+  bool invalid_param = false;
+  std::string arg;
+
+  for (int i = 1; i < argc; i++) {
+    arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      bench_print_usage(argv, params);
+      exit(0);
+    } else if (arg == "--no-mmap") {
+      params.use_mmap = false;
+      continue;
+    }
+
+    if (++i >= argc) {
+      invalid_param = true;
+      break;
+    }
+    const std::string value = argv[i];
+
+    if (arg == "-m" || arg == "--model") {
+      params.model = value;
+    } else if (arg == "-o" || arg == "--output") {
+      params.output = value;
+    } else if (arg == "-p" || arg == "--n-prompt") {
+      invalid_param = !bench_parse_int_list(value, params.n_prompt);
+    } else if (arg == "-b" || arg == "--batch-size") {
+      invalid_param = !bench_parse_int_list(value, params.n_batch);
+    } else if (arg == "-n" || arg == "--n-gen") {
+      invalid_param = !bench_parse_int_list(value, params.n_gen);
+    } else if (arg == "-t" || arg == "--threads") {
+      invalid_param = !bench_parse_int_list(value, params.n_threads);
+    } else if (arg == "--kv-type") {
+      invalid_param = !bench_parse_kv_list(value, params.f16_kv);
+    } else if (arg == "-r" || arg == "--repetitions") {
+      params.n_reps = std::max(1, std::stoi(value));
+    } else if (arg == "--warmup") {
+      params.n_warmup = std::max(0, std::stoi(value));
+    } else if (arg == "-s" || arg == "--seed") {
+      params.seed = std::stoi(value);
+    } else {
+      fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
+      bench_print_usage(argv, params);
+      exit(1);
+    }
+
+    if (invalid_param) {
+      break;
+    }
+  }
+
+  if (invalid_param) {
+    fprintf(stderr, "error: invalid parameter for argument: %s\n", arg.c_str());
+    bench_print_usage(argv, params);
+    return false;
+  }
+  return true;
+}
+
+static long bench_rss_kb() {
+#if defined(__linux__)
+  long pages = 0, resident = 0;
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (fp != NULL) {
+    const int n = fscanf(fp, "%ld %ld", &pages, &resident);
+    fclose(fp);
+    if (n == 2) {
+      return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+  }
+#endif
+  return -1;
+}
+
+static long bench_peak_rss_kb() {
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+  }
+#endif
+  return -1;
+}
+
+static double bench_percentile(std::vector<double> v, double p) {
+  if (v.empty()) {
+    return 0.0;
+  }
+  std::sort(v.begin(), v.end());
+  const double rank = p / 100.0 * (v.size() - 1);
+  const size_t lo = static_cast<size_t>(rank);
+  const size_t hi = std::min(lo + 1, v.size() - 1);
+  return v[lo] + (rank - lo) * (v[hi] - v[lo]);
+}
+
+static size_t bench_weight_bytes(model_context* ctx) {
+  size_t total = 0;
+  for (const auto& kv : model_internal_get_tensor_map(ctx)) {
+    total += ne_nbytes(kv.second);
+  }
+  return total;
+}
+
+static model_token bench_argmax(model_context* ctx) {
+  const float* logits = model_get_logits(ctx);
+  const int n_vocab = model_n_vocab(ctx);
+  return static_cast<model_token>(std::max_element(logits, logits + n_vocab) - logits);
+}
+
+// prefill `tokens` in chunks of `n_batch`, returns the elapsed time in us or -1 on failure
+static int64_t bench_prefill(model_context* ctx, const std::vector<model_token>& tokens, int n_batch, int n_threads) {
+  const int64_t t_start_us = model_time_us();
+  for (int i = 0; i < (int)tokens.size(); i += n_batch) {
+    const int n_eval = std::min(n_batch, (int)tokens.size() - i);
+    if (model_eval(ctx, tokens.data() + i, n_eval, i, n_threads)) {
+      return -1;
+    }
+  }
+  return model_time_us() - t_start_us;
+}
+
+// run `n_gen` single-token decode steps after a prompt of `n_past` tokens
+static bool bench_decode(model_context* ctx, int n_past, int n_gen, int n_threads, std::vector<double>* latency_ms) {
+  model_token token = bench_argmax(ctx);
+  for (int i = 0; i < n_gen; ++i) {
+    const int64_t t_start_us = model_time_us();
+    if (model_eval(ctx, &token, 1, n_past + i, n_threads)) {
+      return false;
+    }
+    const int64_t t_end_us = model_time_us();
+    if (latency_ms != nullptr) {
+      latency_ms->push_back((t_end_us - t_start_us) / 1000.0);
+    }
+    token = bench_argmax(ctx);
+  }
+  return true;
+}
+
+static void bench_write_json(FILE* fp, const bench_params& params, const std::vector<bench_result>& results) {
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"model\": \"%s\",\n", params.model.c_str());
+  fprintf(fp, "  \"system_info\": \"%s\",\n", model_print_system_info());
+  fprintf(fp, "  \"hardware_concurrency\": %u,\n", std::thread::hardware_concurrency());
+  fprintf(fp, "  \"repetitions\": %d,\n", params.n_reps);
+  fprintf(fp, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    const double decode_mean_ms =
+        r.decode_ms.empty() ? 0.0 : std::accumulate(r.decode_ms.begin(), r.decode_ms.end(), 0.0) / r.decode_ms.size();
+    const double decode_tokens_per_s = decode_mean_ms > 0.0 ? 1000.0 / decode_mean_ms : 0.0;
+    const double decode_gb_per_s = decode_mean_ms > 0.0 ? r.decode_bytes_per_token / (decode_mean_ms * 1e6) : 0.0;
+
+    fprintf(fp, "    {\n");
+    fprintf(fp, "      \"n_prompt\": %d,\n", r.n_prompt);
+    fprintf(fp, "      \"n_batch\": %d,\n", r.n_batch);
+    fprintf(fp, "      \"n_gen\": %d,\n", r.n_gen);
+    fprintf(fp, "      \"n_threads\": %d,\n", r.n_threads);
+    fprintf(fp, "      \"kv_type\": \"%s\",\n", r.f16_kv ? "f16" : "f32");
+    fprintf(fp, "      \"prefill_ms\": %.3f,\n", r.prefill_ms);
+    fprintf(fp, "      \"prefill_tokens_per_s\": %.3f,\n", r.prefill_tokens_per_s);
+    fprintf(fp, "      \"decode_tokens_per_s\": %.3f,\n", decode_tokens_per_s);
+    fprintf(fp, "      \"decode_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            decode_mean_ms, bench_percentile(r.decode_ms, 50), bench_percentile(r.decode_ms, 90),
+            bench_percentile(r.decode_ms, 99), bench_percentile(r.decode_ms, 100));
+    fprintf(fp, "      \"decode_bytes_per_token\": %.0f,\n", r.decode_bytes_per_token);
+    fprintf(fp, "      \"decode_mem_bandwidth_gb_per_s\": %.3f,\n", decode_gb_per_s);
+    fprintf(fp, "      \"rss_mb\": %.2f,\n", r.rss_kb / 1024.0);
+    fprintf(fp, "      \"process_peak_rss_mb\": %.2f\n", r.process_peak_rss_kb / 1024.0);
+    fprintf(fp, "    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(fp, "  ]\n");
+  fprintf(fp, "}\n");
+}
+
+int main(int argc, char** argv) {
+  bench_params params;
+
+  if (bench_params_parse(argc, argv, params) == false) {
+    return 1;
+  }
+
+  model_init_backend();
+
+  int n_ctx = 0;
+  for (int n_prompt : params.n_prompt) {
+    for (int n_gen : params.n_gen) {
+      n_ctx = std::max(n_ctx, n_prompt + n_gen);
+    }
+  }
+
+  std::mt19937 rng(params.seed);
+  std::vector<bench_result> results;
+
+  // the KV cache dtype is fixed at context creation, so the model is loaded once per KV dtype;
+  // with mmap the weights stay in the page cache between loads
+  for (bool f16_kv : params.f16_kv) {
+    auto lparams = model_context_default_params();
+    lparams.n_ctx = n_ctx;
+    lparams.seed = params.seed;
+    lparams.f16_kv = f16_kv;
+    lparams.use_mmap = params.use_mmap;
+
+    model_context* ctx = model_init_from_file(params.model.c_str(), lparams);
+    if (ctx == NULL) {
+      fprintf(stderr, "%s: error: failed to load model '%s'\n", __func__, params.model.c_str());
+      return 1;
+    }
+
+    const auto& hparams = ctx->model.hparams;
+    const size_t weight_bytes = bench_weight_bytes(ctx);
+    const size_t kv_bytes_per_token = 2u * hparams.n_layer * hparams.n_embd * ne_element_size(ctx->model.kv_self.k);
+    const int n_vocab = model_n_vocab(ctx);
+
+    for (int n_threads : params.n_threads) {
+      for (int n_batch : params.n_batch) {
+        for (int n_prompt : params.n_prompt) {
+          for (int n_gen : params.n_gen) {
+            std::uniform_int_distribution<model_token> dist(3, n_vocab - 1);
+            std::vector<model_token> tokens(n_prompt);
+            tokens[0] = model_token_bos();
+            for (int i = 1; i < n_prompt; ++i) {
+              tokens[i] = dist(rng);
+            }
+
+            fprintf(stderr, "%s: kv = %s, threads = %d, batch = %d, prompt = %d, gen = %d\n", __func__,
+                    f16_kv ? "f16" : "f32", n_threads, n_batch, n_prompt, n_gen);
+
+            for (int rep = 0; rep < params.n_warmup; ++rep) {
+              if (bench_prefill(ctx, tokens, n_batch, n_threads) < 0 ||
+                  !bench_decode(ctx, n_prompt, std::min(n_gen, 4), n_threads, nullptr)) {
+                fprintf(stderr, "%s: error: failed to eval\n", __func__);
+                model_free(ctx);
+                return 1;
+              }
+            }
+
+            bench_result r;
+            r.n_prompt = n_prompt;
+            r.n_batch = n_batch;
+            r.n_gen = n_gen;
+            r.n_threads = n_threads;
+            r.f16_kv = f16_kv;
+            r.decode_ms.reserve((size_t)params.n_reps * n_gen);
+
+            int64_t t_prefill_us = 0;
+            for (int rep = 0; rep < params.n_reps; ++rep) {
+              const int64_t t_us = bench_prefill(ctx, tokens, n_batch, n_threads);
+              if (t_us < 0 || !bench_decode(ctx, n_prompt, n_gen, n_threads, &r.decode_ms)) {
+                fprintf(stderr, "%s: error: failed to eval\n", __func__);
+                model_free(ctx);
+                return 1;
+              }
+              t_prefill_us += t_us;
+            }
+
+            r.prefill_ms = t_prefill_us / 1000.0 / params.n_reps;
+            r.prefill_tokens_per_s = r.prefill_ms > 0.0 ? n_prompt * 1000.0 / r.prefill_ms : 0.0;
+            // every decode step streams all weights once and reads the KV of n_past + 1 tokens
+            r.decode_bytes_per_token = weight_bytes + kv_bytes_per_token * (n_prompt + (n_gen + 1) / 2.0);
+            r.rss_kb = bench_rss_kb();
+            r.process_peak_rss_kb = bench_peak_rss_kb();
+            results.push_back(r);
+          }
+        }
+      }
+    }
+
+    model_free(ctx);
+  }
+
+  FILE* fp = stdout;
+  if (!params.output.empty()) {
+    fp = fopen(params.output.c_str(), "w");
+    if (fp == NULL) {
+      fprintf(stderr, "%s: error: failed to open '%s' for writing\n", __func__, params.output.c_str());
+      return 1;
+    }
+  }
+  bench_write_json(fp, params, results);
+  if (fp != stdout) {
+    fclose(fp);
+  }
+
+  return 0;
+}
@@ -18,7 +18,7 @@
 
 #include "common.h"
 #include "models/llama/llama_config.h"
-#include "llama_model.h"
+#include "models/model_utils/model_utils.h"
 
 #if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 #include <signal.h>
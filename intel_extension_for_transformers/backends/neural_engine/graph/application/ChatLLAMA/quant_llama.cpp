@@ -10,7 +10,7 @@
 #include <exception>
 #include <utility>
 
-#include "models/llama/llama_model.h"
+#include "models/model_utils/model_utils.h"
 
 static const std::map<std::string, model_ftype> NE_FTYPE_MAP = {
     {"q4_0", MODEL_FTYPE_MOSTLY_Q4_0},
@@ -25,6 +25,12 @@ static const std::map<std::string, model_ftype> NE_FTYPE_MAP = {
 
 };
 
+// token embedding storage, "none" leaves the table unquantized
+static const std::map<std::string, ne_type> NE_EMBD_TYPE_MAP = {
+    {"none", NE_TYPE_F32}, {"q4_0", NE_TYPE_Q4_0}, {"q4_1", NE_TYPE_Q4_1},
+    {"q5_0", NE_TYPE_Q5_0}, {"q5_1", NE_TYPE_Q5_1}, {"q8_0", NE_TYPE_Q8_0},
+};
+
 bool try_parse_ftype(const std::string& ftype_str, model_ftype& ftype, std::string& ftype_str_out) {
   auto it = NE_FTYPE_MAP.find(ftype_str);
   if (it != NE_FTYPE_MAP.end()) {
@@ -49,14 +55,19 @@ bool try_parse_ftype(const std::string& ftype_str, model_ftype& ftype, std::stri
 }
 
 // usage:
-//  ./quantize models/llama/ne-model.bin [models/llama/ne-model-quant.bin] type [nthreads]
+//  ./quantize models/llama/ne-model.bin [models/llama/ne-model-quant.bin] type [nthreads] [embd-type]
 //
 int main(int argc, char** argv) {
   if (argc < 3) {
-    fprintf(stderr, "usage: %s model-f32.bin [model-quant.bin] type [nthreads]\n", argv[0]);
+    fprintf(stderr, "usage: %s model-f32.bin [model-quant.bin] type [nthreads] [embd-type]\n", argv[0]);
     for (auto it = NE_FTYPE_MAP.begin(); it != NE_FTYPE_MAP.end(); it++) {
       fprintf(stderr, "  type = \"%s\" or %d\n", it->first.c_str(), it->second);
     }
+    fprintf(stderr, "  embd-type = token embedding storage:");
+    for (auto it = NE_EMBD_TYPE_MAP.begin(); it != NE_EMBD_TYPE_MAP.end(); it++) {
+      fprintf(stderr, " \"%s\"", it->first.c_str());
+    }
+    fprintf(stderr, " (default: same as type, q4_0 for JBLAS types)\n");
     return 1;
   }
 
@@ -105,10 +116,22 @@ int main(int argc, char** argv) {
       fprintf(stderr, "%s: invalid nthread '%s' (%s)\n", __func__, argv[arg_idx], e.what());
       return 1;
     }
+    arg_idx++;
   } else {
     nthread = 0;
   }
 
+  // parse embd-type
+  ne_type embd_type = NE_TYPE_COUNT;
+  if (argc > arg_idx) {
+    auto it = NE_EMBD_TYPE_MAP.find(argv[arg_idx]);
+    if (it == NE_EMBD_TYPE_MAP.end()) {
+      fprintf(stderr, "%s: invalid embd-type '%s'\n", __func__, argv[arg_idx]);
+      return 1;
+    }
+    embd_type = it->second;
+  }
+
   fprintf(stderr, "%s: quantizing '%s' to '%s' as %s", __func__, fname_inp.c_str(), fname_out.c_str(),
           ftype_str.c_str());
   if (nthread > 0) {
@@ -124,7 +147,7 @@ int main(int argc, char** argv) {
   {
     const int64_t t_start_us = model_time_us();
 
-    if (model_model_quantize(fname_inp.c_str(), fname_out.c_str(), ftype, nthread)) {
+    if (model_model_quantize_embd(fname_inp.c_str(), fname_out.c_str(), ftype, nthread, embd_type)) {
       fprintf(stderr, "%s: failed to quantize model from '%s'\n", __func__, fname_inp.c_str());
       return 1;
     }
@@ -0,0 +1,1140 @@
+// Long-running generation server for the graph LLM runtime: loads one model and serves
+// concurrent requests over localhost HTTP or a Unix domain socket, streaming tokens back
+// as newline-delimited JSON while a single scheduler thread interleaves the sessions.
+//
+//   POST /generate  {"prompt": "...", "n_predict": 128, "priority": 0, "temp": 0.8, "session": "id", ...}
+//   GET  /health
+
+#include <signal.h>
+#include <stdlib.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "models/model_utils/model_utils.h"
+
+struct server_params {
+  std::string model = "models/7B/ne_core-model.bin";
+  model_archs arch = MODEL_LLAMA;
+  std::string unix_path = "";  // non-empty: listen on this Unix domain socket instead of TCP
+  int port = 8080;             // TCP port on 127.0.0.1
+  int n_ctx = 2048;
+  int n_batch = 64;  // prompt tokens evaluated per scheduler step
+  int n_threads = get_num_physical_cores();
+  int seed = -1;
+  size_t kv_mem_mb = 0;  // KV budget for admission, 0: room for 4 sessions
+  int max_queue = 64;    // requests waiting for admission before new ones are refused
+  bool priority = false;  // false: round-robin over sessions, true: highest priority first
+  std::string offload_dir = "";  // where idle conversations are evicted to, empty: drop them instead
+  bool use_mmap = true;
+};
+
+static void server_print_usage(char** argv, const server_params& params) {
+  fprintf(stderr, "usage: %s [options]\n", argv[0]);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -h, --help            show this help message and exit\n");
+  fprintf(stderr, "  -m, --model FNAME     model path (default: %s)\n", params.model.c_str());
+  fprintf(stderr, "  --arch NAME           model architecture: llama, gptneox or mpt (default: llama)\n");
+  fprintf(stderr, "  --port N              listen on 127.0.0.1:N (default: %d)\n", params.port);
+  fprintf(stderr, "  --unix PATH           listen on a Unix domain socket instead of TCP\n");
+  fprintf(stderr, "  -c, --ctx-size N      context size of every session (default: %d)\n", params.n_ctx);
+  fprintf(stderr, "  -b, --batch-size N    prompt tokens per scheduler step (default: %d)\n", params.n_batch);
+  fprintf(stderr, "  -t, --threads N       number of threads to use during computation (default: %d)\n",
+          params.n_threads);
+  fprintf(stderr, "  -s, --seed N          RNG seed (default: -1, use random seed for < 0)\n");
+  fprintf(stderr, "  --kv-mem N            KV cache budget in MB for admitted sessions (default: 4 sessions)\n");
+  fprintf(stderr, "  --max-queue N         requests allowed to wait for admission (default: %d)\n", params.max_queue);
+  fprintf(stderr, "  --policy NAME         scheduling policy: fair or priority (default: fair)\n");
+  fprintf(stderr, "  --offload-dir PATH    evict the KV cache of idle conversations to PATH instead of dropping it\n");
+  fprintf(stderr, "  --no-mmap             do not memory-map model\n");
+  fprintf(stderr, "\n");
+}
+
+static bool server_params_parse(int argc, char** argv, server_params& params) {
+  bool invalid_param = false;
+  std::string arg;
+
+  for (int i = 1; i < argc; i++) {
+    arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      server_print_usage(argv, params);
+      exit(0);
+    } else if (arg == "--no-mmap") {
+      params.use_mmap = false;
+      continue;
+    }
+
+    if (++i >= argc) {
+      invalid_param = true;
+      break;
+    }
+    const std::string value = argv[i];
+
+    if (arg == "-m" || arg == "--model") {
+      params.model = value;
+    } else if (arg == "--arch") {
+      if (value == "llama") {
+        params.arch = MODEL_LLAMA;
+      } else if (value == "gptneox") {
+        params.arch = MODEL_GPTNEOX;
+      } else if (value == "mpt") {
+        params.arch = MODEL_MPT;
+      } else {
+        invalid_param = true;
+        break;
+      }
+    } else if (arg == "--port") {
+      params.port = std::stoi(value);
+    } else if (arg == "--unix") {
+      params.unix_path = value;
+    } else if (arg == "-c" || arg == "--ctx-size") {
+      params.n_ctx = std::stoi(value);
+    } else if (arg == "-b" || arg == "--batch-size") {
+      params.n_batch = std::max(1, std::stoi(value));
+    } else if (arg == "-t" || arg == "--threads") {
+      params.n_threads = std::stoi(value);
+    } else if (arg == "-s" || arg == "--seed") {
+      params.seed = std::stoi(value);
+    } else if (arg == "--kv-mem") {
+      params.kv_mem_mb = std::stoul(value);
+    } else if (arg == "--max-queue") {
+      params.max_queue = std::stoi(value);
+    } else if (arg == "--offload-dir") {
+      params.offload_dir = value;
+    } else if (arg == "--policy") {
+      if (value == "fair") {
+        params.priority = false;
+      } else if (value == "priority") {
+        params.priority = true;
+      } else {
+        invalid_param = true;
+        break;
+      }
+    } else {
+      fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
+      server_print_usage(argv, params);
+      return false;
+    }
+  }
+
+  if (invalid_param) {
+    fprintf(stderr, "error: invalid parameter for argument: %s\n", arg.c_str());
+    server_print_usage(argv, params);
+    return false;
+  }
+  return true;
+}
+
+//
+// poor-man's JSON, enough for flat request objects
+//
+
+static std::string json_escape(const std::string& s) {
+  std::string out;
+  out.reserve(s.size() + 2);
+  for (unsigned char c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += static_cast<char>(c);
+        }
+    }
+  }
+  return out;
+}
+
+// returns the position right after `"key":`, or npos
+static size_t json_find_value(const std::string& body, const char* key) {
+  const std::string needle = std::string("\"") + key + "\"";
+  size_t pos = body.find(needle);
+  if (pos == std::string::npos) {
+    return pos;
+  }
+  pos = body.find(':', pos + needle.size());
+  if (pos == std::string::npos) {
+    return pos;
+  }
+  pos = body.find_first_not_of(" \t\r\n", pos + 1);
+  return pos;
+}
+
+static void json_append_utf8(std::string& out, uint32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xc0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  } else {
+    out += static_cast<char>(0xe0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+static bool json_get_string(const std::string& body, const char* key, std::string& out) {
+  size_t pos = json_find_value(body, key);
+  if (pos == std::string::npos || body[pos] != '"') {
+    return false;
+  }
+  out.clear();
+  for (++pos; pos < body.size(); ++pos) {
+    const char c = body[pos];
+    if (c == '"') {
+      return true;
+    }
+    if (c != '\\') {
+      out += c;
+      continue;
+    }
+    if (++pos >= body.size()) {
+      return false;
+    }
+    switch (body[pos]) {
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'u':
+        if (pos + 4 >= body.size()) {
+          return false;
+        }
+        json_append_utf8(out, static_cast<uint32_t>(strtoul(body.substr(pos + 1, 4).c_str(), nullptr, 16)));
+        pos += 4;
+        break;
+      default:  // '"', '\\', '/'
+        out += body[pos];
+    }
+  }
+  return false;
+}
+
+static bool json_get_number(const std::string& body, const char* key, double& out) {
+  const size_t pos = json_find_value(body, key);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  char* end = nullptr;
+  out = strtod(body.c_str() + pos, &end);
+  return end != body.c_str() + pos;
+}
+
+//
+// sessions and scheduler
+//
+
+struct server_request {
+  std::vector<model_token> prompt;
+  int n_predict = 128;
+  int priority = 0;
+  int top_k = 40;
+  float top_p = 0.95f;
+  float temp = 0.8f;
+  float repeat_penalty = 1.1f;
+  int repeat_last_n = 64;
+  std::string conversation;  // non-empty: continue this conversation and keep its KV cache afterwards
+};
+
+// KV cache and history of a conversation between requests; resident, being offloaded or offloaded to a file
+struct server_conversation {
+  int seq = 0;  // names the offload file, conversation ids never reach the file system
+  model_kv_cache* cache = nullptr;
+  model_kv_offload* offload = nullptr;  // in-flight write of `cache`
+  std::string path;                     // offload file, set while the KV cache is not resident
+  int n_past = 0;
+  model_token pending = -1;  // last sampled token, not yet in the KV cache
+  std::vector<model_token> last_tokens;
+  bool busy = false;  // attached to an admitted session
+  int64_t t_last_us = 0;
+};
+
+// one generation request; the scheduler thread produces pieces, the connection thread consumes them
+struct server_session {
+  int id = 0;
+  server_request req;
+
+  // scheduler state, only touched by the scheduler thread once admitted
+  model_kv_cache* cache = nullptr;
+  server_conversation* conv = nullptr;
+  std::string restore_path;  // offload file to read into `cache` before the first step
+  size_t n_consumed = 0;  // prompt tokens already evaluated
+  int n_past = 0;
+  int n_gen = 0;
+  model_token pending = -1;  // sampled token not yet fed back into the model
+  std::vector<model_token> last_tokens;
+
+  int64_t t_submit_us = 0;
+  int64_t t_admit_us = 0;
+  int64_t t_first_token_us = 0;
+  int64_t t_restore_us = 0;
+
+  // output channel
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<std::string> pieces;
+  bool done = false;
+  std::string finish_reason;
+
+  std::atomic<bool> cancelled{false};  // the client went away
+
+  void push(std::string piece) {
+    std::lock_guard<std::mutex> lock(mtx);
+    pieces.push_back(std::move(piece));
+    cv.notify_one();
+  }
+
+  void finish(const std::string& reason) {
+    std::lock_guard<std::mutex> lock(mtx);
+    done = true;
+    finish_reason = reason;
+    cv.notify_one();
+  }
+};
+
+// the loaded model plus everything needed to turn text into tokens and back
+struct server_model {
+  model_context* ctx = nullptr;
+  model_archs arch = MODEL_LLAMA;
+  gpt_vocab vocab;  // BPE vocabulary of GPT-NeoX and MPT
+  model_token eos = 0;
+
+  void init(model_context* c, model_archs a) {
+    ctx = c;
+    arch = a;
+    eos = arch == MODEL_LLAMA ? model_token_eos() : 0;
+    if (arch == MODEL_LLAMA) {
+      return;
+    }
+
+    const int n_vocab = model_n_vocab(ctx);
+    for (int i = 0; i < n_vocab; i++) {
+      std::string word = model_token_to_str(ctx, i);
+      if (arch == MODEL_MPT) {
+        // MPT stores byte-level BPE tokens as utf-8 encoded code points
+        std::wstring word_multibytes = convert_to_wstring(word);
+        word.resize(word_multibytes.size());
+        for (size_t w = 0; w < word_multibytes.size(); w++) {
+          word[w] = uint8_t(word_multibytes[w]);
+        }
+      }
+      vocab.token_to_id[word] = i;
+      vocab.id_to_token[i] = word;
+    }
+  }
+
+  // read-only on the vocabulary, safe to call from connection threads
+  std::vector<model_token> tokenize(const std::string& text) const {
+    if (arch != MODEL_LLAMA) {
+      return gpt_tokenize(vocab, text);
+    }
+    // add a space in front of the first character to match the OG llama tokenizer behavior
+    const std::string spaced = " " + text;
+    std::vector<model_token> res(spaced.size() + 1);
+    const int n = model_tokenize(ctx, spaced.c_str(), res.data(), res.size(), true);
+    res.resize(std::max(n, 0));
+    return res;
+  }
+
+  std::string detokenize(model_token id) const {
+    if (arch != MODEL_LLAMA) {
+      auto it = vocab.id_to_token.find(id);
+      return it == vocab.id_to_token.end() ? std::string() : it->second;
+    }
+    const char* str = model_token_to_str(ctx, id);
+    return str ? str : "";
+  }
+};
+
+class server_scheduler {
+ public:
+  server_scheduler(server_model& model, const server_params& params) : model_(model), params_(params) {
+    cache_bytes_ = model_kv_cache_size(model_.ctx);
+    kv_budget_ = params_.kv_mem_mb > 0 ? params_.kv_mem_mb * 1024 * 1024 : 4 * cache_bytes_;
+
+    // adopt the cache allocated with the context as the first pool entry, this leaves the context without one:
+    // model_kv_cache_new builds the next ones from the type recorded in the context
+    model_kv_cache* first = new model_kv_cache;
+    model_kv_cache_swap(model_.ctx, first);
+    free_caches_.push_back(first);
+    n_caches_ = 1;
+  }
+
+  size_t cache_bytes() const { return cache_bytes_; }
+
+  ~server_scheduler() {
+    for (auto& it : conversations_) {
+      drop_conversation(*it.second);
+    }
+    for (auto* cache : free_caches_) {
+      model_kv_cache_free(cache);
+    }
+  }
+
+  // returns false when the request cannot ever run or the queue is full
+  bool submit(const std::shared_ptr<server_session>& s, std::string& error) {
+    if (s->req.prompt.empty()) {
+      error = "empty prompt";
+      return false;
+    }
+    if (static_cast<int>(s->req.prompt.size()) >= model_n_ctx(model_.ctx)) {
+      error = "prompt does not fit in the context";
+      return false;
+    }
+    if (cache_bytes_ > kv_budget_) {
+      error = "KV budget is smaller than a single session";
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (static_cast<int>(waiting_.size()) >= params_.max_queue) {
+      error = "server busy";
+      return false;
+    }
+    s->id = ++n_submitted_;
+    s->t_submit_us = model_time_us();
+    waiting_.push_back(s);
+    cv_.notify_one();
+    return true;
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+    cv_.notify_one();
+  }
+
+  std::string stats_json() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t n_offloaded = 0;
+    for (const auto& it : conversations_) {
+      n_offloaded += it.second->cache == nullptr;
+    }
+    char buf[384];
+    snprintf(buf, sizeof(buf),
+             "{\"status\": \"ok\", \"sessions_active\": %zu, \"sessions_waiting\": %zu, \"conversations\": %zu, "
+             "\"conversations_offloaded\": %zu, \"kv_used_mb\": %.2f, \"kv_budget_mb\": %.2f}\n",
+             n_active_, waiting_.size(), conversations_.size(), n_offloaded,
+             (n_caches_ - free_caches_.size()) * cache_bytes_ / 1024.0 / 1024.0, kv_budget_ / 1024.0 / 1024.0);
+    return buf;
+  }
+
+  void run() {
+    std::vector<std::shared_ptr<server_session>> active;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (!stop_) {
+          reap_offloads_locked();
+          admit_locked(active);
+          n_active_ = active.size();
+          if (!active.empty()) {
+            break;
+          }
+          // waiting sessions may only be blocked on an offload freeing its cache, poll for it
+          if (n_offloading_ > 0) {
+            cv_.wait_for(lock, std::chrono::milliseconds(1));
+          } else {
+            cv_.wait(lock);
+          }
+        }
+        if (stop_) {
+          break;
+        }
+      }
+
+      auto& s = active[pick(active)];
+      if (s->cancelled || !step(*s)) {
+        release(*s);
+        active.erase(std::find(active.begin(), active.end(), s));
+      }
+    }
+
+    for (auto& s : active) {
+      s->finish("shutdown");
+      release(*s);
+    }
+  }
+
+ private:
+  // move waiting sessions into `active` while the KV budget allows
+  void admit_locked(std::vector<std::shared_ptr<server_session>>& active) {
+    while (true) {
+      // oldest (or highest priority) session whose conversation is not in use by another one
+      auto it = waiting_.end();
+      for (auto cur = waiting_.begin(); cur != waiting_.end(); ++cur) {
+        if (!(*cur)->cancelled && !(*cur)->req.conversation.empty()) {
+          auto conv = conversations_.find((*cur)->req.conversation);
+          if (conv != conversations_.end() && conv->second->busy) {
+            continue;
+          }
+        }
+        if (it == waiting_.end() || (params_.priority && (*cur)->req.priority > (*it)->req.priority)) {
+          it = cur;
+        }
+        if (!params_.priority) {
+          break;
+        }
+      }
+      if (it == waiting_.end()) {
+        break;
+      }
+      auto s = *it;
+      if (s->cancelled) {
+        s->finish("cancelled");
+        waiting_.erase(it);
+        continue;
+      }
+
+      server_conversation* conv = nullptr;
+      if (!s->req.conversation.empty()) {
+        auto& entry = conversations_[s->req.conversation];
+        if (!entry) {
+          entry.reset(new server_conversation);
+          entry->seq = ++n_conversations_;
+        }
+        conv = entry.get();
+      }
+
+      if (conv && conv->offload) {
+        // the conversation came back while being evicted: finish the write, then keep the cache resident
+        model_kv_offload_wait(conv->offload);
+        conv->offload = nullptr;
+        n_offloading_--;
+        unlink(conv->path.c_str());
+        conv->path.clear();
+      }
+
+      model_kv_cache* cache = conv ? conv->cache : nullptr;
+      if (cache == nullptr) {
+        cache = acquire_cache_locked();
+        if (cache == nullptr) {
+          break;
+        }
+        cache->n = 0;
+      }
+
+      waiting_.erase(it);
+      s->cache = cache;
+      s->t_admit_us = model_time_us();
+      if (conv) {
+        conv->busy = true;
+        conv->cache = cache;
+        s->conv = conv;
+        s->restore_path = conv->path;
+        s->n_past = conv->n_past;
+        s->last_tokens = conv->last_tokens;
+        if (conv->pending >= 0 && conv->pending != model_.eos) {
+          s->req.prompt.insert(s->req.prompt.begin(), conv->pending);
+        }
+      }
+      active.push_back(s);
+    }
+  }
+
+  // a free or newly allocated cache; under memory pressure evicts the least recently used idle conversation
+  // and returns nullptr, the cache becomes free once its offload finishes
+  model_kv_cache* acquire_cache_locked() {
+    if (!free_caches_.empty()) {
+      model_kv_cache* cache = free_caches_.back();
+      free_caches_.pop_back();
+      return cache;
+    }
+    if ((n_caches_ + 1) * cache_bytes_ <= kv_budget_) {
+      model_kv_cache* cache = model_kv_cache_new(model_.ctx);
+      if (cache) {
+        n_caches_++;
+      }
+      return cache;
+    }
+
+    server_conversation* lru = nullptr;
+    for (auto& it : conversations_) {
+      server_conversation* conv = it.second.get();
+      if (!conv->busy && conv->cache && !conv->offload && (!lru || conv->t_last_us < lru->t_last_us)) {
+        lru = conv;
+      }
+    }
+    if (lru == nullptr) {
+      return nullptr;
+    }
+
+    if (!params_.offload_dir.empty()) {
+      lru->path = params_.offload_dir + "/kv-" + std::to_string(lru->seq) + ".bin";
+      lru->offload = model_kv_cache_offload(model_.ctx, lru->cache, lru->path.c_str());
+      if (lru->offload) {
+        n_offloading_++;
+        return nullptr;
+      }
+      lru->path.clear();
+    }
+
+    // nowhere to put it, forget the conversation
+    model_kv_cache* cache = lru->cache;
+    lru->cache = nullptr;
+    forget_conversation_locked(lru);
+    return cache;
+  }
+
+  // return the caches of finished offloads to the pool
+  void reap_offloads_locked() {
+    if (n_offloading_ == 0) {
+      return;
+    }
+    for (auto it = conversations_.begin(); it != conversations_.end();) {
+      server_conversation* conv = it->second.get();
+      if (!conv->offload || !model_kv_offload_done(conv->offload)) {
+        ++it;
+        continue;
+      }
+      const bool ok = model_kv_offload_wait(conv->offload);
+      conv->offload = nullptr;
+      n_offloading_--;
+      free_caches_.push_back(conv->cache);
+      conv->cache = nullptr;
+      if (ok) {
+        ++it;
+      } else {
+        unlink(conv->path.c_str());
+        it = conversations_.erase(it);
+      }
+    }
+  }
+
+  void forget_conversation_locked(server_conversation* conv) {
+    for (auto it = conversations_.begin(); it != conversations_.end(); ++it) {
+      if (it->second.get() == conv) {
+        drop_conversation(*conv);
+        conversations_.erase(it);
+        return;
+      }
+    }
+  }
+
+  // releases everything but the conversation entry itself
+  void drop_conversation(server_conversation& conv) {
+    if (conv.offload) {
+      model_kv_offload_wait(conv.offload);
+      conv.offload = nullptr;
+      n_offloading_--;
+    }
+    if (!conv.path.empty()) {
+      unlink(conv.path.c_str());
+      conv.path.clear();
+    }
+    if (conv.cache) {
+      free_caches_.push_back(conv.cache);
+      conv.cache = nullptr;
+    }
+  }
+
+  // round-robin over the active sessions, restricted to the highest priority under the priority policy
+  size_t pick(const std::vector<std::shared_ptr<server_session>>& active) {
+    int best = active[0]->req.priority;
+    if (params_.priority) {
+      for (const auto& s : active) {
+        best = std::max(best, s->req.priority);
+      }
+    }
+    for (size_t i = 0; i < active.size(); i++) {
+      const size_t idx = (rr_ + i) % active.size();
+      if (!params_.priority || active[idx]->req.priority == best) {
+        rr_ = idx + 1;
+        return idx;
+      }
+    }
+    return 0;
+  }
+
+  // one unit of work for `s`: a prompt chunk of up to n_batch tokens or one decoded token;
+  // returns false once the session has finished
+  bool step(server_session& s) {
+    const auto& prompt = s.req.prompt;
+    const int n_ctx = model_n_ctx(model_.ctx);
+
+    if (!s.restore_path.empty()) {
+      const int64_t t_start_us = model_time_us();
+      if (!model_kv_cache_restore(model_.ctx, s.cache, s.restore_path.c_str())) {
+        s.finish("error");
+        return false;
+      }
+      s.t_restore_us = model_time_us() - t_start_us;
+      unlink(s.restore_path.c_str());
+      s.restore_path.clear();
+      s.conv->path.clear();
+    }
+
+    if (s.n_consumed == 0 && s.n_past + static_cast<int>(prompt.size()) >= n_ctx) {
+      finish(s, "context");
+      return false;
+    }
+
+    std::vector<model_token> batch;
+    if (s.n_consumed < prompt.size()) {
+      const size_t n = std::min(prompt.size() - s.n_consumed, static_cast<size_t>(params_.n_batch));
+      batch.assign(prompt.begin() + s.n_consumed, prompt.begin() + s.n_consumed + n);
+    } else {
+      batch.push_back(s.pending);
+    }
+
+    model_kv_cache_swap(model_.ctx, s.cache);
+    const int ret = model_eval(model_.ctx, batch.data(), batch.size(), s.n_past, params_.n_threads);
+    model_kv_cache_swap(model_.ctx, s.cache);
+    if (ret != 0) {
+      s.finish("error");
+      return false;
+    }
+
+    s.n_past += batch.size();
+    for (model_token id : batch) {
+      s.last_tokens.push_back(id);
+    }
+    if (s.n_consumed < prompt.size()) {
+      s.n_consumed += batch.size();
+      if (s.n_consumed < prompt.size()) {
+        return true;
+      }
+    }
+
+    // the logits now belong to the last token of the batch, sample the next one
+    const model_token id = sample(s);
+    if (s.n_gen == 0) {
+      s.t_first_token_us = model_time_us();
+    }
+    s.n_gen++;
+    s.pending = id;
+
+    if (id == model_.eos) {
+      finish(s, "eos");
+      return false;
+    }
+    s.push(model_.detokenize(id));
+
+    if (s.n_gen >= s.req.n_predict) {
+      finish(s, "length");
+      return false;
+    }
+    if (s.n_past >= n_ctx) {
+      finish(s, "context");
+      return false;
+    }
+    return true;
+  }
+
+  model_token sample(server_session& s) {
+    model_context* ctx = model_.ctx;
+    const int n_vocab = model_n_vocab(ctx);
+    const float* logits = model_get_logits(ctx);
+
+    candidates_.resize(n_vocab);
+    for (model_token id = 0; id < n_vocab; id++) {
+      candidates_[id] = model_token_data{id, logits[id], 0.0f};
+    }
+    model_token_data_array cur_p = {candidates_.data(), candidates_.size(), false};
+
+    const auto& req = s.req;
+    const size_t n_last = std::min(s.last_tokens.size(), static_cast<size_t>(std::max(req.repeat_last_n, 0)));
+    model_sample_repetition_penalty(ctx, &cur_p, s.last_tokens.data() + s.last_tokens.size() - n_last, n_last,
+                                    req.repeat_penalty);
+
+    if (req.temp <= 0) {
+      return model_sample_token_greedy(ctx, &cur_p);
+    }
+    model_sample_top_k(ctx, &cur_p, req.top_k <= 0 ? n_vocab : req.top_k, 1);
+    model_sample_top_p(ctx, &cur_p, req.top_p, 1);
+    model_sample_temperature(ctx, &cur_p, req.temp);
+    return model_sample_token(ctx, &cur_p);
+  }
+
+  void finish(server_session& s, const char* reason) {
+    const int64_t t_end_us = model_time_us();
+    const double t_decode_s = (t_end_us - s.t_first_token_us) / 1e6;
+    const int64_t t_first_us = s.t_first_token_us > 0 ? s.t_first_token_us : t_end_us;
+
+    char buf[384];
+    snprintf(buf, sizeof(buf),
+             "{\"done\": true, \"finish_reason\": \"%s\", \"n_prompt\": %zu, \"n_past\": %d, \"n_gen\": %d, "
+             "\"queue_ms\": %.2f, \"restore_ms\": %.2f, \"ttft_ms\": %.2f, \"decode_tokens_per_s\": %.2f}\n",
+             reason, s.req.prompt.size(), s.n_past, s.n_gen, (s.t_admit_us - s.t_submit_us) / 1000.0,
+             s.t_restore_us / 1000.0, (t_first_us - s.t_submit_us) / 1000.0,
+             t_decode_s > 0 && s.n_gen > 1 ? (s.n_gen - 1) / t_decode_s : 0.0);
+    s.push(buf);
+    s.finish(reason);
+  }
+
+  void release(server_session& s) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (s.conv) {
+      server_conversation* conv = s.conv;
+      conv->busy = false;
+      conv->t_last_us = model_time_us();
+      if (s.finish_reason == "error") {
+        forget_conversation_locked(conv);
+      } else {
+        // the cache stays with the conversation until it is evicted
+        conv->n_past = s.n_past;
+        conv->pending = s.pending;
+        const size_t n_keep = std::min(s.last_tokens.size(), static_cast<size_t>(server_max_history));
+        conv->last_tokens.assign(s.last_tokens.end() - n_keep, s.last_tokens.end());
+      }
+      s.conv = nullptr;
+      s.cache = nullptr;
+      cv_.notify_one();
+    }
+    if (s.cache) {
+      free_caches_.push_back(s.cache);
+      s.cache = nullptr;
+    }
+    if (s.cancelled) {
+      s.finish("cancelled");
+    }
+  }
+
+  // tokens of a conversation kept for the repetition penalty of its next request
+  static const int server_max_history = 256;
+
+  server_model& model_;
+  const server_params& params_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::deque<std::shared_ptr<server_session>> waiting_;
+  std::vector<model_kv_cache*> free_caches_;
+  std::map<std::string, std::unique_ptr<server_conversation>> conversations_;
+  size_t n_caches_ = 0;
+  size_t n_active_ = 0;
+  size_t n_offloading_ = 0;
+  size_t cache_bytes_ = 0;
+  size_t kv_budget_ = 0;
+  int n_submitted_ = 0;
+  int n_conversations_ = 0;
+
+  // scheduler thread only
+  size_t rr_ = 0;
+  std::vector<model_token_data> candidates_;
+};
+
+//
+// HTTP/1.1 over TCP or a Unix domain socket
+//
+
+static bool write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    const ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool write_chunk(int fd, const std::string& data) {
+  char head[32];
+  snprintf(head, sizeof(head), "%zx\r\n", data.size());
+  return write_all(fd, head, strlen(head)) && write_all(fd, data.data(), data.size()) && write_all(fd, "\r\n", 2);
+}
+
+static void write_response(int fd, int status, const char* reason, const std::string& body) {
+  char head[256];
+  snprintf(head, sizeof(head),
+           "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+           status, reason, body.size());
+  if (write_all(fd, head, strlen(head))) {
+    write_all(fd, body.data(), body.size());
+  }
+}
+
+// reads one request; returns false on malformed input
+static bool read_request(int fd, std::string& method, std::string& path, std::string& body) {
+  static const size_t max_request = 4u * 1024 * 1024;
+  std::string data;
+  size_t header_end = std::string::npos;
+  char buf[4096];
+
+  while (header_end == std::string::npos) {
+    const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0 || data.size() + n > max_request) {
+      return false;
+    }
+    data.append(buf, n);
+    header_end = data.find("\r\n\r\n");
+  }
+
+  const std::string header = data.substr(0, header_end);
+  const size_t sp1 = header.find(' ');
+  const size_t sp2 = header.find(' ', sp1 + 1);
+  if (sp1 == std::string::npos || sp2 == std::string::npos) {
+    return false;
+  }
+  method = header.substr(0, sp1);
+  path = header.substr(sp1 + 1, sp2 - sp1 - 1);
+
+  size_t content_length = 0;
+  std::string lower = header;
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  const size_t cl = lower.find("\r\ncontent-length:");
+  if (cl != std::string::npos) {
+    content_length = strtoul(header.c_str() + cl + strlen("\r\ncontent-length:"), nullptr, 10);
+  }
+  if (content_length > max_request) {
+    return false;
+  }
+
+  body = data.substr(header_end + 4);
+  while (body.size() < content_length) {
+    const ssize_t n = recv(fd, buf, std::min(sizeof(buf), content_length - body.size()), 0);
+    if (n <= 0) {
+      return false;
+    }
+    body.append(buf, n);
+  }
+  return true;
+}
+
+static bool parse_generate(const server_model& model, const std::string& body, server_request& req,
+                           std::string& error) {
+  std::string prompt;
+  if (!json_get_string(body, "prompt", prompt)) {
+    error = "missing \"prompt\"";
+    return false;
+  }
+  double v;
+  if (json_get_number(body, "n_predict", v)) req.n_predict = std::max(1, static_cast<int>(v));
+  if (json_get_number(body, "priority", v)) req.priority = static_cast<int>(v);
+  if (json_get_number(body, "top_k", v)) req.top_k = static_cast<int>(v);
+  if (json_get_number(body, "top_p", v)) req.top_p = static_cast<float>(v);
+  if (json_get_number(body, "temp", v)) req.temp = static_cast<float>(v);
+  if (json_get_number(body, "repeat_penalty", v)) req.repeat_penalty = static_cast<float>(v);
+  if (json_get_number(body, "repeat_last_n", v)) req.repeat_last_n = static_cast<int>(v);
+  json_get_string(body, "session", req.conversation);
+
+  req.prompt = model.tokenize(prompt);
+  return true;
+}
+
+static void handle_connection(int fd, server_model& model, server_scheduler& scheduler) {
+  std::string method, path, body;
+  if (!read_request(fd, method, path, body)) {
+    write_response(fd, 400, "Bad Request", "{\"error\": \"malformed request\"}\n");
+    close(fd);
+    return;
+  }
+
+  if (method == "GET" && path == "/health") {
+    write_response(fd, 200, "OK", scheduler.stats_json());
+    close(fd);
+    return;
+  }
+  if (method != "POST" || path != "/generate") {
+    write_response(fd, 404, "Not Found", "{\"error\": \"unknown endpoint\"}\n");
+    close(fd);
+    return;
+  }
+
+  auto session = std::make_shared<server_session>();
+  std::string error;
+  if (!parse_generate(model, body, session->req, error)) {
+    write_response(fd, 400, "Bad Request", "{\"error\": \"" + json_escape(error) + "\"}\n");
+    close(fd);
+    return;
+  }
+  if (!scheduler.submit(session, error)) {
+    write_response(fd, 503, "Service Unavailable", "{\"error\": \"" + json_escape(error) + "\"}\n");
+    close(fd);
+    return;
+  }
+
+  static const char* head =
+      "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\n"
+      "Connection: close\r\n\r\n";
+  bool ok = write_all(fd, head, strlen(head));
+
+  // stream pieces as they are produced; the final stats object is already JSON
+  while (ok) {
+    std::deque<std::string> pieces;
+    bool done;
+    {
+      std::unique_lock<std::mutex> lock(session->mtx);
+      session->cv.wait(lock, [&] { return session->done || !session->pieces.empty(); });
+      pieces.swap(session->pieces);
+      done = session->done;
+    }
+    for (const auto& piece : pieces) {
+      if (!ok) {
+        break;
+      }
+      if (!piece.empty() && piece[0] == '{') {
+        ok = write_chunk(fd, piece);
+      } else {
+        ok = write_chunk(fd, "{\"token\": \"" + json_escape(piece) + "\"}\n");
+      }
+    }
+    if (done) {
+      break;
+    }
+  }
+
+  if (ok) {
+    write_all(fd, "0\r\n\r\n", 5);
+  } else {
+    session->cancelled = true;
+  }
+  close(fd);
+}
+
+static int server_listen(const server_params& params) {
+  int fd;
+  if (!params.unix_path.empty()) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (params.unix_path.size() >= sizeof(addr.sun_path)) {
+      close(fd);
+      return -1;
+    }
+    strncpy(addr.sun_path, params.unix_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(params.unix_path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+  } else {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(params.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // never exposed beyond localhost
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+  }
+  if (listen(fd, 64) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  server_params params;
+  if (!server_params_parse(argc, argv, params)) {
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  model_init_backend();
+
+  auto lparams = model_context_default_params();
+  lparams.arch = params.arch;
+  lparams.n_ctx = params.n_ctx;
+  lparams.seed = params.seed;
+  lparams.use_mmap = params.use_mmap;
+
+  model_context* ctx = model_init_from_file(params.model.c_str(), lparams);
+  if (ctx == NULL) {
+    fprintf(stderr, "%s: error: failed to load model '%s'\n", __func__, params.model.c_str());
+    return 1;
+  }
+
+  server_model model;
+  model.init(ctx, params.arch);
+
+  const int fd = server_listen(params);
+  if (fd < 0) {
+    fprintf(stderr, "%s: error: failed to listen on %s\n", __func__,
+            params.unix_path.empty() ? ("127.0.0.1:" + std::to_string(params.port)).c_str() : params.unix_path.c_str());
+    model_free(ctx);
+    return 1;
+  }
+
+  server_scheduler scheduler(model, params);
+  std::thread scheduler_thread([&] { scheduler.run(); });
+
+  fprintf(stderr, "%s: listening on %s, %s scheduling, %.2f MB KV per session\n", __func__,
+          params.unix_path.empty() ? ("http://127.0.0.1:" + std::to_string(params.port)).c_str()
+                                   : params.unix_path.c_str(),
+          params.priority ? "priority" : "fair", scheduler.cache_bytes() / 1024.0 / 1024.0);
+
+  while (true) {
+    const int conn = accept(fd, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    std::thread(handle_connection, conn, std::ref(model), std::ref(scheduler)).detach();
+  }
+
+  scheduler.stop();
+  scheduler_thread.join();
+  close(fd);
+  if (!params.unix_path.empty()) {
+    unlink(params.unix_path.c_str());
+  }
+  model_free(ctx);
+
+  return 0;
+}
@@ -32,6 +32,7 @@ struct gpt_params {
     float   temp  = 0.9f;
 
     int32_t n_batch = 8; // batch size for prompt processing
+    int32_t n_ctx   = 2048; // context size, capped by the model's own maximum
 
     std::string model      = "models/gpt-2-117M/ggml-model.bin"; // model path
     std::string prompt     = "";
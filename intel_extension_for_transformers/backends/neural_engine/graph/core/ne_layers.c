@@ -6143,10 +6143,10 @@ static void ne_compute_forward_transpose(const struct ne_compute_params* params,
 
 // ne_compute_forward_get_rows
 
+// gathered rows are split between the threads; quantized tables are dequantized one gathered row at a time,
+// so only the rows referenced by src1 are ever expanded to f32
 static void ne_compute_forward_get_rows_q(const struct ne_compute_params* params, const struct ne_tensor* src0,
                                           const struct ne_tensor* src1, struct ne_tensor* dst) {
-  assert(params->ith == 0);
-
   if (params->type == NE_TASK_INIT || params->type == NE_TASK_FINALIZE) {
     return;
   }
@@ -6160,7 +6160,13 @@ static void ne_compute_forward_get_rows_q(const struct ne_compute_params* params
   assert(dst->ne[1] == nr);
   assert(src0->nb[0] == NE_TYPE_SIZE[type]);
 
-  for (int i = 0; i < nr; ++i) {
+  const int ith = params->ith;
+  const int nth = params->nth;
+  const int dr = (nr + nth - 1) / nth;
+  const int ir0 = dr * ith;
+  const int ir1 = MIN(ir0 + dr, nr);
+
+  for (int i = ir0; i < ir1; ++i) {
     const int r = ((int32_t*)src1->data)[i];
 
     dequantize_row_q((const void*)((char*)src0->data + r * src0->nb[1]), (float*)((char*)dst->data + i * dst->nb[1]),
@@ -6170,8 +6176,6 @@ static void ne_compute_forward_get_rows_q(const struct ne_compute_params* params
 
 static void ne_compute_forward_get_rows_f16(const struct ne_compute_params* params, const struct ne_tensor* src0,
                                             const struct ne_tensor* src1, struct ne_tensor* dst) {
-  assert(params->ith == 0);
-
   if (params->type == NE_TASK_INIT || params->type == NE_TASK_FINALIZE) {
     return;
   }
@@ -6183,20 +6187,22 @@ static void ne_compute_forward_get_rows_f16(const struct ne_compute_params* para
   assert(dst->ne[1] == nr);
   assert(src0->nb[0] == sizeof(ne_fp16_t));
 
-  for (int i = 0; i < nr; ++i) {
+  const int ith = params->ith;
+  const int nth = params->nth;
+  const int dr = (nr + nth - 1) / nth;
+  const int ir0 = dr * ith;
+  const int ir1 = MIN(ir0 + dr, nr);
+
+  for (int i = ir0; i < ir1; ++i) {
     const int r = ((int32_t*)src1->data)[i];
 
-    for (int j = 0; j < nc; ++j) {
-      ne_fp16_t v = ((ne_fp16_t*)((char*)src0->data + r * src0->nb[1]))[j];
-      ((float*)((char*)dst->data + i * dst->nb[1]))[j] = NE_FP16_TO_FP32(v);
-    }
+    ne_fp16_to_fp32_row((const ne_fp16_t*)((char*)src0->data + r * src0->nb[1]),
+                        (float*)((char*)dst->data + i * dst->nb[1]), nc);
   }
 }
 
 static void ne_compute_forward_get_rows_f32(const struct ne_compute_params* params, const struct ne_tensor* src0,
                                             const struct ne_tensor* src1, struct ne_tensor* dst) {
-  assert(params->ith == 0);
-
   if (params->type == NE_TASK_INIT || params->type == NE_TASK_FINALIZE) {
     return;
   }
@@ -6208,7 +6214,13 @@ static void ne_compute_forward_get_rows_f32(const struct ne_compute_params* para
   assert(dst->ne[1] == nr);
   assert(src0->nb[0] == sizeof(float));
 
-  for (int i = 0; i < nr; ++i) {
+  const int ith = params->ith;
+  const int nth = params->nth;
+  const int dr = (nr + nth - 1) / nth;
+  const int ir0 = dr * ith;
+  const int ir1 = MIN(ir0 + dr, nr);
+
+  for (int i = ir0; i < ir1; ++i) {
     const int r = ((int32_t*)src1->data)[i];
 
     ne_vec_cpy_f32(nc, (float*)((char*)dst->data + i * dst->nb[1]), (float*)((char*)src0->data + r * src0->nb[1]));
@@ -9529,13 +9541,16 @@ void ne_graph_compute(struct ne_context* ctx, struct ne_cgraph* cgraph) {
         case NE_OP_SCALE: {
           node->n_tasks = n_threads;
         } break;
+        case NE_OP_GET_ROWS: {
+          // a row per thread at least, single-token decode stays on one thread
+          node->n_tasks = MAX(1, MIN(n_threads, ne_nelements(node->src1)));
+        } break;
         case NE_OP_SET:
         case NE_OP_CONT:
         case NE_OP_RESHAPE:
         case NE_OP_VIEW:
         case NE_OP_PERMUTE:
         case NE_OP_TRANSPOSE:
-        case NE_OP_GET_ROWS:
         case NE_OP_GET_ROWS_BACK:
         case NE_OP_DIAG:
         case NE_OP_DIAG_MASK_ZERO: {
@@ -0,0 +1,21 @@
+#ifndef LLAMA_H
+#define LLAMA_H
+
+#include "models/model_utils/model_types.h"
+
+struct model_model_loader;
+
+// create the LLaMA weight tensors of `model` from the loader, returns the bytes placed in VRAM
+size_t llama_model_load_tensors(model_model_loader& ml, model_model& model, int n_gpu_layers);
+
+// evaluate the transformer
+//
+//   - lctx:      model context
+//   - tokens:    new batch of tokens to process
+//   - n_past:    the context size so far
+//   - n_threads: number of threads to use
+//
+bool llama_model_eval_internal(model_context& lctx, const model_token* tokens, const int n_tokens, const int n_past,
+                               const int n_threads);
+
+#endif  // LLAMA_H
@@ -2,7 +2,7 @@
 
 #pragma once
 
-#include "llama_model.h"
+#include "models/model_utils/model_utils.h"
 
 #include <string>
 #include <vector>
@@ -68,7 +68,8 @@ enum e_model {
   MODEL_65B,
 };
 
-enum name_model { MODEL_LLAMA };
+// supported model architectures
+enum model_archs { MODEL_LLAMA, MODEL_GPTNEOX, MODEL_MPT };
 
 static const size_t MB = 1024 * 1024;
 
@@ -162,39 +163,39 @@ struct model_hparams {
   uint32_t n_rot = 64;
   enum model_ftype ftype = MODEL_FTYPE_MOSTLY_F16;
 
+  // GPT-NeoX
+  uint32_t par_res = 1;  // 1 = parallel residual (attention and ffn both read the layer input)
+
+  // MPT
+  float alibi_bias_max = 0.0f;
+  float clip_qkv = 0.0f;  // <= 0: disabled
+
   bool operator!=(const model_hparams& other) const {
     return static_cast<bool>(memcmp(this, &other, sizeof(model_hparams)));
   }
 };
 
+// the meaning of each slot is defined by the architecture, see models/<arch>/<arch>.cpp
 struct model_layer {
   // normalization
-  struct ne_tensor* attention_norm;
+  struct ne_tensor* norm[4] = {NULL};
 
   // attention
-  struct ne_tensor* wq;
-  struct ne_tensor* wk;
-  struct ne_tensor* wv;
-  struct ne_tensor* wo;
-
-  // normalization
-  struct ne_tensor* ffn_norm;
+  struct ne_tensor* attn[4] = {NULL};
 
   // ff
-  struct ne_tensor* w1;
-  struct ne_tensor* w2;
-  struct ne_tensor* w3;
+  struct ne_tensor* ffn[4] = {NULL};
 };
 
 struct model_kv_cache {
-  struct ne_tensor* k;
-  struct ne_tensor* v;
+  struct ne_tensor* k = NULL;
+  struct ne_tensor* v = NULL;
 
   struct ne_context* ctx = NULL;
 
   model_ctx_buffer buf;
 
-  int n;  // number of tokens currently in the cache
+  int n = 0;  // number of tokens currently in the cache
 
   ~model_kv_cache() {
     if (ctx) {
@@ -204,14 +205,16 @@ struct model_kv_cache {
 };
 
 struct model_model {
+  model_archs arch = MODEL_LLAMA;
   e_model type = MODEL_UNKNOWN;
 
   model_hparams hparams;
 
-  struct ne_tensor* tok_embeddings;
+  struct ne_tensor* tok_embeddings = NULL;
 
-  struct ne_tensor* norm;
-  struct ne_tensor* output;
+  struct ne_tensor* norm = NULL;
+  struct ne_tensor* norm_b = NULL;  // final norm bias, NULL if the architecture has none
+  struct ne_tensor* output = NULL;  // may alias tok_embeddings when the weights are tied
 
   std::vector<model_layer> layers;
 
@@ -273,6 +276,9 @@ struct model_context {
   model_model model;
   model_vocab vocab;
 
+  // type of the KV cache, kept apart from kv_self which model_kv_cache_swap may leave empty
+  ne_type kv_type = NE_TYPE_F16;
+
   size_t mem_per_token = 0;
 
   // decode output (2-dimensional array: [n_tokens][n_vocab])
@@ -347,6 +353,7 @@ typedef struct model_token_data_array {
 typedef void (*model_progress_callback)(float progress, void* ctx);
 
 struct model_context_params {
+  model_archs arch;  // architecture of the model file
   int n_ctx;         // text context
   int n_gpu_layers;  // number of layers to store in VRAM
   int seed;          // RNG seed, -1 for random
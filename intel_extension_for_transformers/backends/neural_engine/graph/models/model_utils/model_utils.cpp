@@ -7,7 +7,11 @@
 #endif
 
 #include "models/util.h"
-#include "llama_model.h"
+#include "models/model_utils/model_utils.h"
+#include "models/model_utils/model_files.h"
+#include "models/llama/llama.h"
+#include "models/gptneox/gptneox.h"
+#include "models/mpt/mpt.h"
 
 #include "core/ne_layers.h"
 #include "jblas/jblas/jit_blas_weight_compression.h"
@@ -32,522 +36,16 @@
 #include <sstream>
 #include <numeric>
 
-template <typename T>
-static T checked_mul(T a, T b) {
-  T ret = a * b;
-  if (a != 0 && ret / a != b) {
-    throw format("overflow multiplying %llu * %llu", (unsigned long long)a, (unsigned long long)b);
-  }
-  return ret;
-}
-
-static size_t checked_div(size_t a, size_t b) {
-  if (b == 0 || a % b != 0) {
-    throw format("error dividing %zu / %zu", a, b);
-  }
-  return a / b;
-}
-
-static std::string model_format_tensor_shape(const std::vector<uint32_t>& ne) {
-  char buf[256];
-  snprintf(buf, sizeof(buf), "%5u", ne.at(0));
-  for (size_t i = 1; i < ne.size(); i++) {
-    snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " x %5u", ne.at(i));
-  }
-  return buf;
-}
-
-static size_t model_calc_tensor_size(const std::vector<uint32_t>& ne, enum ne_type type) {
-  size_t size = ne_type_size(type);
-  for (uint32_t dim : ne) {
-    size = checked_mul<size_t>(size, dim);
-  }
-  return size / ne_blck_size(type);
-}
-
-struct model_load_tensor_shard {
-  std::vector<uint32_t> ne;
-  size_t size;
-  enum ne_type type;
-  size_t file_idx;
-  size_t file_off;
-
-  void calc_size() { size = model_calc_tensor_size(ne, type); }
-};
-
-enum model_split_type { SPLIT_NONE, SPLIT_BY_COLUMNS, SPLIT_BY_ROWS };
-
-struct model_load_tensor {
-  std::vector<model_load_tensor_shard> shards;
-
-  std::string name;
-  enum ne_type type = NE_TYPE_F32;
-  model_split_type split_type = SPLIT_NONE;
-  std::vector<uint32_t> ne;
-  size_t size;
-  struct ne_tensor* ne_tensor = NULL;
-  uint8_t* data;
-
-  model_load_tensor(const std::string& name) : name(name) {}
-
-  void calc_all() {
-    calc_type();
-    calc_split_type();
-    calc_ne();
-    if (type == NE_TYPE_Q4_JBLAS) {
-      size = shards[0].size;
-    } else {
-      calc_size();
-    }
-  }
-
-  void calc_type() {
-    const auto& first_shard = shards.at(0);
-    for (const auto& shard : shards) {
-      if (shard.type != first_shard.type) {
-        throw format("inconsistent tensor shard type in '%s'", name.c_str());
-      }
-    }
-    type = first_shard.type;
-  }
-
-  void calc_split_type() {
-    if (shards.at(0).ne.size() == 1 ||  // 1D tensors are just duplicated in every file
-        shards.size() == 1) {           // only one file?
-      split_type = SPLIT_NONE;
-    } else if (name.find("tok_embeddings.") == 0 || name.find(".attention.wo.weight") != std::string::npos ||
-               name.find(".feed_forward.w2.weight") != std::string::npos) {
-      split_type = SPLIT_BY_COLUMNS;
-    } else {
-      split_type = SPLIT_BY_ROWS;
-    }
-  }
-
-  void calc_ne() {
-    const auto& first_shard = shards.at(0);
-    for (const auto& shard : shards) {
-      if (shard.ne != first_shard.ne) {
-        throw format("inconsistent tensor shard shape in '%s': first was %s, other was %s", name.c_str(),
-                     model_format_tensor_shape(first_shard.ne).c_str(), model_format_tensor_shape(shard.ne).c_str());
-      }
-    }
-    ne = first_shard.ne;
-    MODEL_ASSERT(shards.size() <= UINT32_MAX);
-    uint32_t n_shards = (uint32_t)shards.size();
-    switch (split_type) {
-      case SPLIT_NONE:
-        ne = first_shard.ne;
-        break;
-      case SPLIT_BY_COLUMNS:
-        ne = {checked_mul<uint32_t>(first_shard.ne[0], n_shards), first_shard.ne[1]};
-        break;
-      case SPLIT_BY_ROWS:
-        ne = {first_shard.ne[0], checked_mul<uint32_t>(first_shard.ne[1], n_shards)};
-        break;
-    }
-  }
-
-  void calc_size() { size = model_calc_tensor_size(ne, type); }
-};
-
-struct model_load_tensors_map {
-  // tensors is kept in a separate vector to preserve file order
-  std::vector<model_load_tensor> tensors;
-  std::unordered_map<std::string, size_t> name_to_idx;
-};
-
-struct model_file_loader {
-  model_file file;
-  model_file_version file_version;
-  model_hparams hparams;
-  model_vocab vocab;
-
-  model_file_loader(const char* fname, size_t file_idx, model_load_tensors_map& tensors_map) : file(fname, "rb") {
-    fprintf(stderr, "model.cpp: loading model from %s\n", fname);
-    read_magic();
-    read_hparams();
-    read_vocab();
-    read_tensor_metadata(file_idx, tensors_map);
-  }
-  void read_magic() {
-    uint32_t magic = file.read_u32();
-
-    if (magic == MODEL_FILE_MAGIC_NE) {
-      file_version = MODEL_FILE_VERSION_NE;
-      return;
-    }
-
-    uint32_t version = file.read_u32();
-
-    switch (magic) {
-      case MODEL_FILE_MAGIC_GGMF:
-        switch (version) {
-          case 1:
-            file_version = MODEL_FILE_VERSION_GGMF_V1;
-            return;
-        }
-        break;
-      case MODEL_FILE_MAGIC_GGJT:
-        switch (version) {
-          case 1:
-            file_version = MODEL_FILE_VERSION_GGJT_V1;
-            return;
-          case 2:
-            file_version = MODEL_FILE_VERSION_GGJT_V2;
-            return;
-          case 3:
-            file_version = MODEL_FILE_VERSION_GGJT_V3;
-            return;
-        }
-    }
-
-    throw format("unknown (magic, version) combination: %08x, %08x; is this really a NE file?", magic, version);
-  }
-  void read_hparams() {
-    hparams.n_vocab = file.read_u32();
-    hparams.n_embd = file.read_u32();
-    hparams.n_mult = file.read_u32();
-    hparams.n_head = file.read_u32();
-    hparams.n_layer = file.read_u32();
-    hparams.n_rot = file.read_u32();
-    hparams.ftype = (enum model_ftype)file.read_u32();
-  }
-  void read_vocab() {
-    vocab.id_to_token.resize(hparams.n_vocab);
-
-    for (uint32_t i = 0; i < hparams.n_vocab; i++) {
-      uint32_t len = file.read_u32();
-      std::string word = file.read_string(len);
-
-      float score = 0.0f;
-      if (file_version >= MODEL_FILE_VERSION_GGMF_V1) {
-        file.read_raw(&score, sizeof(score));
-      }
-
-      vocab.token_to_id[word] = i;
-
-      auto& tok_score = vocab.id_to_token[i];
-      tok_score.tok = std::move(word);
-      tok_score.score = score;
-    }
-  }
-  void read_tensor_metadata(size_t file_idx, model_load_tensors_map& tensors_map) {
-    while (file.tell() < file.size) {
-      model_load_tensor_shard shard;
-      uint32_t n_dims = file.read_u32();
-      uint32_t name_len = file.read_u32();
-      shard.type = (enum ne_type)file.read_u32();
-      shard.ne.resize(n_dims);
-      file.read_raw(shard.ne.data(), sizeof(shard.ne[0]) * n_dims);
-      std::string name = file.read_string(name_len);
-      if (n_dims < 1 || n_dims > 2) {
-        throw format("model.cpp: tensor '%s' should not be %u-dimensional", name.c_str(), n_dims);
-      }
-      switch (shard.type) {
-        case NE_TYPE_F32:
-        case NE_TYPE_F16:
-        case NE_TYPE_Q4_0:
-        case NE_TYPE_Q4_1:
-        case NE_TYPE_Q5_0:
-        case NE_TYPE_Q5_1:
-        case NE_TYPE_Q8_0:
-        case NE_TYPE_Q4_JBLAS:
-          break;
-        default: {
-          throw format("unrecognized tensor type %u\n", shard.type);
-        }
-      }
-
-      if (file_version >= MODEL_FILE_VERSION_GGJT_V1) {
-        // skip to the next multiple of 32 bytes
-        file.seek(-static_cast<ptrdiff_t>(file.tell()) & 31, SEEK_CUR);
-      }
-      shard.file_idx = file_idx;
-      shard.file_off = file.tell();
-      if (shard.type == NE_TYPE_Q4_JBLAS) {
-        size_t size = 0;
-        file.read_raw(&size, sizeof(size_t));
-        shard.size = size;
-        file.seek(shard.size - sizeof(size_t), SEEK_CUR);
-      } else {
-        shard.calc_size();
-        file.seek(shard.size, SEEK_CUR);
-      }
-
-      auto it = tensors_map.name_to_idx.find(name);
-      size_t idx;
-      if (it != tensors_map.name_to_idx.end()) {
-        idx = it->second;
-      } else {
-        tensors_map.tensors.emplace_back(name);
-        idx = tensors_map.tensors.size() - 1;
-        tensors_map.name_to_idx.emplace(name, idx);
-      }
-      tensors_map.tensors.at(idx).shards.push_back(shard);
-    }
-  }
-};
-
-struct model_file_saver {
-  model_file file;
-  model_file_loader* any_file_loader;
-  model_file_saver(const char* fname, model_file_loader* any_file_loader, enum model_ftype new_ftype)
-      : file(fname, "wb"), any_file_loader(any_file_loader) {
-    fprintf(stderr, "model.cpp: saving model to %s\n", fname);
-    write_magic();
-    write_hparams(new_ftype);
-    write_vocab();
-  }
-  void write_magic() {
-    file.write_u32(MODEL_FILE_MAGIC);    // magic
-    file.write_u32(MODEL_FILE_VERSION);  // version
-  }
-  void write_hparams(enum model_ftype new_ftype) {
-    const model_hparams& hparams = any_file_loader->hparams;
-    file.write_u32(hparams.n_vocab);
-    file.write_u32(hparams.n_embd);
-    file.write_u32(hparams.n_mult);
-    file.write_u32(hparams.n_head);
-    file.write_u32(hparams.n_layer);
-    file.write_u32(hparams.n_rot);
-    file.write_u32(new_ftype);
-  }
-  void write_vocab() {
-    if (any_file_loader->file_version == MODEL_FILE_VERSION_NE) {
-      fprintf(stderr, "model.cpp: WARNING: input is an old file that doesn't have scores; will add dummy scores\n");
-    }
-    uint32_t n_vocab = any_file_loader->hparams.n_vocab;
-    for (uint32_t i = 0; i < n_vocab; i++) {
-      const auto& token_score = any_file_loader->vocab.id_to_token.at(i);
-      file.write_u32((uint32_t)token_score.tok.size());
-      file.write_raw(token_score.tok.data(), token_score.tok.size());
-      file.write_raw(&token_score.score, sizeof(token_score.score));
-    }
-  }
-  void write_tensor(model_load_tensor& tensor, enum ne_type new_type, const void* new_data, size_t new_size) {
-    switch (new_type) {
-      case NE_TYPE_F32:
-      case NE_TYPE_F16:
-      case NE_TYPE_Q4_0:
-      case NE_TYPE_Q4_1:
-      case NE_TYPE_Q5_0:
-      case NE_TYPE_Q5_1:
-      case NE_TYPE_Q8_0:
-      case NE_TYPE_Q4_JBLAS:
-        break;
-      default:
-        MODEL_ASSERT(false);
-    }
-    file.write_u32((uint32_t)tensor.ne.size());
-    file.write_u32((uint32_t)tensor.name.size());
-    file.write_u32(new_type);
-    file.write_raw(tensor.ne.data(), sizeof(tensor.ne[0]) * tensor.ne.size());
-    file.write_raw(tensor.name.data(), tensor.name.size());
-    file.seek(-static_cast<ptrdiff_t>(file.tell()) & 31, SEEK_CUR);
-    if (new_type != NE_TYPE_Q4_JBLAS) MODEL_ASSERT(new_size == model_calc_tensor_size(tensor.ne, new_type));
-    file.write_raw(new_data, new_size);
-  }
-};
-
-struct model_model_loader {
-  std::vector<std::unique_ptr<model_file_loader>> file_loaders;
-  model_load_tensors_map tensors_map;
-  bool use_mmap;
-  size_t num_ne_tensors_created = 0;
-  struct ne_context* ne_ctx = NULL;
-  std::unique_ptr<model_mmap> mapping;
-
-  model_model_loader(const std::string& fname_base, bool use_mmap, bool vocab_only) {
-    auto* first_file = new model_file_loader(fname_base.c_str(), 0, tensors_map);
-    file_loaders.emplace_back(first_file);
-    uint32_t n_parts = vocab_only ? 1 : guess_n_parts();
-    for (uint32_t i = 1; i < n_parts; i++) {
-      std::string fname = fname_base + "." + std::to_string(i);
-      auto* ith_file = new model_file_loader(fname.c_str(), i, tensors_map);
-      file_loaders.emplace_back(ith_file);
-      if (ith_file->hparams != first_file->hparams) {
-        throw format("model.cpp: hparams inconsistent between files");
-      }
-    }
-    if (!model_mmap::SUPPORTED) {
-      use_mmap = false;
-    }
-    if (use_mmap && alignment_prevents_mmap()) {
-      fprintf(stderr,
-              "model.cpp: can't use mmap because tensors are not aligned; convert to new format to avoid this\n");
-      use_mmap = false;
-    }
-    this->use_mmap = use_mmap;
-    for (model_load_tensor& lt : tensors_map.tensors) {
-      lt.calc_all();
-    }
-  }
-
-  bool alignment_prevents_mmap() {
-    for (const model_load_tensor& lt : tensors_map.tensors) {
-      for (const model_load_tensor_shard& shard : lt.shards) {
-        if (shard.file_off & 3) {
-          return true;
-        }
-      }
-    }
-    return false;
-  }
-
-  uint32_t guess_n_parts() const {
-    auto it = tensors_map.name_to_idx.find("tok_embeddings.weight");
-    if (it == tensors_map.name_to_idx.end()) {
-      throw std::string("missing tok_embeddings.weight");
-    }
-    const model_load_tensor& lt = tensors_map.tensors.at(it->second);
-    return file_loaders.at(0)->hparams.n_embd / lt.shards.at(0).ne.at(0);
-  }
-
-  void calc_sizes(size_t* ctx_size_p, size_t* mmapped_size_p) const {
-    *ctx_size_p = *mmapped_size_p = 0;
-    for (const model_load_tensor& lt : tensors_map.tensors) {
-      *ctx_size_p += sizeof(struct ne_tensor) + NE_OBJECT_SIZE;
-      *(use_mmap ? mmapped_size_p : ctx_size_p) += lt.size;
-    }
-  }
-
-  struct ne_tensor* get_tensor(const std::string& name, const std::vector<uint32_t>& ne, ne_backend backend) {
-    auto it = tensors_map.name_to_idx.find(name);
-    if (it == tensors_map.name_to_idx.end()) {
-      throw format("model.cpp: tensor '%s' is missing from model", name.c_str());
-    }
-    model_load_tensor& lt = tensors_map.tensors.at(it->second);
-    if (lt.ne != ne) {
-      throw format("model.cpp: tensor '%s' has wrong shape; expected %s, got %s", name.c_str(),
-                   model_format_tensor_shape(ne).c_str(), model_format_tensor_shape(lt.ne).c_str());
-    }
-
-    return get_tensor_for(lt, backend);
-  }
-
-  struct ne_tensor* get_tensor_for(model_load_tensor& lt, ne_backend backend) {
-    struct ne_tensor* tensor;
-    if (lt.ne.size() == 2) {
-      tensor = ne_new_tensor_2d(ne_ctx, lt.type, lt.ne.at(0), lt.ne.at(1));
-    } else {
-      MODEL_ASSERT(lt.ne.size() == 1);
-      tensor = ne_new_tensor_1d(ne_ctx, lt.type, lt.ne.at(0));
-    }
-    ne_set_name(tensor, lt.name.c_str());
-    MODEL_ASSERT(lt.ne_tensor == NULL);  // if this fails, we called get_tensor twice on the same tensor
-    tensor->backend = backend;
-    lt.ne_tensor = tensor;
-    num_ne_tensors_created++;
-    return tensor;
-  }
-
-  void done_getting_tensors() const {
-    if (num_ne_tensors_created != tensors_map.tensors.size()) {
-      throw std::string("model.cpp: file contained more tensors than expected");
-    }
-  }
-
-  void load_all_data(model_progress_callback progress_callback, void* progress_callback_user_data,
-                     model_mlock* lmlock) {
-    size_t data_size = 0;
-    size_t prefetch_size = 0;
-    for (const model_load_tensor& lt : tensors_map.tensors) {
-      data_size += lt.size;
-      if (lt.ne_tensor->backend == NE_BACKEND_CPU) {
-        prefetch_size += lt.size;
-      }
-    }
-
-    if (use_mmap) {
-      mapping.reset(new model_mmap(&file_loaders.at(0)->file, prefetch_size));
-      if (!lmlock) {
-        // Don't call the callback since the actual loading will be lazy
-        // and we can't measure it.
-        progress_callback = NULL;
-      }
-      if (lmlock) {
-        lmlock->init(mapping->addr);
-      }
-    }
-
-    size_t done_size = 0;
-    for (model_load_tensor& lt : tensors_map.tensors) {
-      if (lt.ne_tensor->backend != NE_BACKEND_CPU) {
-        continue;
-      }
-      if (progress_callback) {
-        progress_callback((float)done_size / data_size, progress_callback_user_data);
-      }
-      MODEL_ASSERT(lt.ne_tensor);  // unused tensors should have been caught by load_data already
-      lt.data = (uint8_t*)lt.ne_tensor->data;
-      load_data_for(lt);
-      lt.ne_tensor->data = lt.data;
-      done_size += lt.size;
-      if (use_mmap && lmlock) {
-        lmlock->grow_to(done_size);
-      }
-    }
-  }
-
-  void load_data_for(model_load_tensor& lt) {
-    if (use_mmap) {
-      MODEL_ASSERT(lt.shards.size() == 1);
-      lt.data = (uint8_t*)mapping->addr + lt.shards.at(0).file_off;
-    } else if (lt.split_type == SPLIT_NONE) {
-      model_file& file = file_loaders.at(lt.shards.at(0).file_idx)->file;
-      file.seek(lt.shards.at(0).file_off, SEEK_SET);
-      file.read_raw(lt.data, lt.size);
-    } else if (lt.split_type == SPLIT_BY_ROWS) {
-      size_t offset = 0;
-      for (model_load_tensor_shard& shard : lt.shards) {
-        model_file& file = file_loaders.at(shard.file_idx)->file;
-        file.seek(shard.file_off, SEEK_SET);
-        file.read_raw(lt.data + offset, shard.size);
-        offset += shard.size;
-      }
-      MODEL_ASSERT(offset == lt.size);
-    } else if (lt.split_type == SPLIT_BY_COLUMNS) {
-      // Let's load the data into temporary buffers to ensure the OS performs large loads.
-      std::vector<model_buffer> tmp_bufs(lt.shards.size());
-      for (size_t i = 0; i < lt.shards.size(); i++) {
-        model_load_tensor_shard& shard = lt.shards.at(i);
-        model_file& file = file_loaders.at(shard.file_idx)->file;
-        file.seek(shard.file_off, SEEK_SET);
-        tmp_bufs.at(i).resize(shard.size);
-        file.read_raw(tmp_bufs.at(i).addr, shard.size);
-      }
-      // Then reshape.
-      size_t num_rows = lt.ne.at(1);
-      size_t per_shard_row_size = lt.shards.at(0).size / num_rows;
-      size_t out_offset = 0;
-      for (size_t row = 0; row < num_rows; row++) {
-        for (model_buffer& tmp_buf : tmp_bufs) {
-          memcpy(lt.data + out_offset, tmp_buf.addr + row * per_shard_row_size, per_shard_row_size);
-          out_offset += per_shard_row_size;
-        }
-      }
-      MODEL_ASSERT(out_offset == lt.size);
-    }
-    if (0) {
-      print_checksum(lt);
-    }
-  }
-
-  static void print_checksum(model_load_tensor& lt) {
-    uint32_t sum = 0;
-    for (size_t i = 0; i < lt.size; i++) {
-      uint8_t byte = lt.data[i];
-      sum = byte + (sum << 6) + (sum << 16) - sum;  // sdbm hash
-    }
-    fprintf(stderr, "%s checksum: %#08x (%s, size %zu)\n", lt.name.c_str(), sum,
-            model_format_tensor_shape(lt.ne).c_str(), lt.size);
-  }
-};
 
 //
 // kv cache
 //
 
+static size_t kv_cache_bytes(const struct model_hparams& hparams, ne_type wtype, int n_ctx) {
+  const int64_t n_elements = int64_t(hparams.n_embd) * hparams.n_layer * n_ctx;
+  return 2u * n_elements * ne_type_size(wtype) + 2u * MB;
+}
+
 static bool kv_cache_init(const struct model_hparams& hparams, struct model_kv_cache& cache, ne_type wtype, int n_ctx) {
   const int n_embd = hparams.n_embd;
   const int n_layer = hparams.n_layer;
@@ -555,7 +53,7 @@ static bool kv_cache_init(const struct model_hparams& hparams, struct model_kv_c
   const int64_t n_mem = n_layer * n_ctx;
   const int64_t n_elements = n_embd * n_mem;
 
-  cache.buf.resize(2u * n_elements * ne_type_size(wtype) + 2u * MB);
+  cache.buf.resize(kv_cache_bytes(hparams, wtype, n_ctx));
 
   struct ne_init_params params;
   params.mem_size = cache.buf.size;
@@ -579,6 +77,7 @@ static bool kv_cache_init(const struct model_hparams& hparams, struct model_kv_c
 
 struct model_context_params model_context_default_params() {
   struct model_context_params result = {
+      /*.arch                        =*/MODEL_LLAMA,
       /*.n_ctx                       =*/512,
       /*.gpu_layers                  =*/0,
       /*.seed                        =*/-1,
@@ -671,62 +170,89 @@ static const char* model_model_type_name(e_model type) {
   }
 }
 
-static void model_model_load_internal(const std::string& fname, model_context& lctx, int n_ctx, int n_gpu_layers,
-                                      ne_type memory_type, bool use_mmap, bool use_mlock, bool vocab_only,
-                                      model_progress_callback progress_callback, void* progress_callback_user_data) {
+static const char* model_arch_name(model_archs arch) {
+  switch (arch) {
+    case MODEL_LLAMA:
+      return "llama";
+    case MODEL_GPTNEOX:
+      return "gptneox";
+    case MODEL_MPT:
+      return "mpt";
+  }
+
+  return "unknown";
+}
+
+// pick the memory budget class of a model; LLaMA sizes are matched exactly, other
+// architectures use the smallest LLaMA class with at least as many layers
+static e_model model_guess_type(const model_hparams& hparams) {
+  switch (hparams.n_layer) {
+    case 32:
+      return MODEL_7B;
+    case 40:
+      return MODEL_13B;
+    case 60:
+      return MODEL_30B;
+    case 80:
+      return MODEL_65B;
+  }
+  if (hparams.n_layer < 32) return MODEL_7B;
+  if (hparams.n_layer < 40) return MODEL_13B;
+  if (hparams.n_layer < 60) return MODEL_30B;
+  return MODEL_65B;
+}
+
+static void model_model_load_internal(const std::string& fname, model_archs arch, model_context& lctx, int n_ctx,
+                                      int n_gpu_layers, ne_type memory_type, bool use_mmap, bool use_mlock,
+                                      bool vocab_only, model_progress_callback progress_callback,
+                                      void* progress_callback_user_data) {
   lctx.t_start_us = ne_time_us();
 
-  std::unique_ptr<model_model_loader> ml(new model_model_loader(fname, use_mmap, vocab_only));
+  std::unique_ptr<model_model_loader> ml(new model_model_loader(fname, arch, use_mmap, vocab_only));
 
   lctx.vocab = std::move(ml->file_loaders.at(0)->vocab);
   auto& model = lctx.model;
+  model.arch = arch;
   model.hparams = ml->file_loaders.at(0)->hparams;
   model_file_version file_version = ml->file_loaders.at(0)->file_version;
   auto& hparams = model.hparams;
-  uint32_t n_ff = ((2 * (4 * hparams.n_embd) / 3 + hparams.n_mult - 1) / hparams.n_mult) * hparams.n_mult;
 
   {
-    switch (hparams.n_layer) {
-      case 32:
-        model.type = e_model::MODEL_7B;
-        break;
-      case 40:
-        model.type = e_model::MODEL_13B;
-        break;
-      case 60:
-        model.type = e_model::MODEL_30B;
-        break;
-      case 80:
-        model.type = e_model::MODEL_65B;
-        break;
-    }
+    model.type = model_guess_type(hparams);
 
+    // GPT-NeoX and MPT files store the trained context length (max_seq_len for MPT) in n_ctx
+    if (arch != MODEL_LLAMA && hparams.n_ctx > 0) {
+      n_ctx = std::min(n_ctx, static_cast<int>(hparams.n_ctx));
+    }
     hparams.n_ctx = n_ctx;
   }
 
   {
+    fprintf(stderr, "%s: arch       = %s\n", __func__, model_arch_name(arch));
     fprintf(stderr, "%s: format     = %s\n", __func__, model_file_version_name(file_version));
     fprintf(stderr, "%s: n_vocab    = %u\n", __func__, hparams.n_vocab);
     fprintf(stderr, "%s: n_ctx      = %u\n", __func__, hparams.n_ctx);
     fprintf(stderr, "%s: n_embd     = %u\n", __func__, hparams.n_embd);
-    fprintf(stderr, "%s: n_mult     = %u\n", __func__, hparams.n_mult);
+    if (arch == MODEL_LLAMA) {
+      fprintf(stderr, "%s: n_mult     = %u\n", __func__, hparams.n_mult);
+    }
     fprintf(stderr, "%s: n_head     = %u\n", __func__, hparams.n_head);
     fprintf(stderr, "%s: n_layer    = %u\n", __func__, hparams.n_layer);
     fprintf(stderr, "%s: n_rot      = %u\n", __func__, hparams.n_rot);
     fprintf(stderr, "%s: ftype      = %u (%s)\n", __func__, hparams.ftype, model_ftype_name(hparams.ftype));
-    fprintf(stderr, "%s: n_ff       = %u\n", __func__, n_ff);
     fprintf(stderr, "%s: n_parts    = %zu\n", __func__, ml->file_loaders.size());
     fprintf(stderr, "%s: model size = %s\n", __func__, model_model_type_name(model.type));
   }
 
-  if (file_version < MODEL_FILE_VERSION_GGJT_V2) {
+  // the un-versioned 'ne' files of GPT-NeoX and MPT are produced by the current quantizers
+  if (arch == MODEL_LLAMA && file_version < MODEL_FILE_VERSION_GGJT_V2) {
     if (hparams.ftype != MODEL_FTYPE_ALL_F32 && hparams.ftype != MODEL_FTYPE_MOSTLY_F16 &&
         hparams.ftype != MODEL_FTYPE_MOSTLY_Q8_0) {
       throw format("this format is no longer supported (see https://github.com/ggerganov/model.cpp/pull/1405)");
     }
   }
 
-  if (file_version < MODEL_FILE_VERSION_GGJT_V3) {
+  if (arch == MODEL_LLAMA && file_version < MODEL_FILE_VERSION_GGJT_V3) {
     if (hparams.ftype == MODEL_FTYPE_MOSTLY_Q4_0 || hparams.ftype == MODEL_FTYPE_MOSTLY_Q4_1 ||
         hparams.ftype == MODEL_FTYPE_MOSTLY_Q8_0) {
       throw format("this format is no longer supported (see https://github.com/ggerganov/model.cpp/pull/1508)");
@@ -737,8 +263,6 @@ static void model_model_load_internal(const std::string& fname, model_context& l
     return;
   }
 
-  auto& ctx = model.ctx;
-
   size_t ctx_size;
   size_t mmapped_size;
   ml->calc_sizes(&ctx_size, &mmapped_size);
@@ -764,65 +288,19 @@ static void model_model_load_internal(const std::string& fname, model_context& l
     }
   }
 
-#ifdef NE_USE_CUBLAS
-#define MODEL_BACKEND_OFFLOAD NE_BACKEND_CUDA
-#else
-#define MODEL_BACKEND_OFFLOAD NE_BACKEND_CPU
-#endif
-
   // prepare memory for the weights
   size_t vram_total = 0;
-  {
-    const uint32_t n_embd = hparams.n_embd;
-    const uint32_t n_layer = hparams.n_layer;
-    const uint32_t n_vocab = hparams.n_vocab;
-
-    ml->ne_ctx = ctx;
-
-    model.tok_embeddings = ml->get_tensor("tok_embeddings.weight", {n_embd, n_vocab}, NE_BACKEND_CPU);
-    model.norm = ml->get_tensor("norm.weight", {n_embd}, NE_BACKEND_CPU);
-
-    // "output" tensor
-    {
-      ne_backend backend_output;
-      if (n_gpu_layers > int(n_layer)) {  // NOLINT
-        backend_output = MODEL_BACKEND_OFFLOAD;
-      } else {
-        backend_output = NE_BACKEND_CPU;
-      }
-
-      model.output = ml->get_tensor("output.weight", {n_embd, n_vocab}, backend_output);
-    }
-
-    const int i_gpu_start = n_layer - n_gpu_layers;
-
-    model.layers.resize(n_layer);
-    for (uint32_t i = 0; i < n_layer; ++i) {
-      const ne_backend backend = int(i) < i_gpu_start ? NE_BACKEND_CPU : MODEL_BACKEND_OFFLOAD;
-
-      auto& layer = model.layers[i];
-
-      std::string layers_i = "layers." + std::to_string(i);
-
-      layer.attention_norm = ml->get_tensor(layers_i + ".attention_norm.weight", {n_embd}, backend);
-
-      layer.wq = ml->get_tensor(layers_i + ".attention.wq.weight", {n_embd, n_embd}, backend);
-      layer.wk = ml->get_tensor(layers_i + ".attention.wk.weight", {n_embd, n_embd}, backend);
-      layer.wv = ml->get_tensor(layers_i + ".attention.wv.weight", {n_embd, n_embd}, backend);
-      layer.wo = ml->get_tensor(layers_i + ".attention.wo.weight", {n_embd, n_embd}, backend);
-
-      layer.ffn_norm = ml->get_tensor(layers_i + ".ffn_norm.weight", {n_embd}, backend);
-
-      layer.w1 = ml->get_tensor(layers_i + ".feed_forward.w1.weight", {n_embd, n_ff}, backend);
-      layer.w2 = ml->get_tensor(layers_i + ".feed_forward.w2.weight", {n_ff, n_embd}, backend);
-      layer.w3 = ml->get_tensor(layers_i + ".feed_forward.w3.weight", {n_embd, n_ff}, backend);
-
-      if (backend == NE_BACKEND_CUDA) {
-        vram_total += ne_nbytes(layer.attention_norm) + ne_nbytes(layer.wq) + ne_nbytes(layer.wk) +
-                      ne_nbytes(layer.wv) + ne_nbytes(layer.wo) + ne_nbytes(layer.attention_norm) +
-                      ne_nbytes(layer.w1) + ne_nbytes(layer.w2) + ne_nbytes(layer.w3);
-      }
-    }
+  ml->ne_ctx = model.ctx;
+  switch (arch) {
+    case MODEL_LLAMA:
+      vram_total = llama_model_load_tensors(*ml, model, n_gpu_layers);
+      break;
+    case MODEL_GPTNEOX:
+      vram_total = gptneox_model_load_tensors(*ml, model, n_gpu_layers);
+      break;
+    case MODEL_MPT:
+      vram_total = mpt_model_load_tensors(*ml, model, n_gpu_layers);
+      break;
   }
 
   ml->done_getting_tensors();
@@ -863,11 +341,11 @@ static void model_model_load_internal(const std::string& fname, model_context& l
   lctx.t_load_us = ne_time_us() - lctx.t_start_us;
 }
 
-static bool model_model_load(const std::string& fname, model_context& lctx, int n_ctx, int n_gpu_layers,
-                             ne_type memory_type, bool use_mmap, bool use_mlock, bool vocab_only,
+static bool model_model_load(const std::string& fname, model_archs arch, model_context& lctx, int n_ctx,
+                             int n_gpu_layers, ne_type memory_type, bool use_mmap, bool use_mlock, bool vocab_only,
                              model_progress_callback progress_callback, void* progress_callback_user_data) {
   try {
-    model_model_load_internal(fname, lctx, n_ctx, n_gpu_layers, memory_type, use_mmap, use_mlock, vocab_only,
+    model_model_load_internal(fname, arch, lctx, n_ctx, n_gpu_layers, memory_type, use_mmap, use_mlock, vocab_only,
                               progress_callback, progress_callback_user_data);
     return true;
   } catch (const std::string& err) {
@@ -1436,7 +914,7 @@ model_token model_sample_token(struct model_context* ctx, model_token_data_array
 //
 
 static void model_model_quantize_internal(const std::string& fname_inp, const std::string& fname_out,
-                                          enum model_ftype ftype, int nthread) {
+                                          enum model_ftype ftype, int nthread, enum ne_type embd_type) {
   ne_type quantized_type;
   switch (ftype) {
     case MODEL_FTYPE_MOSTLY_Q4_0:
@@ -1468,8 +946,8 @@ static void model_model_quantize_internal(const std::string& fname_inp, const st
     nthread = std::thread::hardware_concurrency();
   }
 
-  std::unique_ptr<model_model_loader> model_loader(new model_model_loader(fname_inp, /*use_mmap*/ false,
-                                                                          /*vocab_only*/ false));
+  std::unique_ptr<model_model_loader> model_loader(
+      new model_model_loader(fname_inp, MODEL_LLAMA, /*use_mmap*/ false, /*vocab_only*/ false));
   model_file_saver file_saver(fname_out.c_str(), model_loader->file_loaders.at(0).get(), ftype);
 
   size_t total_size_org = 0;
@@ -1479,6 +957,10 @@ static void model_model_quantize_internal(const std::string& fname_inp, const st
   std::vector<std::thread> workers;
   std::mutex mutex;
 
+  // raw token embeddings, to detect an output projection tied to them
+  std::vector<uint8_t> embd_data;
+  enum ne_type embd_data_type = NE_TYPE_COUNT;
+
   size_t idx = 0;
   for (model_load_tensor& tensor : model_loader->tensors_map.tensors) {
     model_buffer read_data;
@@ -1492,12 +974,23 @@ static void model_model_quantize_internal(const std::string& fname_inp, const st
     // This used to be a regex, but <regex> has an extreme cost to compile times.
     bool quantize = tensor.name.rfind("weight") == tensor.name.size() - 6;  // ends with 'weight'?
     bool embedd = false;
-    // skip embedding for quantization or use q4_0 instead.
+    // embeddings are gathered row by row, they take embd_type rather than the (JBLAS) weight type
     if (tensor.name.find("embedding") != std::string::npos) {
       embedd = true;
+      embd_data.assign((const uint8_t*)tensor.data, (const uint8_t*)tensor.data + tensor.size);
+      embd_data_type = tensor.type;
+    }
+    if (tensor.name == "output.weight" && tensor.type == embd_data_type && tensor.size == embd_data.size() &&
+        memcmp(tensor.data, embd_data.data(), tensor.size) == 0) {
+      // the loader ties a missing output projection to the (quantized) token embeddings
+      printf("tied to token embeddings, skipped\n");
+      continue;
     }
     // quantize only 2D tensors
     quantize &= (tensor.ne.size() == 2);
+    if (embedd && (embd_type == NE_TYPE_F32 || embd_type == NE_TYPE_F16)) {
+      quantize = false;
+    }
 
     // uncomment this to keep the output layer in FP16
     // if (tensor.name == "output.weight") {
@@ -1534,8 +1027,10 @@ static void model_model_quantize_internal(const std::string& fname_inp, const st
 
       printf("quantizing .. ");
       fflush(stdout);
-      if (quantized_type == NE_TYPE_Q4_JBLAS) {
-        if (!embedd) {//emedding of Q4 is not supported now
+      if (embedd && embd_type != NE_TYPE_COUNT) {
+        new_type = embd_type;
+      } else if (quantized_type == NE_TYPE_Q4_JBLAS) {
+        if (!embedd) {  // get_rows does not support the JBLAS layout, embeddings default to q4_0
           using GemmKernel = jblas::wrapper::gemm_default::weight_comp::avx512f::GemmKernelS4KBlock;
           using PrologueB = GemmKernel::WeightType;
           GemmKernel kernel;
@@ -1689,7 +1184,7 @@ struct model_context* model_init_from_file(const char* path_model, struct model_
 
   ne_type memory_type = params.f16_kv ? NE_TYPE_F16 : NE_TYPE_F32;
 
-  if (!model_model_load(path_model, *ctx, params.n_ctx, params.n_gpu_layers, memory_type, params.use_mmap,
+  if (!model_model_load(path_model, params.arch, *ctx, params.n_ctx, params.n_gpu_layers, memory_type, params.use_mmap,
                         params.use_mlock, params.vocab_only, params.progress_callback,
                         params.progress_callback_user_data)) {
     fprintf(stderr, "%s: failed to load model\n", __func__);
@@ -1699,6 +1194,7 @@ struct model_context* model_init_from_file(const char* path_model, struct model_
 
   // reserve memory for context buffers
   if (!params.vocab_only) {
+    ctx->kv_type = memory_type;
     if (!kv_cache_init(ctx->model.hparams, ctx->model.kv_self, memory_type, ctx->model.hparams.n_ctx)) {
       fprintf(stderr, "%s: kv_cache_init() failed for self-attention cache\n", __func__);
       model_free(ctx);
@@ -1735,8 +1231,18 @@ struct model_context* model_init_from_file(const char* path_model, struct model_
 void model_free(struct model_context* ctx) { delete ctx; }
 
 int model_model_quantize(const char* fname_inp, const char* fname_out, enum model_ftype ftype, int nthread) {
+  return model_model_quantize_embd(fname_inp, fname_out, ftype, nthread, NE_TYPE_COUNT);
+}
+
+int model_model_quantize_embd(const char* fname_inp, const char* fname_out, enum model_ftype ftype, int nthread,
+                              enum ne_type embd_type) {
+  if (embd_type != NE_TYPE_COUNT && embd_type != NE_TYPE_F32 && embd_type != NE_TYPE_F16 &&
+      (!ne_is_quantized(embd_type) || embd_type == NE_TYPE_Q4_JBLAS || embd_type == NE_TYPE_Q8_1)) {
+    fprintf(stderr, "%s: unsupported embedding type %s\n", __func__, ne_type_name(embd_type));
+    return 1;
+  }
   try {
-    model_model_quantize_internal(fname_inp, fname_out, ftype, nthread);
+    model_model_quantize_internal(fname_inp, fname_out, ftype, nthread, embd_type);
     return 0;
   } catch (const std::string& err) {
     fprintf(stderr, "%s: failed to quantize: %s\n", __func__, err.c_str());
@@ -1806,7 +1312,8 @@ int model_apply_lora_from_file_internal(struct model_context* ctx, const char* p
   model_buffer base_buf;
   if (path_base_model) {
     fprintf(stderr, "%s: loading base model from '%s'\n", __func__, path_base_model);
-    model_loader.reset(new model_model_loader(path_base_model, /*use_mmap*/ true, /*vocab_only*/ false));
+    model_loader.reset(
+        new model_model_loader(path_base_model, ctx->model.arch, /*use_mmap*/ true, /*vocab_only*/ false));
 
     size_t ctx_size;
     size_t mmapped_size;
@@ -2002,8 +1509,189 @@ int model_apply_lora_from_file(struct model_context* ctx, const char* path_lora,
   }
 }
 
+int model_eval(struct model_context* ctx, const model_token* tokens, int n_tokens, int n_past, int n_threads) {
+  bool ok = false;
+  switch (ctx->model.arch) {
+    case MODEL_LLAMA:
+      ok = llama_model_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads);
+      break;
+    case MODEL_GPTNEOX:
+      ok = gptneox_model_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads);
+      break;
+    case MODEL_MPT:
+      ok = mpt_model_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads);
+      break;
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: failed to eval\n", __func__);
+    return 1;
+  }
+
+  // get a more accurate load time, upon first eval
+  // TODO: fix this
+  if (!ctx->has_evaluated_once) {
+    ctx->t_load_us = ne_time_us() - ctx->t_start_us;
+    ctx->has_evaluated_once = true;
+  }
+
+  return 0;
+}
+
 int model_get_kv_cache_token_count(const struct model_context* ctx) { return ctx->model.kv_self.n; }
 
+struct model_kv_cache* model_kv_cache_new(struct model_context* ctx) {
+  // the context's own cache may be swapped out, build from the recorded type rather than from it
+  model_kv_cache* cache = new model_kv_cache;
+  if (!kv_cache_init(ctx->model.hparams, *cache, ctx->kv_type, ctx->model.hparams.n_ctx)) {
+    delete cache;
+    return nullptr;
+  }
+  return cache;
+}
+
+void model_kv_cache_free(struct model_kv_cache* cache) { delete cache; }
+
+void model_kv_cache_swap(struct model_context* ctx, struct model_kv_cache* cache) {
+  auto& kv_self = ctx->model.kv_self;
+
+  std::swap(kv_self.k, cache->k);
+  std::swap(kv_self.v, cache->v);
+  std::swap(kv_self.ctx, cache->ctx);
+  std::swap(kv_self.n, cache->n);
+  std::swap(kv_self.buf.addr, cache->buf.addr);
+  std::swap(kv_self.buf.size, cache->buf.size);
+#ifdef NE_USE_CUBLAS
+  std::swap(kv_self.buf.is_cuda, cache->buf.is_cuda);
+#endif
+}
+
+size_t model_kv_cache_size(const struct model_context* ctx) {
+  return kv_cache_bytes(ctx->model.hparams, ctx->kv_type, ctx->model.hparams.n_ctx);
+}
+
+// KV offload file layout: magic, version, hparams, type, n, then for every layer the n used K rows
+// followed for every layer by the first n columns of the transposed V
+struct model_kv_offload {
+  std::thread worker;
+  std::atomic<bool> done{false};
+  bool ok = false;
+};
+
+static void kv_cache_write(const model_hparams& hparams, const model_kv_cache& cache, const std::string& path) {
+  const int n_embd = hparams.n_embd;
+  const int n_layer = hparams.n_layer;
+  const int n_ctx = hparams.n_ctx;
+  const int n = cache.n;
+  const size_t elt_size = ne_element_size(cache.k);
+
+  model_file file(path.c_str(), "wb");
+  file.write_u32(MODEL_KV_MAGIC);
+  file.write_u32(MODEL_KV_VERSION);
+  file.write_raw(&hparams, sizeof(model_hparams));
+  file.write_u32((uint32_t)cache.k->type);
+  file.write_u32((uint32_t)n);
+
+  const char* k = (const char*)cache.k->data;
+  const char* v = (const char*)cache.v->data;
+  for (int il = 0; il < n_layer; ++il) {
+    file.write_raw(k + elt_size * n_embd * n_ctx * il, elt_size * n_embd * n);
+  }
+  for (int il = 0; il < n_layer; ++il) {
+    for (int i = 0; i < n_embd; ++i) {
+      file.write_raw(v + elt_size * n_ctx * (il * n_embd + i), elt_size * n);
+    }
+  }
+}
+
+struct model_kv_offload* model_kv_cache_offload(struct model_context* ctx, const struct model_kv_cache* cache,
+                                                const char* path_kv) {
+  MODEL_ASSERT(cache->k != NULL);
+
+  model_kv_offload* job = new model_kv_offload;
+  const model_hparams hparams = ctx->model.hparams;
+  const std::string path(path_kv);
+  try {
+    job->worker = std::thread([job, hparams, cache, path]() {
+      try {
+        kv_cache_write(hparams, *cache, path);
+        job->ok = true;
+      } catch (const std::exception& err) {
+        fprintf(stderr, "%s: failed to offload kv cache to '%s': %s\n", __func__, path.c_str(), err.what());
+      }
+      job->done = true;
+    });
+  } catch (const std::system_error& err) {
+    fprintf(stderr, "%s: failed to start offload thread: %s\n", __func__, err.what());
+    delete job;
+    return nullptr;
+  }
+  return job;
+}
+
+bool model_kv_offload_done(struct model_kv_offload* job) { return job->done; }
+
+bool model_kv_offload_wait(struct model_kv_offload* job) {
+  job->worker.join();
+  const bool ok = job->ok;
+  delete job;
+  return ok;
+}
+
+bool model_kv_cache_restore(struct model_context* ctx, struct model_kv_cache* cache, const char* path_kv) {
+  const auto& hparams = ctx->model.hparams;
+  const int n_embd = hparams.n_embd;
+  const int n_layer = hparams.n_layer;
+  const int n_ctx = hparams.n_ctx;
+  const size_t elt_size = ne_element_size(cache->k);
+
+  try {
+    model_file file(path_kv, "rb");
+
+    const uint32_t magic = file.read_u32();
+    const uint32_t version = file.read_u32();
+    if (magic != MODEL_KV_MAGIC || version != MODEL_KV_VERSION) {
+      fprintf(stderr, "%s : unknown (magic, version) for kv file: %08x, %08x\n", __func__, magic, version);
+      return false;
+    }
+
+    model_hparams file_hparams;
+    file.read_raw(&file_hparams, sizeof(model_hparams));
+    const uint32_t type = file.read_u32();
+    const uint32_t n = file.read_u32();
+    if (file_hparams != hparams || type != (uint32_t)cache->k->type || n > (uint32_t)n_ctx) {
+      fprintf(stderr, "%s : kv file '%s' does not match the model or cache type\n", __func__, path_kv);
+      return false;
+    }
+
+    const size_t offset = file.tell();
+    const size_t n_layer_bytes = elt_size * n_embd * n;
+    if (file.size != offset + 2 * n_layer * n_layer_bytes) {
+      fprintf(stderr, "%s : kv file '%s' has unexpected size %zu\n", __func__, path_kv, file.size);
+      return false;
+    }
+
+    // map the whole file and copy straight into the cache buffers, no staging copy
+    model_mmap mapping(&file);
+    const char* k = (const char*)mapping.addr + offset;
+    const char* v = k + n_layer * n_layer_bytes;
+    char* k_dst = (char*)cache->k->data;
+    char* v_dst = (char*)cache->v->data;
+    for (int il = 0; il < n_layer; ++il) {
+      memcpy(k_dst + elt_size * n_embd * n_ctx * il, k + n_layer_bytes * il, n_layer_bytes);
+    }
+    for (int il = 0; il < n_layer; ++il) {
+      for (int i = 0; i < n_embd; ++i) {
+        memcpy(v_dst + elt_size * n_ctx * (il * n_embd + i), v + elt_size * n * (il * n_embd + i), elt_size * n);
+      }
+    }
+    cache->n = n;
+  } catch (const std::exception& err) {
+    fprintf(stderr, "%s: failed to restore kv cache from '%s': %s\n", __func__, path_kv, err.what());
+    return false;
+  }
+  return true;
+}
+
 #define MODEL_MAX_RNG_STATE (64 * 1024)
 
 void model_set_rng_seed(struct model_context* ctx, int seed) {
@@ -26,12 +26,15 @@
 #define MODEL_FILE_MAGIC_GGMF        0x67676d66u // 'ggmf'
 #define MODEL_FILE_MAGIC_NE        0x67676d6cu // 'ne'
 #define MODEL_FILE_MAGIC_GGSN        0x6767736eu // 'ggsn'
+#define MODEL_FILE_MAGIC_GGKV        0x67676b76u // 'ggkv'
 
 #define MODEL_FILE_VERSION           3
 #define MODEL_FILE_MAGIC             MODEL_FILE_MAGIC_GGJT
 #define MODEL_FILE_MAGIC_UNVERSIONED MODEL_FILE_MAGIC_NE
 #define MODEL_SESSION_MAGIC          MODEL_FILE_MAGIC_GGSN
 #define MODEL_SESSION_VERSION        1
+#define MODEL_KV_MAGIC               MODEL_FILE_MAGIC_GGKV
+#define MODEL_KV_VERSION             1
 
 #ifdef __cplusplus
 extern "C" {
@@ -68,6 +71,18 @@ extern "C" {
             model_ftype   ftype,
             int          nthread);
 
+    // Same as model_model_quantize, but stores the token embedding table as embd_type:
+    // a ne block type (q4_0, q4_1, q5_0, q5_1, q8_0) whose rows get_rows dequantizes on gather,
+    // NE_TYPE_F32 / NE_TYPE_F16 to leave it unquantized, or NE_TYPE_COUNT for the default
+    // (the weight type, q4_0 for JBLAS types). An output projection identical to the embeddings is
+    // dropped from the file and tied to them on load
+    MODEL_API int model_model_quantize_embd(
+            const char * fname_inp,
+            const char * fname_out,
+            model_ftype   ftype,
+            int          nthread,
+            enum ne_type  embd_type);
+
     // Apply a LoRA adapter to a loaded model
     // path_base_model is the path to a higher quality model to use as a base for
     // the layers modified by the adapter. Can be NULL to use the current loaded model.
@@ -83,6 +98,35 @@ extern "C" {
     // Returns the number of tokens in the KV cache
     MODEL_API int model_get_kv_cache_token_count(const struct model_context * ctx);
 
+    // Allocates a KV cache of the same size and type as the one used by ctx.
+    // With model_kv_cache_swap this lets several sessions share one set of weights and compute buffers.
+    // Returns NULL on failure
+    MODEL_API struct model_kv_cache * model_kv_cache_new(struct model_context * ctx);
+    MODEL_API void model_kv_cache_free(struct model_kv_cache * cache);
+
+    // Exchanges the KV cache (including its token count) used by model_eval with `cache`
+    MODEL_API void model_kv_cache_swap(struct model_context * ctx, struct model_kv_cache * cache);
+
+    // Returns the size in bytes of one KV cache of ctx, also while its cache is swapped out
+    MODEL_API size_t model_kv_cache_size(const struct model_context * ctx);
+
+    struct model_kv_offload;
+
+    // Starts writing the `n` used tokens of every layer of `cache` to `path` on a background thread.
+    // `cache` must stay alive and unmodified until model_kv_offload_wait returns.
+    // Returns NULL if the job could not be started
+    MODEL_API struct model_kv_offload * model_kv_cache_offload(struct model_context * ctx, const struct model_kv_cache * cache, const char * path_kv);
+
+    // Returns true once the offload job has finished, without blocking
+    MODEL_API bool model_kv_offload_done(struct model_kv_offload * job);
+
+    // Waits for the offload job, frees it and returns whether the file was written successfully
+    MODEL_API bool model_kv_offload_wait(struct model_kv_offload * job);
+
+    // Maps a file written by model_kv_cache_offload and copies it into `cache`, setting its token count.
+    // Returns false if the file does not belong to this model / cache type
+    MODEL_API bool model_kv_cache_restore(struct model_context * ctx, struct model_kv_cache * cache, const char * path_kv);
+
     // Sets the current rng seed.
     MODEL_API void model_set_rng_seed(struct model_context * ctx, int seed);
 
@@ -0,0 +1,282 @@
+#include <math.h>
+#include <stdio.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "core/ne_layers.h"
+#include "models/model_utils/model_files.h"
+#include "models/model_utils/model_utils.h"
+#include "models/mpt/mpt.h"
+
+// layer slots:
+//   norm: norm_1, norm_2
+//   attn: Wqkv, out_proj
+//   ffn:  up_proj, down_proj
+size_t mpt_model_load_tensors(model_model_loader& ml, model_model& model, int n_gpu_layers) {
+  const auto& hparams = model.hparams;
+  const uint32_t n_embd = hparams.n_embd;
+  const uint32_t n_layer = hparams.n_layer;
+  const uint32_t n_vocab = hparams.n_vocab;
+
+  size_t vram_total = 0;
+
+  model.tok_embeddings = ml.get_tensor("transformer.wte.weight", {n_embd, n_vocab}, NE_BACKEND_CPU);
+  model.norm = ml.get_tensor("transformer.norm_f.weight", {n_embd}, NE_BACKEND_CPU);
+
+  // output embedding weight tied to input embedding
+  model.output = model.tok_embeddings;
+
+  const int i_gpu_start = n_layer - n_gpu_layers;
+
+  model.layers.resize(n_layer);
+  for (uint32_t i = 0; i < n_layer; ++i) {
+    const ne_backend backend = int(i) < i_gpu_start ? NE_BACKEND_CPU : MODEL_BACKEND_OFFLOAD;
+
+    auto& layer = model.layers[i];
+
+    std::string layers_i = "transformer.blocks." + std::to_string(i);
+
+    layer.norm[0] = ml.get_tensor(layers_i + ".norm_1.weight", {n_embd}, backend);
+
+    layer.attn[0] = ml.get_tensor(layers_i + ".attn.Wqkv.weight", {n_embd, 3 * n_embd}, backend);
+    layer.attn[1] = ml.get_tensor(layers_i + ".attn.out_proj.weight", {n_embd, n_embd}, backend);
+
+    layer.norm[1] = ml.get_tensor(layers_i + ".norm_2.weight", {n_embd}, backend);
+
+    layer.ffn[0] = ml.get_tensor(layers_i + ".ffn.up_proj.weight", {n_embd, 4 * n_embd}, backend);
+    layer.ffn[1] = ml.get_tensor(layers_i + ".ffn.down_proj.weight", {4 * n_embd, n_embd}, backend);
+
+    if (backend == NE_BACKEND_CUDA) {
+      vram_total += ne_nbytes(layer.norm[0]) + ne_nbytes(layer.attn[0]) + ne_nbytes(layer.attn[1]) +
+                    ne_nbytes(layer.norm[1]) + ne_nbytes(layer.ffn[0]) + ne_nbytes(layer.ffn[1]);
+    }
+  }
+
+  return vram_total;
+}
+
+bool mpt_model_eval_internal(model_context& lctx, const model_token* tokens, const int n_tokens, const int n_past,
+                             const int n_threads) {
+  const int64_t t_start_us = ne_time_us();
+
+  const int N = n_tokens;
+
+  const auto& model = lctx.model;
+  const auto& hparams = model.hparams;
+
+  const auto& kv_self = model.kv_self;
+
+  MODEL_ASSERT(!!kv_self.ctx);
+
+  const int n_embd = hparams.n_embd;
+  const int n_layer = hparams.n_layer;
+  const int n_ctx = hparams.n_ctx;
+  const int n_head = hparams.n_head;
+  const int n_vocab = hparams.n_vocab;
+
+  auto& mem_per_token = lctx.mem_per_token;
+  auto& buf_compute = lctx.buf_compute;
+
+  struct ne_init_params params = {
+      /*.mem_size   =*/buf_compute.size,
+      /*.mem_buffer =*/buf_compute.addr,
+      /*.no_alloc   =*/false,
+  };
+
+  struct ne_context* ctx0 = ne_init(params);
+
+  ne_cgraph gf = {};
+  gf.n_threads = N >= 32 && ne_cpu_has_blas() ? 1 : n_threads;
+
+  struct ne_tensor* embd = ne_new_tensor_1d(ctx0, NE_TYPE_I32, N);
+  ne_set_name(embd, "embd");
+  memcpy(embd->data, tokens, N * ne_element_size(embd));
+
+  struct ne_tensor* inpL = ne_get_rows(ctx0, model.tok_embeddings, embd);
+
+  for (int il = 0; il < n_layer; ++il) {
+    struct ne_tensor* cur;
+
+    lctx.use_buf(ctx0, 0);
+
+    // a = self.ln_1(x)
+    {
+      cur = ne_norm(ctx0, inpL);
+
+      cur = ne_mul(ctx0, ne_repeat(ctx0, model.layers[il].norm[0], cur), cur);
+    }
+
+    // self-attention
+    //  b, _, past_key_value = self.attn(a, past_key_value=past_key_value,
+    //  attn_bias=attn_bias, attention_mask=attention_mask,
+    //  is_causal=is_causal)
+    {
+      // compute QKV
+      cur = ne_mul_mat(ctx0, model.layers[il].attn[0], cur);
+
+      if (hparams.clip_qkv > 0.0f) {
+        cur = ne_clamp(ctx0, cur, -hparams.clip_qkv, hparams.clip_qkv);
+      }
+
+      struct ne_tensor* Qcur = ne_view_2d(ctx0, cur, n_embd, N, cur->nb[1], 0 * sizeof(float) * n_embd);
+      struct ne_tensor* Kcur = ne_view_2d(ctx0, cur, n_embd, N, cur->nb[1], 1 * sizeof(float) * n_embd);
+      struct ne_tensor* Vcur = ne_view_2d(ctx0, cur, n_embd, N, cur->nb[1], 2 * sizeof(float) * n_embd);
+
+      // store key and value to memory, V transposed like the other architectures
+      {
+        struct ne_tensor* k =
+            ne_view_1d(ctx0, kv_self.k, N * n_embd, (ne_element_size(kv_self.k) * n_embd) * (il * n_ctx + n_past));
+        struct ne_tensor* v =
+            ne_view_2d(ctx0, kv_self.v, N, n_embd, (n_ctx)*ne_element_size(kv_self.v),
+                       (il * n_ctx) * ne_element_size(kv_self.v) * n_embd + n_past * ne_element_size(kv_self.v));
+
+        ne_build_forward_expand(&gf, ne_cpy(ctx0, Kcur, k));
+        ne_build_forward_expand(&gf, ne_cpy(ctx0, ne_transpose(ctx0, Vcur), v));
+      }
+
+      // Q = Qcur.contiguous().view(n_embd/n_head, n_head, N).permute(0, 2, 1, 3)
+      struct ne_tensor* Q =
+          ne_permute(ctx0, ne_cpy(ctx0, Qcur, ne_new_tensor_3d(ctx0, NE_TYPE_F32, n_embd / n_head, n_head, N)), 0, 2,
+                     1, 3);
+
+      // K = Kmem.view(n_embd/n_head, n_head, n_past + N).permute(0, 2, 1, 3)
+      struct ne_tensor* K =
+          ne_permute(ctx0,
+                     ne_reshape_3d(ctx0,
+                                   ne_view_1d(ctx0, kv_self.k, (n_past + N) * n_embd,
+                                              il * n_ctx * ne_element_size(kv_self.k) * n_embd),
+                                   n_embd / n_head, n_head, n_past + N),
+                     0, 2, 1, 3);
+
+      // K * Q
+      struct ne_tensor* KQ = ne_mul_mat(ctx0, K, Q);
+
+      // KQ_scaled = KQ / sqrt(n_embd/n_head)
+      struct ne_tensor* KQ_scaled = ne_scale(ctx0, KQ, ne_new_f32(ctx0, 1.0f / sqrt(float(n_embd) / n_head)));
+
+      struct ne_tensor* KQ_scaled_alibi = ne_alibi(ctx0, KQ_scaled, n_past, n_head, hparams.alibi_bias_max);
+
+      // KQ_masked = mask_past(KQ_scaled)
+      struct ne_tensor* KQ_masked = ne_diag_mask_inf(ctx0, KQ_scaled_alibi, n_past);
+
+      // KQ = soft_max(KQ_masked)
+      struct ne_tensor* KQ_soft_max = ne_soft_max(ctx0, KQ_masked);
+
+      // split cached V into n_head heads
+      struct ne_tensor* V =
+          ne_view_3d(ctx0, kv_self.v, n_past + N, n_embd / n_head, n_head, n_ctx * ne_element_size(kv_self.v),
+                     n_ctx * ne_element_size(kv_self.v) * n_embd / n_head,
+                     il * n_ctx * ne_element_size(kv_self.v) * n_embd);
+
+      // KQV = transpose(V) * KQ_soft_max
+      struct ne_tensor* KQV = ne_mul_mat(ctx0, V, KQ_soft_max);
+
+      // KQV_merged = KQV.permute(0, 2, 1, 3)
+      struct ne_tensor* KQV_merged = ne_permute(ctx0, KQV, 0, 2, 1, 3);
+
+      // cur = KQV_merged.contiguous().view(n_embd, N)
+      cur = ne_cpy(ctx0, KQV_merged, ne_new_tensor_2d(ctx0, NE_TYPE_F32, n_embd, N));
+
+      // projection
+      cur = ne_mul_mat(ctx0, model.layers[il].attn[1], cur);
+    }
+
+    inpL = ne_add(ctx0, inpL, cur);
+
+    lctx.use_buf(ctx0, 1);
+
+    // m = self.ln_2(x)
+    {
+      cur = ne_norm(ctx0, inpL);
+
+      cur = ne_mul(ctx0, ne_repeat(ctx0, model.layers[il].norm[1], cur), cur);
+    }
+
+    // n = self.mlp(m)
+    {
+      cur = ne_mul_mat(ctx0, model.layers[il].ffn[0], cur);
+
+      // GELU activation
+      cur = ne_gelu(ctx0, cur);
+
+      // projection
+      cur = ne_mul_mat(ctx0, model.layers[il].ffn[1], cur);
+    }
+
+    // x = x + n
+    inpL = ne_add(ctx0, inpL, cur);
+  }
+
+  lctx.use_buf(ctx0, 0);
+
+  // used at the end to optionally extract the embeddings
+  struct ne_tensor* embeddings = NULL;
+
+  // norm
+  {
+    inpL = ne_norm(ctx0, inpL);
+
+    // inpL = ln_f_g*inpL
+    inpL = ne_mul(ctx0, ne_repeat(ctx0, model.norm, inpL), inpL);
+
+    embeddings = inpL;
+  }
+
+  // lm_head, tied to the token embeddings
+  inpL = ne_mul_mat(ctx0, model.output, inpL);
+
+  lctx.use_buf(ctx0, -1);
+
+  // run the computation
+  ne_build_forward_expand(&gf, inpL);
+  ne_graph_compute(ctx0, &gf);
+
+#ifdef NE_PERF
+  // print timing information per ne operation (for debugging purposes)
+  // requires NE_PERF to be defined
+  ne_graph_print(&gf);
+#endif
+
+  // update kv token count
+  lctx.model.kv_self.n = n_past + N;
+
+  // extract logits
+  {
+    auto& logits_out = lctx.logits;
+
+    if (lctx.logits_all) {
+      logits_out.resize(n_vocab * N);
+      memcpy(logits_out.data(), (float*)ne_get_data(inpL), sizeof(float) * n_vocab * N);
+    } else {
+      // return result for just the last token
+      logits_out.resize(n_vocab);
+      memcpy(logits_out.data(), (float*)ne_get_data(inpL) + (n_vocab * (N - 1)), sizeof(float) * n_vocab);
+    }
+  }
+
+  // extract embeddings
+  if (!lctx.embedding.empty()) {
+    auto& embedding_out = lctx.embedding;
+
+    embedding_out.resize(n_embd);
+    memcpy(embedding_out.data(), (float*)ne_get_data(embeddings) + (n_embd * (N - 1)), sizeof(float) * n_embd);
+  }
+
+  if (mem_per_token == 0) {
+    mem_per_token = ne_used_mem(ctx0) / N;
+  }
+
+  ne_free(ctx0);
+
+  // measure the performance only for the single-token evals
+  if (N == 1) {
+    lctx.t_eval_us += ne_time_us() - t_start_us;
+    lctx.n_eval++;
+  } else if (N > 1) {
+    lctx.t_p_eval_us += ne_time_us() - t_start_us;
+    lctx.n_p_eval += N;
+  }
+
+  return true;
+}
@@ -0,0 +1,21 @@
+#ifndef MPT_H
+#define MPT_H
+
+#include "models/model_utils/model_types.h"
+
+struct model_model_loader;
+
+// create the MPT weight tensors of `model` from the loader, returns the bytes placed in VRAM
+size_t mpt_model_load_tensors(model_model_loader& ml, model_model& model, int n_gpu_layers);
+
+// evaluate the transformer
+//
+//   - lctx:      model context
+//   - tokens:    new batch of tokens to process
+//   - n_past:    the context size so far
+//   - n_threads: number of threads to use
+//
+bool mpt_model_eval_internal(model_context& lctx, const model_token* tokens, const int n_tokens, const int n_past,
+                             const int n_threads);
+
+#endif  // MPT_H
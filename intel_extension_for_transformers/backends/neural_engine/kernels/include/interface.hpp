@@ -198,6 +198,13 @@ class SPARSE_API_ slice_desc : public kernel_desc_proxy {
   virtual ~slice_desc() {}
 };
 
+class SPARSE_API_ topk_desc : public kernel_desc_proxy {
+ public:
+  topk_desc() {}
+  explicit topk_desc(const operator_desc& op_desc) : kernel_desc_proxy(op_desc) {}
+  virtual ~topk_desc() {}
+};
+
 /**
  * @brief Derived proxy class, interfacing to the real/cached sparse_matmul_t.
  */
@@ -305,5 +312,12 @@ class SPARSE_API_ slice : public kernel_proxy {
   virtual ~slice() {}
 };
 
+class SPARSE_API_ topk : public kernel_proxy {
+ public:
+  topk() {}
+  explicit topk(const kernel_desc_proxy& kdp) : kernel_proxy(kdp) {}
+  virtual ~topk() {}
+};
+
 }  // namespace jd
 #endif  // ENGINE_SPARSELIB_INCLUDE_INTERFACE_HPP_
@@ -147,6 +147,13 @@ class hash_t {
       case kernel_kind::dynamic_quant:
         hash_combine(seed, op_attrs["input_dt"]);
         break;
+      case kernel_kind::topk:
+        hash_combine(seed, op_attrs["k"]);
+        hash_combine(seed, op_attrs["largest"]);
+        hash_combine(seed, op_attrs["sorted"]);
+        hash_combine(seed, op_attrs["normalize"]);
+        hash_combine(seed, op_attrs["batch_beam"]);
+        break;
       case kernel_kind::eltwiseop:
       default:
         break;
@@ -51,6 +51,9 @@ enum io {
   M,  // "seq_len" for Q & DST
   N,  // "seq_len" for K & V
 
+  // ragged batch: s32 [bs], first token of each sequence in Q / K / V / DST; MASK gives the length of each sequence
+  SEQ_OFFSET,
+
   SIZE,
 };
 }  // namespace mha_dense
@@ -68,6 +71,10 @@ enum io { SRC, IDX, DST, BINARY0, BINARY1, BINARY2, BINARY3, BINARY4, SIZE };
 namespace slice {
 enum io { SRC, DST, SIZE };
 }
+namespace topk {
+// BEAM_SCORE is optional: log-probabilities of the beams added to the normalized logits of their rows
+enum io { SRC, DST, IDX, BEAM_SCORE, SIZE };
+}
 
 }  // namespace exposed_enum
 }  // namespace jd
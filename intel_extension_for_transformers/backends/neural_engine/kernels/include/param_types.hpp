@@ -36,7 +36,8 @@ enum class kernel_kind : uint8_t {
   transpose_mha,
   mha_dense,
   slice,
-  dynamic_quant
+  dynamic_quant,
+  topk
 };
 
 enum class postop_alg : uint8_t {
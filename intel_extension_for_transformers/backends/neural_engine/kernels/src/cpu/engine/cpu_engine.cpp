@@ -38,6 +38,7 @@ DECLARE_IMPL_LIST(transpose_mha);
 DECLARE_IMPL_LIST(mha_dense);
 DECLARE_IMPL_LIST(slice);
 DECLARE_IMPL_LIST(dynamic_quant);
+DECLARE_IMPL_LIST(topk);
 
 #undef DECLARE_IMPL_LIST
 
@@ -62,6 +63,7 @@ const std::vector<impl_list_item_t>* cpu_engine_t::get_implementation_list(const
     CASE(slice);
     CASE(dynamic_quant_matmul);
     CASE(dynamic_quant);
+    CASE(topk);
     default:
       return &cpu_engine_t::empty_list;
   }
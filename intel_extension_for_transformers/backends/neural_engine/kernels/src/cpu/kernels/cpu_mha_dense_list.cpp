@@ -22,6 +22,7 @@
 #include "mha_dense.hpp"
 #include "mha_dense_bf16.hpp"
 #include "mha_dense_ref.hpp"
+#include "mha_dense_vnni.hpp"
 #include "param_types.hpp"
 namespace jd {
 static const std::vector<impl_list_item_t> bf16_impl_list{
@@ -31,6 +32,7 @@ static const std::vector<impl_list_item_t> bf16_impl_list{
 };
 static const std::vector<impl_list_item_t> static_impl_list{
     CPU_INSTANCE(mha_dense_k_t),
+    CPU_INSTANCE(mha_dense_vnni_k_t),
     CPU_INSTANCE(mha_dense_ref_k_t),
     NULL_INSTANCE(),
 };
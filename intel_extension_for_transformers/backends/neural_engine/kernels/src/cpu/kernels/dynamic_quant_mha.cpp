@@ -58,6 +58,7 @@ bool dynamic_quant_mha_kd_t::init() {
   KERNEL_INIT_CHECK((shapes[io::SRC_K] == std::vector<dim_t>{batch_size, N, head_num, head_size}));
   KERNEL_INIT_CHECK((shapes[io::SRC_V] == std::vector<dim_t>{batch_size, N, head_num, head_size}));
   KERNEL_INIT_CHECK((shapes[io::DST] == std::vector<dim_t>{batch_size, M, head_num, head_size}));
+  KERNEL_INIT_CHECK(dtypes.size() <= io::SEQ_OFFSET || dtypes[io::SEQ_OFFSET] == data_type::undef)  // no ragged batch
   KERNEL_INIT_CHECK((shapes[io::BINARY_ADD].size() == 0 ||  //
                      shapes[io::BINARY_ADD] == std::vector<dim_t>{batch_size, 1, 1, N}));
 
@@ -53,6 +53,8 @@ bool mha_dense_kd_t::init() {
   auto& dst_shape = tensor_desc[io::DST].shape();
   KERNEL_INIT_CHECK(q_shape == dst_shape)
   KERNEL_INIT_CHECK(k_shape == v_shape)
+  KERNEL_INIT_CHECK(tensor_desc.size() <= io::SEQ_OFFSET ||
+                    tensor_desc[io::SEQ_OFFSET].dtype() == data_type::undef)  // no ragged batch
 
   KERNEL_INIT_CHECK(tensor_desc[io::SRC_Q].ftype() == format_type::abcd)
   KERNEL_INIT_CHECK(tensor_desc[io::DST].ftype() == format_type::abcd)
@@ -48,6 +48,7 @@ bool mha_dense_bf16_kd_t::init() {
   KERNEL_INIT_CHECK((desc[io::SRC_K].shape() == std::vector<dim_t>{batch_size, sl_n, head_num, head_size}));
   KERNEL_INIT_CHECK((desc[io::SRC_V].shape() == std::vector<dim_t>{batch_size, sl_n, head_num, head_size}));
   KERNEL_INIT_CHECK((desc[io::DST].shape() == std::vector<dim_t>{batch_size, sl_m, head_num, head_size}));
+  KERNEL_INIT_CHECK(desc.size() <= io::SEQ_OFFSET || desc[io::SEQ_OFFSET].dtype() == data_type::undef)  // no ragged
   const auto& badd_shape = desc[io::BINARY_ADD].shape();
   if (!badd_shape.empty()) {
     KERNEL_INIT_CHECK(desc[io::BINARY_ADD].dtype() == data_type::fp32);
@@ -101,6 +101,16 @@ bool mha_dense_ref_kd_t::init() {
     KERNEL_INIT_CHECK(badd_shape_bcst[3] == 1 || badd_shape_bcst[3] == sl_n())
   }
 
+  // ragged batch: sequence `b` is the MASK[b] tokens starting from token SEQ_OFFSET[b] of Q / K / V / DST
+  if (ragged()) {
+    KERNEL_INIT_CHECK((dtypes[io::SEQ_OFFSET] == data_type::s32 && shapes[io::SEQ_OFFSET] == std::vector<dim_t>{bs()}))
+    KERNEL_INIT_CHECK(dtypes[io::MASK] == data_type::s32)
+    KERNEL_INIT_CHECK(sl_m() == sl_n() && ftypes[io::SRC_K] == format_type::abcd)  // self-attention only
+    KERNEL_INIT_CHECK(dtypes[io::DST_SCALE] == data_type::undef)
+    KERNEL_INIT_CHECK(is_all_of({io::Q_SCALE, io::K_SCALE, io::V_SCALE, io::SRC_DST_SCALE, io::SRC_DST_ZP},
+                                [&shapes](const int i) { return shapes[i].size() <= 1; }))  // per-tensor
+  }
+
   // dtype
   KERNEL_INIT_CHECK(is_all_of({dtypes[io::SRC_Q], dtypes[io::SRC_K], dtypes[io::SRC_V], dtypes[io::DST]},
                               [&](const data_type t) { return t != data_type::undef; }));
@@ -145,6 +155,7 @@ mha_dense_ref_k_t::mha_dense_ref_k_t(const std::shared_ptr<const kernel_desc_t>&
           dim2step(pre_pad1(4, ts_descs_[io::BINARY_ADD].shape()))[3],
       },
       is_dynq10n_dst(ts_descs_.size() > io::DST_SCALE && ts_descs_[io::DST_SCALE].dtype() != data_type::undef),
+      ragged_(derived_kd()->ragged()),
       workspace_size_(!is_dynq10n_dst ? 0 : sizeof(float) * ts_descs_[io::DST].size()) {}
 
 bool mha_dense_ref_k_t::init() { return true; }
@@ -202,9 +213,12 @@ bool mha_dense_ref_k_t::execute_(const std::vector<const void*>& rt_data) const
         const auto curr_sl_n = ts_descs_[io::MASK].dtype() == data_type::undef
                                    ? sl_n_
                                    : reinterpret_cast<const int32_t*>(rt_data[io::MASK])[ibs];
+        if (ragged_ && i >= curr_sl_n) continue;  // rows past the end of the sequence are not touched
+        const int q_tok = ragged_ ? reinterpret_cast<const int32_t*>(rt_data[io::SEQ_OFFSET])[ibs] : ibs * sl_m_;
+        const int kv_tok = ragged_ ? q_tok : ibs * sl_n_;
 
-        const int src_offset_q = ibs * sl_m_ * ld_q_ + ihn * head_size_;
-        const int src_offset_kv = kv_ft_ == format_type::abcd   ? ibs * sl_n_ * ld_kv_ + ihn * head_size_
+        const int src_offset_q = q_tok * ld_q_ + ihn * head_size_;
+        const int src_offset_kv = kv_ft_ == format_type::abcd   ? kv_tok * ld_kv_ + ihn * head_size_
                                   : kv_ft_ == format_type::acbd ? (ibs * head_num_ + ihn) * sl_n_ * ld_kv_
                                                                 : 0;
         const auto q_s8 = reinterpret_cast<const int8_t*>(rt_data[io::SRC_Q]) + src_offset_q;
@@ -214,7 +228,7 @@ bool mha_dense_ref_k_t::execute_(const std::vector<const void*>& rt_data) const
         const auto k_bf16 = reinterpret_cast<const bfloat16_t*>(rt_data[io::SRC_K]) + src_offset_kv;
         const auto v_bf16 = reinterpret_cast<const bfloat16_t*>(rt_data[io::SRC_V]) + src_offset_kv;
 
-        const int dst_offset = ibs * sl_m_ * ld_dst_ + ihn * head_size_;
+        const int dst_offset = q_tok * ld_dst_ + ihn * head_size_;
         const auto dst_data = const_cast<void*>(rt_data[io::DST]);
         const auto dst_u8 = reinterpret_cast<uint8_t*>(dst_data) + dst_offset;
         const auto dst_s8 = reinterpret_cast<int8_t*>(dst_data) + dst_offset;
@@ -73,6 +73,10 @@ class SPARSE_TEST_API_ mha_dense_ref_kd_t : public kernel_desc_t {
   inline bool stable_softmax() const { return stable_softmax_; }
   inline data_type dst_dt() const { return dst_dt_; }
   inline format_type kv_ft() const { return op_desc_.tensor_descs()[io::SRC_K].ftype(); }
+  inline bool ragged() const {
+    return op_desc_.tensor_descs().size() > io::SEQ_OFFSET &&
+           op_desc_.tensor_descs()[io::SEQ_OFFSET].dtype() != data_type::undef;
+  }
 
  private:
   operator_desc op_desc_;
@@ -114,6 +118,7 @@ class SPARSE_TEST_API_ mha_dense_ref_k_t : public kernel_t {
   const int bs_, sl_m_, sl_n_, head_num_, head_size_, ld_q_, ld_kv_, ld_dst_;  // in #elements
   const std::array<dim_t, 4> badd_step;
   const bool is_dynq10n_dst;
+  const bool ragged_;
   const size_t workspace_size_;
 };
 
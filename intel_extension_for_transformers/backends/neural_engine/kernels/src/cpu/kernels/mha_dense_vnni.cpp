@@ -0,0 +1,634 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "mha_dense_vnni.hpp"
+
+#ifdef WITH_GCC_FLAGS
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"  // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+#define KERNEL_INIT_CHECK(f)                                              \
+  if (!(f)) {                                                             \
+    SPARSE_LOG(ERROR) << "MHA dense VNNI kernel requires `" << #f << "`"; \
+    return false;                                                         \
+  }
+namespace jd {
+
+static constexpr int VEC = 16;
+static constexpr int MAX_M = 8;   // rows of Q / A of a register tile
+static constexpr int MAX_NB = 3;  // vectors of keys of a QK tile
+static constexpr int MAX_HB = 2;  // vectors of head_size of an AV tile
+
+bool mha_dense_vnni_kd_t::init() {
+#ifndef __AVX512F__
+  return false;
+#endif
+  if (!isa_available(avx512_core_vnni)) return false;
+  auto op_attrs = op_desc_.attrs();
+  merged_ = (op_attrs.find("merged_QKV") != op_attrs.end() && op_attrs["merged_QKV"] == "True");
+  KERNEL_INIT_CHECK(op_attrs.find("approx_exp") != op_attrs.end() && op_attrs.at("approx_exp") == "True");
+  KERNEL_INIT_CHECK(op_attrs.find("stable_softmax") != op_attrs.end() && op_attrs.at("stable_softmax") == "True");
+  KERNEL_INIT_CHECK(op_attrs.find("softmax_rescale") != op_attrs.end() && op_attrs.at("softmax_rescale") != "dynamic");
+  KERNEL_INIT_CHECK(std::all_of(op_attrs.cbegin(), op_attrs.cend(), [](auto&& kv) {
+    return kv.first == "merged_QKV" || kv.first == "approx_exp" || kv.first == "stable_softmax" ||
+           kv.first == "softmax_rescale";
+  }))
+
+  auto& tensor_desc = op_desc_.tensor_descs();
+  auto& q_shape = tensor_desc[io::SRC_Q].shape();
+  auto& k_shape = tensor_desc[io::SRC_K].shape();
+  auto& v_shape = tensor_desc[io::SRC_V].shape();
+  auto& dst_shape = tensor_desc[io::DST].shape();
+  KERNEL_INIT_CHECK(q_shape.size() == 4 && k_shape.size() == 4)
+  KERNEL_INIT_CHECK(q_shape == dst_shape)
+  KERNEL_INIT_CHECK(k_shape == v_shape)
+  KERNEL_INIT_CHECK(q_shape[0] == k_shape[0] && q_shape[2] == k_shape[2] && q_shape[3] == k_shape[3])
+
+  KERNEL_INIT_CHECK(tensor_desc[io::SRC_Q].ftype() == format_type::abcd)
+  KERNEL_INIT_CHECK(tensor_desc[io::DST].ftype() == format_type::abcd)
+  KERNEL_INIT_CHECK(tensor_desc[io::SRC_K].ftype() == format_type::abcd ||
+                    tensor_desc[io::SRC_K].ftype() == format_type::acbd)
+  KERNEL_INIT_CHECK(tensor_desc[io::SRC_V].ftype() == tensor_desc[io::SRC_K].ftype())
+
+  KERNEL_INIT_CHECK(tensor_desc[io::SRC_Q].dtype() == data_type::s8)
+  KERNEL_INIT_CHECK(tensor_desc[io::SRC_K].dtype() == data_type::s8)
+  KERNEL_INIT_CHECK(tensor_desc[io::SRC_V].dtype() == data_type::s8)
+  KERNEL_INIT_CHECK((tensor_desc[io::MASK] == jd::tensor_desc{{q_shape[0]}, data_type::s32, format_type::a}));
+
+  const auto dst_dt = tensor_desc[io::DST].dtype();
+  const auto src_bs = q_shape[0];
+  const auto src_sl_m = q_shape[1];
+  const auto src_sl_n = k_shape[1];
+  const auto head_num = q_shape[2];
+  const auto head_size = q_shape[3];
+
+  KERNEL_INIT_CHECK(head_size % VEC == 0)
+  KERNEL_INIT_CHECK(is_any_of({data_type::u8, data_type::s8, data_type::fp32, data_type::bf16},
+                              [dst_dt](auto t) { return dst_dt == t; }))
+
+  KERNEL_INIT_CHECK((tensor_desc[io::ATT_SCALE] == jd::tensor_desc{{1}, data_type::fp32, format_type::a}));
+  KERNEL_INIT_CHECK((tensor_desc[io::Q_SCALE] == jd::tensor_desc{{1}, data_type::fp32, format_type::a}));
+  KERNEL_INIT_CHECK((tensor_desc[io::K_SCALE] == jd::tensor_desc{{1}, data_type::fp32, format_type::a}));
+  KERNEL_INIT_CHECK((tensor_desc[io::V_SCALE] == jd::tensor_desc{{1}, data_type::fp32, format_type::a}));
+  KERNEL_INIT_CHECK((tensor_desc[io::SRC_DST_SCALE] == jd::tensor_desc{{1}, data_type::fp32, format_type::a}));
+  KERNEL_INIT_CHECK((tensor_desc[io::SRC_DST_ZP] == jd::tensor_desc{{1}, data_type::s32, format_type::a}));
+
+  if (has_binary_add()) {
+    const auto& badd_shape = tensor_desc[io::BINARY_ADD].shape();
+    const auto badd_dim = badd_shape.size();
+    KERNEL_INIT_CHECK(tensor_desc[io::BINARY_ADD].dtype() == data_type::fp32);
+    KERNEL_INIT_CHECK(tensor_desc[io::BINARY_ADD].ftype() == plain_format(badd_dim));
+    KERNEL_INIT_CHECK(badd_dim >= 1 && badd_dim <= 4);
+    const auto badd_pad1 = pre_pad1(4, badd_shape);
+    KERNEL_INIT_CHECK(badd_pad1[0] == 1 || badd_pad1[0] == src_bs);
+    KERNEL_INIT_CHECK(badd_pad1[1] == 1 || badd_pad1[1] == head_num);
+    KERNEL_INIT_CHECK(badd_pad1[2] == 1 || badd_pad1[2] == src_sl_m);
+    KERNEL_INIT_CHECK(badd_pad1[3] == src_sl_n);  // the last dim can not be broadcasted
+  }
+  if (ragged()) {
+    KERNEL_INIT_CHECK((tensor_desc[io::SEQ_OFFSET] == jd::tensor_desc{{src_bs}, data_type::s32, format_type::a}));
+    KERNEL_INIT_CHECK(src_sl_m == src_sl_n && tensor_desc[io::SRC_K].ftype() == format_type::abcd)
+  }
+  return true;
+}
+
+mha_dense_vnni_k_t::mha_dense_vnni_k_t(const std::shared_ptr<const kernel_desc_t>& kd)
+    : kernel_t(kd),
+      ts_descs_(derived_kd()->get_operator_desc().tensor_descs()),
+      dst_dt_(ts_descs_[io::DST].dtype()),
+      kv_ft_(ts_descs_[io::SRC_K].ftype()),
+      src_bs_(ts_descs_[io::SRC_Q].shape()[0]),
+      src_sl_m_(ts_descs_[io::SRC_Q].shape()[1]),
+      src_sl_n_(ts_descs_[io::SRC_K].shape()[1]),
+      head_num_(ts_descs_[io::SRC_Q].shape()[2]),
+      head_size_(ts_descs_[io::SRC_Q].shape()[3]),
+      ld_q_(head_size_ * head_num_ * (derived_kd()->merged() ? 3 : 1)),
+      ld_kv_(kv_ft_ == format_type::abcd   ? ld_q_
+             : kv_ft_ == format_type::acbd ? head_size_ * (derived_kd()->merged() ? 3 : 1)
+                                           : 0),
+      ld_dst_(head_size_ * head_num_ * get_data_size(dst_dt_)),
+      sl_n_pad16_(pad_to(src_sl_n_, VEC)),
+      sl_n_pad64_(pad_to(src_sl_n_, 64)),
+      softmax_rescale_f32_(str_to_num<float>(derived_kd()->get_operator_desc().attrs().at("softmax_rescale"))),
+      has_binary_add(derived_kd()->has_binary_add()),
+      ragged_(derived_kd()->ragged()),
+      badd_stride_{0, 0, 0, 0},
+      tiled_(src_sl_n_ > MAX_SL_N),
+      thread_workspace_size_(tiled_ ? sizeof(uint8_t) * head_size_ * KV_BLOCK +  // k
+                                          sizeof(int8_t) * head_size_ * KV_BLOCK +   // v
+                                          sizeof(float) * MAX_M * KV_BLOCK +         // qk
+                                          sizeof(uint8_t) * MAX_M * KV_BLOCK +       // softmax
+                                          sizeof(float) * Q_BLOCK * head_size_ +     // AV accumulators
+                                          sizeof(float) * Q_BLOCK * 2                // running max & sum
+                                    : sizeof(uint8_t) * head_size_ * sl_n_pad16_ +   // k
+                                          sizeof(int8_t) * head_size_ * sl_n_pad16_ +  // v
+                                          sizeof(float) * MAX_M * sl_n_pad16_ +        // qk
+                                          sizeof(uint8_t) * MAX_M * sl_n_pad64_) {     // softmax
+  if (has_binary_add) {
+    const auto tmp_stride_ = dim2step(pre_pad1(4, ts_descs_[io::BINARY_ADD].shape()));
+    for (int i = 0; i < 4; ++i) badd_stride_[i] = tmp_stride_[i];
+  }
+}
+
+#ifdef __AVX512F__
+// same approximation as the reference: 2nd order polynomial of the fraction and a scale by 2^ceil(x*log2e)
+static inline __m512 exp_2nd_ps(__m512 x) {
+  static const float v_log2e = std::log2(std::exp(1.f));
+  static const float v_ln2 = std::log(2.f);
+  const auto z = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(v_log2e)), _MM_FROUND_TO_POS_INF);
+  const auto f = _mm512_sub_ps(x, _mm512_mul_ps(z, _mm512_set1_ps(v_ln2)));
+  const auto y =
+      _mm512_fmadd_ps(_mm512_fmadd_ps(f, _mm512_set1_ps(0.35815147f), _mm512_set1_ps(0.96963238f)), f,
+                      _mm512_set1_ps(1.f));
+  return _mm512_scalef_ps(y, z);
+}
+
+/**
+ * @brief Reorder n rows of K into [n/16][head_size/4][16][4], adding 128 to make it the unsigned side of vpdpbusd.
+ * Rows of the last block past n are zero.
+ */
+static inline void reorder_k(const int8_t* src, const int ld_src, const int n, const int head_size, uint8_t* dst) {
+  const auto vidx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                       _mm512_set1_epi32(ld_src));
+  const auto v_128u = _mm512_set1_epi8(-128);
+  for (int j = 0; j < n; j += VEC) {
+    const __mmask16 mask = n - j >= VEC ? 0xffff : (1U << (n - j)) - 1;
+    for (int k = 0; k < head_size; k += 4) {
+      const auto v = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, vidx, src + j * ld_src + k, 1);
+      _mm512_store_si512(dst + j * head_size + k * VEC, _mm512_xor_si512(v, v_128u));
+    }
+  }
+}
+
+/**
+ * @brief Reorder n rows of V into [head_size/16][ld_n/4][16][4] with 4 successive keys of a column in a dword. Keys
+ * of the last group past n are zero.
+ */
+static inline void reorder_v(const int8_t* src, const int ld_src, const int n, const int head_size, const int ld_n,
+                             int8_t* dst) {
+  for (int i = 0; i < n; i += 4) {
+    for (int j = 0; j < head_size; j += VEC) {
+      const auto row = [&](int ii) {
+        return i + ii < n ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (i + ii) * ld_src + j))
+                          : _mm_setzero_si128();
+      };
+      const auto a = row(0), b = row(1), c = row(2), d = row(3);
+      const auto ab_lo = _mm_unpacklo_epi8(a, b), ab_hi = _mm_unpackhi_epi8(a, b);
+      const auto cd_lo = _mm_unpacklo_epi8(c, d), cd_hi = _mm_unpackhi_epi8(c, d);
+      const auto dst_ij = reinterpret_cast<__m128i*>(dst + (j / VEC * ld_n + i) * VEC);
+      _mm_store_si128(dst_ij + 0, _mm_unpacklo_epi16(ab_lo, cd_lo));
+      _mm_store_si128(dst_ij + 1, _mm_unpackhi_epi16(ab_lo, cd_lo));
+      _mm_store_si128(dst_ij + 2, _mm_unpacklo_epi16(ab_hi, cd_hi));
+      _mm_store_si128(dst_ij + 3, _mm_unpackhi_epi16(ab_hi, cd_hi));
+    }
+  }
+}
+
+/**
+ * @brief M rows of Q times NB*16 keys of the reordered K, dequantized to fp32. The 128 added to K is taken back by
+ * the per-row `q_sum128`, i.e. 128 times the sum of a row of Q.
+ */
+template <int M, int NB>
+static void qk_tile(const int8_t* q, const int ld_q, const uint8_t* k_reo, const int head_size,
+                    const int32_t* q_sum128, const float scale, float* dst, const int ld_dst) {
+  __m512i acc[M][NB];
+#pragma GCC unroll 8
+  for (int i = 0; i < M; ++i)
+#pragma GCC unroll 3
+    for (int j = 0; j < NB; ++j) acc[i][j] = _mm512_setzero_si512();
+
+  for (int k = 0; k < head_size; k += 4) {
+    __m512i v_k[NB];
+#pragma GCC unroll 3
+    for (int j = 0; j < NB; ++j) v_k[j] = _mm512_load_si512(k_reo + j * VEC * head_size + k * VEC);
+#pragma GCC unroll 8
+    for (int i = 0; i < M; ++i) {
+      const auto v_q = _mm512_set1_epi32(*reinterpret_cast<const int32_t*>(q + i * ld_q + k));
+#pragma GCC unroll 3
+      for (int j = 0; j < NB; ++j) acc[i][j] = _mm512_dpbusd_epi32(acc[i][j], v_k[j], v_q);
+    }
+  }
+
+  const auto v_scale = _mm512_set1_ps(scale);
+#pragma GCC unroll 8
+  for (int i = 0; i < M; ++i) {
+    const auto v_sum128 = _mm512_set1_epi32(q_sum128[i]);
+#pragma GCC unroll 3
+    for (int j = 0; j < NB; ++j) {
+      const auto v_qk = _mm512_cvtepi32_ps(_mm512_sub_epi32(acc[i][j], v_sum128));
+      _mm512_store_ps(dst + i * ld_dst + j * VEC, _mm512_mul_ps(v_qk, v_scale));
+    }
+  }
+}
+#define QK_TILES(M) \
+  { qk_tile<M, 1>, qk_tile<M, 2>, qk_tile<M, 3> }
+static const decltype(qk_tile<1, 1>)* qk_tile_tbl[MAX_M][MAX_NB] = {
+    QK_TILES(1), QK_TILES(2), QK_TILES(3), QK_TILES(4), QK_TILES(5), QK_TILES(6), QK_TILES(7), QK_TILES(8),
+};
+#undef QK_TILES
+
+struct av_post_t {
+  float scale;  // v_scale / softmax_rescale
+  float dst_scale;
+  float dst_zp;
+  data_type dst_dt;
+};
+
+static inline void store_dst(const __m512 xs, void* dst, const data_type dt) {
+  constexpr int rn_sae = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+  switch (dt) {
+    case data_type::u8:
+      _mm512_mask_cvtusepi32_storeu_epi8(
+          dst, 0xffff, _mm512_max_epi32(_mm512_cvt_roundps_epi32(xs, rn_sae), _mm512_setzero_si512()));
+      break;
+    case data_type::s8:
+      _mm512_mask_cvtsepi32_storeu_epi8(dst, 0xffff, _mm512_cvt_roundps_epi32(xs, rn_sae));
+      break;
+    case data_type::fp32:
+      _mm512_storeu_ps(dst, xs);
+      break;
+    case data_type::bf16: {  // round to nearest even
+      const auto bits = _mm512_castps_si512(xs);
+      const auto lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+      const auto rounded = _mm512_add_epi32(_mm512_add_epi32(bits, _mm512_set1_epi32(0x7fff)), lsb);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm512_cvtepi32_epi16(_mm512_srli_epi32(rounded, 16)));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// M rows of the u8 softmax result times 4*n4 keys of HB*16 columns of the reordered V
+template <int M, int HB>
+static inline void av_dot(const uint8_t* a, const int ld_a, const int8_t* v_reo, const int ld_v, const int n4,
+                          __m512i (&acc)[M][HB]) {
+#pragma GCC unroll 8
+  for (int i = 0; i < M; ++i)
+#pragma GCC unroll 2
+    for (int j = 0; j < HB; ++j) acc[i][j] = _mm512_setzero_si512();
+
+  for (int k = 0; k < n4; ++k) {
+    __m512i v_v[HB];
+#pragma GCC unroll 2
+    for (int j = 0; j < HB; ++j) v_v[j] = _mm512_load_si512(v_reo + j * ld_v + k * 4 * VEC);
+#pragma GCC unroll 8
+    for (int i = 0; i < M; ++i) {
+      const auto v_a = _mm512_set1_epi32(*reinterpret_cast<const int32_t*>(a + i * ld_a + k * 4));
+#pragma GCC unroll 2
+      for (int j = 0; j < HB; ++j) acc[i][j] = _mm512_dpbusd_epi32(acc[i][j], v_a, v_v[j]);
+    }
+  }
+}
+
+/**
+ * @brief M rows of the u8 softmax result times 4*n4 keys of HB*16 columns of the reordered V, requantized to dst.
+ */
+template <int M, int HB>
+static void av_tile(const uint8_t* a, const int ld_a, const int8_t* v_reo, const int ld_v, const int n4, char* dst,
+                    const int ld_dst, const av_post_t& post) {
+  __m512i acc[M][HB];
+  av_dot<M, HB>(a, ld_a, v_reo, ld_v, n4, acc);
+
+  const auto dt_size = get_data_size(post.dst_dt);
+#pragma GCC unroll 8
+  for (int i = 0; i < M; ++i)
+#pragma GCC unroll 2
+    for (int j = 0; j < HB; ++j) {
+      auto xs = _mm512_mul_ps(_mm512_cvtepi32_ps(acc[i][j]), _mm512_set1_ps(post.scale));
+      xs = _mm512_add_ps(_mm512_div_ps(xs, _mm512_set1_ps(post.dst_scale)), _mm512_set1_ps(post.dst_zp));
+      store_dst(xs, dst + i * ld_dst + j * VEC * dt_size, post.dst_dt);
+    }
+}
+#define AV_TILES(M) \
+  { av_tile<M, 1>, av_tile<M, 2> }
+static const decltype(av_tile<1, 1>)* av_tile_tbl[MAX_M][MAX_HB] = {
+    AV_TILES(1), AV_TILES(2), AV_TILES(3), AV_TILES(4), AV_TILES(5), AV_TILES(6), AV_TILES(7), AV_TILES(8),
+};
+#undef AV_TILES
+
+/**
+ * @brief AV of a K/V tile added to the fp32 accumulators of M rows, which are first rescaled by the `alpha` of
+ * their row.
+ */
+template <int M, int HB>
+static void av_acc_tile(const uint8_t* a, const int ld_a, const int8_t* v_reo, const int ld_v, const int n4,
+                        float* acc_f32, const int ld_acc, const float* alpha) {
+  __m512i acc[M][HB];
+  av_dot<M, HB>(a, ld_a, v_reo, ld_v, n4, acc);
+#pragma GCC unroll 8
+  for (int i = 0; i < M; ++i) {
+    const auto v_alpha = _mm512_set1_ps(alpha[i]);
+#pragma GCC unroll 2
+    for (int j = 0; j < HB; ++j) {
+      const auto acc_ij = acc_f32 + i * ld_acc + j * VEC;
+      _mm512_store_ps(acc_ij, _mm512_fmadd_ps(_mm512_load_ps(acc_ij), v_alpha, _mm512_cvtepi32_ps(acc[i][j])));
+    }
+  }
+}
+#define AV_ACC_TILES(M) \
+  { av_acc_tile<M, 1>, av_acc_tile<M, 2> }
+static const decltype(av_acc_tile<1, 1>)* av_acc_tile_tbl[MAX_M][MAX_HB] = {
+    AV_ACC_TILES(1), AV_ACC_TILES(2), AV_ACC_TILES(3), AV_ACC_TILES(4),
+    AV_ACC_TILES(5), AV_ACC_TILES(6), AV_ACC_TILES(7), AV_ACC_TILES(8),
+};
+#undef AV_ACC_TILES
+
+/**
+ * @brief Softmax of the first n elements of a row of fp32 QK (binary_add not yet applied) into u8 scaled by
+ * softmax_rescale. Elements of `a` up to the next multiple of 16 are zero.
+ */
+static inline void softmax_row(float* qk, const float* badd, const int n, const float softmax_rescale, uint8_t* a) {
+  constexpr int rn_sae = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+  auto v_max = _mm512_set1_ps(-INFINITY);
+  for (int j = 0; j < n; j += VEC) {
+    const __mmask16 mask = n - j >= VEC ? 0xffff : (1U << (n - j)) - 1;
+    auto xs = _mm512_load_ps(qk + j);
+    if (badd != nullptr) xs = _mm512_add_ps(xs, _mm512_maskz_loadu_ps(mask, badd + j));
+    v_max = _mm512_mask_max_ps(v_max, mask, v_max, xs);
+    _mm512_store_ps(qk + j, xs);
+  }
+  v_max = _mm512_set1_ps(_mm512_reduce_max_ps(v_max));
+
+  auto v_sum = _mm512_setzero_ps();
+  for (int j = 0; j < n; j += VEC) {
+    const __mmask16 mask = n - j >= VEC ? 0xffff : (1U << (n - j)) - 1;
+    const auto xs = _mm512_max_ps(_mm512_sub_ps(_mm512_load_ps(qk + j), v_max), _mm512_set1_ps(-1000.f));
+    const auto es = _mm512_maskz_mov_ps(mask, exp_2nd_ps(xs));
+    v_sum = _mm512_add_ps(v_sum, es);
+    _mm512_store_ps(qk + j, es);
+  }
+  const auto v_rcp = _mm512_set1_ps(1.f / _mm512_reduce_add_ps(v_sum));
+  const auto v_rescale = _mm512_set1_ps(softmax_rescale);
+  for (int j = 0; j < n; j += VEC) {
+    const auto xs = _mm512_mul_ps(_mm512_mul_ps(_mm512_load_ps(qk + j), v_rcp), v_rescale);
+    _mm512_mask_cvtusepi32_storeu_epi8(a + j, 0xffff, _mm512_cvt_roundps_epu32(xs, rn_sae));
+  }
+}
+
+/**
+ * @brief Online softmax of the first n elements of a row of fp32 QK of a K/V tile (binary_add not yet applied) into
+ * u8 scaled by softmax_rescale, against the running max of the row. `row_max` and `row_sum` (of the u8 weights) are
+ * updated, and the factor to rescale what the previous tiles accumulated is returned.
+ */
+static inline float softmax_row_online(const float* qk, const float* badd, const int n, const float softmax_rescale,
+                                       uint8_t* a, float* row_max, float* row_sum) {
+  constexpr int rn_sae = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+  auto v_max = _mm512_set1_ps(-INFINITY);
+  for (int j = 0; j < n; j += VEC) {
+    const __mmask16 mask = n - j >= VEC ? 0xffff : (1U << (n - j)) - 1;
+    auto xs = _mm512_load_ps(qk + j);
+    if (badd != nullptr) xs = _mm512_add_ps(xs, _mm512_maskz_loadu_ps(mask, badd + j));
+    v_max = _mm512_mask_max_ps(v_max, mask, v_max, xs);
+  }
+  const float new_max = std::max(*row_max, _mm512_reduce_max_ps(v_max));
+  const float alpha =
+      _mm512_cvtss_f32(exp_2nd_ps(_mm512_set1_ps(std::max(*row_max - new_max, -1000.f))));  // 0 for the 1st tile
+  v_max = _mm512_set1_ps(new_max);
+
+  const auto v_rescale = _mm512_set1_ps(softmax_rescale);
+  auto v_sum = _mm512_setzero_si512();
+  for (int j = 0; j < n; j += VEC) {
+    const __mmask16 mask = n - j >= VEC ? 0xffff : (1U << (n - j)) - 1;
+    auto xs = _mm512_load_ps(qk + j);
+    if (badd != nullptr) xs = _mm512_add_ps(xs, _mm512_maskz_loadu_ps(mask, badd + j));
+    xs = exp_2nd_ps(_mm512_max_ps(_mm512_sub_ps(xs, v_max), _mm512_set1_ps(-1000.f)));
+    const auto as = _mm512_maskz_cvt_roundps_epu32(mask, _mm512_mul_ps(xs, v_rescale), rn_sae);
+    v_sum = _mm512_add_epi32(v_sum, as);
+    _mm512_mask_cvtusepi32_storeu_epi8(a + j, 0xffff, as);
+  }
+  *row_max = new_max;
+  *row_sum = *row_sum * alpha + _mm512_reduce_add_epi32(v_sum);
+  return alpha;
+}
+
+void mha_dense_vnni_k_t::mha_rows_tiled(const std::vector<const void*>& rt_data, const int ibs, const int ihn,
+                                        const int m_begin, const int m_end) const {
+  const auto att_scale = reinterpret_cast<const float*>(rt_data[io::ATT_SCALE])[0];
+  const auto q_scale = reinterpret_cast<const float*>(rt_data[io::Q_SCALE])[0];
+  const auto k_scale = reinterpret_cast<const float*>(rt_data[io::K_SCALE])[0];
+  const auto v_scale = reinterpret_cast<const float*>(rt_data[io::V_SCALE])[0];
+  const auto dst_scale = reinterpret_cast<const float*>(rt_data[io::SRC_DST_SCALE])[0];
+  const auto dst_zp = static_cast<float>(reinterpret_cast<const int32_t*>(rt_data[io::SRC_DST_ZP])[0]);
+  const float qk_scale = q_scale * k_scale * att_scale;
+  const auto dt_size = get_data_size(dst_dt_);
+
+  const int sl_n = std::min(src_sl_n_, reinterpret_cast<const int32_t*>(rt_data[io::MASK])[ibs]);
+  const int q_tok = ragged_ ? reinterpret_cast<const int32_t*>(rt_data[io::SEQ_OFFSET])[ibs] : ibs * src_sl_m_;
+  const int kv_tok = ragged_ ? q_tok : ibs * src_sl_n_;
+
+  const auto thread_id = omp_get_thread_num();
+  const auto thread_workspace =
+      reinterpret_cast<char*>(const_cast<void*>(rt_data[io::WORKSPACE])) + thread_id * thread_workspace_size_;
+  const auto k_scrach = reinterpret_cast<uint8_t*>(thread_workspace);
+  const auto v_scrach = reinterpret_cast<int8_t*>(k_scrach + head_size_ * KV_BLOCK);
+  const auto qk_scrach = reinterpret_cast<float*>(v_scrach + head_size_ * KV_BLOCK);
+  const auto softmax_scrach = reinterpret_cast<uint8_t*>(qk_scrach + MAX_M * KV_BLOCK);
+  const auto acc_scrach = reinterpret_cast<float*>(softmax_scrach + MAX_M * KV_BLOCK);
+  const auto row_max = acc_scrach + Q_BLOCK * head_size_;
+  const auto row_sum = row_max + Q_BLOCK;
+
+  const int src_q_offset = q_tok * ld_q_ + ihn * head_size_;
+  const int src_kv_offset = kv_ft_ == format_type::abcd   ? kv_tok * ld_kv_ + ihn * head_size_
+                            : kv_ft_ == format_type::acbd ? (ibs * head_num_ + ihn) * src_sl_n_ * ld_kv_
+                                                          : 0;
+  const int dst_offset = q_tok * ld_dst_ + ihn * head_size_ * dt_size;
+  const int badd_offset = ibs * badd_stride_[0] + ihn * badd_stride_[1];
+
+  const auto curr_q = reinterpret_cast<const int8_t*>(rt_data[io::SRC_Q]) + src_q_offset;
+  const auto curr_k = reinterpret_cast<const int8_t*>(rt_data[io::SRC_K]) + src_kv_offset;
+  const auto curr_v = reinterpret_cast<const int8_t*>(rt_data[io::SRC_V]) + src_kv_offset;
+  const auto curr_dst = reinterpret_cast<char*>(const_cast<void*>(rt_data[io::DST])) + dst_offset;
+  const auto badd_f32 =
+      has_binary_add ? reinterpret_cast<const float*>(rt_data[io::BINARY_ADD]) + badd_offset : nullptr;
+
+  int32_t q_sum128[Q_BLOCK];
+  for (int i = m_begin; i < m_end; ++i) {
+    int32_t sum = 0;
+#pragma omp simd
+    for (int k = 0; k < head_size_; ++k) sum += curr_q[i * ld_q_ + k];
+    q_sum128[i - m_begin] = sum * 128;
+  }
+  std::fill_n(acc_scrach, (m_end - m_begin) * head_size_, 0.f);
+  std::fill_n(row_max, m_end - m_begin, -INFINITY);
+  std::fill_n(row_sum, m_end - m_begin, 0.f);
+
+  for (int kb = 0; kb < sl_n; kb += KV_BLOCK) {
+    const int n = std::min(KV_BLOCK, sl_n - kb);
+    reorder_k(curr_k + kb * ld_kv_, ld_kv_, n, head_size_, k_scrach);
+    reorder_v(curr_v + kb * ld_kv_, ld_kv_, n, head_size_, KV_BLOCK, v_scrach);
+
+    for (int i = m_begin; i < m_end; i += MAX_M) {
+      const int m = std::min(MAX_M, m_end - i);
+      const int ic_i = i - m_begin;
+
+      // Q x K
+      for (int j = 0; j < n; j += MAX_NB * VEC) {
+        const int nb = std::min(MAX_NB, ceil_div(n - j, VEC));
+        qk_tile_tbl[m - 1][nb - 1](curr_q + i * ld_q_, ld_q_, k_scrach + j * head_size_, head_size_,
+                                   q_sum128 + ic_i, qk_scale, qk_scrach + j, KV_BLOCK);
+      }
+
+      // binary_add + online softmax
+      float alpha[MAX_M];
+      for (int ii = 0; ii < m; ++ii) {
+        const auto badd_row = has_binary_add ? badd_f32 + (i + ii) * badd_stride_[2] + kb : nullptr;
+        alpha[ii] = softmax_row_online(qk_scrach + ii * KV_BLOCK, badd_row, n, softmax_rescale_f32_,
+                                       softmax_scrach + ii * KV_BLOCK, row_max + ic_i + ii, row_sum + ic_i + ii);
+      }
+
+      // A x V
+      for (int j = 0; j < head_size_; j += MAX_HB * VEC) {
+        const int hb = std::min(MAX_HB, (head_size_ - j) / VEC);
+        av_acc_tile_tbl[m - 1][hb - 1](softmax_scrach, KV_BLOCK, v_scrach + j * KV_BLOCK, VEC * KV_BLOCK,
+                                       pad_to(n, 4) / 4, acc_scrach + ic_i * head_size_ + j, head_size_, alpha);
+      }
+    }
+  }
+
+  // normalize by the sum of the weights and requantize, a row of no keys (zero mask) is the zero point as in mha_rows
+  const auto v_dst_scale = _mm512_set1_ps(dst_scale);
+  const auto v_zp = _mm512_set1_ps(dst_zp);
+  for (int i = m_begin; i < m_end; ++i) {
+    const float sum_i = row_sum[i - m_begin];
+    const auto v_scale_i = _mm512_set1_ps(sum_i == 0.f ? 0.f : v_scale / sum_i);
+    for (int j = 0; j < head_size_; j += VEC) {
+      auto xs = _mm512_mul_ps(_mm512_load_ps(acc_scrach + (i - m_begin) * head_size_ + j), v_scale_i);
+      xs = _mm512_add_ps(_mm512_div_ps(xs, v_dst_scale), v_zp);
+      store_dst(xs, curr_dst + i * ld_dst_ + j * dt_size, dst_dt_);
+    }
+  }
+}
+
+void mha_dense_vnni_k_t::mha_rows(const std::vector<const void*>& rt_data, const int ibs, const int ihn,
+                                  const int m_begin, const int m_end) const {
+  const auto att_scale = reinterpret_cast<const float*>(rt_data[io::ATT_SCALE])[0];
+  const auto q_scale = reinterpret_cast<const float*>(rt_data[io::Q_SCALE])[0];
+  const auto k_scale = reinterpret_cast<const float*>(rt_data[io::K_SCALE])[0];
+  const auto v_scale = reinterpret_cast<const float*>(rt_data[io::V_SCALE])[0];
+  const auto dst_scale = reinterpret_cast<const float*>(rt_data[io::SRC_DST_SCALE])[0];
+  const auto dst_zp = static_cast<float>(reinterpret_cast<const int32_t*>(rt_data[io::SRC_DST_ZP])[0]);
+  const float qk_scale = q_scale * k_scale * att_scale;
+  const av_post_t av_post{v_scale / softmax_rescale_f32_, dst_scale, dst_zp, dst_dt_};
+
+  const int sl_n = std::min(src_sl_n_, reinterpret_cast<const int32_t*>(rt_data[io::MASK])[ibs]);
+  const int q_tok = ragged_ ? reinterpret_cast<const int32_t*>(rt_data[io::SEQ_OFFSET])[ibs] : ibs * src_sl_m_;
+  const int kv_tok = ragged_ ? q_tok : ibs * src_sl_n_;
+  const int sl_n_pad4 = pad_to(sl_n, 4);
+
+  const auto thread_id = omp_get_thread_num();
+  const auto thread_workspace =
+      reinterpret_cast<char*>(const_cast<void*>(rt_data[io::WORKSPACE])) + thread_id * thread_workspace_size_;
+  const auto k_scrach = reinterpret_cast<uint8_t*>(thread_workspace);
+  const auto v_scrach = reinterpret_cast<int8_t*>(k_scrach + head_size_ * sl_n_pad16_);
+  const auto qk_scrach = reinterpret_cast<float*>(v_scrach + head_size_ * sl_n_pad16_);
+  const auto softmax_scrach_p64 = reinterpret_cast<uint8_t*>(qk_scrach + MAX_M * sl_n_pad16_);
+
+  const int src_q_offset = q_tok * ld_q_ + ihn * head_size_;
+  const int src_kv_offset = kv_ft_ == format_type::abcd   ? kv_tok * ld_kv_ + ihn * head_size_
+                            : kv_ft_ == format_type::acbd ? (ibs * head_num_ + ihn) * src_sl_n_ * ld_kv_
+                                                          : 0;
+  const int dst_offset = q_tok * ld_dst_ + ihn * head_size_ * get_data_size(dst_dt_);
+  const int badd_offset = ibs * badd_stride_[0] + ihn * badd_stride_[1];
+
+  const auto curr_q = reinterpret_cast<const int8_t*>(rt_data[io::SRC_Q]) + src_q_offset;
+  const auto curr_k = reinterpret_cast<const int8_t*>(rt_data[io::SRC_K]) + src_kv_offset;
+  const auto curr_v = reinterpret_cast<const int8_t*>(rt_data[io::SRC_V]) + src_kv_offset;
+  const auto curr_dst = reinterpret_cast<char*>(const_cast<void*>(rt_data[io::DST])) + dst_offset;
+  const auto badd_f32 =
+      has_binary_add ? reinterpret_cast<const float*>(rt_data[io::BINARY_ADD]) + badd_offset : nullptr;
+
+  reorder_k(curr_k, ld_kv_, sl_n, head_size_, k_scrach);
+  reorder_v(curr_v, ld_kv_, sl_n, head_size_, sl_n_pad16_, v_scrach);
+
+  for (int i = m_begin; i < m_end; i += MAX_M) {
+    const int m = std::min(MAX_M, m_end - i);
+    const auto q_i = curr_q + i * ld_q_;
+
+    int32_t q_sum128[MAX_M];
+    for (int ii = 0; ii < m; ++ii) {
+      int32_t sum = 0;
+#pragma omp simd
+      for (int k = 0; k < head_size_; ++k) sum += q_i[ii * ld_q_ + k];
+      q_sum128[ii] = sum * 128;
+    }
+
+    // Q x K
+    for (int j = 0; j < sl_n; j += MAX_NB * VEC) {
+      const int nb = std::min(MAX_NB, ceil_div(sl_n - j, VEC));
+      qk_tile_tbl[m - 1][nb - 1](q_i, ld_q_, k_scrach + j * head_size_, head_size_, q_sum128, qk_scale,
+                                 qk_scrach + j, sl_n_pad16_);
+    }
+
+    // binary_add + softmax
+    for (int ii = 0; ii < m; ++ii) {
+      const auto badd_row = has_binary_add ? badd_f32 + (i + ii) * badd_stride_[2] : nullptr;
+      softmax_row(qk_scrach + ii * sl_n_pad16_, badd_row, sl_n, softmax_rescale_f32_,
+                  softmax_scrach_p64 + ii * sl_n_pad64_);
+    }
+
+    // A x V
+    for (int j = 0; j < head_size_; j += MAX_HB * VEC) {
+      const int hb = std::min(MAX_HB, (head_size_ - j) / VEC);
+      const auto dst_ij = curr_dst + i * ld_dst_ + j * get_data_size(dst_dt_);
+      av_tile_tbl[m - 1][hb - 1](softmax_scrach_p64, sl_n_pad64_, v_scrach + j * sl_n_pad16_,
+                                 VEC * sl_n_pad16_, sl_n_pad4 / 4, dst_ij, ld_dst_, av_post);
+    }
+  }
+}
+
+bool mha_dense_vnni_k_t::execute(const std::vector<const void*>& rt_data) const {
+  const int bs = src_bs_;
+  const auto seq_len = reinterpret_cast<const int32_t*>(rt_data[io::MASK]);
+  // split the rows of a head when there are not enough heads to keep the threads busy
+  const int nthr = omp_get_max_threads();
+  const int m_split = std::max(1, std::min(ceil_div(nthr, bs * head_num_), ceil_div(src_sl_m_, tiled_ ? MAX_M : 64)));
+  const int m_chunk = std::min(tiled_ ? Q_BLOCK : src_sl_m_, pad_to(ceil_div(src_sl_m_, m_split), MAX_M));
+  const auto rows_of = [&](int ibs) { return ragged_ ? std::max(0, std::min(src_sl_m_, seq_len[ibs])) : src_sl_m_; };
+
+  // tasks are (batch, chunk of rows, head); a ragged batch only has the chunks of the tokens of its sequences
+  std::vector<int> task_offset(bs + 1, 0);
+  for (int ibs = 0; ibs < bs; ++ibs)
+    task_offset[ibs + 1] = task_offset[ibs] + ceil_div(rows_of(ibs), m_chunk) * head_num_;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int it = 0; it < task_offset[bs]; ++it) {
+    const int ibs = std::upper_bound(task_offset.cbegin(), task_offset.cend(), it) - task_offset.cbegin() - 1;
+    const int ihn = (it - task_offset[ibs]) % head_num_;
+    const int m_begin = (it - task_offset[ibs]) / head_num_ * m_chunk;
+    const int m_end = std::min(rows_of(ibs), m_begin + m_chunk);
+    if (tiled_) {
+      mha_rows_tiled(rt_data, ibs, ihn, m_begin, m_end);
+    } else {
+      mha_rows(rt_data, ibs, ihn, m_begin, m_end);
+    }
+  }
+  return true;
+}
+#else
+bool mha_dense_vnni_k_t::execute(const std::vector<const void*>&) const {
+  SPARSE_LOG(ERROR) << "mha_dense VNNI kernel for AVX2 not implemented!";
+  return false;
+}
+#endif
+}  // namespace jd
@@ -0,0 +1,128 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_SPARSELIB_SRC_CPU_KERNELS_MHA_DENSE_VNNI_HPP_
+#define ENGINE_SPARSELIB_SRC_CPU_KERNELS_MHA_DENSE_VNNI_HPP_
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "src/cpu/cpu_isa.hpp"
+#include "kernels/exposed_enum.hpp"
+#include "kernel.hpp"
+#include "kernel_desc.hpp"
+#include "operator_desc.hpp"
+#include "src/utils.hpp"
+
+namespace jd {
+class mha_dense_vnni_k_t;
+
+/**
+ * @brief Multi-head attention kernel with static quantization for AVX512-VNNI hosts without AMX.
+ *
+ * Takes the same operator desc as mha_dense_kd_t (s8 Q/K/V, padding mask, optional binary_add and u8/s8/fp32/bf16
+ * dst) and gives the same results, with looser limits: any sl_m, any sl_n, head_size a multiple of 16 and no
+ * binary_add required for sl_m == 1. Sequences longer than the AMX kernel takes (mha_dense_k_t::MAX_SL_N) are
+ * computed K/V block by K/V block with online softmax, see mha_dense_vnni_k_t::mha_rows_tiled.
+ *
+ * Ragged batch: when SEQ_OFFSET is given, sequence `b` is the MASK[b] tokens starting from token SEQ_OFFSET[b] of
+ * Q / K / V / DST (self-attention only), and only those rows are computed and written. The sequences can be packed
+ * one after another or left at their padded places; binary_add is indexed by the position within the sequence.
+ *
+ * Currently only support per-tensor quantization.
+ */
+class mha_dense_vnni_kd_t : public kernel_desc_t {
+  using io = exposed_enum::mha_dense::io;
+
+ public:
+  explicit mha_dense_vnni_kd_t(const operator_desc& op_desc)
+      : kernel_desc_t(kernel_kind::mha_dense), op_desc_(op_desc) {}
+  virtual ~mha_dense_vnni_kd_t() {}
+
+  bool init() override;
+  DECLARE_COMMON_PD_T(mha_dense_vnni_k_t, mha_dense_vnni_kd_t);
+
+  const operator_desc& get_operator_desc() const override { return op_desc_; }
+  inline std::vector<dim_t> shape() const override { return op_desc_.tensor_descs()[io::DST].shape(); }
+  bool has_binary_add() const {
+    return op_desc_.tensor_descs().size() > io::BINARY_ADD &&
+           op_desc_.tensor_descs()[io::BINARY_ADD].dtype() != data_type::undef;
+  }
+  bool merged() const { return merged_; }
+  bool ragged() const {
+    return op_desc_.tensor_descs().size() > io::SEQ_OFFSET &&
+           op_desc_.tensor_descs()[io::SEQ_OFFSET].dtype() != data_type::undef;
+  }
+
+ private:
+  operator_desc op_desc_;
+  bool merged_;
+};
+
+/**
+ * @brief Every (batch, head) has its K and V reordered into VNNI blocks in the thread workspace, then its rows are
+ * taken 8 at a time: QK is computed in 8x48 register tiles with vpdpbusd, softmax-ed into u8 and multiplied with V
+ * in 8x32 tiles. Only the keys within the padding mask are computed. When there are fewer (batch, head) pairs than
+ * threads, the rows of a head are split among several threads, each reordering K and V on its own. Chunks of rows
+ * are scheduled dynamically, so that the short sequences of a ragged batch do not leave threads idle.
+ */
+class mha_dense_vnni_k_t : public kernel_t {
+  using io = exposed_enum::mha_dense::io;
+
+ public:
+  using kd_t = mha_dense_vnni_kd_t;
+  static constexpr int MAX_SL_N = 2048;  // longer K/V are tiled
+  static constexpr int KV_BLOCK = 512;   // keys of a K/V tile
+  static constexpr int Q_BLOCK = 64;     // rows of Q sharing the reorder of a K/V tile
+  explicit mha_dense_vnni_k_t(const std::shared_ptr<const kernel_desc_t>& kd);
+  virtual ~mha_dense_vnni_k_t() {}
+  // Delete move constructor and move operator
+  mha_dense_vnni_k_t(mha_dense_vnni_k_t&& other) = delete;
+  mha_dense_vnni_k_t& operator=(mha_dense_vnni_k_t&& other) = delete;
+  // Delete copy constructor and copy operator
+  mha_dense_vnni_k_t(const mha_dense_vnni_k_t& other) = delete;
+  mha_dense_vnni_k_t& operator=(const mha_dense_vnni_k_t& other) = delete;
+
+  size_t get_workspace_size() const override { return omp_get_max_threads() * thread_workspace_size_; }
+  bool init() override { return true; }
+  bool execute(const std::vector<const void*>& rt_data) const override;
+  const std::shared_ptr<const kd_t> derived_kd() const { return std::static_pointer_cast<const kd_t>(kd_); }
+
+ private:
+  // computes rows [m_begin, m_end) of head `ihn` of sequence `ibs`
+  void mha_rows(const std::vector<const void*>& rt_data, int ibs, int ihn, int m_begin, int m_end) const;
+  /**
+   * @brief Flash-attention style path for long sequences: for a chunk of at most Q_BLOCK rows, K and V are visited
+   * KV_BLOCK keys at a time. A tile is softmax-ed into u8 against the running max of each row, its AV is added to
+   * fp32 accumulators after rescaling them to the new max, and the accumulators are normalized by the running sum
+   * of the u8 weights at the end. Workspace is independent of sl_n.
+   */
+  void mha_rows_tiled(const std::vector<const void*>& rt_data, int ibs, int ihn, int m_begin, int m_end) const;
+  const std::vector<tensor_desc>& ts_descs_;
+  const data_type dst_dt_;
+  const format_type kv_ft_;
+  const int src_bs_, src_sl_m_, src_sl_n_, head_num_, head_size_, ld_q_, ld_kv_, ld_dst_;
+  const int sl_n_pad16_, sl_n_pad64_;
+  const float softmax_rescale_f32_;
+  const bool has_binary_add;
+  const bool ragged_;
+  std::array<int, 4> badd_stride_;
+  const bool tiled_;
+
+  const size_t thread_workspace_size_;
+};
+
+}  // namespace jd
+#endif  // ENGINE_SPARSELIB_SRC_CPU_KERNELS_MHA_DENSE_VNNI_HPP_
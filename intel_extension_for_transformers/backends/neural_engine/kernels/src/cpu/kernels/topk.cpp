@@ -0,0 +1,294 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "topk.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#ifdef WITH_GCC_FLAGS
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"  // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+
+#define KERNEL_INIT_CHECK(f)                                     \
+  if (!(f)) {                                                    \
+    SPARSE_LOG(ERROR) << "Top-k kernel requires `" << #f << "`"; \
+    return false;                                                \
+  }
+
+namespace jd {
+using io = exposed_enum::topk::io;
+
+namespace {
+constexpr dim_t VEC = 16;
+// rows are not split into parts shorter than this, merging them would cost more than the threads save
+constexpr dim_t MIN_PART_LEN = 4096;
+
+typedef std::pair<float, int32_t> cand_t;
+// the larger key first and the lower index of equal keys, as std::nth_element on an index holder gives
+inline bool cand_before(const cand_t& a, const cand_t& b) {
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// keeps the best k candidates and returns the worst of them, which later candidates have to beat
+inline float shrink(std::vector<cand_t>* buf, int k) {
+  std::nth_element(buf->begin(), buf->begin() + (k - 1), buf->end(), cand_before);
+  buf->resize(k);
+  return (*buf)[k - 1].first;
+}
+
+#ifdef __AVX512F__
+// e^x with the range reduction and polynomial of cephes expf
+inline __m512 exp_ps(__m512 x) {
+  x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-88.f)), _mm512_set1_ps(88.f));
+  const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504f)),
+                                        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+  r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+  __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+  p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.f)));
+  return _mm512_scalef_ps(p, n);
+}
+
+inline __mmask16 tail_mask(dim_t n) { return n >= VEC ? 0xffff : static_cast<__mmask16>((1u << n) - 1); }
+#endif
+
+// max of src[0, len) and the sum of e^(x - max)
+void max_sum_exp(const float* src, dim_t len, float* max, float* sum) {
+#ifdef __AVX512F__
+  __m512 vmax = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+  for (dim_t i = 0; i < len; i += VEC) {
+    const __mmask16 m = tail_mask(len - i);
+    vmax = _mm512_mask_max_ps(vmax, m, vmax, _mm512_maskz_loadu_ps(m, src + i));
+  }
+  *max = _mm512_reduce_max_ps(vmax);
+  const __m512 bmax = _mm512_set1_ps(*max);
+  __m512 vsum = _mm512_setzero_ps();
+  for (dim_t i = 0; i < len; i += VEC) {
+    const __mmask16 m = tail_mask(len - i);
+    const __m512 e = exp_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(m, src + i), bmax));
+    vsum = _mm512_mask_add_ps(vsum, m, vsum, e);
+  }
+  *sum = _mm512_reduce_add_ps(vsum);
+#else
+  float m = -std::numeric_limits<float>::infinity();
+  for (dim_t i = 0; i < len; ++i) m = std::max(m, src[i]);
+  float s = 0.f;
+  for (dim_t i = 0; i < len; ++i) s += std::exp(src[i] - m);
+  *max = m;
+  *sum = s;
+#endif
+}
+
+/**
+ * Feeds the elements of src[0, len) whose key `sign * x + off` beats `*thr` to `buf`, with indices from `base`.
+ * Until the buffer has been cut back once (`*full`) every element is taken, so that rows of -inf keep k too.
+ */
+void filter(const float* src, dim_t len, float sign, float off, int32_t base, int k, size_t cap,
+            std::vector<cand_t>* buf, bool* full, float* thr) {
+#ifdef __AVX512F__
+  const __m512 vsign = _mm512_set1_ps(sign);
+  const __m512 voff = _mm512_set1_ps(off);
+  alignas(64) float keys[VEC];
+  __m512 vthr = _mm512_set1_ps(*thr);
+  for (dim_t i = 0; i < len; i += VEC) {
+    const __mmask16 tail = tail_mask(len - i);
+    const __m512 key = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, src + i), vsign, voff);
+    uint32_t m = *full ? _mm512_mask_cmp_ps_mask(tail, key, vthr, _CMP_GT_OQ) : tail;
+    if (m == 0) continue;
+    _mm512_store_ps(keys, key);
+    for (; m != 0; m &= m - 1) {
+      const uint32_t lane = _tzcnt_u32(m);
+      buf->emplace_back(keys[lane], static_cast<int32_t>(base + i + lane));
+    }
+    if (buf->size() >= cap) {
+      *thr = shrink(buf, k);
+      *full = true;
+      vthr = _mm512_set1_ps(*thr);
+    }
+  }
+#else
+  for (dim_t i = 0; i < len; ++i) {
+    const float key = src[i] * sign + off;
+    if (*full && !(key > *thr)) continue;
+    buf->emplace_back(key, static_cast<int32_t>(base + i));
+    if (buf->size() >= cap) {
+      *thr = shrink(buf, k);
+      *full = true;
+    }
+  }
+#endif
+}
+}  // namespace
+
+bool topk_kd_t::init() {
+  const auto& descs = op_desc_.tensor_descs();
+  const auto& attrs = op_desc_.attrs();
+  KERNEL_INIT_CHECK(descs.size() > io::IDX);
+  KERNEL_INIT_CHECK(descs[io::SRC].dtype() == data_type::fp32);
+  KERNEL_INIT_CHECK(descs[io::DST].dtype() == data_type::fp32);
+  KERNEL_INIT_CHECK(descs[io::IDX].dtype() == data_type::s32);
+  KERNEL_INIT_CHECK(attrs.find("k") != attrs.end());
+  k_ = str_to_num<int>(attrs.at("k"));
+  if (attrs.find("largest") != attrs.end()) largest_ = attrs.at("largest") != "false";
+  if (attrs.find("sorted") != attrs.end()) sorted_ = attrs.at("sorted") != "false";
+  if (attrs.find("normalize") != attrs.end()) {
+    const auto& normalize = attrs.at("normalize");
+    KERNEL_INIT_CHECK(normalize == "none" || normalize == "softmax" || normalize == "log_softmax");
+    normalize_ = normalize == "softmax"       ? normalize_t::softmax
+                 : normalize == "log_softmax" ? normalize_t::log_softmax
+                                              : normalize_t::none;
+  }
+  const bool batch_beam = attrs.find("batch_beam") != attrs.end() && attrs.at("batch_beam") == "true";
+
+  const auto& src_shape = descs[io::SRC].shape();
+  KERNEL_INIT_CHECK(src_shape.size() >= (batch_beam ? 2 : 1));
+  vocab_ = src_shape.back();
+  group_ = batch_beam ? src_shape[src_shape.size() - 2] : 1;
+  KERNEL_INIT_CHECK(vocab_ > 0 && group_ > 0);
+  rows_ = descs[io::SRC].size() / (group_ * vocab_);
+  KERNEL_INIT_CHECK(k_ > 0 && k_ <= group_ * vocab_);
+  KERNEL_INIT_CHECK(descs[io::DST].size() == rows_ * k_);
+  KERNEL_INIT_CHECK(descs[io::IDX].size() == rows_ * k_);
+
+  has_beam_score_ = descs.size() > io::BEAM_SCORE && descs[io::BEAM_SCORE].size() != 0;
+  if (has_beam_score_) {
+    // beam scores are log-probabilities, they add up with the log-softmax (or with already normalized logits)
+    KERNEL_INIT_CHECK(batch_beam && normalize_ != normalize_t::softmax);
+    KERNEL_INIT_CHECK(descs[io::BEAM_SCORE].dtype() == data_type::fp32);
+    KERNEL_INIT_CHECK(descs[io::BEAM_SCORE].size() == rows_ * group_);
+  }
+  return true;
+}
+
+bool topk_k_t::init() {
+  const auto& kd = *derived_kd();
+  const dim_t len = kd.group() * kd.vocab();
+  const dim_t nthr = omp_get_max_threads();
+  parts_ = kd.rows() >= nthr ? 1 : std::max(dim_t(1), std::min(ceil_div(nthr, kd.rows()), len / MIN_PART_LEN));
+  part_len_ = ceil_div(ceil_div(len, parts_), VEC) * VEC;
+  parts_ = ceil_div(len, part_len_);
+  return true;
+}
+
+bool topk_k_t::execute(const std::vector<const void*>& rt_data) const {
+  const auto& kd = *derived_kd();
+  const auto src = reinterpret_cast<const float*>(rt_data[io::SRC]);
+  const auto dst = reinterpret_cast<float*>(const_cast<void*>(rt_data[io::DST]));
+  const auto idx = reinterpret_cast<int32_t*>(const_cast<void*>(rt_data[io::IDX]));
+  const auto beam_score = kd.has_beam_score() ? reinterpret_cast<const float*>(rt_data[io::BEAM_SCORE]) : nullptr;
+  const dim_t rows = kd.rows(), group = kd.group(), vocab = kd.vocab(), len = group * vocab;
+  const dim_t parts = parts_, part_len = part_len_;
+  const int k = kd.k();
+  const float sign = kd.largest() ? 1.f : -1.f;
+  const auto normalize = kd.normalize();
+
+  // what each [vocab] row adds to its logits: minus the log of its softmax denominator, plus its beam score
+  std::vector<float> offset(rows * group, 0.f);
+  if (normalize != topk_kd_t::normalize_t::none) {
+    std::vector<float> part_max(rows * parts * group, -std::numeric_limits<float>::infinity());
+    std::vector<float> part_sum(rows * parts * group, 0.f);
+#pragma omp parallel for collapse(2)
+    for (dim_t row = 0; row < rows; ++row) {
+      for (dim_t part = 0; part < parts; ++part) {
+        const dim_t begin = part * part_len, end = std::min(len, begin + part_len);
+        for (dim_t g = begin / vocab; g * vocab < end; ++g) {
+          const dim_t lo = std::max(begin, g * vocab), hi = std::min(end, (g + 1) * vocab);
+          const dim_t stat = (row * parts + part) * group + g;
+          max_sum_exp(src + row * len + lo, hi - lo, &part_max[stat], &part_sum[stat]);
+        }
+      }
+    }
+#pragma omp parallel for
+    for (dim_t r = 0; r < rows * group; ++r) {
+      const dim_t row = r / group, g = r % group;
+      float max = -std::numeric_limits<float>::infinity();
+      for (dim_t part = 0; part < parts; ++part) max = std::max(max, part_max[(row * parts + part) * group + g]);
+      float sum = 0.f;
+      for (dim_t part = 0; part < parts; ++part) {
+        const dim_t stat = (row * parts + part) * group + g;
+        if (part_sum[stat] > 0.f) sum += part_sum[stat] * std::exp(part_max[stat] - max);
+      }
+      offset[r] = -(max + std::log(sum));
+    }
+  }
+  if (beam_score != nullptr) {
+    for (dim_t r = 0; r < rows * group; ++r) offset[r] += beam_score[r];
+  }
+
+  // best k candidates of every part of every row
+  std::vector<cand_t> part_cands(rows * parts * k);
+  std::vector<int> part_count(rows * parts, 0);
+  const size_t cap = std::max(4 * k, 256) + VEC;
+#pragma omp parallel
+  {
+    std::vector<cand_t> buf;
+    buf.reserve(cap + VEC);
+#pragma omp for collapse(2)
+    for (dim_t row = 0; row < rows; ++row) {
+      for (dim_t part = 0; part < parts; ++part) {
+        const dim_t begin = part * part_len, end = std::min(len, begin + part_len);
+        buf.clear();
+        bool full = false;
+        float thr = -std::numeric_limits<float>::infinity();
+        for (dim_t g = begin / vocab; g * vocab < end; ++g) {
+          const dim_t lo = std::max(begin, g * vocab), hi = std::min(end, (g + 1) * vocab);
+          filter(src + row * len + lo, hi - lo, sign, sign * offset[row * group + g], lo, k, cap, &buf, &full, &thr);
+        }
+        if (static_cast<int>(buf.size()) > k) shrink(&buf, k);
+        std::copy(buf.begin(), buf.end(), part_cands.begin() + (row * parts + part) * k);
+        part_count[row * parts + part] = buf.size();
+      }
+    }
+  }
+
+#pragma omp parallel
+  {
+    std::vector<cand_t> merged;
+    merged.reserve(parts * k);
+#pragma omp for
+    for (dim_t row = 0; row < rows; ++row) {
+      merged.clear();
+      for (dim_t part = 0; part < parts; ++part) {
+        const auto first = part_cands.begin() + (row * parts + part) * k;
+        merged.insert(merged.end(), first, first + part_count[row * parts + part]);
+      }
+      if (static_cast<int>(merged.size()) > k) shrink(&merged, k);
+      if (kd.sorted()) std::sort(merged.begin(), merged.end(), cand_before);
+      for (int i = 0; i < k; ++i) {
+        // the key back to the (log-)probability or logit, e^ of the log-probability for the softmax
+        const float value = sign * merged[i].first;
+        dst[row * k + i] = normalize == topk_kd_t::normalize_t::softmax ? std::exp(value) : value;
+        idx[row * k + i] = merged[i].second;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace jd
@@ -0,0 +1,111 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_SPARSELIB_SRC_CPU_KERNELS_TOPK_HPP_
+#define ENGINE_SPARSELIB_SRC_CPU_KERNELS_TOPK_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "kernel.hpp"
+#include "kernel_desc.hpp"
+#include "kernels/exposed_enum.hpp"
+#include "operator_desc.hpp"
+#include "src/utils.hpp"
+
+namespace jd {
+class topk_k_t;
+
+/**
+ * @brief Top-k along the last dimension of an fp32 tensor, optionally on its softmax or log-softmax.
+ *
+ * Attributes:
+ * - k: number of elements kept of every row
+ * - largest: "false" to keep the smallest elements, default "true"
+ * - sorted: "false" to skip sorting the k elements of a row, default "true"
+ * - normalize: "none" (default), "softmax" or "log_softmax" of every row, applied to the kept values only
+ * - batch_beam: "true" to take the src of shape [batch, beam, vocab] as `batch` rows of `beam * vocab` elements.
+ *   Every [vocab] row is normalized on its own and the optional BEAM_SCORE [batch, beam] of its beam is added, so
+ *   that one call gives the next tokens of a beam search step. IDX are then `beam * vocab + token`.
+ */
+class SPARSE_TEST_API_ topk_kd_t : public kernel_desc_t {
+ public:
+  enum class normalize_t : uint8_t { none, softmax, log_softmax };
+
+  explicit topk_kd_t(const operator_desc& op_desc) : kernel_desc_t(kernel_kind::topk), op_desc_(op_desc) {}
+  virtual ~topk_kd_t() {}
+
+  bool init() override;
+  DECLARE_COMMON_PD_T(topk_k_t, topk_kd_t);
+
+  inline std::vector<dim_t> shape() const override { return op_desc_.tensor_descs()[0].shape(); }
+  const operator_desc& get_operator_desc() const override { return op_desc_; }
+
+  int k() const { return k_; }
+  bool largest() const { return largest_; }
+  bool sorted() const { return sorted_; }
+  normalize_t normalize() const { return normalize_; }
+  bool has_beam_score() const { return has_beam_score_; }
+  // length of the rows that are normalized
+  dim_t vocab() const { return vocab_; }
+  // normalized rows of a selection row: the beam size in batch_beam mode, 1 otherwise
+  dim_t group() const { return group_; }
+  // rows the k elements are selected from, each of group() * vocab() elements
+  dim_t rows() const { return rows_; }
+
+ private:
+  operator_desc op_desc_;
+  int k_ = 0;
+  bool largest_ = true;
+  bool sorted_ = true;
+  normalize_t normalize_ = normalize_t::none;
+  bool has_beam_score_ = false;
+  dim_t vocab_ = 0;
+  dim_t group_ = 1;
+  dim_t rows_ = 0;
+};
+
+/**
+ * @brief Threshold filtering top-k.
+ *
+ * A row is scanned 16 elements at a time against the k-th best element found so far, only the few elements that
+ * beat it reach a small candidate buffer, which is cut back to the best k when it fills. Rows too few to keep the
+ * threads busy are split into parts whose candidates are merged at the end.
+ */
+class topk_k_t : public kernel_t {
+ public:
+  using kd_t = topk_kd_t;
+  explicit topk_k_t(const std::shared_ptr<const kd_t>& kd) : kernel_t(kd) {}
+  virtual ~topk_k_t() {}
+  // Delete move constructor and move operator
+  topk_k_t(topk_k_t&&) = delete;
+  topk_k_t& operator=(topk_k_t&&) = delete;
+  // Delete copy constructor and copy operator
+  topk_k_t(const topk_k_t&) = delete;
+  topk_k_t& operator=(const topk_k_t&) = delete;
+
+  bool init() override;
+  bool execute(const std::vector<const void*>& rt_data) const override;
+
+  const std::shared_ptr<const kd_t> derived_kd() const { return std::static_pointer_cast<const kd_t>(kd_); }
+
+ private:
+  // parts a row is split into and their length, a multiple of the vector length
+  dim_t parts_ = 1;
+  dim_t part_len_ = 0;
+};
+
+}  // namespace jd
+#endif  // ENGINE_SPARSELIB_SRC_CPU_KERNELS_TOPK_HPP_
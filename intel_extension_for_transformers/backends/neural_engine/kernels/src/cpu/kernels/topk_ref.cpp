@@ -0,0 +1,62 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "topk_ref.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace jd {
+using io = exposed_enum::topk::io;
+
+bool topk_ref_k_t::execute(const std::vector<const void*>& rt_data) const {
+  const auto& kd = *derived_kd();
+  const auto src = reinterpret_cast<const float*>(rt_data[io::SRC]);
+  const auto dst = reinterpret_cast<float*>(const_cast<void*>(rt_data[io::DST]));
+  const auto idx = reinterpret_cast<int32_t*>(const_cast<void*>(rt_data[io::IDX]));
+  const auto beam_score = kd.has_beam_score() ? reinterpret_cast<const float*>(rt_data[io::BEAM_SCORE]) : nullptr;
+  const dim_t group = kd.group(), vocab = kd.vocab(), len = group * vocab;
+  const int k = kd.k();
+  const float sign = kd.largest() ? 1.f : -1.f;
+  const auto normalize = kd.normalize();
+
+#pragma omp parallel for
+  for (dim_t row = 0; row < kd.rows(); ++row) {
+    std::vector<std::pair<float, int32_t>> keys(len);
+    for (dim_t g = 0; g < group; ++g) {
+      const float* logits = src + row * len + g * vocab;
+      float offset = 0.f;
+      if (normalize != topk_kd_t::normalize_t::none) {
+        const float max = *std::max_element(logits, logits + vocab);
+        double sum = 0;
+        for (dim_t i = 0; i < vocab; ++i) sum += std::exp(logits[i] - max);
+        offset = -(max + static_cast<float>(std::log(sum)));
+      }
+      if (beam_score != nullptr) offset += beam_score[row * group + g];
+      for (dim_t i = 0; i < vocab; ++i) keys[g * vocab + i] = {logits[i] * sign + sign * offset, g * vocab + i};
+    }
+    // the larger key first and the lower index of equal keys
+    std::partial_sort(keys.begin(), keys.begin() + k, keys.end(), [](const auto& a, const auto& b) {
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    for (int i = 0; i < k; ++i) {
+      const float value = sign * keys[i].first;
+      dst[row * k + i] = normalize == topk_kd_t::normalize_t::softmax ? std::exp(value) : value;
+      idx[row * k + i] = keys[i].second;
+    }
+  }
+  return true;
+}
+
+}  // namespace jd
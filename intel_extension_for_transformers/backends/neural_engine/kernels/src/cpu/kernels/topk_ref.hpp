@@ -0,0 +1,54 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_SPARSELIB_SRC_CPU_KERNELS_TOPK_REF_HPP_
+#define ENGINE_SPARSELIB_SRC_CPU_KERNELS_TOPK_REF_HPP_
+
+#include <memory>
+#include <vector>
+
+#include "topk.hpp"
+
+namespace jd {
+class topk_ref_k_t;
+
+// same attributes and checks as topk_kd_t
+class SPARSE_TEST_API_ topk_ref_kd_t : public topk_kd_t {
+ public:
+  explicit topk_ref_kd_t(const operator_desc& op_desc) : topk_kd_t(op_desc) {}
+  virtual ~topk_ref_kd_t() {}
+
+  DECLARE_COMMON_PD_T(topk_ref_k_t, topk_ref_kd_t);
+};
+
+class SPARSE_TEST_API_ topk_ref_k_t : public kernel_t {
+ public:
+  using kd_t = topk_ref_kd_t;
+  explicit topk_ref_k_t(const std::shared_ptr<const kd_t>& kd) : kernel_t(kd) {}
+  virtual ~topk_ref_k_t() {}
+  // Delete move constructor and move operator
+  topk_ref_k_t(topk_ref_k_t&& other) = delete;
+  topk_ref_k_t& operator=(topk_ref_k_t&& other) = delete;
+  // Delete copy constructor and copy operator
+  topk_ref_k_t(const topk_ref_k_t& other) = delete;
+  topk_ref_k_t& operator=(const topk_ref_k_t& other) = delete;
+
+  bool init() override { return true; }
+  bool execute(const std::vector<const void*>& rt_data) const override;
+
+  const std::shared_ptr<const kd_t> derived_kd() const { return std::static_pointer_cast<const kd_t>(kd_); }
+};
+
+}  // namespace jd
+#endif  // ENGINE_SPARSELIB_SRC_CPU_KERNELS_TOPK_REF_HPP_
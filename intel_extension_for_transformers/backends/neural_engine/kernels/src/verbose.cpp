@@ -84,6 +84,7 @@ DEFINE_DEFAULT_INIT_INFO(dynamic_quant_matmul)
 DEFINE_DEFAULT_INIT_INFO(dynamic_quant)
 DEFINE_DEFAULT_INIT_INFO(matmul)
 DEFINE_DEFAULT_INIT_INFO(groupnorm)
+DEFINE_DEFAULT_INIT_INFO(topk)
 #undef DEFINE_DEFAULT_INIT_INFO
 
 void kd_info_t::init(kernel_kind kind, std::vector<dim_t> shape) {
@@ -110,6 +111,7 @@ void kd_info_t::init(kernel_kind kind, std::vector<dim_t> shape) {
       CASE(dynamic_quant);
       CASE(matmul);
       CASE(groupnorm);
+      CASE(topk);
       case kernel_kind::undef:
         SPARSE_LOG(FATAL) << "unknown primitive kind";
         break;
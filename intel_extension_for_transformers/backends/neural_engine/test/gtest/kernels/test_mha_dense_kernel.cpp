@@ -34,6 +34,8 @@ struct test_params_t {
   jd::format_type ft_kv /* = jd::format_type::u8*/;
   int nthr;
   bool expect_to_fail;
+  bool ragged = false;  // sequences of the lengths of the mask packed one after another
+  bool zero_mask = false;  // the first sequence has no keys
 };
 
 struct test_data_t {
@@ -56,6 +58,8 @@ inline static std::string TestParam2str(const testing::TestParamInfo<test_params
   params_str.push_back("badddim" + std::to_string(p.badd_dim));  // badddim
   params_str.push_back(jd::data_type_name.at(p.dt_dst) + std::string{"dst"});
   params_str.push_back(jd::format_type_name.at(p.ft_kv));  // kv_ft
+  if (p.ragged) params_str.push_back("ragged");
+  if (p.zero_mask) params_str.push_back("zeromask");
   return join_str(params_str, "_");
 }
 
@@ -142,7 +146,8 @@ std::pair<const void*, const void*> make_tensor_obj(const jd::tensor_desc& ts_de
 
 test_data_t gen_data(const dim_t bs, const dim_t sl_m, const dim_t sl_n, const dim_t head_num, const dim_t head_size,
                      int badd_dim = 0, const jd::data_type dt_dst = jd::data_type::u8,
-                     const jd::format_type kv_ft = jd::format_type::abcd) {
+                     const jd::format_type kv_ft = jd::format_type::abcd, const bool ragged = false,
+                     const bool zero_mask = false) {
   std::vector<dim_t> badd_fullshape = {bs, head_num, sl_m, sl_n};
   std::vector<jd::tensor_desc> ts_descs(io::SIZE, jd::tensor_desc{});
   ts_descs[io::SRC_Q] = {{bs, sl_m, head_num, head_size}, jd::data_type::s8, jd::format_type::abcd};
@@ -161,6 +166,7 @@ test_data_t gen_data(const dim_t bs, const dim_t sl_m, const dim_t sl_n, const d
   ts_descs[io::V_SCALE] = {{1}, jd::data_type::fp32, jd::format_type::a};
   ts_descs[io::SRC_DST_SCALE] = {{1}, jd::data_type::fp32, jd::format_type::a};
   ts_descs[io::SRC_DST_ZP] = {{1}, jd::data_type::s32, jd::format_type::a};
+  if (ragged) ts_descs[io::SEQ_OFFSET] = {{bs}, jd::data_type::s32, jd::format_type::a};
 
   // Step 1.1: Construct Operator config obj
   std::unordered_map<std::string, std::string> attr_map;
@@ -173,6 +179,9 @@ test_data_t gen_data(const dim_t bs, const dim_t sl_m, const dim_t sl_n, const d
   auto Ks = make_tensor_obj(ts_descs[io::SRC_K]);
   auto Vs = make_tensor_obj(ts_descs[io::SRC_V]);
   auto masks = make_tensor_obj(ts_descs[io::MASK], 1, sl_n);
+  if (zero_mask) {
+    for (auto p : {masks.first, masks.second}) reinterpret_cast<int32_t*>(const_cast<void*>(p))[0] = 0;
+  }
   auto dsts = make_tensor_obj(ts_descs[io::DST], 0);
 
   auto badds = badd_dim > 0 ? make_tensor_obj(ts_descs[io::BINARY_ADD], -1.f, 1.f)
@@ -184,6 +193,15 @@ test_data_t gen_data(const dim_t bs, const dim_t sl_m, const dim_t sl_n, const d
   auto v_scales = make_tensor_obj(ts_descs[io::V_SCALE], 1.2f);
   auto dst_scales = make_tensor_obj(ts_descs[io::SRC_DST_SCALE], 1.2f);
   auto dst_zps = make_tensor_obj(ts_descs[io::SRC_DST_ZP], 110);
+  auto seq_offsets = ragged ? make_tensor_obj(ts_descs[io::SEQ_OFFSET], 0)
+                            : std::pair<const void*, const void*>{nullptr, nullptr};
+  if (ragged) {
+    const auto mask = reinterpret_cast<const int32_t*>(masks.first);
+    for (auto p : {seq_offsets.first, seq_offsets.second}) {
+      const auto offset = reinterpret_cast<int32_t*>(const_cast<void*>(p));
+      for (dim_t i = 1; i < bs; ++i) offset[i] = offset[i - 1] + mask[i - 1];
+    }
+  }
 
   std::vector<const void*> data_p(io::SIZE, nullptr);
   data_p[io::SRC_Q] = Qs.first;
@@ -198,6 +216,7 @@ test_data_t gen_data(const dim_t bs, const dim_t sl_m, const dim_t sl_n, const d
   data_p[io::V_SCALE] = v_scales.first;
   data_p[io::SRC_DST_SCALE] = dst_scales.first;
   data_p[io::SRC_DST_ZP] = dst_zps.first;
+  data_p[io::SEQ_OFFSET] = seq_offsets.first;
 
   std::vector<const void*> data_q(io::SIZE, nullptr);
   data_q[io::SRC_Q] = Qs.second;
@@ -212,6 +231,7 @@ test_data_t gen_data(const dim_t bs, const dim_t sl_m, const dim_t sl_n, const d
   data_q[io::V_SCALE] = v_scales.second;
   data_q[io::SRC_DST_SCALE] = dst_scales.second;
   data_q[io::SRC_DST_ZP] = dst_zps.second;
+  data_q[io::SEQ_OFFSET] = seq_offsets.second;
 
   jd::operator_desc op_desc(jd::kernel_kind::mha_dense, jd::kernel_prop::forward_inference, jd::engine_kind::cpu,
                             ts_descs, attr_map);
@@ -261,6 +281,25 @@ static auto case_func = []() {
     cases.push_back({4, 1, sl_n, 16, 256, 2, jd::data_type::bf16, jd::format_type::acbd, 0, false});
   }
 
+  // beyond the AMX kernel: sl_m != sl_n, long sl_n, head_size of 16x, sl_m == 1 without binary add, fp32 dst
+  cases.push_back({2, 100, 300, 3, 48, 4, jd::data_type::u8, jd::format_type::abcd, 0, false});
+  cases.push_back({2, 33, 4100, 2, 64, 2, jd::data_type::fp32, jd::format_type::abcd, 0, false});
+  cases.push_back({3, 1, 77, 4, 80, 0, jd::data_type::bf16, jd::format_type::abcd, 0, false});
+  cases.push_back({3, 17, 17, 4, 64, 3, jd::data_type::fp32, jd::format_type::abcd, 0, false});
+
+  // long sequences, K/V tiled with online softmax
+  cases.push_back({1, 64, 8192, 2, 64, 0, jd::data_type::fp32, jd::format_type::abcd, 0, false});
+  cases.push_back({2, 20, 5000, 3, 48, 4, jd::data_type::bf16, jd::format_type::abcd, 0, false});
+  cases.push_back({4, 1, 16384, 4, 128, 2, jd::data_type::fp32, jd::format_type::abcd, 0, false});
+  // a sequence without keys gets the zero point, as it does when K/V are not tiled
+  cases.push_back({2, 16, 4100, 2, 64, 2, jd::data_type::fp32, jd::format_type::abcd, 0, false, false, true});
+  cases.push_back({2, 16, 300, 2, 64, 2, jd::data_type::fp32, jd::format_type::abcd, 0, false, false, true});
+
+  // ragged batch: only the tokens of the sequences are computed, rows past the packed sequences are left untouched
+  cases.push_back({4, 128, 128, 4, 64, 0, jd::data_type::u8, jd::format_type::abcd, 0, false, true});
+  cases.push_back({3, 64, 64, 2, 32, 4, jd::data_type::fp32, jd::format_type::abcd, 0, false, true});
+  cases.push_back({2, 3000, 3000, 2, 64, 2, jd::data_type::bf16, jd::format_type::abcd, 0, false, true});
+
   return ::testing::ValuesIn(cases);
 };
 
@@ -274,7 +313,8 @@ class MhaDenseKernTest : public testing::TestWithParam<test_params_t> {
 
 TEST_P(MhaDenseKernTest, ) {
   const test_params_t& t = testing::TestWithParam<test_params_t>::GetParam();
-  const auto d = gen_data(t.bs, t.sl_m, t.sl_n, t.head_num, t.head_size, t.badd_dim, t.dt_dst);
+  const auto d = gen_data(t.bs, t.sl_m, t.sl_n, t.head_num, t.head_size, t.badd_dim, t.dt_dst,
+                          jd::format_type::abcd, t.ragged, t.zero_mask);
   EXPECT_TRUE(check_result(t.nthr, t.expect_to_fail, d));
 
   for (auto data : {d.rt_data_kern, d.rt_data_ref})
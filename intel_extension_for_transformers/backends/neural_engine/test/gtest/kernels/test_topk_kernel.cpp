@@ -0,0 +1,141 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <cmath>
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "unit_test_utils.hpp"
+#include "interface.hpp"
+#include "kernels/exposed_enum.hpp"
+#include "src/cpu/kernels/topk_ref.hpp"
+
+namespace test {
+using io = jd::exposed_enum::topk::io;
+using dt = jd::data_type;
+
+struct test_params_t {
+  std::vector<dim_t> src_shape;
+  int k;
+  bool largest;
+  std::string normalize;
+  bool batch_beam;
+  bool beam_score;
+  bool masked;  // a third of the logits are -inf, as banned tokens are in beam search
+  bool expect_to_fail;
+};
+
+bool check_result(const test_params_t& p) {
+  const dim_t vocab = p.src_shape.back();
+  const dim_t group = p.batch_beam ? p.src_shape[p.src_shape.size() - 2] : 1;
+  const dim_t size = std::accumulate(p.src_shape.begin(), p.src_shape.end(), dim_t{1}, std::multiplies<dim_t>());
+  const dim_t rows = size / (group * vocab);
+
+  std::vector<jd::tensor_desc> ts_descs(io::SIZE);
+  ts_descs[io::SRC] = {p.src_shape, dt::fp32, jd::plain_format(p.src_shape.size())};
+  ts_descs[io::DST] = {{rows, p.k}, dt::fp32, jd::format_type::ab};
+  ts_descs[io::IDX] = {{rows, p.k}, dt::s32, jd::format_type::ab};
+  if (p.beam_score) ts_descs[io::BEAM_SCORE] = {{rows, group}, dt::fp32, jd::format_type::ab};
+  std::unordered_map<std::string, std::string> attrs = {
+      {"k", std::to_string(p.k)},
+      {"largest", p.largest ? "true" : "false"},
+      {"normalize", p.normalize},
+      {"batch_beam", p.batch_beam ? "true" : "false"},
+  };
+  jd::operator_desc op_desc(jd::kernel_kind::topk, jd::kernel_prop::forward_inference, jd::engine_kind::cpu, ts_descs,
+                            attrs);
+
+  std::vector<float> src(size), beam_score(rows * group);
+  init_vector(src.data(), src.size(), -10.f, 10.f);
+  if (p.masked) {
+    for (dim_t i = 0; i < size; i += 3) src[i] = -INFINITY;
+  }
+  init_vector(beam_score.data(), beam_score.size(), -5.f, -0.1f);
+  std::vector<float> dst(rows * p.k), dst_ref(rows * p.k);
+  std::vector<int32_t> idx(rows * p.k), idx_ref(rows * p.k);
+  std::vector<const void*> rt_data = {src.data(), dst.data(), idx.data(), beam_score.data()};
+  std::vector<const void*> rt_data_ref = {src.data(), dst_ref.data(), idx_ref.data(), beam_score.data()};
+  // the reference shares the checks of the kernel, a desc it rejects would give the proxy no kernel
+  std::shared_ptr<const jd::kernel_desc_t> topk_ref_desc;
+  if (!jd::kernel_desc_t::create<jd::topk_ref_kd_t>(topk_ref_desc, op_desc)) return p.expect_to_fail;
+  if (p.expect_to_fail) return false;
+  try {
+    jd::topk_desc topk_d(op_desc);
+    jd::topk topk_ker(topk_d);
+    topk_ker.execute(rt_data);
+
+    std::shared_ptr<const jd::kernel_t> topk_ref_ker;
+    jd::kernel_t::create<jd::topk_ref_k_t, jd::topk_ref_kd_t>(topk_ref_ker, topk_ref_desc);
+    topk_ref_ker->execute(rt_data_ref);
+  } catch (const std::exception& e) {
+    return false;
+  }
+
+  // the kernel and the reference order equal values by index alike, their normalizations only differ in rounding
+  for (size_t i = 0; i < idx.size(); ++i) {
+    if (std::isinf(dst_ref[i]) && dst[i] == dst_ref[i]) continue;
+    if (std::abs(dst[i] - dst_ref[i]) > 1e-4f * std::max(1.f, std::abs(dst_ref[i]))) return false;
+  }
+  return compare_data<int32_t>(idx.data(), idx.size(), idx_ref.data(), idx_ref.size(), 0);
+}
+
+static auto case_func = []() {
+  std::vector<test_params_t> cases;
+
+  cases.push_back({{4, 1000}, 5, true, "none", false, false, false, false});
+  cases.push_back({{4, 1000}, 5, false, "none", false, false, false, false});
+  cases.push_back({{2, 3, 7}, 7, true, "softmax", false, false, false, false});
+  // rows too few for the threads, split and merged
+  cases.push_back({{2, 50257}, 8, true, "log_softmax", false, false, false, false});
+  cases.push_back({{1, 250000}, 40, true, "softmax", false, false, false, false});
+  // beam search steps
+  cases.push_back({{2, 4, 32000}, 8, true, "log_softmax", true, true, false, false});
+  cases.push_back({{8, 4, 1003}, 8, true, "log_softmax", true, true, true, false});
+  cases.push_back({{2, 3, 333}, 600, false, "none", true, false, true, false});
+
+  cases.push_back({{1, 17}, 18, true, "none", false, false, false, true});
+  cases.push_back({{2, 4, 64}, 8, true, "softmax", true, true, false, true});
+  return ::testing::ValuesIn(cases);
+};
+
+class TopKKernelTest : public testing::TestWithParam<test_params_t> {
+ protected:
+  TopKKernelTest() {}
+  virtual ~TopKKernelTest() {}
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+TEST_P(TopKKernelTest, ) {
+  test_params_t t = testing::TestWithParam<test_params_t>::GetParam();
+  EXPECT_TRUE(check_result(t));
+}
+
+std::string test_suffix(testing::TestParamInfo<test_params_t> tpi) {
+  const auto& p = tpi.param;
+  std::vector<std::string> params;
+  params.push_back("src");
+  for (auto&& i : p.src_shape) params.push_back(std::to_string(i));
+  params.push_back("k" + std::to_string(p.k));
+  params.push_back(p.largest ? "largest" : "smallest");
+  params.push_back(p.normalize);
+  if (p.batch_beam) params.push_back("batch_beam");
+  if (p.beam_score) params.push_back("beam_score");
+  if (p.masked) params.push_back("masked");
+  return join_str(params, "_");
+}
+
+INSTANTIATE_TEST_SUITE_P(SparseLib, TopKKernelTest, case_func(), test_suffix);
+}  // namespace test
@@ -0,0 +1,139 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <cstring>
+#include <set>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "../../executor/include/activation_arena.hpp"
+#include "gtest/gtest.h"
+
+using executor::ActivationArena;
+using executor::ArenaStats;
+
+TEST(ActivationArenaTest, ReuseAfterUnref) {
+  ActivationArena arena;
+  void* a = arena.Acquire(1000, 2);
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % 64, 0);
+  EXPECT_EQ(ActivationArena::Owner(a), &arena);
+  EXPECT_EQ(ActivationArena::Life(a), 2);
+  memset(a, 1, 1000);
+
+  EXPECT_EQ(ActivationArena::Unref(a), 1);
+  EXPECT_EQ(ActivationArena::Unref(a), 0);
+  // a dead block is handed out again to a request of the same size class
+  void* b = arena.Acquire(900, 1);
+  EXPECT_EQ(a, b);
+  void* c = arena.Acquire(900, 1);
+  EXPECT_NE(b, c);
+
+  ArenaStats stats = arena.Stats();
+  EXPECT_EQ(stats.alloc_count, 3);
+  EXPECT_EQ(stats.free_count, 1);
+  EXPECT_GE(stats.peak_bytes, stats.live_bytes);
+  EXPECT_GT(stats.reserved_bytes, 0);
+}
+
+TEST(ActivationArenaTest, ParkedBlockCanBeResurrected) {
+  ActivationArena arena;
+  void* a = arena.Acquire(4096, 1);
+  // inplace hand over: the life reaches 0 and is set again before any other allocation
+  EXPECT_EQ(ActivationArena::Unref(a), 0);
+  ActivationArena::SetLife(a, 3);
+  void* b = arena.Acquire(4096, 1);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(ActivationArena::Life(a), 3);
+
+  ActivationArena::SetLife(a, 0);
+  void* c = arena.Acquire(4096, 1);
+  EXPECT_EQ(a, c);
+}
+
+TEST(ActivationArenaTest, ForeignPointers) {
+  ActivationArena arena;
+  std::vector<char> host(256);
+  EXPECT_EQ(ActivationArena::Owner(host.data()), nullptr);
+  EXPECT_EQ(ActivationArena::Owner(nullptr), nullptr);
+  void* a = arena.Acquire(64, 1);
+  EXPECT_EQ(ActivationArena::Owner(static_cast<char*>(a) + 64), nullptr);
+}
+
+TEST(ActivationArenaTest, LargeBlocksAndReset) {
+  ActivationArena arena;
+  void* big = arena.Acquire(size_t(64) << 20, 1);
+  void* small = arena.Acquire(128, 1);
+  ASSERT_NE(big, nullptr);
+  EXPECT_EQ(ActivationArena::Owner(big), &arena);
+  EXPECT_FALSE(arena.Reset());
+
+  ActivationArena::Unref(big);
+  ActivationArena::Unref(small);
+  int64_t reserved = arena.Stats().reserved_bytes;
+  EXPECT_TRUE(arena.Reset());
+  EXPECT_EQ(arena.Acquire(size_t(64) << 20, 1), big);
+  EXPECT_EQ(arena.Acquire(128, 1), small);
+  EXPECT_EQ(arena.Stats().reserved_bytes, reserved);
+}
+
+TEST(ActivationArenaTest, ConcurrentAcquireAndCrossThreadRelease) {
+  ActivationArena arena;
+  const int num_threads = 8;
+  const int rounds = 2000;
+  std::vector<std::vector<void*>> handed(num_threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < num_threads; ++t) {
+    workers.emplace_back([&, t]() {
+      ActivationArena::Scope scope(&arena);
+      for (int i = 0; i < rounds; ++i) {
+        size_t size = 64 * (1 + (i * 7 + t) % 50);
+        char* p = static_cast<char*>(ActivationArena::Current()->Acquire(size, 1));
+        memset(p, t, size);
+        for (size_t j = 0; j < size; ++j) ASSERT_EQ(p[j], static_cast<char>(t));
+        // every second block is released by the neighbouring thread
+        if (i % 2) {
+          handed[t].push_back(p);
+        } else {
+          ActivationArena::Unref(p);
+        }
+      }
+    });
+  }
+  for (auto& w : workers) w.join();
+  workers.clear();
+
+  std::set<void*> unique;
+  for (int t = 0; t < num_threads; ++t) unique.insert(handed[t].begin(), handed[t].end());
+  EXPECT_EQ(unique.size(), static_cast<size_t>(num_threads * rounds / 2));
+
+  for (int t = 0; t < num_threads; ++t) {
+    workers.emplace_back([&, t]() {
+      for (void* p : handed[(t + 1) % num_threads]) ActivationArena::Unref(p);
+    });
+  }
+  for (auto& w : workers) w.join();
+  EXPECT_TRUE(arena.Reset());
+  EXPECT_EQ(arena.Stats().live_bytes, 0);
+}
+
+TEST(ActivationArenaTest, ScopeBindsCurrentArena) {
+  ActivationArena* process_arena = ActivationArena::Current();
+  ActivationArena arena;
+  {
+    ActivationArena::Scope scope(&arena);
+    EXPECT_EQ(ActivationArena::Current(), &arena);
+  }
+  EXPECT_EQ(ActivationArena::Current(), process_arena);
+}
@@ -701,3 +701,30 @@ static auto CasesFp32 = []() {
 };
 
 INSTANTIATE_TEST_SUITE_P(Prefix, ConvolutionTest, CasesFp32());
+
+TEST(ConvolutionWeightTest, PlansShareTheReorderedWeight) {
+  MemoryAllocator::InitStrategy();
+  // two batches of the same weight, each gets a plan of its own
+  auto first = GenerateFp32Case({{3, 32, 13, 13}, {64, 32, 3, 3}, {64}}, "0,1,2,3", "0,1,2,3", "1", "1,1,1,1", "4,4",
+                                "fp32", "");
+  auto second = GenerateFp32Case({{5, 32, 13, 13}, {64, 32, 3, 3}, {64}}, "0,1,2,3", "0,1,2,3", "1", "1,1,1,1",
+                                 "4,4", "fp32", "");
+  executor::ConvolutionOperator convolution(first.first.conf);
+  convolution.Prepare(first.first.input, first.first.output);
+  convolution.Reshape(first.first.input, first.first.output);
+  convolution.Forward(first.first.input, first.first.output);
+  size_t reorders = convolution.weight_reorders();
+  EXPECT_LE(reorders, 1u);
+
+  std::vector<Tensor*> input = {second.first.input[0], first.first.input[1], first.first.input[2]};
+  convolution.Reshape(input, second.first.output);
+  convolution.Forward(input, second.first.output);
+  EXPECT_EQ(convolution.plan_cache_misses(), 2);
+  // the primitives of both batches take the same weight layout, it is reordered once
+  EXPECT_EQ(convolution.weight_reorders(), reorders);
+
+  std::vector<Tensor*> ref_input = {second.second.input[0], first.second.input[1], first.second.input[2]};
+  GetTrueData(ref_input, second.second.output, second.second.conf);
+  EXPECT_TRUE(executor::CompareData<float>(second.first.output[0]->data(), second.first.output[0]->size(),
+                                           second.second.output[0]->data(), second.second.output[0]->size(), 5e-3));
+}
@@ -32,6 +32,7 @@ struct OpArgs {
 struct TestParams {
   std::pair<OpArgs, OpArgs> args;
   bool expect_to_fail;
+  executor::Isa max_isa = executor::Isa::kAvx512;
 };
 
 void GetTrueData(const std::vector<Tensor*>& input, const std::vector<Tensor*>& output,
@@ -54,7 +55,10 @@ bool CheckResult(const TestParams& t) {
   const auto& p = t.args.first;
   const auto& q = t.args.second;
   try {
+    // every variant the host can run is checked
+    executor::SetMaxIsa(t.max_isa);
     executor::CosSinOperator CosSin(p.conf);
+    executor::SetMaxIsa(executor::Isa::kAvx512);
     CosSin.Reshape(p.input, p.output);
     CosSin.Forward(p.input, p.output);
   } catch (const dnnl::error& e) {
@@ -144,6 +148,15 @@ static auto CasesFp32 = []() {
   src_shape = {1024, 1024, 1024};
   cases.push_back({GenerateFp32Case({src_shape})});
 
+  // case: 512*768 and a tail of 3*37 on the avx2 and scalar variants
+  src_shape = {512, 768};
+  cases.push_back({GenerateFp32Case({src_shape}), false, executor::Isa::kAvx2});
+  cases.push_back({GenerateFp32Case({src_shape}), false, executor::Isa::kScalar});
+  src_shape = {3, 37};
+  cases.push_back({GenerateFp32Case({src_shape}), false});
+  cases.push_back({GenerateFp32Case({src_shape}), false, executor::Isa::kAvx2});
+  cases.push_back({GenerateFp32Case({src_shape}), false, executor::Isa::kScalar});
+
   return ::testing::ValuesIn(cases);
 };
 
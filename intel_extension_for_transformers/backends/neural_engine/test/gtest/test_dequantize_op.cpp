@@ -36,6 +36,7 @@ struct OpArgs {
 struct TestParams {
   std::pair<OpArgs, OpArgs> args;
   bool expect_to_fail;
+  executor::Isa max_isa = executor::Isa::kAvx512;
 };
 
 template<typename T>
@@ -118,7 +119,10 @@ bool CheckResult(const TestParams& t) {
   const auto& q = t.args.second;
   try {
     executor::DequantizeLinearOperator dequantize(p.conf);
+    // every variant the host can run is checked
+    executor::SetMaxIsa(t.max_isa);
     dequantize.Prepare(p.input, p.output);
+    executor::SetMaxIsa(executor::Isa::kAvx512);
     dequantize.Reshape(p.input, p.output);
     dequantize.Forward(p.input, p.output);
   } catch (const dnnl::error& e) {
@@ -357,6 +361,18 @@ static auto CasesInt8Fp32 = []() {
   src2_shape = {3};
   cases.push_back({GenerateFp32Case({src0_shape, src1_shape, src2_shape}, "1", "s8"), false});
 
+  // case: per tensor u8 and s8 with a tail of 5*37 on the avx2 and scalar variants
+  src1_shape = {1};
+  src2_shape = {1};
+  for (auto isa : {executor::Isa::kAvx2, executor::Isa::kScalar}) {
+    src0_shape = {16, 1024};
+    cases.push_back({GenerateFp32Case({src0_shape, src1_shape, src2_shape}, "1", "u8"), false, isa});
+    src0_shape = {5, 37};
+    cases.push_back({GenerateFp32Case({src0_shape, src1_shape, src2_shape}, "1", "u8"), false, isa});
+    cases.push_back({GenerateFp32Case({src0_shape, src1_shape, src2_shape}, "1", "s8"), false, isa});
+  }
+  src0_shape = {5, 37};
+  cases.push_back({GenerateFp32Case({src0_shape, src1_shape, src2_shape}, "1", "s8"), false});
 
   return ::testing::ValuesIn(cases);
 };
@@ -0,0 +1,221 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "../../executor/include/dynamic_batcher.hpp"
+#include "gtest/gtest.h"
+
+using executor::DynamicBatcher;
+using executor::DynamicBatcherOptions;
+using executor::Tensor;
+using std::string;
+using std::vector;
+
+namespace {
+
+// a model of input ids and attention mask [batch, seq]. It returns the masked ids [batch, seq], the sequence
+// lengths [batch] and the flattened tokens [batch * seq, 2] of (id, position).
+struct FakeModel {
+  std::mutex mutex;
+  vector<vector<int64_t>> run_shapes;
+  vector<float> masked, lengths, tokens;
+  vector<Tensor> outputs;
+
+  vector<Tensor>& Forward(vector<Tensor>& input) {
+    const vector<int64_t>& shape = input[0].shape();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      run_shapes.push_back(shape);
+    }
+    int64_t batch = shape[0], seq = shape[1];
+    const int32_t* ids = static_cast<const int32_t*>(input[0].raw_data());
+    const int32_t* mask = static_cast<const int32_t*>(input[1].raw_data());
+    masked.assign(batch * seq, 0);
+    lengths.assign(batch, 0);
+    tokens.assign(batch * seq * 2, 0);
+    for (int64_t b = 0; b < batch; ++b) {
+      for (int64_t s = 0; s < seq; ++s) {
+        masked[b * seq + s] = static_cast<float>(ids[b * seq + s] * mask[b * seq + s]);
+        lengths[b] += mask[b * seq + s];
+        tokens[(b * seq + s) * 2] = static_cast<float>(ids[b * seq + s]);
+        tokens[(b * seq + s) * 2 + 1] = static_cast<float>(s);
+      }
+    }
+    outputs = {Tensor(masked.data(), {batch, seq}, "fp32"), Tensor(lengths.data(), {batch}, "fp32"),
+               Tensor(tokens.data(), {batch * seq, 2}, "fp32")};
+    return outputs;
+  }
+};
+
+struct Request {
+  vector<int32_t> ids, mask;
+  int64_t batch, seq;
+  vector<vector<float>> outputs;
+  vector<vector<int64_t>> shapes;
+  string error;
+  bool done = false;
+
+  Request(int64_t b, int64_t s, int32_t first_id) : batch(b), seq(s) {
+    for (int64_t i = 0; i < b * s; ++i) {
+      ids.push_back(first_id + static_cast<int32_t>(i));
+      mask.push_back(1);
+    }
+  }
+  vector<Tensor> Input() {
+    return {Tensor(ids.data(), {batch, seq}, "int32"), Tensor(mask.data(), {batch, seq}, "int32")};
+  }
+  DynamicBatcher::DoneFunc Done() {
+    return [this](vector<Tensor>* result, const string& err) {
+      error = err;
+      done = true;
+      if (result == nullptr) return;
+      for (const auto& tensor : *result) {
+        const float* data = static_cast<const float*>(tensor.raw_data());
+        outputs.emplace_back(data, data + tensor.size());
+        shapes.push_back(tensor.shape());
+      }
+    };
+  }
+};
+
+DynamicBatcherOptions Options(int64_t max_batch, int64_t max_wait_us) {
+  DynamicBatcherOptions options;
+  options.max_batch = max_batch;
+  options.max_wait_us = max_wait_us;
+  options.buckets = {8, 16};
+  options.sequence_inputs = {0, 1};
+  options.sequence_outputs = {0};
+  options.token_outputs = {2};
+  return options;
+}
+
+}  // namespace
+
+TEST(DynamicBatcherTest, BucketsPadAndScatter) {
+  FakeModel model;
+  // long enough that every request is queued before the first group runs
+  DynamicBatcher batcher([&](vector<Tensor>& in) -> vector<Tensor>& { return model.Forward(in); },
+                         Options(4, 200000));
+  EXPECT_EQ(batcher.Bucket(5), 8);
+  EXPECT_EQ(batcher.Bucket(8), 8);
+  EXPECT_EQ(batcher.Bucket(9), 16);
+  EXPECT_EQ(batcher.Bucket(20), 20);
+  vector<std::unique_ptr<Request>> requests;
+  requests.emplace_back(new Request(1, 5, 100));
+  requests.emplace_back(new Request(2, 7, 200));
+  requests.emplace_back(new Request(1, 12, 300));
+  requests.emplace_back(new Request(1, 3, 400));
+  for (auto& request : requests) batcher.Submit(request->Input(), request->Done());
+  batcher.Drain();
+  // the three short requests make one group of 4 rows, the long one runs alone
+  ASSERT_EQ(model.run_shapes.size(), 2);
+  EXPECT_EQ(batcher.runs(), 2);
+  EXPECT_EQ(batcher.batched_requests(), 4);
+  EXPECT_EQ(model.run_shapes[0], vector<int64_t>({4, 8}));
+  EXPECT_EQ(model.run_shapes[1], vector<int64_t>({1, 16}));
+  for (auto& request : requests) {
+    ASSERT_TRUE(request->done);
+    ASSERT_TRUE(request->error.empty()) << request->error;
+    ASSERT_EQ(request->outputs.size(), 3);
+    int64_t b = request->batch, s = request->seq;
+    // padding is cut off again, every output looks like an unbatched run
+    EXPECT_EQ(request->shapes[0], vector<int64_t>({b, s}));
+    EXPECT_EQ(request->shapes[1], vector<int64_t>({b}));
+    EXPECT_EQ(request->shapes[2], vector<int64_t>({b * s, 2}));
+    for (int64_t i = 0; i < b * s; ++i) {
+      EXPECT_EQ(request->outputs[0][i], request->ids[i]);
+      EXPECT_EQ(request->outputs[2][i * 2], request->ids[i]);
+      EXPECT_EQ(request->outputs[2][i * 2 + 1], i % s);
+    }
+    for (int64_t i = 0; i < b; ++i) EXPECT_EQ(request->outputs[1][i], s);
+  }
+}
+
+TEST(DynamicBatcherTest, MaxWaitRunsPartialGroups) {
+  FakeModel model;
+  DynamicBatcher batcher([&](vector<Tensor>& in) -> vector<Tensor>& { return model.Forward(in); }, Options(8, 100));
+  Request request(1, 4, 1);
+  batcher.Submit(request.Input(), request.Done());
+  batcher.Drain();
+  ASSERT_TRUE(request.done);
+  EXPECT_EQ(model.run_shapes.size(), 1);
+  EXPECT_EQ(request.shapes[0], vector<int64_t>({1, 4}));
+}
+
+TEST(DynamicBatcherTest, MismatchedInputsFailTheGroup) {
+  FakeModel model;
+  DynamicBatcher batcher([&](vector<Tensor>& in) -> vector<Tensor>& { return model.Forward(in); },
+                         Options(4, 200000));
+  Request good(1, 4, 1), bad(1, 4, 1);
+  vector<Tensor> bad_input = bad.Input();
+  bad_input.pop_back();
+  batcher.Submit(good.Input(), good.Done());
+  batcher.Submit(bad_input, bad.Done());
+  batcher.Drain();
+  EXPECT_TRUE(good.done && bad.done);
+  EXPECT_FALSE(bad.error.empty());
+  EXPECT_TRUE(model.run_shapes.empty());
+}
+
+TEST(DynamicBatcherTest, ShapesMatchingTheBucketAreNotSequences) {
+  // ids [batch, seq] and features [batch, 4], pooled [batch, 8] of the features and the sum of the ids
+  vector<vector<int64_t>> feature_shapes;
+  vector<float> pooled;
+  vector<Tensor> outputs;
+  auto forward = [&](vector<Tensor>& in) -> vector<Tensor>& {
+    int64_t batch = in[0].shape()[0], seq = in[0].shape()[1];
+    feature_shapes.push_back(in[1].shape());
+    const int32_t* ids = static_cast<const int32_t*>(in[0].raw_data());
+    const float* features = static_cast<const float*>(in[1].raw_data());
+    pooled.assign(batch * 8, 0);
+    for (int64_t b = 0; b < batch; ++b) {
+      for (int64_t j = 0; j < 4; ++j) pooled[b * 8 + j] = features[b * 4 + j];
+      for (int64_t s = 0; s < seq; ++s) pooled[b * 8 + 4] += ids[b * seq + s];
+    }
+    outputs = {Tensor(pooled.data(), {batch, 8}, "fp32")};
+    return outputs;
+  };
+  DynamicBatcherOptions options = Options(2, 200000);
+  options.sequence_inputs = {0};
+  options.sequence_outputs = {};
+  options.token_outputs = {};
+  DynamicBatcher batcher(forward, options);
+  // a sequence of 4 as the features, padded to a bucket of 8 as the pooled output
+  vector<int32_t> ids[2] = {{1, 2, 3, 4}, {5, 6, 7, 8}};
+  vector<float> features[2] = {{1, 2, 3, 4}, {5, 6, 7, 8}};
+  vector<float> results[2];
+  vector<int64_t> result_shapes[2];
+  for (int i = 0; i < 2; ++i) {
+    batcher.Submit({Tensor(ids[i].data(), {1, 4}, "int32"), Tensor(features[i].data(), {1, 4}, "fp32")},
+                   [&, i](vector<Tensor>* result, const string& err) {
+                     ASSERT_TRUE(result != nullptr) << err;
+                     const float* data = static_cast<const float*>((*result)[0].raw_data());
+                     results[i].assign(data, data + (*result)[0].size());
+                     result_shapes[i] = (*result)[0].shape();
+                   });
+  }
+  batcher.Drain();
+  ASSERT_EQ(feature_shapes.size(), 1);
+  EXPECT_EQ(feature_shapes[0], vector<int64_t>({2, 4}));
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(result_shapes[i], vector<int64_t>({1, 8}));
+    ASSERT_EQ(results[i].size(), 8);
+    for (int j = 0; j < 4; ++j) EXPECT_EQ(results[i][j], features[i][j]);
+    EXPECT_EQ(results[i][4], i == 0 ? 10 : 26);
+  }
+}
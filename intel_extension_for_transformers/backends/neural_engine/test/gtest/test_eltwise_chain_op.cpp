@@ -0,0 +1,210 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "../../include/common.hpp"
+#include "../../include/conf.hpp"
+#include "../../include/operators/eltwise_chain.hpp"
+#include "gtest/gtest.h"
+
+using executor::AttrConfig;
+using executor::MemoryAllocator;
+using executor::OperatorConfig;
+using executor::Tensor;
+using executor::TensorConfig;
+
+struct OpArgs {
+  std::vector<Tensor*> input;
+  std::vector<Tensor*> output;
+  shared_ptr<OperatorConfig> conf;
+};
+
+struct TestParams {
+  std::pair<OpArgs, OpArgs> args;
+  bool expect_to_fail;
+};
+
+// runs the steps one by one, as the unfused operators do
+void GetTrueData(const std::vector<Tensor*>& input, const std::vector<Tensor*>& output,
+                 const shared_ptr<OperatorConfig>& conf) {
+  auto attrs_map = conf->attributes();
+  auto size = input[0]->size();
+  const float* src_data = static_cast<const float*>(input[0]->data());
+  output[0]->set_shape(input[0]->shape());
+  float* dst_data = static_cast<float*>(output[0]->mutable_data());
+  memcpy(dst_data, src_data, size * sizeof(float));
+  std::stringstream steps(attrs_map["postops"]);
+  string step;
+  while (std::getline(steps, step, '+')) {
+    std::stringstream fields(step);
+    string name, alpha = "0", beta = "0";
+    std::getline(fields, name, ':');
+    std::getline(fields, alpha, ':');
+    std::getline(fields, beta, ':');
+    for (int i = 0; i < size; ++i) {
+      float x = dst_data[i];
+      if (name == "gelu") {
+        dst_data[i] = 0.5f * x * (1.f + ::tanhf(0.797884f * x * (1.f + 0.044715f * x * x)));
+      } else if (name == "exp") {
+        dst_data[i] = ::expf(x);
+      } else if (name == "tanh") {
+        dst_data[i] = ::tanhf(x);
+      } else if (name == "linear") {
+        dst_data[i] = std::stof(alpha) * x + std::stof(beta);
+      }
+    }
+  }
+}
+
+bool CheckResult(const TestParams& t) {
+  const auto& p = t.args.first;
+  const auto& q = t.args.second;
+  executor::EltwiseChainOperator eltwise_chain(p.conf);
+  eltwise_chain.Prepare(p.input, p.output);
+  eltwise_chain.Reshape(p.input, p.output);
+  eltwise_chain.Forward(p.input, p.output);
+  if (!t.expect_to_fail) {
+    GetTrueData(q.input, q.output, q.conf);
+    // Should compare buffer with different addresses
+    EXPECT_NE(p.output[0]->data(), q.output[0]->data());
+    float eps = 1e-3;
+    return executor::CompareData<float>(p.output[0]->data(), p.output[0]->size(), q.output[0]->data(),
+                                        q.output[0]->size(), eps);
+  }
+  return false;
+}
+
+class EltwiseChainTest : public testing::TestWithParam<TestParams> {
+ protected:
+  EltwiseChainTest() {}
+  ~EltwiseChainTest() {}
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+TEST_P(EltwiseChainTest, TestPostfix) {
+  // models fuse the chains on avx512_core hosts only, elsewhere the kernel is the reference one
+  if (executor::RuntimeIsa() != executor::Isa::kAvx512) GTEST_SKIP() << "EltwiseChain runs on avx512_core only";
+  TestParams t = testing::TestWithParam<TestParams>::GetParam();
+  EXPECT_TRUE(CheckResult(t));
+}
+
+std::pair<OpArgs, OpArgs> GenerateFp32Case(const std::vector<std::vector<int64_t>>& input_shape,
+                                           std::string postops) {
+  // Step 1: Construct Tensor config ptr
+  const auto& src_shape = input_shape[0];
+  shared_ptr<TensorConfig> src_config = std::make_shared<TensorConfig>("src", src_shape);
+  std::vector<shared_ptr<TensorConfig>> input_config = {src_config};
+  std::vector<int64_t> dst_shape = {};
+  shared_ptr<TensorConfig> dst_config = std::make_shared<TensorConfig>("dst", dst_shape);
+  std::vector<shared_ptr<TensorConfig>> output_config = {dst_config};
+
+  // Step 1.1: Construct Operator config obj
+  std::map<std::string, std::string> attr_map = {{"postops", postops}};
+  shared_ptr<AttrConfig> op_attr = std::make_shared<AttrConfig>(attr_map);
+  shared_ptr<OperatorConfig> op_config =
+      std::make_shared<OperatorConfig>("eltwise_chain", "EltwiseChain", input_config, output_config, op_attr);
+
+  // Step 2: Construct Tensor ptr
+  auto make_tensor_obj = [&](const shared_ptr<TensorConfig>& a_tensor_config) {
+    // step1: set shape
+    Tensor* a_tensor = new Tensor(*a_tensor_config);
+    // step2: set tensor life
+    a_tensor->add_tensor_life(1);
+    // step3: library buffer can only be obtained afterwards
+    auto tensor_data = a_tensor->mutable_data();
+    // keep exp of the chain in range
+    executor::InitVector<float>(static_cast<float*>(tensor_data), a_tensor->size(), -2, 2);
+
+    Tensor* a_tensor_copy = new Tensor(*a_tensor_config);
+    a_tensor_copy->add_tensor_life(1);
+    auto tensor_data_copy = a_tensor_copy->mutable_data();
+    memcpy(reinterpret_cast<void*>(tensor_data_copy), tensor_data, a_tensor_copy->size() * sizeof(float));
+    return std::pair<Tensor*, Tensor*>{a_tensor, a_tensor_copy};
+  };
+
+  auto src_tensors = make_tensor_obj(src_config);
+  Tensor* dst_tensor = new Tensor(*dst_config);
+  dst_tensor->add_tensor_life(1);
+  Tensor* dst_tensor_copy = new Tensor(*dst_config);
+  dst_tensor_copy->add_tensor_life(1);
+
+  OpArgs op_args = {{src_tensors.first}, {dst_tensor}, op_config};
+  OpArgs op_args_copy = {{src_tensors.second}, {dst_tensor_copy}, op_config};
+
+  return {op_args, op_args_copy};
+}
+
+static auto CasesFp32 = []() {
+  std::string memory_strategy = getenv("DIRECT_BUFFER") == NULL ? "cycle_buffer" : "direct_buffer";
+  MemoryAllocator::SetStrategy(memory_strategy);
+  std::vector<TestParams> cases;
+
+  // Config
+  std::vector<int64_t> src_shape;
+
+  // case: Gelu - Exp
+  src_shape = {3, 2};
+  cases.push_back({GenerateFp32Case({src_shape}, "gelu+exp"), false});
+
+  // case: BinaryAdd 0.5 - Sigmoid, with tail
+  src_shape = {8, 33};
+  cases.push_back({GenerateFp32Case({src_shape}, "linear:1:0.5+linear:0.5:0+tanh+linear:0.5:0.5"), false});
+
+  // case: Gelu - Mul 2 - Exp, more than a thread's share
+  src_shape = {16, 1024};
+  cases.push_back({GenerateFp32Case({src_shape}, "gelu+linear:2:0+exp"), false});
+
+  return ::testing::ValuesIn(cases);
+};
+
+INSTANTIATE_TEST_SUITE_P(Prefix, EltwiseChainTest, CasesFp32());
+
+TEST(EltwiseChainLowerTest, LowerByTypeAndDtype) {
+  vector<float> data(6, 1.f), dst(6);
+  float three = 3.f;
+  Tensor src(data.data(), {2, 3}, "fp32");
+  Tensor out(dst.data(), {2, 3}, "fp32");
+  // a weight of one element
+  Tensor scalar(&three, {1}, "fp32", {}, {0, 4});
+  int data_input = -1;
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("Sigmoid", {}, {&src}, {&out}, &data_input),
+            "linear:0.5:0+tanh+linear:0.5:0.5");
+  EXPECT_EQ(data_input, 0);
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("Gelu", {{"algorithm", "gelu_tanh"}}, {&src}, {&out}, &data_input),
+            "gelu");
+  // no erf in the injector
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("Gelu", {{"algorithm", "gelu_erf"}}, {&src}, {&out}, &data_input),
+            "");
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("BinaryAdd", {}, {&src, &scalar}, {&out}, &data_input),
+            "linear:1:3");
+  EXPECT_EQ(data_input, 0);
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("BinaryOp", {{"algorithm", "sub"}}, {&scalar, &src}, {&out},
+                                                  &data_input),
+            "linear:-1:3");
+  EXPECT_EQ(data_input, 1);
+  // 3 / x is not linear
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("BinaryOp", {{"algorithm", "div"}}, {&scalar, &src}, {&out},
+                                                  &data_input),
+            "");
+  // an activation is not a constant, even of one element
+  Tensor one(&three, {1}, "fp32");
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("BinaryAdd", {}, {&src, &one}, {&out}, &data_input), "");
+  Tensor bf16_src(data.data(), {2, 3}, "bf16");
+  EXPECT_EQ(executor::EltwiseChainOperator::Lower("Exp", {}, {&bf16_src}, {&out}, &data_input), "");
+}
@@ -0,0 +1,122 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "../../executor/include/forward_queue.hpp"
+#include "gtest/gtest.h"
+
+using executor::ForwardQueue;
+using executor::Tensor;
+using std::string;
+using std::vector;
+
+namespace {
+
+// doubles the first element of its input like a one operator model, its outputs live in the "model"
+struct FakeModel {
+  float buffer = 0;
+  vector<Tensor> outputs;
+  std::thread::id thread;
+
+  vector<Tensor>& Forward(vector<Tensor>& input) {
+    thread = std::this_thread::get_id();
+    float value = *reinterpret_cast<const float*>(input[0].raw_data());
+    if (value < 0) throw std::runtime_error("negative input");
+    buffer = value * 2;
+    outputs = {Tensor(&buffer, {1}, "fp32")};
+    return outputs;
+  }
+};
+
+}  // namespace
+
+TEST(ForwardQueueTest, RunsInOrderOnItsThread) {
+  FakeModel model;
+  ForwardQueue queue([&](vector<Tensor>& input) -> vector<Tensor>& { return model.Forward(input); });
+  float inputs[8];
+  vector<float> results;
+  for (int i = 0; i < 8; ++i) {
+    inputs[i] = static_cast<float>(i);
+    queue.Submit({Tensor(&inputs[i], {1}, "fp32")}, [&](vector<Tensor>* outputs, const string& error) {
+      ASSERT_NE(outputs, nullptr);
+      EXPECT_TRUE(error.empty());
+      // read before the next request reuses the buffer
+      results.push_back(*reinterpret_cast<const float*>((*outputs)[0].raw_data()));
+    });
+  }
+  queue.Drain();
+  EXPECT_EQ(queue.pending(), 0);
+  ASSERT_EQ(results.size(), 8);
+  for (int i = 0; i < 8; ++i) EXPECT_EQ(results[i], 2.f * i);
+  EXPECT_NE(model.thread, std::this_thread::get_id());
+}
+
+TEST(ForwardQueueTest, ErrorsReachTheCallback) {
+  FakeModel model;
+  ForwardQueue queue([&](vector<Tensor>& input) -> vector<Tensor>& { return model.Forward(input); });
+  float bad = -1, good = 3;
+  string bad_error;
+  bool good_done = false;
+  queue.Submit({Tensor(&bad, {1}, "fp32")}, [&](vector<Tensor>* outputs, const string& error) {
+    EXPECT_EQ(outputs, nullptr);
+    bad_error = error;
+  });
+  // a failed request leaves the queue running
+  queue.Submit({Tensor(&good, {1}, "fp32")}, [&](vector<Tensor>* outputs, const string& error) {
+    ASSERT_NE(outputs, nullptr);
+    EXPECT_EQ(*reinterpret_cast<const float*>((*outputs)[0].raw_data()), 6.f);
+    good_done = true;
+  });
+  queue.Drain();
+  EXPECT_EQ(bad_error, "negative input");
+  EXPECT_TRUE(good_done);
+}
+
+TEST(ForwardQueueTest, DestructorFinishesQueuedRequests) {
+  FakeModel model;
+  std::atomic<int> done(0);
+  float input = 1;
+  {
+    ForwardQueue queue([&](vector<Tensor>& in) -> vector<Tensor>& {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      return model.Forward(in);
+    });
+    for (int i = 0; i < 4; ++i) {
+      queue.Submit({Tensor(&input, {1}, "fp32")}, [&](vector<Tensor>*, const string&) { done++; });
+    }
+  }
+  EXPECT_EQ(done.load(), 4);
+}
+
+TEST(ForwardQueueTest, CallbackMayDestroyTheQueue) {
+  // like a python future holding the last reference to its model
+  FakeModel model;
+  auto queue = std::make_shared<std::unique_ptr<ForwardQueue>>(
+      new ForwardQueue([&](vector<Tensor>& in) -> vector<Tensor>& { return model.Forward(in); }));
+  std::atomic<bool> destroyed(false);
+  float input = 1;
+  (*queue)->Submit({Tensor(&input, {1}, "fp32")}, [queue, &destroyed](vector<Tensor>*, const string&) {
+    queue->reset();
+    destroyed = true;
+  });
+  while (!destroyed) std::this_thread::yield();
+  EXPECT_EQ(queue->get(), nullptr);
+}
@@ -0,0 +1,83 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "../../executor/include/hw_counters.hpp"
+#include "gtest/gtest.h"
+
+using executor::HwCounterSample;
+using executor::HwCounters;
+using executor::OperatorFlops;
+using executor::Roofline;
+
+TEST(HwCountersTest, GemmFlopsFollowShapes) {
+  // [M, K] x [K, N], the weight may be stored transposed
+  EXPECT_DOUBLE_EQ(OperatorFlops("InnerProduct", {{128, 768}, {768, 3072}}, {{128, 3072}}), 2. * 128 * 768 * 3072);
+  EXPECT_DOUBLE_EQ(OperatorFlops("InnerProduct", {{2, 64, 768}, {3072, 768}}, {{2, 64, 3072}}),
+                   2. * 128 * 768 * 3072);
+  // attention scores of 8 x 12 heads
+  EXPECT_DOUBLE_EQ(OperatorFlops("Matmul", {{8, 12, 128, 64}, {8, 12, 64, 128}}, {{8, 12, 128, 128}}),
+                   2. * 8 * 12 * 128 * 128 * 64);
+  // weight [OC, IC, KH, KW]
+  EXPECT_DOUBLE_EQ(OperatorFlops("Convolution", {{1, 64, 56, 56}, {128, 64, 3, 3}}, {{1, 128, 56, 56}}),
+                   2. * 128 * 56 * 56 * 64 * 3 * 3);
+  // one operation per output element for the rest
+  EXPECT_DOUBLE_EQ(OperatorFlops("BinaryAdd", {{128, 768}, {128, 768}}, {{128, 768}}), 128. * 768);
+  EXPECT_DOUBLE_EQ(OperatorFlops("Softmax", {{16, 128}}, {{16, 128}}), 16. * 128);
+  EXPECT_DOUBLE_EQ(OperatorFlops("Output", {{16, 128}}, {}), 0.);
+}
+
+TEST(HwCountersTest, RooflineSplitsAtTheRidge) {
+  Roofline roofline;
+  roofline.peak_gflops = 1000;
+  roofline.peak_gbps = 100;
+  EXPECT_DOUBLE_EQ(roofline.ridge(), 10);
+  EXPECT_STREQ(roofline.Bound(1e6, 1e6), "memory");
+  EXPECT_STREQ(roofline.Bound(1e8, 1e6), "compute");
+
+  HwCounterSample sample;
+  sample.ms = 1;
+  // 50 GB/s with 1 flop per byte: half of the memory roof
+  sample.bytes = 50e6;
+  sample.flops = 50e6;
+  EXPECT_NEAR(roofline.Efficiency(sample), 0.5, 1e-9);
+  // measured DRAM traffic takes over the tensor bytes
+  sample.has_dram = true;
+  sample.dram_bytes = 25e6;
+  EXPECT_NEAR(sample.gbps(), 25, 1e-9);
+  // 250 GFLOP/s at 100 flops per byte: a quarter of the compute roof
+  sample.has_dram = false;
+  sample.flops = 250e6;
+  sample.bytes = 2.5e6;
+  EXPECT_STREQ(roofline.Bound(sample.flops, sample.traffic_bytes()), "compute");
+  EXPECT_NEAR(roofline.Efficiency(sample), 0.25, 1e-9);
+}
+
+TEST(HwCountersTest, CountersCountTheWorkInBetween) {
+  HwCounters counters;
+  // where perf events are not allowed the samples are empty rather than failing
+  if (!counters.available()) GTEST_SKIP() << "perf events are not available";
+  std::vector<float> data(1 << 20, 1.f);
+  counters.Start();
+  float sum = 0;
+  for (int round = 0; round < 16; ++round) {
+    for (const auto& value : data) sum += value;
+  }
+  HwCounterSample sample = counters.Stop();
+  EXPECT_GT(sum, 0);
+  EXPECT_GT(sample.cycles, 0u);
+  EXPECT_GT(sample.instructions, static_cast<uint64_t>(data.size()));
+}
@@ -0,0 +1,79 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <random>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "../../executor/include/inter_op_scheduler.hpp"
+#include "gtest/gtest.h"
+
+using executor::InterOpScheduler;
+
+TEST(InterOpSchedulerTest, ChainRunsInline) {
+  std::vector<std::vector<int>> deps = {{}, {0}, {1}, {2}};
+  InterOpScheduler scheduler(deps, 8);
+  EXPECT_FALSE(scheduler.parallel());
+  EXPECT_EQ(scheduler.thread_budget(2), 8);
+  std::vector<int> order;
+  scheduler.Run([&](int op) { order.push_back(op); });
+  EXPECT_EQ(order, std::vector<int>({0, 1, 2, 3}));
+}
+
+TEST(InterOpSchedulerTest, BranchesOverlap) {
+  // input -> {q, k, v} -> attention -> output
+  std::vector<std::vector<int>> deps = {{}, {0}, {0}, {0}, {1, 2, 3}, {4}};
+  InterOpScheduler scheduler(deps, 6);
+  ASSERT_TRUE(scheduler.parallel());
+  EXPECT_EQ(scheduler.thread_budget(1), 2);
+  EXPECT_EQ(scheduler.thread_budget(4), 6);
+
+  std::atomic<int> running(0), max_running(0);
+  scheduler.Run([&](int op) {
+    if (op < 1 || op > 3) return;
+    int now = ++running;
+    int seen = max_running.load();
+    while (now > seen && !max_running.compare_exchange_weak(seen, now)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    --running;
+  });
+  EXPECT_GT(max_running.load(), 1);
+}
+
+TEST(InterOpSchedulerTest, RandomDagRespectsDependencies) {
+  std::mt19937 rng(7);
+  const int num_ops = 200;
+  std::vector<std::vector<int>> deps(num_ops);
+  for (int i = 1; i < num_ops; ++i) {
+    int n = rng() % 3 + 1;
+    for (int k = 0; k < n; ++k) deps[i].push_back(rng() % i);
+  }
+  InterOpScheduler scheduler(deps, 8);
+  for (int run = 0; run < 20; ++run) {
+    std::vector<std::atomic<int>> done(num_ops);
+    std::atomic<int> violations(0), count(0);
+    scheduler.Run([&](int op) {
+      for (int d : deps[op]) {
+        if (!done[d].load()) violations++;
+      }
+      done[op].store(1);
+      count++;
+    });
+    EXPECT_EQ(violations.load(), 0);
+    EXPECT_EQ(count.load(), num_ops);
+  }
+}
@@ -183,7 +183,7 @@ TEST_P(MatmulTest, TestPostfix) {
 std::pair<OpArgs, OpArgs> GenerateFp32Case(const std::vector<std::vector<int64_t> >& input_shape,
                                            std::string src0_perm = "", std::string src1_perm = "",
                                            std::string dst_perm = "", std::string format_any = "false",
-                                           std::string append_op = "") {
+                                           std::string append_op = "", std::string cache_weight = "false") {
   // Step 1: Construct Tensor config ptr
   const auto& src0_shape = input_shape[0];
   const auto& src1_shape = input_shape[1];
@@ -200,7 +200,8 @@ std::pair<OpArgs, OpArgs> GenerateFp32Case(const std::vector<std::vector<int64_t
   // Step 1.1: Construct Operator config obj
   std::map<std::string, std::string> attr_map;
   attr_map = {{"src0_perm", src0_perm},   {"src1_perm", src1_perm}, {"dst_perm", dst_perm},
-              {"format_any", format_any}, {"output_dtype", "fp32"}, {"append_op", append_op}};
+              {"format_any", format_any}, {"output_dtype", "fp32"}, {"append_op", append_op},
+              {"cache_weight", cache_weight}};
 
   shared_ptr<AttrConfig> op_attr = std::make_shared<AttrConfig>(attr_map);
   shared_ptr<OperatorConfig> op_config = std::make_shared<OperatorConfig>("matmul", "fp32",
@@ -281,3 +282,28 @@ static auto CasesFp32 = []() {
 };
 
 INSTANTIATE_TEST_SUITE_P(Prefix, MatmulTest, CasesFp32());
+
+TEST(MatmulWeightTest, PlansShareTheReorderedWeight) {
+  MemoryAllocator::InitStrategy();
+  // two batches of the same weight, each gets a plan of its own
+  auto first = GenerateFp32Case({{10, 64}, {64, 48}}, "0,1", "0,1", "0,1", "true", "", "true");
+  auto second = GenerateFp32Case({{20, 64}, {64, 48}}, "0,1", "0,1", "0,1", "true", "", "true");
+  executor::MatmulOperator matmul(first.first.conf);
+  matmul.Prepare(first.first.input, first.first.output);
+  matmul.Reshape(first.first.input, first.first.output);
+  matmul.Forward(first.first.input, first.first.output);
+  size_t reorders = matmul.weight_reorders();
+  EXPECT_LE(reorders, 1u);
+
+  vector<Tensor*> input = {second.first.input[0], first.first.input[1]};
+  matmul.Reshape(input, second.first.output);
+  matmul.Forward(input, second.first.output);
+  EXPECT_EQ(matmul.plan_cache_misses(), 2);
+  // the primitives of both batches take the same weight layout, it is reordered once
+  EXPECT_EQ(matmul.weight_reorders(), reorders);
+
+  vector<Tensor*> ref_input = {second.second.input[0], first.second.input[1]};
+  GetTrueData(ref_input, second.second.output, second.second.conf);
+  EXPECT_TRUE(executor::CompareData<float>(second.first.output[0]->data(), second.first.output[0]->size(),
+                                           second.second.output[0]->data(), second.second.output[0]->size(), 1e-3));
+}
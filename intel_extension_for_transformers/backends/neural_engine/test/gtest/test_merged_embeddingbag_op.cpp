@@ -0,0 +1,248 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <string>
+
+#include "../../include/common.hpp"
+#include "../../include/conf.hpp"
+#include "../../include/operators/merged_embeddingbag.hpp"
+#include "gtest/gtest.h"
+
+using executor::AttrConfig;
+using executor::MemoryAllocator;
+using executor::OperatorConfig;
+using executor::Tensor;
+using executor::TensorConfig;
+
+struct TestParams {
+  // "fp32", "bf16", "u8", "fp16" or "rowwise_u8" for every table
+  std::string table_format;
+  std::string mode;
+  int64_t n_tables;
+  int64_t bs;
+  int64_t rows;
+  int64_t dim;
+  // pooling factor of each bag of a table, skewed towards the last bags
+  std::vector<int32_t> pooling;
+};
+
+namespace {
+
+uint16_t FloatToHalf(float value) {
+  // values of the test are in [-1, 1], normal halves or zero
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000u;
+  int32_t exp = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  if (exp <= 0) return sign;
+  uint32_t mant = (bits >> 13) & 0x3ffu;
+  return sign | (exp << 10) | mant;
+}
+
+uint16_t FloatToBf16(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+float Bf16ToFloat(uint16_t b) {
+  uint32_t bits = static_cast<uint32_t>(b) << 16;
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+float HalfToFloat(uint16_t h) {
+  uint32_t sign = (h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t bits = exp == 0 ? sign : sign | ((exp + 112) << 23) | ((h & 0x3ffu) << 13);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+bool CheckResult(const TestParams& t) {
+  const int64_t n_indices = std::accumulate(t.pooling.begin(), t.pooling.end(), int64_t(0));
+  shared_ptr<TensorConfig> offsets_config = std::make_shared<TensorConfig>("offsets", vector<int64_t>{t.n_tables, t.bs},
+                                                                           "int32");
+  shared_ptr<TensorConfig> indices_config =
+      std::make_shared<TensorConfig>("indices", vector<int64_t>{t.n_tables, n_indices}, "int32");
+  std::vector<shared_ptr<TensorConfig>> input_config = {offsets_config, indices_config};
+  std::vector<shared_ptr<TensorConfig>> output_config;
+  std::string dtype = t.table_format == "rowwise_u8" ? "u8" : t.table_format;
+  int64_t row_elems = t.table_format == "rowwise_u8" ? t.dim + 2 * sizeof(float) : t.dim;
+  for (int64_t i = 0; i < t.n_tables; ++i) {
+    input_config.push_back(std::make_shared<TensorConfig>("weight" + std::to_string(i),
+                                                          vector<int64_t>{t.rows, row_elems}, dtype));
+    output_config.push_back(std::make_shared<TensorConfig>("dst" + std::to_string(i), vector<int64_t>{}));
+  }
+  std::map<std::string, std::string> attr_map = {{"mode", t.mode}};
+  if (t.table_format == "rowwise_u8") attr_map["rowwise_quantized"] = "true";
+  shared_ptr<AttrConfig> op_attr = std::make_shared<AttrConfig>(attr_map);
+  shared_ptr<OperatorConfig> op_config = std::make_shared<OperatorConfig>("merged_embeddingbag", "MergedEmbeddingbag",
+                                                                          input_config, output_config, op_attr);
+
+  std::vector<Tensor*> input, output;
+  for (const auto& config : input_config) {
+    Tensor* tensor = new Tensor(*config);
+    tensor->add_tensor_life(1);
+    input.push_back(tensor);
+  }
+  for (const auto& config : output_config) {
+    Tensor* tensor = new Tensor(*config);
+    tensor->add_tensor_life(1);
+    output.push_back(tensor);
+  }
+
+  // offsets count from the indices of their table
+  int32_t* offsets = static_cast<int32_t*>(input[0]->mutable_data());
+  int32_t* indices = static_cast<int32_t*>(input[1]->mutable_data());
+  for (int64_t tb = 0; tb < t.n_tables; ++tb) {
+    int32_t offset = 0;
+    for (int64_t n = 0; n < t.bs; ++n) {
+      offsets[tb * t.bs + n] = offset;
+      offset += t.pooling[n];
+    }
+    for (int64_t i = 0; i < n_indices; ++i) indices[tb * n_indices + i] = (i * 7 + tb * 3) % t.rows;
+  }
+  // fp32 values of every table as the operator should read them
+  std::vector<std::vector<float>> tables(t.n_tables, std::vector<float>(t.rows * t.dim));
+  for (int64_t tb = 0; tb < t.n_tables; ++tb) {
+    std::vector<float> values(t.rows * t.dim);
+    executor::InitVector<float>(values.data(), values.size(), -1, 1, tb + 1);
+    void* data = input[tb + 2]->mutable_data();
+    for (int64_t r = 0; r < t.rows; ++r) {
+      float* value = &values[r * t.dim];
+      float* expect = &tables[tb][r * t.dim];
+      if (t.table_format == "fp32") {
+        memcpy(static_cast<float*>(data) + r * t.dim, value, t.dim * sizeof(float));
+        memcpy(expect, value, t.dim * sizeof(float));
+      } else if (t.table_format == "fp16") {
+        uint16_t* row = static_cast<uint16_t*>(data) + r * t.dim;
+        for (int64_t d = 0; d < t.dim; ++d) {
+          row[d] = FloatToHalf(value[d]);
+          expect[d] = HalfToFloat(row[d]);
+        }
+      } else if (t.table_format == "bf16") {
+        uint16_t* row = static_cast<uint16_t*>(data) + r * t.dim;
+        for (int64_t d = 0; d < t.dim; ++d) {
+          row[d] = FloatToBf16(value[d]);
+          expect[d] = Bf16ToFloat(row[d]);
+        }
+      } else if (t.table_format == "u8") {
+        // 0 to 4, the longest bags saturate
+        uint8_t* row = static_cast<uint8_t*>(data) + r * t.dim;
+        for (int64_t d = 0; d < t.dim; ++d) {
+          row[d] = static_cast<uint8_t>(std::lround((value[d] + 1) * 2));
+          expect[d] = row[d];
+        }
+      } else {
+        uint8_t* row = static_cast<uint8_t*>(data) + r * row_elems;
+        float min = *std::min_element(value, value + t.dim);
+        float max = *std::max_element(value, value + t.dim);
+        float scale = (max - min) / 255;
+        for (int64_t d = 0; d < t.dim; ++d) {
+          row[d] = static_cast<uint8_t>(std::lround((value[d] - min) / scale));
+          expect[d] = row[d] * scale + min;
+        }
+        memcpy(row + t.dim, &scale, sizeof(float));
+        memcpy(row + t.dim + sizeof(float), &min, sizeof(float));
+      }
+    }
+  }
+
+  executor::MergedEmbeddingbagOperator merged_embeddingbag(op_config);
+  merged_embeddingbag.Prepare(input, output);
+  merged_embeddingbag.Reshape(input, output);
+  merged_embeddingbag.Forward(input, output);
+
+  bool ok = true;
+  // bf16 and u8 tables keep their type, the others are pooled to fp32
+  const bool keeps_type = t.table_format == "bf16" || t.table_format == "u8";
+  for (int64_t tb = 0; tb < t.n_tables; ++tb) {
+    EXPECT_EQ(output[tb]->dtype(), keeps_type ? t.table_format : "fp32");
+    EXPECT_EQ(output[tb]->shape(), vector<int64_t>({t.bs, t.dim}));
+    std::vector<float> expect(t.bs * t.dim, 0);
+    for (int64_t n = 0; n < t.bs; ++n) {
+      for (int32_t p = offsets[tb * t.bs + n]; p < offsets[tb * t.bs + n] + t.pooling[n]; ++p) {
+        int32_t row = indices[tb * n_indices + p];
+        for (int64_t d = 0; d < t.dim; ++d) expect[n * t.dim + d] += tables[tb][row * t.dim + d];
+      }
+      float scale = t.mode == "mean" && t.pooling[n] > 0 ? 1.f / t.pooling[n] : 1.f;
+      for (int64_t d = 0; d < t.dim; ++d) {
+        float& value = expect[n * t.dim + d];
+        // u8 means are rounded to nearest and sums saturate
+        value = t.table_format == "u8" ? std::min(std::max(std::nearbyint(value * scale), 0.f), 255.f)
+                                       : value * scale;
+      }
+    }
+    std::vector<float> result(output[tb]->size());
+    for (size_t i = 0; i < result.size(); ++i) {
+      if (t.table_format == "bf16") {
+        result[i] = Bf16ToFloat(static_cast<const uint16_t*>(output[tb]->data())[i]);
+      } else if (t.table_format == "u8") {
+        result[i] = static_cast<const uint8_t*>(output[tb]->data())[i];
+      } else {
+        result[i] = static_cast<const float*>(output[tb]->data())[i];
+      }
+    }
+    // bf16 outputs keep 8 bits of mantissa
+    float eps = t.table_format == "bf16" ? 1e-2 : 1e-4;
+    ok = ok && executor::CompareData<float>(result.data(), result.size(), expect.data(), expect.size(), eps);
+  }
+  return ok;
+}
+
+class MergedEmbeddingbagTest : public testing::TestWithParam<TestParams> {
+ protected:
+  MergedEmbeddingbagTest() {}
+  ~MergedEmbeddingbagTest() {}
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+TEST_P(MergedEmbeddingbagTest, TestPostfix) {
+  TestParams t = testing::TestWithParam<TestParams>::GetParam();
+  EXPECT_TRUE(CheckResult(t));
+}
+
+static auto CasesFp32 = []() {
+  std::string memory_strategy = getenv("DIRECT_BUFFER") == NULL ? "cycle_buffer" : "direct_buffer";
+  MemoryAllocator::SetStrategy(memory_strategy);
+  std::vector<TestParams> cases;
+  // one index per bag
+  cases.push_back({"fp32", "sum", 2, 8, 64, 16, std::vector<int32_t>(8, 1)});
+  // fewer tables than threads and skewed bags, including an empty one
+  std::vector<int32_t> skewed = {1, 1, 0, 2, 1, 3, 1, 1, 40, 1, 2, 64};
+  cases.push_back({"fp32", "sum", 1, 12, 100, 37, skewed});
+  cases.push_back({"fp32", "mean", 3, 12, 100, 64, skewed});
+  // dequantized while pooled
+  cases.push_back({"fp16", "sum", 2, 12, 100, 40, skewed});
+  cases.push_back({"rowwise_u8", "sum", 2, 12, 100, 40, skewed});
+  cases.push_back({"rowwise_u8", "mean", 1, 12, 100, 128, skewed});
+  // pooled in fp32 and rounded once, rows wider than a block of columns
+  cases.push_back({"bf16", "sum", 2, 12, 100, 40, skewed});
+  cases.push_back({"bf16", "mean", 1, 12, 100, 300, skewed});
+  cases.push_back({"u8", "sum", 2, 12, 100, 40, skewed});
+  cases.push_back({"u8", "mean", 1, 12, 100, 300, skewed});
+  return ::testing::ValuesIn(cases);
+};
+
+INSTANTIATE_TEST_SUITE_P(Prefix, MergedEmbeddingbagTest, CasesFp32());
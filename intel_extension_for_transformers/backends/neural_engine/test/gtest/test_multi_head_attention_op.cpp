@@ -12,6 +12,7 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include <algorithm>
 #include <map>
 #include <string>
 
@@ -408,3 +409,232 @@ static auto CasesInt8 = []() {
 };
 
 INSTANTIATE_TEST_SUITE_P(Engine, MultiheadAttentionInt8Test, CasesInt8());
+
+// the operator with a state store of its own, as it would have inside a model
+class MultiHeadAttentionProbe : public executor::MultiHeadAttentionOperator {
+ public:
+  explicit MultiHeadAttentionProbe(const shared_ptr<OperatorConfig>& conf) : MultiHeadAttentionOperator(conf) {}
+  int64_t kv_cache_capacity() const { return kv_cache_capacity_; }
+  bool ragged() const { return ragged_; }
+  int zero_point() const { return QKV_zeropoint_; }
+  // keeps the kernel of the whole padded batch for every mask
+  void DenseOnly() { ragged_ = false; }
+
+ protected:
+  executor::StateStore* state_store() const override { return &store_; }
+
+ private:
+  mutable executor::StateStore store_;
+};
+
+// static int8 MHA of Q, K, V, a SequenceLength mask and an optional binary add mask, Q/K/V in [-4, 4]
+OpArgs StaticInt8Args(bool binary_add, bool kv_cache) {
+  vector<shared_ptr<TensorConfig>> inputs_configs = {
+      std::make_shared<TensorConfig>("Q", vector<int64_t>{}, "s8"),
+      std::make_shared<TensorConfig>("K", vector<int64_t>{}, "s8"),
+      std::make_shared<TensorConfig>("V", vector<int64_t>{}, "s8"),
+      std::make_shared<TensorConfig>("mask", vector<int64_t>{}, "int32")};
+  if (binary_add) inputs_configs.push_back(std::make_shared<TensorConfig>("badd", vector<int64_t>{}, "fp32"));
+  vector<Tensor*> inputs;
+  for (const auto& config : inputs_configs) {
+    inputs.push_back(new Tensor(*config));
+    inputs.back()->add_tensor_life(1);
+  }
+  const vector<std::pair<std::string, float>> ranges = {{"Q_min", -4},  {"Q_max", 4},  {"K_min", -4}, {"K_max", 4},
+                                                        {"V_min", -4},  {"V_max", 4},  {"qk_min", 0}, {"qk_max", 1},
+                                                        {"dst_min", -4}, {"dst_max", 4}};
+  for (const auto& range : ranges) {
+    inputs_configs.push_back(std::make_shared<TensorConfig>(range.first, vector<int64_t>{1}, "fp32"));
+    inputs.push_back(make_fp32_tensor_obj(inputs_configs.back(), range.second, range.second));
+  }
+  Tensor* dst = new Tensor();
+  dst->set_name("dst");
+  dst->add_tensor_life(1);
+  map<string, string> attr_map = {{"output_scale", "0.05"},
+                                  {"Q_perm", "0,2,1,3"},
+                                  {"K_perm", "0,2,3,1"},
+                                  {"V_perm", "0,2,1,3"},
+                                  {"dst_perm", "0,2,1,3"}};
+  if (kv_cache) attr_map["kv_cache"] = "true";
+  auto op_config = std::make_shared<OperatorConfig>(
+      "multiheadattention", "u8", inputs_configs,
+      vector<shared_ptr<TensorConfig>>{std::make_shared<TensorConfig>("dst", vector<int64_t>{}, "u8")},
+      std::make_shared<AttrConfig>(attr_map));
+  return {inputs, {dst}, op_config, false};
+}
+
+// sets the shape of an input of the step and copies its data in, the operator frees it after Forward
+template <typename T>
+void FillInput(Tensor* tensor, const vector<int64_t>& shape, const vector<T>& data) {
+  tensor->set_shape(shape);
+  ASSERT_EQ(static_cast<size_t>(tensor->size()), data.size());
+  memcpy(tensor->mutable_data(), data.data(), data.size() * sizeof(T));
+}
+
+// rows [begin, begin + len) of batches [b_begin, b_end) of a [bs, seq, row] sequence
+vector<int8_t> SequenceRows(const vector<int8_t>& seq_data, int64_t seq, int64_t row, int64_t b_begin, int64_t b_end,
+                            int64_t begin, int64_t len) {
+  vector<int8_t> rows;
+  for (int64_t b = b_begin; b < b_end; ++b) {
+    const auto src = seq_data.begin() + (b * seq + begin) * row;
+    rows.insert(rows.end(), src, src + len * row);
+  }
+  return rows;
+}
+
+// the attention of one sequence without the cache, `q_len` queries against `kv_len` keys, output rows of u8
+vector<uint8_t> RunWithoutCache(const vector<int8_t>& q, const vector<int8_t>& k, const vector<int8_t>& v,
+                                const vector<float>& badd, int64_t q_len, int64_t kv_len, int64_t hn, int64_t hs) {
+  OpArgs p = StaticInt8Args(!badd.empty(), false);
+  FillInput(p.input[0], {1, q_len, hn, hs}, q);
+  FillInput(p.input[1], {1, kv_len, hn, hs}, k);
+  FillInput(p.input[2], {1, kv_len, hn, hs}, v);
+  FillInput(p.input[3], {1}, vector<int32_t>{static_cast<int32_t>(kv_len)});
+  if (!badd.empty()) FillInput(p.input[4], {1, 1, 1, kv_len}, badd);
+  executor::MultiHeadAttentionOperator mha(p.conf);
+  mha.Prepare(p.input, p.output);
+  mha.Reshape(p.input, p.output);
+  mha.Forward(p.input, p.output);
+  const uint8_t* dst = reinterpret_cast<const uint8_t*>(p.output[0]->data());
+  return vector<uint8_t>(dst, dst + p.output[0]->size());
+}
+
+struct KVCacheStep {
+  int64_t new_tokens;
+  vector<int32_t> valid;  // valid new tokens of each batch
+};
+
+// runs the steps of a decoding on one kv_cache operator; the output of every step must match the attention of its
+// valid queries against the valid K/V rows of the sequence so far, computed by a plain operator per batch
+void CheckKVCacheSteps(int64_t bs, int64_t hn, int64_t hs, const vector<KVCacheStep>& steps, bool binary_add,
+                       int64_t expect_capacity) {
+  const int64_t row = hn * hs;
+  int64_t total = 0;
+  for (const auto& step : steps) total += step.new_tokens;
+  vector<int8_t> q_seq(bs * total * row), k_seq(bs * total * row), v_seq(bs * total * row);
+  executor::InitVector<int8_t>(q_seq.data(), q_seq.size(), -127, 127, 1);
+  executor::InitVector<int8_t>(k_seq.data(), k_seq.size(), -127, 127, 2);
+  executor::InitVector<int8_t>(v_seq.data(), v_seq.size(), -127, 127, 3);
+  vector<float> badd_seq(bs * total);
+  executor::InitVector<float>(badd_seq.data(), badd_seq.size(), -2, 0, 4);
+
+  OpArgs p = StaticInt8Args(binary_add, true);
+  MultiHeadAttentionProbe mha(p.conf);
+  mha.Prepare(p.input, p.output);
+  // the valid K/V of every batch, the padding of a step is dropped as it is in the cache
+  vector<vector<int8_t>> k_valid(bs), v_valid(bs);
+  int64_t begin = 0, seq_len = 0;
+  vector<int64_t> q_shape;
+  for (const auto& step : steps) {
+    const int64_t n = step.new_tokens;
+    seq_len += n;
+    FillInput(p.input[0], {bs, n, hn, hs}, SequenceRows(q_seq, total, row, 0, bs, begin, n));
+    FillInput(p.input[1], {bs, n, hn, hs}, SequenceRows(k_seq, total, row, 0, bs, begin, n));
+    FillInput(p.input[2], {bs, n, hn, hs}, SequenceRows(v_seq, total, row, 0, bs, begin, n));
+    FillInput(p.input[3], {bs}, step.valid);
+    vector<float> badd;
+    for (int64_t b = 0; binary_add && b < bs; ++b)
+      badd.insert(badd.end(), badd_seq.begin() + b * total, badd_seq.begin() + b * total + seq_len);
+    if (binary_add) FillInput(p.input[4], {bs, 1, 1, seq_len}, badd);
+    // as in a model, the operator is reshaped when the shapes of the step change, not for every token
+    if (p.input[0]->shape() != q_shape) mha.Reshape(p.input, p.output);
+    q_shape = p.input[0]->shape();
+    mha.Forward(p.input, p.output);
+
+    const uint8_t* dst = reinterpret_cast<const uint8_t*>(p.output[0]->data());
+    for (int64_t b = 0; b < bs; ++b) {
+      const int64_t valid = step.valid[b];
+      auto k_new = SequenceRows(k_seq, total, row, b, b + 1, begin, valid);
+      auto v_new = SequenceRows(v_seq, total, row, b, b + 1, begin, valid);
+      k_valid[b].insert(k_valid[b].end(), k_new.begin(), k_new.end());
+      v_valid[b].insert(v_valid[b].end(), v_new.begin(), v_new.end());
+      const int64_t kv_len = static_cast<int64_t>(k_valid[b].size()) / row;
+      vector<float> badd_b;
+      if (binary_add) badd_b.assign(badd.begin() + b * seq_len, badd.begin() + (b + 1) * seq_len);
+      auto expect = RunWithoutCache(SequenceRows(q_seq, total, row, b, b + 1, begin, valid), k_valid[b],
+                                    v_valid[b], badd_b, valid, kv_len, hn, hs);
+      EXPECT_TRUE(executor::CompareData<uint8_t>(dst + b * n * row, valid * row, expect.data(), expect.size(), 2))
+          << "batch " << b << " at sequence length " << seq_len;
+    }
+    begin += n;
+  }
+  EXPECT_EQ(mha.kv_cache_capacity(), expect_capacity);
+}
+
+TEST(MultiheadAttentionKVCacheTest, PrefillThenDecode) {
+  MemoryAllocator::InitStrategy();
+  CheckKVCacheSteps(2, 2, 32, {{8, {8, 8}}, {1, {1, 1}}, {1, {1, 1}}, {1, {1, 1}}, {1, {1, 1}}}, false,
+                    executor::StateBuffer::kMinCapacity);
+}
+
+TEST(MultiheadAttentionKVCacheTest, DecodePastTheCapacity) {
+  MemoryAllocator::InitStrategy();
+  // the 65th token doubles the cache in Forward, which rebuilds the kernel and widens the binary add mask
+  vector<KVCacheStep> steps = {{60, {60, 60}}};
+  for (int i = 0; i < 8; ++i) steps.push_back({1, {1, 1}});
+  CheckKVCacheSteps(2, 2, 32, steps, true, 2 * executor::StateBuffer::kMinCapacity);
+}
+
+TEST(MultiheadAttentionKVCacheTest, PaddedBatch) {
+  MemoryAllocator::InitStrategy();
+  // the second sequence is padded in the prompt, its decoded tokens follow its own 3 tokens
+  CheckKVCacheSteps(2, 2, 32, {{6, {6, 3}}, {1, {1, 1}}, {1, {1, 1}}, {1, {1, 1}}}, false,
+                    executor::StateBuffer::kMinCapacity);
+}
+
+// a padded batch under a SequenceLength mask, run as it is and on the dense kernel only
+void CheckRaggedCutOver(const vector<int32_t>& seq_len, bool expect_ragged) {
+  const int64_t bs = seq_len.size(), seq = 32, hn = 2, hs = 32, row = hn * hs;
+  vector<int8_t> q(bs * seq * row), k(bs * seq * row), v(bs * seq * row);
+  executor::InitVector<int8_t>(q.data(), q.size(), -127, 127, 1);
+  executor::InitVector<int8_t>(k.data(), k.size(), -127, 127, 2);
+  executor::InitVector<int8_t>(v.data(), v.size(), -127, 127, 3);
+  vector<vector<uint8_t>> dst(2);
+  bool ragged = false;
+  int zero_point = 0;
+  for (int dense_only = 0; dense_only < 2; ++dense_only) {
+    OpArgs p = StaticInt8Args(false, false);
+    FillInput(p.input[0], {bs, seq, hn, hs}, q);
+    FillInput(p.input[1], {bs, seq, hn, hs}, k);
+    FillInput(p.input[2], {bs, seq, hn, hs}, v);
+    FillInput(p.input[3], {bs}, seq_len);
+    MultiHeadAttentionProbe mha(p.conf);
+    mha.Prepare(p.input, p.output);
+    mha.Reshape(p.input, p.output);
+    if (dense_only) {
+      mha.DenseOnly();
+    } else {
+      ragged = mha.ragged();
+      zero_point = mha.zero_point();
+    }
+    mha.Forward(p.input, p.output);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(p.output[0]->data());
+    dst[dense_only].assign(data, data + p.output[0]->size());
+  }
+  if (expect_ragged && !ragged) GTEST_SKIP() << "the ragged kernel needs avx512_core_vnni";
+
+  for (int64_t b = 0; b < bs; ++b) {
+    const int64_t len = seq_len[b];
+    EXPECT_TRUE(executor::CompareData<uint8_t>(dst[0].data() + b * seq * row, len * row,
+                                               dst[1].data() + b * seq * row, len * row, 2))
+        << "real rows of batch " << b;
+    if (!expect_ragged) continue;
+    const auto padding = dst[0].begin() + (b * seq + len) * row;
+    EXPECT_TRUE(std::all_of(padding, padding + (seq - len) * row, [&](uint8_t x) { return x == zero_point; }))
+        << "padded rows of batch " << b << " should hold the zero point " << zero_point;
+  }
+  // the dense kernel computes the padded rows as well
+  if (!expect_ragged) EXPECT_EQ(dst[0], dst[1]);
+}
+
+TEST(MultiheadAttentionRaggedTest, LightPaddingRunsDense) {
+  MemoryAllocator::InitStrategy();
+  // 52 of 64 tokens are real, above the 3/4 cut-over
+  CheckRaggedCutOver({32, 20}, false);
+}
+
+TEST(MultiheadAttentionRaggedTest, HeavyPaddingSkipsIt) {
+  MemoryAllocator::InitStrategy();
+  // 32 of 64 tokens are real
+  CheckRaggedCutOver({12, 20}, true);
+}
@@ -0,0 +1,156 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <map>
+#include <mutex>  // NOLINT
+#include <stdexcept>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "../../executor/include/online_tuner.hpp"
+#include "gtest/gtest.h"
+
+using executor::OnlineTuner;
+using std::string;
+using std::vector;
+
+TEST(OnlineTunerTest, WinnerIsPromotedOnce) {
+  OnlineTuner tuner;
+  std::mutex mutex;
+  std::map<size_t, vector<string>> table;
+  std::atomic<int> tuned(0);
+  auto promote_to = [&](size_t hash_key) {
+    return [&, hash_key](const vector<string>& kernel_config) {
+      std::lock_guard<std::mutex> lock(mutex);
+      table[hash_key] = kernel_config;
+    };
+  };
+  int owner = 0;
+  EXPECT_TRUE(tuner.Submit(&owner, "InnerProduct", 1, [&]() -> vector<string> {
+    tuned++;
+    return {"Convolution", "4,1,40,1024"};
+  }, promote_to(1)));
+  // the default kernel wins, nothing to promote
+  EXPECT_TRUE(tuner.Submit(&owner, "InnerProduct", 2, [&]() -> vector<string> {
+    tuned++;
+    return {};
+  }, promote_to(2)));
+  tuner.Drain();
+  // a shape is tuned once, whether its winner was promoted or not
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 1, [&]() -> vector<string> {
+    tuned++;
+    return {"Convolution"};
+  }, promote_to(1)));
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 2, [&]() -> vector<string> { return {}; }, promote_to(2)));
+  // the same hash of another op type is another job
+  EXPECT_TRUE(tuner.Submit(&owner, "Matmul", 1, [&]() -> vector<string> {
+    tuned++;
+    throw std::runtime_error("unsupported dtype");
+  }, promote_to(3)));
+  tuner.Drain();
+  EXPECT_EQ(tuned.load(), 3);
+  EXPECT_EQ(tuner.generation(), 1u);
+  ASSERT_EQ(table.size(), 1u);
+  EXPECT_EQ(table[1], vector<string>({"Convolution", "4,1,40,1024"}));
+  EXPECT_EQ(tuner.pending(), 0u);
+}
+
+TEST(OnlineTunerTest, CancelDropsQueuedJobsOfOwner) {
+  OnlineTuner tuner;
+  std::atomic<bool> release(false);
+  std::atomic<int> tuned(0);
+  int busy_owner = 0;
+  int cancelled_owner = 0;
+  auto noop = [](const vector<string>&) {};
+  // keeps the worker busy, so that the next jobs stay queued
+  ASSERT_TRUE(tuner.Submit(&busy_owner, "InnerProduct", 0, [&]() -> vector<string> {
+    while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return {};
+  }, noop));
+  for (size_t hash_key = 1; hash_key <= 3; ++hash_key) {
+    ASSERT_TRUE(tuner.Submit(&cancelled_owner, "InnerProduct", hash_key, [&]() -> vector<string> {
+      tuned++;
+      return {};
+    }, noop));
+  }
+  EXPECT_EQ(tuner.pending(), 4u);
+  tuner.Cancel(&cancelled_owner);
+  release = true;
+  tuner.Drain();
+  EXPECT_EQ(tuned.load(), 0);
+  // a cancelled shape may be submitted again, e.g. by the next model
+  EXPECT_TRUE(tuner.Submit(&busy_owner, "InnerProduct", 1, [&]() -> vector<string> {
+    tuned++;
+    return {};
+  }, noop));
+  tuner.Drain();
+  EXPECT_EQ(tuned.load(), 1);
+}
+
+TEST(OnlineTunerTest, FullQueueDropsJobs) {
+  OnlineTuner tuner(1);
+  std::atomic<bool> release(false);
+  int owner = 0;
+  auto noop = [](const vector<string>&) {};
+  auto wait = [&]() -> vector<string> {
+    while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return {};
+  };
+  ASSERT_TRUE(tuner.Submit(&owner, "InnerProduct", 0, wait, noop));
+  // wait until the worker took the first job out of the queue
+  while (tuner.Submit(&owner, "InnerProduct", 1, wait, noop) == false) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 2, wait, noop));
+  release = true;
+  tuner.Drain();
+  // dropped shapes are not marked as tuned
+  EXPECT_TRUE(tuner.Submit(&owner, "InnerProduct", 2, wait, noop));
+  tuner.Drain();
+}
+
+TEST(OnlineTunerTest, DroppedJobsAreNotBuilt) {
+  OnlineTuner tuner(1);
+  std::atomic<bool> release(false);
+  std::atomic<int> built(0);
+  int owner = 0;
+  auto noop = [](const vector<string>&) {};
+  auto make_wait = [&]() -> OnlineTuner::TuneFunc {
+    built++;
+    return [&]() -> vector<string> {
+      while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return {};
+    };
+  };
+  ASSERT_TRUE(tuner.Submit(&owner, "InnerProduct", 0, OnlineTuner::MakeTuneFunc(make_wait), noop));
+  while (tuner.Submit(&owner, "InnerProduct", 1, OnlineTuner::MakeTuneFunc(make_wait), noop) == false) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(built.load(), 2);
+  // full queue
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 2, OnlineTuner::MakeTuneFunc(make_wait), noop));
+  // queued and running keys
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 0, OnlineTuner::MakeTuneFunc(make_wait), noop));
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 1, OnlineTuner::MakeTuneFunc(make_wait), noop));
+  EXPECT_EQ(built.load(), 2);
+  release = true;
+  tuner.Drain();
+  // the default kernel won both, they are never built again
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 0, OnlineTuner::MakeTuneFunc(make_wait), noop));
+  EXPECT_FALSE(tuner.Submit(&owner, "InnerProduct", 1, OnlineTuner::MakeTuneFunc(make_wait), noop));
+  EXPECT_EQ(built.load(), 2);
+}
@@ -0,0 +1,55 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <string>
+
+#include "../../executor/include/plan_cache.hpp"
+#include "gtest/gtest.h"
+
+using executor::PlanCache;
+
+TEST(PlanCacheTest, GetAndPut) {
+  PlanCache<std::string> cache(4);
+  EXPECT_TRUE(cache.enabled());
+  EXPECT_EQ(cache.Get(1), nullptr);
+  EXPECT_EQ(*cache.Put(1, "seq_16"), "seq_16");
+  ASSERT_NE(cache.Get(1), nullptr);
+  EXPECT_EQ(*cache.Get(1), "seq_16");
+  // a plan of the same key is replaced
+  cache.Put(1, "seq_16_new");
+  EXPECT_EQ(*cache.Get(1), "seq_16_new");
+  EXPECT_EQ(cache.size(), 1u);
+}
+
+TEST(PlanCacheTest, EvictsLeastRecentlyUsed) {
+  PlanCache<int> cache(2);
+  cache.Put(16, 16);
+  cache.Put(32, 32);
+  // 16 becomes the most recently used plan, so 32 goes first
+  EXPECT_NE(cache.Get(16), nullptr);
+  cache.Put(64, 64);
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(cache.Get(32), nullptr);
+  EXPECT_EQ(*cache.Get(16), 16);
+  EXPECT_EQ(*cache.Get(64), 64);
+  cache.Clear();
+  EXPECT_EQ(cache.Get(16), nullptr);
+}
+
+TEST(PlanCacheTest, ZeroCapacityDisables) {
+  PlanCache<int> cache(0);
+  EXPECT_FALSE(cache.enabled());
+  EXPECT_EQ(cache.Put(1, 1), nullptr);
+  EXPECT_EQ(cache.Get(1), nullptr);
+}
@@ -35,6 +35,7 @@ struct OpArgs {
 struct TestParams {
   std::pair<OpArgs, OpArgs> args;
   bool expect_to_fail;
+  executor::Isa max_isa = executor::Isa::kAvx512;
 };
 
 void RmsNormRefGT(const float* src_data, const float* gamma_data, float* dst_data, const vector<int64_t>& src_shape,
@@ -81,7 +82,10 @@ bool CheckResult(const TestParams& t) {
   const auto& p = t.args.first;
   const auto& q = t.args.second;
   executor::RmsNormOperator rms_norm(p.conf);
+  // every variant the host can run is checked
+  executor::SetMaxIsa(t.max_isa);
   rms_norm.Prepare(p.input, p.output);
+  executor::SetMaxIsa(executor::Isa::kAvx512);
   rms_norm.Reshape(p.input, p.output);
   rms_norm.Forward(p.input, p.output);
 
@@ -178,6 +182,10 @@ static auto CasesFp32 = []() {
   epsilon = "0.00001";
   cases.push_back({GenerateFp32Case({src_shape, gamma_shape}, epsilon), false});
 
+  // case: 32*4096 on the avx2 and scalar variants
+  cases.push_back({GenerateFp32Case({src_shape, gamma_shape}, epsilon), false, executor::Isa::kAvx2});
+  cases.push_back({GenerateFp32Case({src_shape, gamma_shape}, epsilon), false, executor::Isa::kScalar});
+
   return ::testing::ValuesIn(cases);
 };
 
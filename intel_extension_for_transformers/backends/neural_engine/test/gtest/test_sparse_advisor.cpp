@@ -0,0 +1,102 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdlib.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../executor/include/sparse_advisor.hpp"
+#include "gtest/gtest.h"
+
+using executor::SparseFormat;
+using executor::SparseFormatAdvisor;
+using std::vector;
+
+namespace {
+const SparseFormat kDense = {"dense", 0, 0, 1, true};
+const SparseFormat kBsr4x1 = {"bsr_4x1_g4", 4, 1, 4, true};
+const SparseFormat kBsr16x1 = {"bsr_16x1_g64", 16, 1, 64, false};
+
+// [8, 16]: block row 0 has 5 non-zero 4x1 blocks, padded to 8 by the group of 4, block row 1 is all zero
+vector<int8_t> BlockSparseWeight() {
+  vector<int8_t> weight(8 * 16, 0);
+  for (int k : {0, 3, 4, 9, 15}) weight[(k % 4) * 16 + k] = 1;
+  return weight;
+}
+}  // namespace
+
+TEST(SparseFormatAdvisorTest, DenseWeightStaysDense) {
+  vector<float> weight(32 * 64, 1.f);
+  SparseFormatAdvisor advisor({kDense, kBsr4x1}, 2.5f);
+  const auto& selected = advisor.Advise(weight.data(), 32, 64);
+  EXPECT_EQ(selected.format.name, "dense");
+  EXPECT_FLOAT_EQ(advisor.costs()[1].block_density, 1.f);
+  EXPECT_FLOAT_EQ(advisor.costs()[1].cost, 2.5f);
+}
+
+TEST(SparseFormatAdvisorTest, GroupPaddingIsCounted) {
+  vector<int8_t> weight = BlockSparseWeight();
+  SparseFormatAdvisor advisor({kDense, kBsr4x1, {"bsr_4x1", 4, 1, 1, true}}, 2.5f);
+  const auto& selected = advisor.Advise(weight.data(), 8, 16);
+  EXPECT_FLOAT_EQ(advisor.costs()[1].block_density, 8.f / 32);
+  EXPECT_FLOAT_EQ(advisor.costs()[1].cost, 2.5f * 8 / 32);
+  EXPECT_FLOAT_EQ(advisor.costs()[2].block_density, 5.f / 32);
+  EXPECT_EQ(selected.format.name, "bsr_4x1");
+}
+
+TEST(SparseFormatAdvisorTest, TransposedWeight) {
+  vector<int8_t> weight = BlockSparseWeight();
+  vector<int8_t> weight_t(weight.size());
+  for (int n = 0; n < 8; ++n)
+    for (int k = 0; k < 16; ++k) weight_t[k * 8 + n] = weight[n * 16 + k];
+  SparseFormatAdvisor advisor({kDense, kBsr4x1}, 2.5f);
+  EXPECT_EQ(advisor.Advise(weight_t.data(), 8, 16, true).format.name, "bsr_4x1_g4");
+  EXPECT_FLOAT_EQ(advisor.costs()[1].block_density, 8.f / 32);
+}
+
+TEST(SparseFormatAdvisorTest, GroupPaddingCanLoseToDense) {
+  // 5 non-zero 4x1 blocks in each block row: 69% of the blocks are zero, over the 0.52 threshold, but the groups
+  // of 4 still store half of all blocks
+  vector<int8_t> weight(8 * 16, 0);
+  for (int n = 0; n < 8; n += 4)
+    for (int k : {0, 3, 4, 9, 15}) weight[n * 16 + k] = 1;
+  SparseFormatAdvisor advisor({kDense, kBsr4x1}, 2.5f);
+  EXPECT_EQ(advisor.Advise(weight.data(), 8, 16).format.name, "dense");
+  EXPECT_FLOAT_EQ(advisor.costs()[1].block_density, 0.5f);
+  EXPECT_FLOAT_EQ(advisor.costs()[1].cost, 1.25f);
+}
+
+TEST(SparseFormatAdvisorTest, OnlySupportedFormatsAreSelected) {
+  vector<int8_t> weight = BlockSparseWeight();
+  // the cheapest format has no kernel, and dense neither: the one left is taken even though it is slower
+  SparseFormatAdvisor advisor({{"dense", 0, 0, 1, false}, {"bsr_4x1", 4, 1, 1, false}, kBsr16x1, kBsr4x1}, 5.f);
+  const auto& selected = advisor.Advise(weight.data(), 8, 16);
+  EXPECT_EQ(selected.format.name, "bsr_4x1_g4");
+  EXPECT_FLOAT_EQ(selected.cost, 5.f * 8 / 32);
+  // a 16x1 block covers all 8 rows, the group of 64 pads the 5 non-zero columns to 64 blocks of 16 possible
+  EXPECT_FLOAT_EQ(advisor.costs()[2].block_density, 4.f);
+  EXPECT_EQ(advisor.Report(), "*bsr_4x1_g4 25.0% 1.25x | dense 1.00x; bsr_4x1 15.6% 0.78x; bsr_16x1_g64 400.0% 20.00x");
+}
+
+TEST(SparseFormatAdvisorTest, BlockCostFromEnv) {
+  unsetenv("ENGINE_SPARSE_BLOCK_COST");
+  EXPECT_FLOAT_EQ(SparseFormatAdvisor::DefaultBlockCost(), 2.5f);
+  setenv("ENGINE_SPARSE_BLOCK_COST", "1.5", 1);
+  EXPECT_FLOAT_EQ(SparseFormatAdvisor::DefaultBlockCost(), 1.5f);
+  setenv("ENGINE_SPARSE_BLOCK_COST", "-1", 1);
+  EXPECT_FLOAT_EQ(SparseFormatAdvisor::DefaultBlockCost(), 2.5f);
+  unsetenv("ENGINE_SPARSE_BLOCK_COST");
+}
@@ -0,0 +1,139 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "../../executor/include/state_store.hpp"
+#include "gtest/gtest.h"
+
+using executor::StateBuffer;
+using executor::StateStore;
+
+// row r of batch b of a sequence holds r * 10 + b in every byte
+static std::vector<int8_t> Rows(int64_t batch, int64_t first, int64_t rows, int64_t row_bytes) {
+  std::vector<int8_t> data(batch * rows * row_bytes);
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t r = 0; r < rows; ++r) {
+      for (int64_t i = 0; i < row_bytes; ++i) data[(b * rows + r) * row_bytes + i] = (first + r) * 10 + b;
+    }
+  }
+  return data;
+}
+
+static void ExpectSequence(const StateBuffer& buffer) {
+  const int8_t* data = static_cast<const int8_t*>(buffer.data());
+  for (int64_t b = 0; b < buffer.batch(); ++b) {
+    for (int64_t r = 0; r < buffer.length(); ++r) {
+      const int8_t* row = data + (b * buffer.capacity() + r) * buffer.row_bytes();
+      for (size_t i = 0; i < buffer.row_bytes(); ++i) ASSERT_EQ(row[i], static_cast<int8_t>(r * 10 + b));
+    }
+  }
+}
+
+TEST(StateStoreTest, AppendKeepsEveryBatchAPrefix) {
+  const int64_t batch = 2, row_bytes = 8;
+  StateBuffer buffer(batch, row_bytes);
+  EXPECT_TRUE(buffer.Reserve(5));
+  EXPECT_EQ(buffer.capacity(), StateBuffer::kMinCapacity);
+  auto prompt = Rows(batch, 0, 5, row_bytes);
+  buffer.Append(prompt.data(), 5, row_bytes);
+  // decode steps only copy the new token
+  for (int64_t t = 5; t < 9; ++t) {
+    EXPECT_FALSE(buffer.Reserve(t + 1));
+    auto token = Rows(batch, t, 1, row_bytes);
+    buffer.Append(token.data(), 1, row_bytes);
+  }
+  EXPECT_EQ(buffer.length(), 9);
+  ExpectSequence(buffer);
+}
+
+TEST(StateStoreTest, GrowthMovesThePast) {
+  const int64_t batch = 3, row_bytes = 4;
+  StateBuffer buffer(batch, row_bytes);
+  buffer.Reserve(60);
+  auto past = Rows(batch, 0, 60, row_bytes);
+  buffer.Append(past.data(), 60, row_bytes);
+  EXPECT_TRUE(buffer.Reserve(70));
+  EXPECT_EQ(buffer.capacity(), 2 * StateBuffer::kMinCapacity);
+  auto next = Rows(batch, 60, 10, row_bytes);
+  buffer.Append(next.data(), 10, row_bytes);
+  ExpectSequence(buffer);
+}
+
+TEST(StateStoreTest, StridedSource) {
+  // rows read out of wider source rows by their stride
+  const int64_t batch = 1, row_bytes = 4, stride = 12;
+  StateBuffer buffer(batch, row_bytes);
+  buffer.Reserve(3);
+  std::vector<int8_t> src(3 * stride, -1);
+  for (int r = 0; r < 3; ++r) {
+    for (int i = 0; i < row_bytes; ++i) src[r * stride + i] = r * 10;
+  }
+  buffer.Append(src.data(), 3, stride);
+  ExpectSequence(buffer);
+}
+
+TEST(StateStoreTest, PaddedBatchKeepsItsOwnLengths) {
+  // a right padded prompt of 5 tokens whose batch 0 has only 3 of them, like the padding mask of MHA kv_cache
+  const int64_t batch = 2, row_bytes = 4;
+  StateBuffer buffer(batch, row_bytes);
+  buffer.Reserve(5);
+  auto prompt = Rows(batch, 0, 5, row_bytes);
+  const int32_t prompt_valid[] = {3, 5};
+  buffer.Append(prompt.data(), 5, row_bytes, prompt_valid);
+  EXPECT_EQ(buffer.length(0), 3);
+  EXPECT_EQ(buffer.length(1), 5);
+  EXPECT_EQ(buffer.length(), 5);
+  // the next token of batch 0 takes the place of its first padding row
+  buffer.Reserve(6);
+  auto token = Rows(batch, 7, 1, row_bytes);
+  const int32_t token_valid[] = {1, 1};
+  buffer.Append(token.data(), 1, row_bytes, token_valid);
+  EXPECT_EQ(buffer.length(0), 4);
+  EXPECT_EQ(buffer.length(1), 6);
+  const int8_t* data = static_cast<const int8_t*>(buffer.data());
+  EXPECT_EQ(data[(0 * buffer.capacity() + 2) * row_bytes], 20);
+  EXPECT_EQ(data[(0 * buffer.capacity() + 3) * row_bytes], 70);
+  EXPECT_EQ(data[(1 * buffer.capacity() + 4) * row_bytes], 41);
+  EXPECT_EQ(data[(1 * buffer.capacity() + 5) * row_bytes], 71);
+  // the moved past keeps the lengths
+  buffer.Reserve(StateBuffer::kMinCapacity + 1);
+  data = static_cast<const int8_t*>(buffer.data());
+  EXPECT_EQ(data[(0 * buffer.capacity() + 3) * row_bytes], 70);
+  EXPECT_EQ(data[(1 * buffer.capacity() + 5) * row_bytes], 71);
+  buffer.Clear();
+  EXPECT_EQ(buffer.length(0), 0);
+  EXPECT_EQ(buffer.length(1), 0);
+}
+
+TEST(StateStoreTest, ResetAndLayoutChange) {
+  StateStore store;
+  StateBuffer* k = store.Get("attn_0:K", 1, 16);
+  k->Reserve(10);
+  auto rows = Rows(1, 0, 10, 16);
+  k->Append(rows.data(), 10, 16);
+  EXPECT_EQ(store.Get("attn_0:K", 1, 16), k);
+  EXPECT_EQ(store.reserved_bytes(), 16 * StateBuffer::kMinCapacity);
+
+  store.Reset();
+  EXPECT_EQ(k->length(), 0);
+  EXPECT_EQ(k->capacity(), StateBuffer::kMinCapacity);
+  // another batch size starts from scratch
+  StateBuffer* k2 = store.Get("attn_0:K", 2, 16);
+  EXPECT_EQ(k2->batch(), 2);
+  EXPECT_EQ(k2->capacity(), 0);
+  store.Release();
+  EXPECT_EQ(store.reserved_bytes(), 0u);
+}
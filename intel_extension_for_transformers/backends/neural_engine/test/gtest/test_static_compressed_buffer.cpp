@@ -136,3 +136,69 @@ static auto Cases = [] {
 };
 
 INSTANTIATE_TEST_SUITE_P(Prefix, StaticCompressedBufferTest, Cases());
+
+using executor::ActivationOperator;
+using executor::ActivationTensor;
+
+// a chain of `n` operators with a large tensor kept alive over the whole chain and a workspace in every operator
+static ActivationDAG ChainDAG(int n) {
+  vector<shared_ptr<ActivationOperator>> ops;
+  auto skip = std::make_shared<ActivationTensor>("skip", 1 << 20, "u8", vector<int64_t>{1 << 20});
+  shared_ptr<ActivationTensor> prev = skip;
+  for (int i = 0; i < n; ++i) {
+    int64_t bytes = (i % 3 + 1) * 4096;
+    auto out = std::make_shared<ActivationTensor>("t" + std::to_string(i), bytes, "u8", vector<int64_t>{bytes});
+    vector<shared_ptr<ActivationTensor>> in = {prev};
+    if (i == n - 1) in.push_back(skip);
+    auto workspace = std::make_shared<ActivationTensor>("op" + std::to_string(i) + ":workspace", 1000 * (i + 1), "u8",
+                                                        vector<int64_t>{1000 * (i + 1)});
+    ops.push_back(std::make_shared<ActivationOperator>("op" + std::to_string(i), i, in,
+                                                       vector<shared_ptr<ActivationTensor>>{out}, workspace));
+    prev = out;
+  }
+  return ActivationDAG(ops);
+}
+
+TEST(StaticCompressedBufferPlanTest, LiveTensorsAndWorkspacesDoNotOverlap) {
+  const int n = 12;
+  ActivationDAG dag = ChainDAG(n);
+  StaticCompressedBuffer buffer(dag);
+  // tensor name -> [life begin, life end], bytes
+  map<string, std::pair<std::pair<int, int>, size_t>> lives;
+  lives["skip"] = {{0, n - 1}, 1 << 20};
+  for (int i = 0; i < n; ++i) {
+    lives["t" + std::to_string(i)] = {{i, i + 1 < n ? i + 1 : i}, static_cast<size_t>((i % 3 + 1) * 4096)};
+    lives["op" + std::to_string(i) + ":workspace"] = {{i, i}, static_cast<size_t>(1000 * (i + 1))};
+  }
+  for (const auto& a : lives) {
+    ASSERT_TRUE(buffer.Contains(a.first)) << a.first;
+    char* a_data = static_cast<char*>(buffer.GetDataByName(a.first));
+    for (const auto& b : lives) {
+      if (a.first == b.first) continue;
+      bool live_together =
+          a.second.first.first <= b.second.first.second && b.second.first.first <= a.second.first.second;
+      if (!live_together) continue;
+      char* b_data = static_cast<char*>(buffer.GetDataByName(b.first));
+      EXPECT_TRUE(a_data + a.second.second <= b_data || b_data + b.second.second <= a_data)
+          << a.first << " overlaps " << b.first;
+    }
+  }
+  const auto& stats = buffer.Stats();
+  EXPECT_LE(stats.low_bound_bytes, stats.planned_bytes);
+  EXPECT_LT(stats.planned_bytes, stats.raw_bytes);
+  buffer.RecordUse(buffer.GetDataByName("skip"), 1 << 20);
+  EXPECT_GE(buffer.Stats().touched_bytes, static_cast<size_t>(1 << 20));
+}
+
+TEST(StaticCompressedBufferPlanTest, WorkspaceRoundTripsThroughYaml) {
+  ActivationDAG dag = ChainDAG(3);
+  dag.Dump("workspace_dag.yaml");
+  ActivationDAG loaded("workspace_dag.yaml");
+  ASSERT_EQ(loaded.operators().size(), 3u);
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_NE(loaded.operators()[i]->workspace(), nullptr);
+    EXPECT_EQ(loaded.operators()[i]->workspace()->name(), "op" + std::to_string(i) + ":workspace");
+    EXPECT_EQ(loaded.operators()[i]->workspace()->alloc_bytes(), 1000u * (i + 1));
+  }
+  remove("workspace_dag.yaml");
+}
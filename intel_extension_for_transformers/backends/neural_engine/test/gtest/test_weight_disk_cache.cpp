@@ -0,0 +1,95 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../../executor/include/weight_disk_cache.hpp"
+#include "gtest/gtest.h"
+
+using executor::WeightDiskCache;
+
+static std::vector<int8_t> Packed(size_t bytes, int seed) {
+  std::vector<int8_t> data(bytes);
+  for (size_t i = 0; i < bytes; ++i) data[i] = static_cast<int8_t>((i * 7 + seed) % 251);
+  return data;
+}
+
+TEST(WeightDiskCacheTest, StoredWeightIsLoadedAligned) {
+  WeightDiskCache cache("./weight_disk_cache_test/");
+  std::vector<int8_t> packed = Packed(10000, 1);
+  const std::string key = "ip_0|onednn|isa 1|s8 100 100|layout 42";
+  EXPECT_EQ(cache.Load(key, packed.size()), nullptr);
+  ASSERT_TRUE(cache.Store(key, packed.data(), packed.size()));
+  void* loaded = cache.Load(key, packed.size());
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(loaded) % 64, 0u);
+  EXPECT_EQ(0, memcmp(loaded, packed.data(), packed.size()));
+  EXPECT_TRUE(cache.Contains(loaded));
+  EXPECT_FALSE(cache.Contains(packed.data()));
+  // another cache on the same directory is a later start of the model
+  WeightDiskCache restarted("./weight_disk_cache_test");
+  EXPECT_NE(restarted.Load(key, packed.size()), nullptr);
+}
+
+TEST(WeightDiskCacheTest, ChangedKeyOrSizeMisses) {
+  WeightDiskCache cache("./weight_disk_cache_test");
+  std::vector<int8_t> packed = Packed(4096, 2);
+  const std::string key = "ip_1|onednn|isa 1";
+  ASSERT_TRUE(cache.Store(key, packed.data(), packed.size()));
+  EXPECT_EQ(cache.Load("ip_1|onednn|isa 3", packed.size()), nullptr);
+  EXPECT_EQ(cache.Load(key, packed.size() + 64), nullptr);
+  // an entry is replaced when the weight of its key is packed again
+  std::vector<int8_t> repacked = Packed(4096, 3);
+  ASSERT_TRUE(cache.Store(key, repacked.data(), repacked.size()));
+  void* loaded = cache.Load(key, repacked.size());
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(0, memcmp(loaded, repacked.data(), repacked.size()));
+}
+
+TEST(WeightDiskCacheTest, FingerprintFollowsTheWeight) {
+  std::vector<int8_t> small = Packed(100, 4);
+  std::vector<int8_t> large = Packed(1 << 20, 4);
+  size_t small_print = WeightDiskCache::Fingerprint(small.data(), small.size());
+  size_t large_print = WeightDiskCache::Fingerprint(large.data(), large.size());
+  EXPECT_EQ(small_print, WeightDiskCache::Fingerprint(small.data(), small.size()));
+  small[50] += 1;
+  large[large.size() - 1] += 1;
+  EXPECT_NE(small_print, WeightDiskCache::Fingerprint(small.data(), small.size()));
+  EXPECT_NE(large_print, WeightDiskCache::Fingerprint(large.data(), large.size()));
+}
+
+TEST(WeightDiskCacheTest, FingerprintCoversEveryByte) {
+  // checkpoints of one shape which differ in a single byte deep inside the weight, away from head and tail
+  std::vector<int8_t> weight = Packed(3 * (1 << 20) + 5, 9);
+  const size_t print = WeightDiskCache::Fingerprint(weight.data(), weight.size());
+  for (size_t i : {size_t(12345), size_t(1 << 20) + 77, weight.size() - 3}) {
+    weight[i] += 1;
+    EXPECT_NE(print, WeightDiskCache::Fingerprint(weight.data(), weight.size())) << "changed byte " << i;
+    weight[i] -= 1;
+  }
+  EXPECT_EQ(print, WeightDiskCache::Fingerprint(weight.data(), weight.size()));
+}
+
+TEST(WeightDiskCacheTest, DisabledWithoutDirectory) {
+  WeightDiskCache cache("");
+  int8_t weight = 1;
+  EXPECT_FALSE(cache.enabled());
+  EXPECT_FALSE(cache.Store("key", &weight, 1));
+  EXPECT_EQ(cache.Load("key", 1), nullptr);
+}
@@ -0,0 +1,69 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../../executor/include/weight_mapping.hpp"
+#include "gtest/gtest.h"
+
+using executor::WeightMapping;
+
+static std::string WriteBin(const std::string& name, const std::vector<char>& bytes) {
+  std::string file_name = "./" + name;
+  std::ofstream file(file_name, std::ios::out | std::ios::binary);
+  file.write(bytes.data(), bytes.size());
+  return file_name;
+}
+
+TEST(WeightMappingTest, SlicesPointIntoTheFile) {
+  std::vector<char> bytes(4096 + 100);
+  for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<char>(i % 127);
+  std::string file_name = WriteBin("weight_mapping_test.bin", bytes);
+  auto mapping = WeightMapping::Map(file_name, 0, true, true);
+  ASSERT_NE(mapping, nullptr);
+  EXPECT_EQ(mapping->size(), bytes.size());
+  char* weight = static_cast<char*>(mapping->Slice(4096, 100));
+  ASSERT_NE(weight, nullptr);
+  EXPECT_EQ(0, memcmp(weight, bytes.data() + 4096, 100));
+  EXPECT_TRUE(mapping->Contains(weight));
+  EXPECT_EQ(mapping->Slice(4096, 101), nullptr);
+  // the mapping is copy-on-write, an operator rewriting its weight leaves the file alone
+  weight[0] = 100;
+  auto other = WeightMapping::Map(file_name);
+  EXPECT_EQ(static_cast<const char*>(other->Slice(4096, 1))[0], bytes[4096]);
+  remove(file_name.c_str());
+}
+
+TEST(WeightMappingTest, OffsetSkipsTheModelConf) {
+  std::vector<char> bytes(256);
+  for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<char>(i);
+  std::string file_name = WriteBin("weight_mapping_offset_test.bin", bytes);
+  auto mapping = WeightMapping::Map(file_name, 64);
+  ASSERT_NE(mapping, nullptr);
+  EXPECT_EQ(mapping->size(), 192u);
+  EXPECT_EQ(static_cast<const char*>(mapping->Slice(0, 1))[0], 64);
+  EXPECT_FALSE(mapping->Contains(bytes.data()));
+  remove(file_name.c_str());
+}
+
+TEST(WeightMappingTest, MissingFileIsNotMapped) {
+  EXPECT_EQ(WeightMapping::Map("./no_such_weight.bin"), nullptr);
+  EXPECT_EQ(WeightMapping::Map("."), nullptr);
+}
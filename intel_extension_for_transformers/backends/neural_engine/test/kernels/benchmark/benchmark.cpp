@@ -22,6 +22,7 @@
 #include "mha_dense/mha_dense.hpp"
 #include "dynamic_quant_matmul/dynamic_quant_matmul.hpp"
 #include "dynamic_quant/dynamic_quant.hpp"
+#include "topk/topk.hpp"
 int main(int argc, char** argv) {
   bench::bench_mode mode;
   std::shared_ptr<bench::kernel_bench> kb;
@@ -63,6 +64,8 @@ int main(int argc, char** argv) {
     kb = std::make_shared<bench::dynamic_quant_matmul_bench>();
   } else if (!strcmp(argv[0], "dynamic_quant")) {
     kb = std::make_shared<bench::dynamic_quant_bench>();
+  } else if (!strcmp(argv[0], "topk")) {
+    kb = std::make_shared<bench::topk_bench>();
   } else {
     LOG(ERROR) << "unknown kernel type";
     return 1;
@@ -89,6 +89,9 @@ source $script_dir/benchmark.sh --modes=$modes --op=dynamic_quant_matmul --mediu
 source $script_dir/benchmark.sh --modes=$modes --op=dynamic_quant --medium_n=$medium_n --it_per_core=300 \
     --batch="$script_dir/inputs/ci_dynamic_quant_input" |
     tee "$log_dir/dynamic_quant.log"
+source $script_dir/benchmark.sh --modes=$modes --op=topk --medium_n=$medium_n --it_per_core=300 \
+    --batch="$script_dir/inputs/ci_topk_input" |
+    tee "$log_dir/topk.log"
 source $script_dir/benchmark.sh --modes=$modes --op=mha_dense --medium_n=$medium_n --it_per_core=300 \
     --batch="$script_dir/inputs/ci_mha_dense_dynamic_input" |
     tee "$log_dir/mha_dense_dynamic.log"
@@ -0,0 +1,103 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "topk.hpp"
+
+#include <cmath>
+
+#include "benchmark_utils.hpp"
+#include "common_utils.hpp"
+#include "src/cpu/kernels/topk_ref.hpp"
+
+namespace bench {
+bench_res_t topk_bench::set_config(int argc, char** argv) {
+  if (argc < TOPK_ARG_NUM) {
+    LOG(ERROR) << "Not enough arguments passed";
+    return {bench_status::wrong_input};
+  }
+  LOG(INFO) << "topk\n";
+  for (auto&& i : split_str<int64_t>(argv[0], 'x')) shape.push_back(i);
+  k = str_to_num<int>(argv[1]);
+  normalize = argc > 2 ? argv[2] : "none";
+  batch_beam = argc > 3 && !strcmp(argv[3], "true");
+  if (shape.empty() || (batch_beam && shape.size() < 2)) {
+    LOG(ERROR) << "batch_beam takes a shape of batch x beam x vocab";
+    return {bench_status::wrong_input};
+  }
+  return {bench_status::success};
+}
+void topk_bench::get_true_data() {
+  const auto& q = args.second;
+  std::shared_ptr<const jd::kernel_desc_t> topk_ref_desc;
+  jd::kernel_desc_t::create<jd::topk_ref_kd_t>(topk_ref_desc, q.op_desc);
+  std::shared_ptr<const jd::kernel_t> topk_ref_ker;
+  jd::kernel_t::create<jd::topk_ref_k_t, jd::topk_ref_kd_t>(topk_ref_ker, topk_ref_desc);
+  topk_ref_ker->execute(q.rt_data);
+}
+bool topk_bench::check_result() {
+  const auto& p = args.first;
+  const auto& q = args.second;
+  get_true_data();
+  const auto size = p.op_desc.tensor_descs()[io::DST].size();
+  const auto dst = reinterpret_cast<const float*>(p.rt_data[io::DST]);
+  const auto dst_ref = reinterpret_cast<const float*>(q.rt_data[io::DST]);
+  for (int64_t i = 0; i < size; ++i) {
+    if (std::isinf(dst_ref[i]) && dst[i] == dst_ref[i]) continue;
+    if (std::abs(dst[i] - dst_ref[i]) > 1e-4f * std::max(1.f, std::abs(dst_ref[i]))) return false;
+  }
+  return compare_data<int32_t>(p.rt_data[io::IDX], size, q.rt_data[io::IDX], size, 0);
+}
+void topk_bench::gen_case() {
+  const int64_t vocab = shape.back();
+  const int64_t group = batch_beam ? shape[shape.size() - 2] : 1;
+  const int64_t rows =
+      std::accumulate(shape.begin(), shape.end(), int64_t{1}, std::multiplies<int64_t>()) / (group * vocab);
+  // a beam search step adds the scores of the beams to their log-probabilities
+  const bool beam_score = batch_beam && normalize != "softmax";
+  op_attrs = {
+      {"k", std::to_string(k)},
+      {"normalize", normalize},
+      {"batch_beam", batch_beam ? "true" : "false"},
+  };
+  ts_descs.assign(io::SIZE, {});
+  ts_descs[io::SRC] = {shape, jd::data_type::fp32, jd::plain_format(shape.size())};
+  ts_descs[io::DST] = {{rows, k}, jd::data_type::fp32, jd::format_type::ab};
+  ts_descs[io::IDX] = {{rows, k}, jd::data_type::s32, jd::format_type::ab};
+  if (beam_score) ts_descs[io::BEAM_SCORE] = {{rows, group}, jd::data_type::fp32, jd::format_type::ab};
+
+  void* src = malloc(ts_descs[io::SRC].size() * sizeof(float));
+  init_vector(static_cast<float*>(src), ts_descs[io::SRC].size(), -ranges[0], ranges[1], rand());
+  void* score = nullptr;
+  if (beam_score) {
+    score = malloc(rows * group * sizeof(float));
+    init_vector(static_cast<float*>(score), rows * group, -5.f, -0.1f, rand());
+  }
+  std::vector<const void*> rt_data_p(io::SIZE, nullptr);
+  std::vector<const void*> rt_data_q(io::SIZE, nullptr);
+  rt_data_p[io::SRC] = src;
+  rt_data_p[io::DST] = malloc(rows * k * sizeof(float));
+  rt_data_p[io::IDX] = malloc(rows * k * sizeof(int32_t));
+  rt_data_p[io::BEAM_SCORE] = score;
+  rt_data_q[io::SRC] = src;
+  rt_data_q[io::DST] = malloc(rows * k * sizeof(float));
+  rt_data_q[io::IDX] = malloc(rows * k * sizeof(int32_t));
+  rt_data_q[io::BEAM_SCORE] = score;
+  jd::operator_desc op_desc(jd::kernel_kind::topk, jd::kernel_prop::forward_inference, jd::engine_kind::cpu, ts_descs,
+                            op_attrs);
+  // Step 3: op_args_t testcase pair
+  op_args_t op_args_p = {op_desc, rt_data_p};
+  op_args_t op_args_q = {op_desc, rt_data_q};
+  args = {op_args_p, op_args_q};
+}
+}  // namespace bench
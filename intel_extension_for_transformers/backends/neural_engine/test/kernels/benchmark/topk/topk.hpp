@@ -0,0 +1,68 @@
+//  Copyright (c) 2023 Intel Corporation
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ENGINE_SPARSELIB_BENCH_INCLUDE_TOPK_HPP_
+#define ENGINE_SPARSELIB_BENCH_INCLUDE_TOPK_HPP_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "common_utils.hpp"
+#include "interface.hpp"
+#include "kernels/exposed_enum.hpp"
+
+#define TOPK_ARG_NUM 2
+namespace bench {
+class topk_bench : public kernel_bench {
+  using io = jd::exposed_enum::topk::io;
+
+ private:
+  std::vector<int64_t> shape;
+  int k;
+  std::string normalize;
+  bool batch_beam;
+  std::unordered_map<std::string, std::string> op_attrs;
+
+ public:
+  topk_bench() {}
+  virtual ~topk_bench() {
+    const auto& p_rt_data = args.first.rt_data;
+    const auto& q_rt_data = args.second.rt_data;
+    for (auto&& i : p_rt_data) free(const_cast<void*>(i));
+    free(const_cast<void*>(q_rt_data[io::DST]));
+    free(const_cast<void*>(q_rt_data[io::IDX]));
+  }
+  bench_res_t set_config(int argc, char** argv) override;
+  double calc_flop() const override {
+    // a compare per element, the normalization adds a max, an exp and a sum
+    const double elt_num = ts_descs[io::SRC].size();
+    return (normalize == "none" ? 1. : 4.) * elt_num;
+  }
+  std::vector<int> get_refresh_data_idx() const override { return std::vector<int>{io::SRC}; }
+  // Just like that in gtest file
+  void get_true_data() override;
+  // Just like that in gtest file
+  bool check_result() override;
+  // Just like that in gtest file
+  void gen_case() override;
+  void set_kernel_proxy() override {
+    jd::topk_desc desc(args.first.op_desc);
+    kp = std::make_shared<jd::topk>(desc);
+  }
+};
+}  // namespace bench
+#endif  // ENGINE_SPARSELIB_BENCH_INCLUDE_TOPK_HPP_
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright (c) 2023 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+from intel_extension_for_transformers.backends.neural_engine.compile import compile
+import numpy as np
+import os
+import copy
+
+
+class TestDynamicBatcher(unittest.TestCase):
+    @classmethod
+    def setUpClass(self):
+        pass
+
+    @classmethod
+    def tearDownClass(self):
+        pass
+
+    def test_dynamic_batcher(self):
+        model_dir = '/home/tensorflow/inc_ut/engine/bert_mlperf_2none.pb'
+        if not os.path.exists(model_dir):
+            print(
+                "The model dir is not not found, therefore test may not all round"
+            )
+            return
+
+        model = compile(model_dir)
+        inputs = []
+        expected = []
+        for seq_len in [10, 13, 16, 30, 40]:
+            input_0 = np.random.randint(0, 384, (1, seq_len)).reshape(1, seq_len)
+            input_1 = np.random.randint(0, 2, (1, seq_len)).reshape(1, seq_len)
+            input_2 = np.ones((1, seq_len), dtype=np.int64)
+            inputs.append([input_0, input_1, input_2])
+            expected.append(copy.deepcopy(list(model.inference(inputs[-1]).values())))
+
+        # the positions of a request of 10 tokens tell the sequence and token outputs apart
+        names = list(model.inference(inputs[0]).keys())
+        sequence_outputs = [name for name, out in zip(names, expected[0]) if out.ndim >= 2 and out.shape[1] == 10]
+        token_outputs = [name for name, out in zip(names, expected[0]) if out.shape[0] == 10]
+        # 10, 13 and 16 share the 16 bucket, 30 and 40 are padded to 32 and 64
+        submit = model.dynamic_batcher(max_batch=4, max_wait_ms=50, buckets=[16, 32, 64],
+                                       sequence_outputs=sequence_outputs, token_outputs=token_outputs)
+        futures = [submit(data) for data in inputs]
+        for idx, future in enumerate(futures):
+            outputs = list(future.result().values())
+            for out, ref in zip(outputs, expected[idx]):
+                self.assertEqual(out.shape, ref.shape)
+                self.assertTrue(np.allclose(out, ref, atol=1e-3))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright (c) 2023 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+import numpy as np
+import os
+from collections import OrderedDict
+from intel_extension_for_transformers.backends.neural_engine.compile.ops.op import OPERATORS, Operator
+from intel_extension_for_transformers.backends.neural_engine.compile.ops.tensor import Tensor
+from intel_extension_for_transformers.backends.neural_engine.compile.graph import Graph
+import copy
+
+
+def has_avx512_core():
+    # models fuse the chains only where the eltwiseop kernel is jitted, see Model::Init
+    if os.environ.get('NE_MAX_ISA', 'avx512') != 'avx512':
+        return False
+    try:
+        with open('/proc/cpuinfo') as cpuinfo:
+            flags = cpuinfo.read().split()
+    except OSError:
+        return False
+    return all(flag in flags for flag in ['avx512f', 'avx512bw', 'avx512vl', 'avx512dq'])
+
+
+def build_graph():
+    # gelu -> mul 2 -> exp is one chain, gelu_1 also feeds the output so it can't fuse with exp_1
+    graph = Graph()
+    graph.framework_modeling_config['framework'] = 'onnxruntime'
+    input_data_node = OPERATORS['Input']()
+    input_data_node.construct('input_data', 'Input', input_tensors=[],
+                              output_tensors=[Tensor(name='src', shape=[-1, -1], dtype='fp32')])
+    nodes = [input_data_node]
+
+    def eltwise(name, op_type, inputs, attr=None):
+        node = OPERATORS['Gelu']() if op_type == 'Gelu' else Operator()
+        output = Tensor(name=name + ':0', source_op=[name], dtype='fp32')
+        node.construct(name, op_type, input_tensors=inputs, output_tensors=[output], attr=attr or OrderedDict())
+        nodes.append(node)
+        return output
+
+    gelu = eltwise('gelu', 'Gelu', [Tensor(name='src', dtype='fp32')],
+                   OrderedDict({'algorithm': 'gelu_tanh'}))
+    two = Tensor(name='two', shape=[1], dtype='fp32', data=np.array([2], dtype=np.float32))
+    mul = eltwise('mul', 'BinaryOp', [gelu, two], OrderedDict({'algorithm': 'mul'}))
+    exp = eltwise('exp', 'Exp', [mul])
+    gelu_1 = eltwise('gelu_1', 'Gelu', [Tensor(name='src', dtype='fp32')],
+                     OrderedDict({'algorithm': 'gelu_tanh'}))
+    exp_1 = eltwise('exp_1', 'Exp', [gelu_1])
+
+    output_node = OPERATORS['Output']()
+    output_node.construct('output_data', 'Output',
+                          input_tensors=[Tensor(name=t.name, dtype='fp32') for t in [exp, gelu_1, exp_1]],
+                          output_tensors=[])
+    nodes.append(output_node)
+    graph.insert_nodes(len(graph.nodes), nodes)
+    return graph
+
+
+class TestEltwiseChainFusion(unittest.TestCase):
+    @classmethod
+    def setUpClass(self):
+        pass
+
+    @classmethod
+    def tearDownClass(self):
+        pass
+
+    @unittest.skipIf(not has_avx512_core(), "EltwiseChain fusion needs avx512_core")
+    def test_eltwise_chain_fusion(self):
+        data = np.random.uniform(-2, 2, (8, 33)).astype(np.float32)
+        fused = build_graph()
+        out = fused.inference([data])
+        fused_out = [copy.deepcopy(out[name]) for name in ['exp:0', 'gelu_1:0', 'exp_1:0']]
+        fused_types = fused._engine[0].operator_types()
+
+        os.environ['ENGINE_ELTWISE_FUSION_OFF'] = '1'
+        try:
+            unfused = build_graph()
+            out = unfused.inference([data])
+            unfused_out = [copy.deepcopy(out[name]) for name in ['exp:0', 'gelu_1:0', 'exp_1:0']]
+            unfused_types = unfused._engine[0].operator_types()
+        finally:
+            del os.environ['ENGINE_ELTWISE_FUSION_OFF']
+
+        self.assertEqual(unfused_types, ['Input', 'Gelu', 'BinaryOp', 'Exp', 'Gelu', 'Exp', 'Output'])
+        # the chain runs as the operator in place of its tail, the branch keeps its operators
+        self.assertEqual(fused_types, ['Input', 'EltwiseChain', 'Gelu', 'Exp', 'Output'])
+        for fused_value, unfused_value in zip(fused_out, unfused_out):
+            self.assertTrue(np.allclose(fused_value, unfused_value, rtol=1e-3, atol=1e-3))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright (c) 2023 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+from intel_extension_for_transformers.backends.neural_engine.compile import compile
+import numpy as np
+import os
+import copy
+import threading
+
+
+class TestExecutionContext(unittest.TestCase):
+    @classmethod
+    def setUpClass(self):
+        pass
+
+    @classmethod
+    def tearDownClass(self):
+        pass
+
+    def test_concurrent_contexts(self):
+        model_dir = '/home/tensorflow/inc_ut/engine/bert_mlperf_2none.pb'
+        if not os.path.exists(model_dir):
+            print(
+                "The model dir is not not found, therefore test may not all round"
+            )
+            return
+
+        model = compile(model_dir)
+        model.execution_options = {'enable_execution_context': True}
+        inputs = []
+        expected = []
+        for seq_len in [16, 32, 48, 64]:
+            input_0 = np.random.randint(0, 384, (1, seq_len)).reshape(1, seq_len)
+            input_1 = np.random.randint(0, 2, (1, seq_len)).reshape(1, seq_len)
+            input_2 = np.random.randint(0, 2, (1, seq_len)).reshape(1, seq_len)
+            inputs.append([input_0, input_1, input_2])
+            expected.append(copy.deepcopy(list(model.inference(inputs[-1]).values())[0]))
+
+        # every thread runs different shapes with its own context of the same model
+        results = [None] * len(inputs)
+        def run(idx):
+            context = model.create_context()
+            for _ in range(3):
+                out = model.inference(inputs[idx], context)
+                results[idx] = copy.deepcopy(list(out.values())[0])
+
+        threads = [threading.Thread(target=run, args=(i,)) for i in range(len(inputs))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        for idx in range(len(inputs)):
+            self.assertTrue(np.allclose(expected[idx], results[idx], atol=1e-4))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright (c) 2023 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+from intel_extension_for_transformers.backends.neural_engine.compile import compile
+import numpy as np
+import os
+import copy
+import asyncio
+
+
+class TestForwardAsync(unittest.TestCase):
+    @classmethod
+    def setUpClass(self):
+        pass
+
+    @classmethod
+    def tearDownClass(self):
+        pass
+
+    def test_inference_async(self):
+        model_dir = '/home/tensorflow/inc_ut/engine/bert_mlperf_2none.pb'
+        if not os.path.exists(model_dir):
+            print(
+                "The model dir is not not found, therefore test may not all round"
+            )
+            return
+
+        model = compile(model_dir)
+        inputs = []
+        expected = []
+        for seq_len in [16, 32, 48, 64]:
+            input_0 = np.random.randint(0, 384, (1, seq_len)).reshape(1, seq_len)
+            input_1 = np.random.randint(0, 2, (1, seq_len)).reshape(1, seq_len)
+            input_2 = np.random.randint(0, 2, (1, seq_len)).reshape(1, seq_len)
+            inputs.append([input_0, input_1, input_2])
+            expected.append(copy.deepcopy(list(model.inference(inputs[-1]).values())[0]))
+
+        # all requests are queued before the first one is read, their outputs must not overwrite each other
+        futures = [model.inference_async(data) for data in inputs]
+        results = [list(future.result().values())[0] for future in futures]
+        for idx in range(len(inputs)):
+            self.assertTrue(np.allclose(expected[idx], results[idx], atol=1e-4))
+
+        async def serve():
+            return await asyncio.gather(*[asyncio.wrap_future(model.inference_async(data)) for data in inputs])
+
+        outputs = asyncio.run(serve())
+        for idx in range(len(inputs)):
+            self.assertTrue(np.allclose(expected[idx], list(outputs[idx].values())[0], atol=1e-4))
+
+
+if __name__ == "__main__":
+    unittest.main()